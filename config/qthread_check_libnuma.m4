@@ -37,7 +37,7 @@ AS_IF([test "x$libnuma_happy" = "xyes"],
   dnl libnuma interface we're dealing with
   AC_CHECK_FUNC([numa_allocate_nodemask],
     [AC_DEFINE([QTHREAD_LIBNUMA_V2],[1],[if libnuma provides numa_allocate_nodemask])])
-  AC_CHECK_FUNCS([numa_num_configured_cpus numa_num_thread_cpus numa_bitmask_nbytes numa_distance])
+  AC_CHECK_FUNCS([numa_num_configured_cpus numa_num_thread_cpus numa_bitmask_nbytes numa_distance numa_move_pages])
   AS_IF([test "x$ac_cv_func_numa_distance" = "xyes"],
         [AC_TRY_RUN([
 #include <numa.h>
@@ -0,0 +1,29 @@
+# -*- Autoconf -*-
+#
+# Copyright (c)      2026  Sandia Corporation
+#
+
+# QTHREAD_CHECK_SENDFILE([action-if-found], [action-if-not-found])
+# ------------------------------------------------------------------------------
+# The BSDs and OS X have a sendfile() too, but it takes other arguments and
+# does other things; only the Linux one, sendfile(out, in, off_t *, count)
+# from <sys/sendfile.h>, will do.
+AC_DEFUN([QTHREAD_CHECK_SENDFILE], [
+AC_CHECK_FUNCS([sendfile],
+               [AC_CACHE_CHECK([whether sendfile is the Linux one],
+                               [qthread_cv_linux_sendfile],
+                               [AC_COMPILE_IFELSE([AC_LANG_PROGRAM([[
+#include <sys/types.h>
+#include <sys/sendfile.h>]], [[
+off_t   offset = 0;
+ssize_t ret    = sendfile(1, 0, &offset, (size_t)1);
+return (int)ret;]])],
+                                                  [qthread_cv_linux_sendfile=yes],
+                                                  [qthread_cv_linux_sendfile=no])])],
+               [qthread_cv_linux_sendfile=no])
+AS_IF([test "x$qthread_cv_linux_sendfile" = "xyes"],
+      [AC_DEFINE([QTHREAD_LINUX_SENDFILE],[1],[Define if sendfile() is the Linux one])
+       $1],
+      [$2])
+])
+# vim:set expandtab
@@ -1,6 +1,6 @@
 AC_DEFUN([QTHREAD_CHECK_SYSCALLTYPES],[
 AS_IF([test "x$1" = xyes],
-	  [AC_CHECK_DECLS([SYS_nanosleep,SYS_sleep,SYS_usleep,SYS_system,SYS_select,SYS_wait4,SYS_pread,SYS_connect,SYS_poll,SYS_read,SYS_write,SYS_pwrite],
+	  [AC_CHECK_DECLS([SYS_nanosleep,SYS_sleep,SYS_usleep,SYS_system,SYS_select,SYS_wait4,SYS_pread,SYS_connect,SYS_poll,SYS_close,SYS_read,SYS_write,SYS_pwrite,SYS_readv,SYS_writev,SYS_recvfrom,SYS_recvmsg,SYS_sendto,SYS_sendmsg],
     [],[],[[#include <sys/syscall.h>]])
 AC_CHECK_SIZEOF([socklen_t],[],[[#include <sys/socket.h>]])
 AS_IF([test "$ac_cv_sizeof_socklen_t" -eq 4],
@@ -25,6 +25,7 @@ AS_IF([test "x$qt_cv_accept_prototype_sane" = xyes],
 	  [AC_CHECK_DECLS([SYS_accept],[],[],[[#include <sys/syscall.h>]])],
 	  [ac_cv_have_decl_SYS_accept=no])])
 AM_CONDITIONAL([HAVE_DECL_SYS_ACCEPT], [test "x$ac_cv_have_decl_SYS_accept" == xyes])
+AM_CONDITIONAL([HAVE_DECL_SYS_CLOSE], [test "x$ac_cv_have_decl_SYS_close" == xyes])
 AM_CONDITIONAL([HAVE_DECL_SYS_CONNECT], [test "x$ac_cv_have_decl_SYS_connect" == xyes])
 AM_CONDITIONAL([HAVE_DECL_SYS_SYSTEM], [test "x$ac_cv_have_decl_SYS_system" == xyes])
 AM_CONDITIONAL([HAVE_DECL_SYS_SELECT], [test "x$ac_cv_have_decl_SYS_select" == xyes])
@@ -34,4 +35,10 @@ AM_CONDITIONAL([HAVE_DECL_SYS_READ], [test "x$ac_cv_have_decl_SYS_read" == xyes]
 AM_CONDITIONAL([HAVE_DECL_SYS_WRITE], [test "x$ac_cv_have_decl_SYS_write" == xyes])
 AM_CONDITIONAL([HAVE_DECL_SYS_PWRITE], [test "x$ac_cv_have_decl_SYS_pwrite" == xyes])
 AM_CONDITIONAL([HAVE_DECL_SYS_POLL], [test "x$ac_cv_have_decl_SYS_poll" == xyes])
+AM_CONDITIONAL([HAVE_DECL_SYS_READV], [test "x$ac_cv_have_decl_SYS_readv" == xyes])
+AM_CONDITIONAL([HAVE_DECL_SYS_WRITEV], [test "x$ac_cv_have_decl_SYS_writev" == xyes])
+AM_CONDITIONAL([HAVE_DECL_SYS_RECVFROM], [test "x$ac_cv_have_decl_SYS_recvfrom" == xyes])
+AM_CONDITIONAL([HAVE_DECL_SYS_RECVMSG], [test "x$ac_cv_have_decl_SYS_recvmsg" == xyes])
+AM_CONDITIONAL([HAVE_DECL_SYS_SENDTO], [test "x$ac_cv_have_decl_SYS_sendto" == xyes])
+AM_CONDITIONAL([HAVE_DECL_SYS_SENDMSG], [test "x$ac_cv_have_decl_SYS_sendmsg" == xyes])
 ])
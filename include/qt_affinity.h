@@ -96,6 +96,11 @@ void INTERNAL *qt_affinity_alloc_onnode(size_t bytes,
 void INTERNAL qt_affinity_mem_tonode(void  *addr,
                                      size_t bytes,
                                      int    node);
+/* like qt_affinity_mem_tonode(), but also moves pages that are already
+ * resident on some other node */
+void INTERNAL qt_affinity_mem_migrate(void  *addr,
+                                      size_t bytes,
+                                      int    node);
 void INTERNAL qt_affinity_free(void  *ptr,
                                size_t bytes);
 #endif
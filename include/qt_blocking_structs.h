@@ -15,19 +15,32 @@ typedef enum blocking_syscalls {
     POLL,
     READ,
     PREAD,
-    /*RECV,
-     * RECVFROM,*/
+    READV,
+    RECV,
+    RECVFROM,
+    RECVMSG,
     SELECT,
-    /*SEND,
-     * SENDTO,*/
+    SEND,
+    SENDTO,
+    SENDMSG,
     /*SIGWAIT,*/
     SLEEP,
     SYSTEM,
     USLEEP,
     WAIT4,
     WRITE,
+    WRITEV,
     PWRITE,
-    USER_DEFINED
+    PREADV,
+    PWRITEV,
+    PREAD_FIXED,  /* pread into a buffer registered with the rings */
+    PWRITE_FIXED,
+    SENDFILE,
+    SPLICE,
+    COPY_FILE_RANGE,
+    USER_DEFINED,
+    FD_READY,     /* wait for a non-blocking fd; see io_reactor.c */
+    SLEEP_UNTIL   /* wait for a deadline; see timer_wheel.c */
 } syscall_t;
 
 typedef struct qthread_addrres_s {
@@ -40,8 +53,10 @@ typedef struct _qt_blocking_queue_node_s {
     struct _qt_blocking_queue_node_s *next;
     qthread_t                        *thread;
     syscall_t                         op;
-    uintptr_t                         args[5];
+    uintptr_t                         args[6];
     ssize_t                           ret;
+    int                               err;    /* errno, if ret < 0 */
+    uint64_t                          queued; /* when it was handed to a proxy */
 } qt_blocking_queue_node_t;
 
 typedef struct qthread_addrstat_s {
@@ -0,0 +1,104 @@
+#ifndef QT_CONTENTION_H
+#define QT_CONTENTION_H
+
+/* FEB and syncvar contention profiling (contention.c), for
+ * --enable-profiling=contention builds. One in every QT_CONTENTION_SAMPLE
+ * waits that actually block is timed, from the moment the qthread queues up
+ * on the address until it runs again, and charged to the address and to the
+ * place it was called from, along with the number of qthreads that were
+ * waiting on the address at the time. Each worker keeps the heaviest
+ * (address, return addresses) pairs it has seen in a space-saving sketch with
+ * a fixed number of slots, so memory does not grow with the number of
+ * addresses. The return addresses are collected once the wait is over and
+ * its lock is gone, and only looked up, to find the call site, when the
+ * sketches are merged and the hottest addresses reported: at
+ * qthread_finalize() and when QT_CONTENTION_SIGNAL arrives. In other builds,
+ * the macros below compile to nothing. */
+
+#ifdef QTHREAD_CONTENTION_PROFILING
+
+# include <signal.h>                  /* for sig_atomic_t */
+
+# include "qt_visibility.h"
+# include "qt_shepherd_innards.h"
+# include "qt_blocking_structs.h"     /* for qthread_addrstat_t */
+
+/* how many return addresses are kept for finding the call site */
+# define QT_CONTENTION_FRAMES 10
+
+typedef struct {
+    const void *addr;                 /* the FEB or syncvar */
+    void       *frames[QT_CONTENTION_FRAMES]; /* of the wait, innermost first */
+    void       *site;                 /* found in frames, for the report */
+    void       *f;                    /* the function of the task that did */
+    uint64_t    ns;                   /* time blocked, counting the error */
+    uint64_t    error;                /* how much of ns may belong to others */
+    uint64_t    max_ns;
+    uint32_t    waits;
+    uint32_t    max_waiters;
+    uint32_t    nframes;
+} qt_contention_entry_t;
+
+typedef struct qt_contention_worker_s {
+    uint32_t              countdown;  /* blocking waits until the next sample */
+    uint32_t              used;
+    qt_contention_entry_t top[];      /* QT_CONTENTION_TOP of them */
+} qt_contention_worker_t;
+
+/* what a sampled wait carries across the context switch */
+typedef struct {
+    uint64_t    start;                /* 0 if this wait isn't sampled */
+    const void *addr;
+    uint32_t    waiters;
+} qt_contention_sample_t;
+
+extern int                   qt_contention_enabled;
+extern volatile sig_atomic_t qt_contention_dump_requested;
+
+void INTERNAL qt_contention_subsystem_init(void);
+void INTERNAL qt_contention_internal_dump_requested(void);
+
+/* m must be locked, with the caller already on one of its queues */
+void INTERNAL qt_contention_internal_block(qt_contention_sample_t   *s,
+                                           const void               *addr,
+                                           const qthread_addrstat_t *m);
+void INTERNAL qt_contention_internal_wake(const qt_contention_sample_t *s,
+                                          void                         *f);
+
+# define QTHREAD_CONTENTION_DECLARATION qt_contention_sample_t contention_sample
+
+/* The countdown is the only thing unsampled waits pay for. */
+# define QTHREAD_CONTENTION_BLOCK(addr, m) do {                                  \
+        contention_sample.start = 0;                                             \
+        if (qt_contention_enabled) {                                             \
+            qthread_worker_t *w_ = qthread_internal_getworker();                 \
+            if (w_ && (--w_->contention->countdown == 0)) {                      \
+                qt_contention_internal_block(&contention_sample, (addr), (m));   \
+            }                                                                    \
+        }                                                                        \
+} while (0)
+
+# define QTHREAD_CONTENTION_WAKE(me) do {                                        \
+        if (contention_sample.start) {                                           \
+            qt_contention_internal_wake(&contention_sample, (void *)(me)->f);    \
+        }                                                                        \
+} while (0)
+
+# define QTHREAD_CONTENTION_POLL() do {                                          \
+        if (qt_contention_dump_requested) {                                      \
+            qt_contention_internal_dump_requested();                             \
+        }                                                                        \
+} while (0)
+
+#else /* ifdef QTHREAD_CONTENTION_PROFILING */
+
+# define qt_contention_subsystem_init()    do {} while (0)
+# define QTHREAD_CONTENTION_DECLARATION
+# define QTHREAD_CONTENTION_BLOCK(addr, m) do {} while (0)
+# define QTHREAD_CONTENTION_WAKE(me)       do {} while (0)
+# define QTHREAD_CONTENTION_POLL()         do {} while (0)
+
+#endif /* ifdef QTHREAD_CONTENTION_PROFILING */
+
+#endif // ifndef QT_CONTENTION_H
+/* vim:set expandtab: */
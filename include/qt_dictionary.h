@@ -0,0 +1,49 @@
+#ifndef QT_DICTIONARY_INTERNAL_H
+#define QT_DICTIONARY_INTERNAL_H
+
+#include <stdint.h>
+
+#include <qthread/common.h> /* for QINLINE */
+#include <qthread/dictionary.h>
+
+#include "qt_visibility.h"
+
+/* Each backend provides these for the operations in dictionary_bulk.c. */
+
+/* The hash the backend files key under; its low bits pick the bucket. */
+uint64_t INTERNAL qt_dictionary_key_hash(qt_dictionary *dict,
+                                         void          *key);
+
+/* Prepares dict to receive n more entries, e.g. by growing it ahead of
+ * time, so that a bulk insert does not have to. */
+void INTERNAL qt_dictionary_reserve(qt_dictionary *dict,
+                                    size_t         n);
+
+/* A dictionary created with neither a key comparison nor a hash function
+ * stores integer (pointer-sized) keys. These are the functions the backends
+ * use in that case. */
+
+/* the 64-bit finalizer from MurmurHash3 */
+static QINLINE uint64_t qt_dict_mix64(uint64_t k)
+{   /*{{{*/
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+} /*}}}*/
+
+static QINLINE int qt_dict_int_equals(void *a,
+                                      void *b)
+{   /*{{{*/
+    return a == b;
+} /*}}}*/
+
+static QINLINE int qt_dict_int_hash(void *key)
+{   /*{{{*/
+    return (int)qt_dict_mix64((uint64_t)(uintptr_t)key);
+} /*}}}*/
+
+#endif // ifndef QT_DICTIONARY_INTERNAL_H
+/* vim:set expandtab: */
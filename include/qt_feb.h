@@ -18,6 +18,7 @@ typedef filter_code (*qt_feb_taskfilter_f)(qt_key_t            addr,
                                            void *restrict      arg);
 
 void INTERNAL qt_feb_subsystem_init(uint_fast8_t);
+size_t INTERNAL qt_feb_subsystem_entries(void);
 
 int INTERNAL qthread_writeEF_nb(aligned_t *restrict const       dest,
                                 const aligned_t *restrict const src);
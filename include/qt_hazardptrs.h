@@ -3,7 +3,7 @@
 
 #include "qt_visibility.h"
 
-#define HAZARD_PTRS_PER_SHEP 2
+#define HAZARD_PTRS_PER_SHEP 3
 
 typedef struct {
     void (*freefunc)(void *);
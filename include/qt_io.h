@@ -12,6 +12,7 @@
 #include "qt_qthread_struct.h"
 #include "qt_qthread_mgmt.h"
 #include "qt_debug.h"
+#include "qt_timer_wheel.h"
 
 #if defined(UNPOOLED)
 # define ALLOC_SYSCALLJOB() (qt_blocking_queue_node_t *)MALLOC(sizeof(qt_blocking_queue_node_t))
@@ -24,9 +25,57 @@
 extern qt_mpool syscall_job_pool;
 
 void            qt_blocking_subsystem_init(void);
-int             qt_process_blocking_call(void);
+int             qt_process_blocking_call(int home);
 void            qt_blocking_subsystem_enqueue(qt_blocking_queue_node_t *job);
 
+/* For qthread_readstate() */
+size_t qt_blocking_subsystem_queue_depth(void);
+size_t qt_blocking_subsystem_proxies(void);
+size_t qt_blocking_subsystem_latency(unsigned int pct);
+
+/* The reactor (io_reactor.c), for non-blocking sockets and pipes */
+extern saligned_t qt_io_reactor_parked;
+
+void qt_io_reactor_init(void);
+int  qt_io_reactor_pollable(int fd);
+void qt_io_reactor_forget(int fd);
+void qt_io_reactor_wait(int   fd,
+                        short events);
+int  qt_io_reactor_register(qt_blocking_queue_node_t *job);
+int  qt_io_reactor_poll(qthread_shepherd_t *shep);
+
+/* io_uring (io_uring.c), for files; its in-flight requests count as parked */
+void qt_io_uring_init(void);
+int  qt_io_uring_submit(qt_blocking_queue_node_t *job);
+int  qt_io_uring_reap(qthread_shepherd_t *shep);
+
+/* For the schedulers' idle loops: wakes the tasks parked on this shepherd
+ * whose fds have become ready, whose I/O has completed, or whose timers have
+ * expired (armed timers count as parked too), and returns how many there
+ * were. */
+static inline int qt_io_reactor_idle(qthread_shepherd_t *shep)
+{
+    if (qt_io_reactor_parked == 0) {
+        return 0;
+    }
+    return qt_io_reactor_poll(shep) + qt_io_uring_reap(shep) +
+           qt_timer_wheel_tick(shep);
+}
+
+/* For the scheduling loop, so that a shepherd that never runs out of work
+ * still wakes its parked tasks: cheap when nothing is parked, and otherwise
+ * polls once every QT_IO_BUSY_POLL passes. */
+#define QT_IO_BUSY_POLL 64
+static inline int qt_io_reactor_tick(qthread_shepherd_t *shep,
+                                     qthread_worker_t   *wkr)
+{
+    if ((qt_io_reactor_parked == 0) || (++wkr->io_ticks < QT_IO_BUSY_POLL)) {
+        return 0;
+    }
+    wkr->io_ticks = 0;
+    return qt_io_reactor_poll(shep) + qt_io_uring_reap(shep);
+}
+
 static inline int qt_blockable(void)
 {
     qthread_t *t = qthread_internal_self();
@@ -0,0 +1,102 @@
+#ifndef QT_LATENCY_H
+#define QT_LATENCY_H
+
+/* Ready-queue latency histograms (latency.c), for --enable-profiling=latency
+ * builds. Whatever makes a qthread ready to run (spawning it, filling the FEB
+ * or syncvar it waits on, releasing it from a qthread_queue_t, completing its
+ * I/O, or expiring its timeout) stamps it with the time and the reason, and
+ * the worker that eventually runs it adds the time it spent waiting to a
+ * histogram of its own, one per reason. Yields and migrations are not timed.
+ * The histograms are log-linear, HDR-style: exact below 16ns, and within
+ * 1/16 of the value above that. They are merged and reported at
+ * qthread_finalize(), and by qthread_latency_dump(). In other builds, the
+ * macros below compile to nothing. */
+
+#ifdef QTHREAD_LATENCY_PROFILING
+
+# include "qt_visibility.h"
+# include "qt_macros.h"
+# include "qt_shepherd_innards.h"
+# include "qt_qthread_struct.h"
+# include "qt_timer_wheel.h"          /* for qt_timer_now() */
+
+enum qt_latency_kind {
+    QT_LATENCY_SPAWN = 1,             /* 0 is "not timed" */
+    QT_LATENCY_FEB,                   /* FEBs, syncvars, and spawn preconditions */
+    QT_LATENCY_QUEUE,                 /* qthread_queue_t releases */
+    QT_LATENCY_IO,
+    QT_LATENCY_TIMER,                 /* timed waits that ran out */
+    QT_LATENCY_KINDS
+};
+
+# define QT_LATENCY_SUB_BITS 4
+# define QT_LATENCY_SUB      (1 << QT_LATENCY_SUB_BITS)
+# define QT_LATENCY_BUCKETS  ((64 - QT_LATENCY_SUB_BITS + 1) * QT_LATENCY_SUB)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;                     /* ns */
+    uint64_t max;
+    uint64_t bucket[QT_LATENCY_BUCKETS];
+} qt_latency_hist_t;
+
+/* aligned so that no two workers' histograms share a cache line */
+typedef struct qt_latency_worker_s {
+    Q_ALIGNED(CACHELINE_WIDTH) qt_latency_hist_t hist[QT_LATENCY_KINDS];   /* hist[0] is unused */
+} qt_latency_worker_t;
+
+extern int qt_latency_enabled;
+
+void INTERNAL qt_latency_subsystem_init(void);
+
+/* Values below QT_LATENCY_SUB get a bucket each; above that, each power of
+ * two is split into QT_LATENCY_SUB buckets. */
+static QINLINE unsigned qt_latency_bucket(uint64_t ns)
+{
+    unsigned e;
+
+    if (ns < QT_LATENCY_SUB) {
+        return (unsigned)ns;
+    }
+    e = 63 - __builtin_clzll(ns);
+    return (e - QT_LATENCY_SUB_BITS + 1) * QT_LATENCY_SUB +
+           (unsigned)((ns >> (e - QT_LATENCY_SUB_BITS)) & (QT_LATENCY_SUB - 1));
+}
+
+static QINLINE void qt_latency_record(qthread_worker_t *w,
+                                      qthread_t        *t)
+{
+    const uint64_t     now = qt_timer_now();
+    const uint64_t     ns  = (now > t->ready_at) ? now - t->ready_at : 0;
+    qt_latency_hist_t *h   = &w->latency->hist[t->ready_kind];
+
+    h->count++;
+    h->sum += ns;
+    if (ns > h->max) { h->max = ns; }
+    h->bucket[qt_latency_bucket(ns)]++;
+    t->ready_at = 0;
+}
+
+/* where t is about to go into a ready queue */
+# define QTHREAD_LATENCY_READY(t, kind) do {                          \
+        if (qt_latency_enabled) {                                     \
+            (t)->ready_kind = (kind);                                 \
+            (t)->ready_at   = qt_timer_now();                         \
+        }                                                             \
+} while (0)
+
+/* where worker w is about to run t */
+# define QTHREAD_LATENCY_RUN(w, t) do {                               \
+        if ((t)->ready_at) { qt_latency_record((w), (t)); }           \
+} while (0)
+
+#else /* ifdef QTHREAD_LATENCY_PROFILING */
+
+# define qt_latency_subsystem_init()     do {} while (0)
+# define QTHREAD_LATENCY_READY(t, kind)  do {} while (0)
+# define QTHREAD_LATENCY_RUN(w, t)       do {} while (0)
+
+#endif /* ifdef QTHREAD_LATENCY_PROFILING */
+
+#endif // ifndef QT_LATENCY_H
+/* vim:set expandtab: */
@@ -18,5 +18,8 @@ void qt_mpool_destroy(qt_mpool pool);
 
 void qt_mpool_subsystem_init(void);
 
+/* how much memory the pools are holding, in bytes */
+size_t qt_mpool_subsystem_bytes(void);
+
 #endif // ifndef QT_MPOOL_H
 /* vim:set expandtab: */
@@ -0,0 +1,70 @@
+#ifndef QT_PERF_COUNTERS_H
+#define QT_PERF_COUNTERS_H
+
+/* Per-task-function hardware counters (perf_counters.c), for
+ * --enable-profiling=perf builds on Linux. Each worker opens a perf_event
+ * group on itself when it starts (cycles, instructions, LLC misses and
+ * backend stall cycles unless QT_PERF_EVENTS says otherwise) and reads it on
+ * either side of every qthread_exec(): with rdpmc, through each event's
+ * mmap'd page, while the events are on the PMU and user code may run it, and
+ * with read() otherwise. The difference is charged to the function the task
+ * was spawned with, in a table that only that worker touches. The tables are
+ * merged and reported at qthread_finalize(). In other builds, the macros
+ * below compile to nothing. */
+
+#ifdef QTHREAD_PERF_COUNTERS
+
+# include "qt_visibility.h"
+# include "qt_shepherd_innards.h"
+
+# define QT_PERF_MAX_EVENTS 8
+
+typedef struct {
+    void    *f;
+    uint64_t slices;   /* times a task running f was switched to */
+    uint64_t tasks;    /* of those, the ones that ran f to the end */
+    uint64_t count[QT_PERF_MAX_EVENTS];
+    int      used;
+} qt_perf_entry_t;
+
+typedef struct qt_perf_worker_s {
+    int              fds[QT_PERF_MAX_EVENTS];   /* the first leads the group */
+    void            *pages[QT_PERF_MAX_EVENTS]; /* their mmap'd pages, or NULL */
+    uint64_t         start[QT_PERF_MAX_EVENTS];
+    uint64_t         enabled, running;   /* for spotting multiplexing */
+    qt_perf_entry_t *table;              /* open addressing, keyed on f */
+    size_t           mask, used;
+} qt_perf_worker_t;
+
+void INTERNAL qt_perf_subsystem_init(void);
+
+/* on the worker's own thread, before it runs anything */
+void INTERNAL qt_perf_worker_start(qthread_worker_t *w);
+
+void INTERNAL qt_perf_internal_begin(qt_perf_worker_t *p);
+void INTERNAL qt_perf_internal_end(qt_perf_worker_t *p,
+                                   void             *f,
+                                   int               done);
+
+/* w->perf stays NULL on workers that aren't counting */
+# define QTHREAD_PERF_BEGIN(w) do {                                   \
+        if ((w)->perf) { qt_perf_internal_begin((w)->perf); }         \
+} while (0)
+
+# define QTHREAD_PERF_END(w, f, done) do {                            \
+        if ((w)->perf) {                                              \
+            qt_perf_internal_end((w)->perf, (void *)(f), (done));     \
+        }                                                             \
+} while (0)
+
+#else /* ifdef QTHREAD_PERF_COUNTERS */
+
+# define qt_perf_subsystem_init()      do {} while (0)
+# define qt_perf_worker_start(w)       do {} while (0)
+# define QTHREAD_PERF_BEGIN(w)         do {} while (0)
+# define QTHREAD_PERF_END(w, f, done)  do {} while (0)
+
+#endif /* ifdef QTHREAD_PERF_COUNTERS */
+
+#endif // ifndef QT_PERF_COUNTERS_H
+/* vim:set expandtab: */
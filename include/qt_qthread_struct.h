@@ -91,6 +91,10 @@ struct qthread_s {
     qthread_shepherd_id_t      target_shepherd; /* the shepherd we'd rather run on; set to NO_SHEPHERD unless the thread either migrated or was spawned to a specific destination (aka the programmer expressed a desire for this thread to be somewhere) */
     uint16_t                   flags;           /* may not need all bits */
     uint8_t                    thread_state : 4;
+#ifdef QTHREAD_LATENCY_PROFILING
+    uint8_t                    ready_kind;      /* why it was made ready (qt_latency.h) */
+    uint64_t                   ready_at;        /* when; 0 if it wasn't timed */
+#endif
 
     Q_ALIGNED(8) uint8_t data[]; /* this is where we stick argcopy and tasklocal data */
 };
@@ -0,0 +1,37 @@
+#ifndef QT_REPORT_H
+#define QT_REPORT_H
+
+/* What the profiling reports (trace.c, latency.c, contention.c) share about
+ * writing themselves out: getting stdio off a qthread's stack, and a signal
+ * that asks for a report, which a scheduling loop then writes. */
+
+#include <signal.h>                   /* for sig_atomic_t */
+
+#include "qthread/qthread.h"          /* for aligned_t */
+#include "qt_visibility.h"
+
+typedef struct {
+    const char            *what;      /* for warnings, e.g. "trace" */
+    int                  (*write)(const char *path);
+    volatile sig_atomic_t *requested; /* set by the signal */
+    aligned_t              busy;      /* one is being written */
+    aligned_t              dumps;     /* how many the signal has asked for */
+} qt_report_t;
+
+/* Calls r->write(path) and returns what it did, or QTHREAD_OPFAIL if another
+ * of r's reports is being written. */
+int INTERNAL qt_report_dump(qt_report_t *r,
+                            const char  *path);
+
+/* For the scheduling loops, once *r->requested is set: writes the report to
+ * <path>.1, <path>.2, and so on, or as path says if that is NULL, empty, or
+ * "-". Only one worker does it. */
+void INTERNAL qt_report_dump_requested(qt_report_t *r,
+                                       const char  *path);
+
+/* Makes sig, if it is positive, set *r->requested. */
+void INTERNAL qt_report_signal(qt_report_t *r,
+                               int          sig);
+
+#endif // ifndef QT_REPORT_H
+/* vim:set expandtab: */
@@ -43,6 +43,20 @@ struct qthread_worker_s {
     qthread_worker_id_t       unique_id;
     qthread_worker_id_t       worker_id;
     qthread_worker_id_t       packed_worker_id;
+    struct qt_stats_slot_s   *stats;     /* this worker's counters (qt_stats.h) */
+    unsigned int              io_ticks;  /* scheduling passes since it last polled for I/O */
+#ifdef QTHREAD_TRACING
+    struct qt_trace_ring_s   *trace;     /* this worker's events (qt_trace.h) */
+#endif
+#ifdef QTHREAD_PERF_COUNTERS
+    struct qt_perf_worker_s  *perf;      /* this worker's counters (qt_perf_counters.h) */
+#endif
+#ifdef QTHREAD_LATENCY_PROFILING
+    struct qt_latency_worker_s *latency; /* this worker's histograms (qt_latency.h) */
+#endif
+#ifdef QTHREAD_CONTENTION_PROFILING
+    struct qt_contention_worker_s *contention; /* this worker's sketch (qt_contention.h) */
+#endif
     Q_ALIGNED(8) uint_fast8_t QTHREAD_CASLOCK(active);
 };
 typedef struct qthread_worker_s qthread_worker_t;
@@ -0,0 +1,78 @@
+#ifndef QT_STATS_H
+#define QT_STATS_H
+
+#include "qthread/qthread.h"
+#include "qt_visibility.h"
+#include "qt_shepherd_innards.h"
+
+/* Per-worker event counters (stats.c). Each worker owns a cache-line-padded
+ * slot and bumps its counters with plain adds; qthread_stats_snapshot() sums
+ * the slots without stopping anyone, so a snapshot is only approximately
+ * consistent. Threads that are not workers count into a shared slot,
+ * atomically. Counting can be switched off (QT_STATS=0, or
+ * qthread_stats_enable()), which leaves one predictable branch per event. */
+
+/* A worker's slot. While the worker waits for work, idle_since says since
+ * when, so that snapshots can count a wait that hasn't ended yet. */
+typedef struct qt_stats_slot_s {
+    qthread_stats_t s;
+    uint64_t        idle_since;
+} qt_stats_slot_t;
+
+extern int qt_stats_enabled;
+
+void INTERNAL qt_stats_subsystem_init(void);
+
+/* The counters as they stand, ignoring qthread_stats_reset(), for the live
+ * statistics page. idle[i] says whether worker i (in packed_worker_id order)
+ * is waiting for work right now. */
+void INTERNAL qt_stats_internal_sample(qthread_stats_t *total,
+                                       qthread_stats_t *per_worker,
+                                       uint8_t         *idle);
+
+/* Starts publishing the live statistics page (stats_page.c), if
+ * QT_STATS_PAGE asks for it. */
+void INTERNAL qt_stats_page_init(void);
+
+/* The calling thread's counters, for the rare events (spawns) that may come
+ * from outside of the workers */
+void INTERNAL qt_stats_count_external(size_t   offset,
+                                      uint64_t n);
+
+#define QTHREAD_STAT(w, field, n) do {                                    \
+        if (qt_stats_enabled) { (w)->stats->s.field += (n); }             \
+} while (0)
+
+#define QTHREAD_STAT_HERE(field, n) do {                                  \
+        if (qt_stats_enabled) {                                           \
+            qthread_worker_t *w_ = qthread_internal_getworker();          \
+            if (w_ != NULL) {                                             \
+                w_->stats->s.field += (n);                                \
+            } else {                                                      \
+                qt_stats_count_external(offsetof(qthread_stats_t, field), \
+                                        (n));                             \
+            }                                                             \
+        }                                                                 \
+} while (0)
+
+/* Bracket a wait for work. A wait that began while counting was off isn't
+ * counted. */
+static QINLINE void qt_stats_idle_begin(qthread_worker_t *w,
+                                        uint64_t          now)
+{
+    w->stats->idle_since = now;
+}
+
+static QINLINE void qt_stats_idle_end(qthread_worker_t *w,
+                                      uint64_t          now)
+{
+    const uint64_t since = w->stats->idle_since;
+
+    if (since != 0) {
+        w->stats->idle_since  = 0;
+        w->stats->s.idle_ns  += now - since;
+    }
+}
+
+#endif // ifndef QT_STATS_H
+/* vim:set expandtab: */
@@ -0,0 +1,70 @@
+#ifndef QT_STATS_PAGE_H
+#define QT_STATS_PAGE_H
+
+/* The live statistics page (stats_page.c) and how to read it (tools/qtstat).
+ *
+ * With QT_STATS_PAGE set, a thread of the runtime's own copies the counters
+ * and gauges below into a SysV shared memory segment every
+ * QT_STATS_PAGE_INTERVAL milliseconds; the segment's key is
+ * QT_STATS_PAGE_KEY(pid). Readers in other processes attach to it read-only
+ * and never block the writer: it makes seq odd, writes, and makes seq even
+ * again, and a reader that saw seq change (or odd) while copying the page
+ * copies it again. Nothing here may depend on the build, since qtstat reads
+ * pages from programs built every which way; the layout only ever grows at
+ * the end, and anything else is a new version. */
+
+#include <stdint.h>
+
+#define QT_STATS_PAGE_MAGIC   UINT64_C(0x2153544154535451) /* "QTSTATS!" */
+#define QT_STATS_PAGE_VERSION 1
+#define QT_STATS_PAGE_KEY(pid) ((int)(0x51000000 | ((uint32_t)(pid) & 0xffffff)))
+
+typedef struct {
+    uint64_t queue_length;      /* tasks waiting in the shepherd's queue */
+    uint32_t workers;
+    uint32_t active_workers;    /* workers that haven't been disabled */
+    uint32_t idle_workers;      /* workers waiting for work right now */
+    uint32_t reserved;
+    uint64_t tasks_spawned;     /* the rest are counters, as in qthread_stats_t */
+    uint64_t tasks_run;
+    uint64_t tasks_stolen;
+    uint64_t steal_attempts;
+    uint64_t feb_blocks;
+    uint64_t idle_ns;
+} qt_stats_page_shepherd_t;
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t size;              /* of the whole page, in bytes */
+    uint64_t seq;               /* odd while the page is being written */
+    uint64_t pid;
+    uint64_t interval_ns;       /* how often the page is rewritten */
+    uint64_t samples;           /* how many times it has been */
+    uint64_t sample_ns;         /* CLOCK_MONOTONIC, when it last was */
+    uint64_t finalized;         /* nonzero once the library has shut down */
+
+    uint32_t nshepherds;
+    uint32_t nworkerspershep;
+
+    /* everything, including spawns from outside of the workers */
+    uint64_t tasks_spawned;
+    uint64_t tasks_run;
+    uint64_t tasks_blocked;
+    uint64_t tasks_stolen;
+    uint64_t steal_attempts;
+    uint64_t steal_failures;
+    uint64_t feb_blocks;
+    uint64_t context_switches;
+    uint64_t idle_ns;
+
+    uint64_t feb_entries;       /* addresses in the FEB tables */
+    uint64_t io_queue_depth;    /* blocking calls waiting for a proxy thread */
+    uint64_t io_proxies;        /* proxy threads */
+    uint64_t pool_bytes;        /* memory held by the internal pools */
+
+    qt_stats_page_shepherd_t shepherds[];
+} qt_stats_page_t;
+
+#endif // ifndef QT_STATS_PAGE_H
+/* vim:set expandtab: */
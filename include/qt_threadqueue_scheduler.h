@@ -1,7 +1,14 @@
 #ifndef _QT_THREADQUEUE_SCHEDULER_H_
 #define _QT_THREADQUEUE_SCHEDULER_H_
 
+#if !defined(QTHREAD_RUNTIME_SCHEDULER) || defined(QT_THREADQUEUE_NAME)
 qthread_shepherd_id_t INTERNAL qt_threadqueue_choose_dest(qthread_shepherd_t * curr_shep);
+#else
+static QINLINE qthread_shepherd_id_t qt_threadqueue_choose_dest(qthread_shepherd_t *curr_shep)
+{
+    return qt_threadqueue_ops.choose_dest(curr_shep);
+}
+#endif
 
 #endif // _QT_THREADQUEUE_SCHEDULER_H_
 
@@ -11,6 +11,54 @@
 
 typedef filter_code (*qt_threadqueue_filter_f)(qthread_t *);
 
+#if defined(QTHREAD_RUNTIME_SCHEDULER) && defined(QT_THREADQUEUE_NAME)
+/* With --with-scheduler=runtime, every scheduler in src/threadqueues is built
+ * into the library, each with QT_THREADQUEUE_NAME set to its name. Their
+ * entry points (and anything else they don't keep static) get that name as a
+ * prefix here, so that they don't collide, and each scheduler describes
+ * itself to runtime_threadqueues.c with a qt_threadqueue_impl table. */
+# define QT_THREADQUEUE_PASTE_(a, b) a ## _ ## b
+# define QT_THREADQUEUE_PASTE(a, b)  QT_THREADQUEUE_PASTE_(a, b)
+# define QT_THREADQUEUE_SYM(s)       QT_THREADQUEUE_PASTE(QT_THREADQUEUE_NAME, s)
+# define QT_THREADQUEUE_STR_(s)      # s
+# define QT_THREADQUEUE_STR(s)       QT_THREADQUEUE_STR_(s)
+
+# define qt_threadqueue_impl                    QT_THREADQUEUE_SYM(threadqueue_impl)
+# define qt_threadqueue_subsystem_init          QT_THREADQUEUE_SYM(threadqueue_subsystem_init)
+# define qt_threadqueue_new                     QT_THREADQUEUE_SYM(threadqueue_new)
+# define qt_threadqueue_free                    QT_THREADQUEUE_SYM(threadqueue_free)
+# define qt_threadqueue_filter                  QT_THREADQUEUE_SYM(threadqueue_filter)
+# define qt_threadqueue_enqueue                 QT_THREADQUEUE_SYM(threadqueue_enqueue)
+# define qt_threadqueue_enqueue_yielded         QT_THREADQUEUE_SYM(threadqueue_enqueue_yielded)
+# define qt_threadqueue_enqueue_cache           QT_THREADQUEUE_SYM(threadqueue_enqueue_cache)
+# define qt_threadqueue_private_enqueue         QT_THREADQUEUE_SYM(threadqueue_private_enqueue)
+# define qt_threadqueue_private_enqueue_yielded QT_THREADQUEUE_SYM(threadqueue_private_enqueue_yielded)
+# define qt_threadqueue_private_dequeue         QT_THREADQUEUE_SYM(threadqueue_private_dequeue)
+# define qt_threadqueue_private_filter          QT_THREADQUEUE_SYM(threadqueue_private_filter)
+# define qt_threadqueue_advisory_queuelen       QT_THREADQUEUE_SYM(threadqueue_advisory_queuelen)
+# define qt_scheduler_get_thread                QT_THREADQUEUE_SYM(scheduler_get_thread)
+# define qthread_steal_stat                     QT_THREADQUEUE_SYM(steal_stat)
+# define qthread_steal_enable                   QT_THREADQUEUE_SYM(steal_enable)
+# define qthread_steal_disable                  QT_THREADQUEUE_SYM(steal_disable)
+# define qthread_cas_steal_stat                 QT_THREADQUEUE_SYM(cas_steal_stat)
+# define qt_threadqueue_dequeue_specific        QT_THREADQUEUE_SYM(threadqueue_dequeue_specific)
+# define qt_threadqueue_policy                  QT_THREADQUEUE_SYM(threadqueue_policy)
+# define qt_threadqueue_choose_dest             QT_THREADQUEUE_SYM(threadqueue_choose_dest)
+/* not part of the interface, but not static either */
+# define generic_threadqueue_pools              QT_THREADQUEUE_SYM(threadqueue_pools)
+# define qt_threadqueue_enqueue_multiple        QT_THREADQUEUE_SYM(threadqueue_enqueue_multiple)
+# define qt_threadqueue_dequeue_steal           QT_THREADQUEUE_SYM(threadqueue_dequeue_steal)
+# define qt_threadqueue_enqueue_unstealable     QT_THREADQUEUE_SYM(threadqueue_enqueue_unstealable)
+# define qt_threadqueue_resize_and_enqueue      QT_THREADQUEUE_SYM(threadqueue_resize_and_enqueue)
+# define qt_threadqueue_enqueue_head            QT_THREADQUEUE_SYM(threadqueue_enqueue_head)
+# define qt_threadqueue_enqueue_tail            QT_THREADQUEUE_SYM(threadqueue_enqueue_tail)
+# define qt_threadqueue_dequeue_head            QT_THREADQUEUE_SYM(threadqueue_dequeue_head)
+# define qt_threadqueue_dequeue_tail            QT_THREADQUEUE_SYM(threadqueue_dequeue_tail)
+# define qt_init_agg_task                       QT_THREADQUEUE_SYM(init_agg_task)
+# define qt_keep_adding_agg_task                QT_THREADQUEUE_SYM(keep_adding_agg_task)
+# define qt_add_first_agg_task                  QT_THREADQUEUE_SYM(add_first_agg_task)
+#endif /* if defined(QTHREAD_RUNTIME_SCHEDULER) && defined(QT_THREADQUEUE_NAME) */
+
 typedef struct _qt_threadqueue qt_threadqueue_t;
 typedef struct _qt_threadqueue_pools {
     qt_mpool nodes;
@@ -19,6 +67,49 @@ typedef struct _qt_threadqueue_pools {
 
 #include "qt_spawncache.h"
 
+enum threadqueue_policy {
+    THREADQUEUE_POLICY_FALSE = 0,
+    THREADQUEUE_POLICY_TRUE  = 1,
+    THREADQUEUE_POLICY_UNSUPPORTED = 2,
+    SINGLE_WORKER
+};
+
+#ifdef QTHREAD_RUNTIME_SCHEDULER
+struct qthread_shepherd_s;
+
+/* A scheduler, as runtime_threadqueues.c sees it. The calls made for every
+ * task come first, so that they share a cache line. */
+typedef struct qt_threadqueue_ops_s {
+    void (*enqueue)(qt_threadqueue_t *restrict q,
+                    qthread_t *restrict        t);
+    qthread_t *(*get_thread)(qt_threadqueue_t         *q,
+# ifdef QTHREAD_LOCAL_PRIORITY
+                             qt_threadqueue_t         *lpq,
+# endif
+                             qt_threadqueue_private_t *qc,
+                             uint_fast8_t              active);
+    void (*enqueue_yielded)(qt_threadqueue_t *restrict q,
+                            qthread_t *restrict        t);
+    qthread_shepherd_id_t (*choose_dest)(struct qthread_shepherd_s *curr_shep);
+    ssize_t (*advisory_queuelen)(qt_threadqueue_t *q);
+    qthread_t *(*dequeue_specific)(qt_threadqueue_t *q,
+                                   void             *value);
+
+    void (*subsystem_init)(void);
+    qt_threadqueue_t *(*new_queue)(void);
+    void (*free_queue)(qt_threadqueue_t *q);
+    size_t (*policy)(const enum threadqueue_policy policy);
+    void (*filter)(qt_threadqueue_t       *q,
+                   qt_threadqueue_filter_f f); /* NULL if it can't */
+    void (*steal_enable)(void);
+    void (*steal_disable)(void);
+    void (*steal_stat)(void);                  /* NULL if it has none */
+    void (*cas_steal_stat)(void);              /* NULL if it has none */
+    const char *name;
+} qt_threadqueue_ops_t;
+#endif /* ifdef QTHREAD_RUNTIME_SCHEDULER */
+
+#if !defined(QTHREAD_RUNTIME_SCHEDULER) || defined(QT_THREADQUEUE_NAME)
 void INTERNAL qt_threadqueue_subsystem_init(void);
 
 qt_threadqueue_t INTERNAL *qt_threadqueue_new(void);
@@ -57,13 +148,140 @@ void INTERNAL qthread_cas_steal_stat(void);
 /* Functions for work stealing functionality */
 qthread_t INTERNAL *qt_threadqueue_dequeue_specific(qt_threadqueue_t *q,
                                                     void             *value);
-enum threadqueue_policy {
-    THREADQUEUE_POLICY_FALSE = 0,
-    THREADQUEUE_POLICY_TRUE  = 1,
-    THREADQUEUE_POLICY_UNSUPPORTED = 2,
-    SINGLE_WORKER
-};
 size_t qt_threadqueue_policy(const enum threadqueue_policy policy);
 
+
+# ifdef QT_THREADQUEUE_NAME
+extern const qt_threadqueue_ops_t INTERNAL qt_threadqueue_impl;
+
+/* what every scheduler has; each adds whichever of the rest it has */
+#  define QT_THREADQUEUE_IMPL_COMMON                        \
+    .enqueue           = qt_threadqueue_enqueue,           \
+    .get_thread        = qt_scheduler_get_thread,          \
+    .enqueue_yielded   = qt_threadqueue_enqueue_yielded,   \
+    .choose_dest       = qt_threadqueue_choose_dest,       \
+    .advisory_queuelen = qt_threadqueue_advisory_queuelen, \
+    .dequeue_specific  = qt_threadqueue_dequeue_specific,  \
+    .subsystem_init    = qt_threadqueue_subsystem_init,    \
+    .new_queue         = qt_threadqueue_new,               \
+    .free_queue        = qt_threadqueue_free,              \
+    .policy            = qt_threadqueue_policy,            \
+    .steal_enable      = qthread_steal_enable,             \
+    .steal_disable     = qthread_steal_disable,            \
+    .name              = QT_THREADQUEUE_STR(QT_THREADQUEUE_NAME)
+# endif
+#else /* everything else calls whichever scheduler QT_SCHEDULER chose */
+# include "qt_expect.h"
+
+/* Sherwood is what the library uses when QT_SCHEDULER doesn't say, so its
+ * enqueue and get_thread, which are called for every task, are called
+ * directly rather than through the table whenever it is the one in use. */
+extern qt_threadqueue_ops_t INTERNAL qt_threadqueue_ops;
+
+void INTERNAL qt_threadqueue_select(void);
+
+void INTERNAL       sherwood_threadqueue_enqueue(qt_threadqueue_t *restrict q,
+                                                 qthread_t *restrict        t);
+qthread_t INTERNAL *sherwood_scheduler_get_thread(qt_threadqueue_t         *q,
+# ifdef QTHREAD_LOCAL_PRIORITY
+                                                  qt_threadqueue_t         *lpq,
+# endif
+                                                  qt_threadqueue_private_t *qc,
+                                                  uint_fast8_t              active);
+
+static QINLINE void qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
+                                           qthread_t *restrict        t)
+{
+    if (QTHREAD_LIKELY(qt_threadqueue_ops.enqueue == sherwood_threadqueue_enqueue)) {
+        sherwood_threadqueue_enqueue(q, t);
+    } else {
+        qt_threadqueue_ops.enqueue(q, t);
+    }
+}
+
+static QINLINE qthread_t *qt_scheduler_get_thread(qt_threadqueue_t         *q,
+# ifdef QTHREAD_LOCAL_PRIORITY
+                                                  qt_threadqueue_t         *lpq,
+# endif
+                                                  qt_threadqueue_private_t *qc,
+                                                  uint_fast8_t              active)
+{
+# ifdef QTHREAD_LOCAL_PRIORITY
+    if (QTHREAD_LIKELY(qt_threadqueue_ops.get_thread == sherwood_scheduler_get_thread)) {
+        return sherwood_scheduler_get_thread(q, lpq, qc, active);
+    }
+    return qt_threadqueue_ops.get_thread(q, lpq, qc, active);
+# else
+    if (QTHREAD_LIKELY(qt_threadqueue_ops.get_thread == sherwood_scheduler_get_thread)) {
+        return sherwood_scheduler_get_thread(q, qc, active);
+    }
+    return qt_threadqueue_ops.get_thread(q, qc, active);
+# endif
+}
+
+static QINLINE void qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
+                                                   qthread_t *restrict        t)
+{
+    qt_threadqueue_ops.enqueue_yielded(q, t);
+}
+
+static QINLINE ssize_t qt_threadqueue_advisory_queuelen(qt_threadqueue_t *q)
+{
+    return qt_threadqueue_ops.advisory_queuelen(q);
+}
+
+static QINLINE qthread_t *qt_threadqueue_dequeue_specific(qt_threadqueue_t *q,
+                                                          void             *value)
+{
+    return qt_threadqueue_ops.dequeue_specific(q, value);
+}
+
+static QINLINE void qt_threadqueue_subsystem_init(void)
+{
+    qt_threadqueue_ops.subsystem_init();
+}
+
+static QINLINE qt_threadqueue_t *qt_threadqueue_new(void)
+{
+    return qt_threadqueue_ops.new_queue();
+}
+
+static QINLINE void qt_threadqueue_free(qt_threadqueue_t *q)
+{
+    qt_threadqueue_ops.free_queue(q);
+}
+
+static QINLINE size_t qt_threadqueue_policy(const enum threadqueue_policy policy)
+{
+    return qt_threadqueue_ops.policy(policy);
+}
+
+static QINLINE void qt_threadqueue_filter(qt_threadqueue_t       *q,
+                                          qt_threadqueue_filter_f f)
+{
+    qt_threadqueue_ops.filter(q, f);
+}
+
+static QINLINE void qthread_steal_enable(void)
+{
+    qt_threadqueue_ops.steal_enable();
+}
+
+static QINLINE void qthread_steal_disable(void)
+{
+    qt_threadqueue_ops.steal_disable();
+}
+
+static QINLINE void qthread_steal_stat(void)
+{
+    if (qt_threadqueue_ops.steal_stat) { qt_threadqueue_ops.steal_stat(); }
+}
+
+static QINLINE void qthread_cas_steal_stat(void)
+{
+    if (qt_threadqueue_ops.cas_steal_stat) { qt_threadqueue_ops.cas_steal_stat(); }
+}
+#endif /* if !defined(QTHREAD_RUNTIME_SCHEDULER) || defined(QT_THREADQUEUE_NAME) */
+
 #endif // ifndef QT_THREADQUEUES_H
 /* vim:set expandtab: */
@@ -0,0 +1,71 @@
+#ifndef QT_TIMER_WHEEL_H
+#define QT_TIMER_WHEEL_H
+
+#include <time.h>                    /* for struct timespec */
+
+#include "qt_visibility.h"
+#include "qt_qthread_t.h"
+#include "qt_shepherd_innards.h"
+
+/* A deadline on the shepherds' timer wheels (timer_wheel.c). These normally
+ * live on the waiting task's stack; once armed, they belong to the wheel
+ * until they expire or qt_timer_cancel() returns. */
+typedef struct qt_timer_s qt_timer_t;
+
+/* Called, outside of the wheel's lock, when a timer expires. Returns nonzero
+ * if it woke the waiter. When there is no callback, the waiter is woken. */
+typedef int (*qt_timer_expire_f)(qt_timer_t *t);
+
+struct qt_timer_s {
+    qt_timer_t       *next;
+    qt_timer_t       *prev;
+    uint64_t          deadline; /* CLOCK_MONOTONIC, in ns */
+    qthread_t        *waiter;
+    qt_timer_expire_f expire;
+    void             *arg;      /* for the callback */
+    aligned_t         state;
+    int               shep;     /* whose wheel it is on */
+    int               slot;     /* and where */
+};
+
+enum qt_timer_state {
+    QT_TIMER_IDLE,
+    QT_TIMER_ARMED,
+    QT_TIMER_FIRING,            /* off the wheel; the callback is running */
+    QT_TIMER_FIRED,             /* done; the callback returned nonzero */
+    QT_TIMER_MISSED             /* done; the callback returned zero */
+};
+
+void     INTERNAL qt_timer_wheel_init(void);
+uint64_t INTERNAL qt_timer_now(void);
+uint64_t INTERNAL qt_timer_deadline(const struct timespec *abstime);
+
+/* A timer that is already due fires at the wheel's next tick, never from
+ * inside qt_timer_arm(), so the caller may hold locks its callback needs. */
+void INTERNAL qt_timer_arm(qthread_shepherd_t *shep,
+                           qt_timer_t         *t);
+
+/* Returns nonzero if the timer was still armed, in which case it never will
+ * expire; otherwise, waits for its callback to finish. */
+int INTERNAL qt_timer_cancel(qt_timer_t *t);
+
+/* Parks the calling task until the deadline. */
+void INTERNAL qt_timer_sleep_until(uint64_t deadline);
+
+/* Expires this shepherd's due timers, returning how many woke a task. */
+int INTERNAL qt_timer_wheel_expire(qthread_shepherd_t *shep);
+
+/* The number of armed timers on all of the wheels */
+extern saligned_t qt_timers_armed;
+
+/* For the scheduling loop: cheap when nothing is armed */
+static inline int qt_timer_wheel_tick(qthread_shepherd_t *shep)
+{
+    if (qt_timers_armed == 0) {
+        return 0;
+    }
+    return qt_timer_wheel_expire(shep);
+}
+
+#endif // ifndef QT_TIMER_WHEEL_H
+/* vim:set expandtab: */
@@ -0,0 +1,130 @@
+#ifndef QT_TRACE_H
+#define QT_TRACE_H
+
+/* Scheduling event traces (trace.c), for --enable-profiling=trace builds.
+ * Each worker appends fixed-size records to a ring of its own, overwriting
+ * the oldest ones when it is full; nothing is shared, so recording an event
+ * is a clock read and a handful of stores. The rings are turned into a Chrome
+ * trace-event file at qthread_finalize(), on a signal, or on request. In
+ * other builds, the macros below compile to nothing.
+ *
+ * Besides what the scheduler does, the trace records enough of what tasks do
+ * to one another (spawns, FEB and syncvar fills and reads, sinc submissions,
+ * wake-ups) for tools/qtdag to rebuild the task graph from it. */
+
+#ifdef QTHREAD_TRACING
+
+# include <signal.h>                  /* for sig_atomic_t */
+
+# include "qt_visibility.h"
+# include "qt_macros.h"
+# include "qt_shepherd_innards.h"
+# include "qt_timer_wheel.h"          /* for qt_timer_now() */
+
+enum qt_trace_type {
+    QT_TRACE_SPAWN,   /* obj: the new task, arg: its function, aux: the
+                       * shepherd it went to */
+    QT_TRACE_EXEC,    /* obj: the task, arg: its function */
+    QT_TRACE_RETURN,  /* obj: the task, aux: the state it came back in */
+    QT_TRACE_STEAL,   /* obj: the victim shepherd, aux: the tasks taken */
+    QT_TRACE_BARRIER, /* obj: the barrier, aux: the participant id */
+    QT_TRACE_WAKE,    /* obj: the blocked task that was made runnable */
+    QT_TRACE_FILL,    /* obj: the word (FEB or syncvar) that was filled */
+    QT_TRACE_EMPTY,   /* obj: the word that was emptied */
+    QT_TRACE_READ,    /* obj: the word that was found full */
+    QT_TRACE_SIGNAL   /* obj: the word that a sinc submission counts toward */
+};
+
+typedef struct {
+    uint64_t ts;      /* qt_trace_clock() ticks */
+    uint64_t obj;
+    uint64_t arg;
+    uint32_t type;
+    uint32_t aux;
+} qt_trace_event_t;
+
+typedef struct qt_trace_ring_s {
+    uint64_t          head;   /* events ever recorded; only the owner writes it */
+    uint64_t          mask;   /* the ring has mask + 1 entries */
+    qt_trace_event_t *events;
+} qt_trace_ring_t;
+
+extern int                   qt_trace_enabled;
+extern volatile sig_atomic_t qt_trace_dump_requested;
+
+void INTERNAL qt_trace_subsystem_init(void);
+void INTERNAL qt_trace_internal_dump_requested(void);
+
+/* Something cheaper than a system call where there is one; trace.c maps the
+ * ticks to nanoseconds against qt_timer_now() when it writes them out. */
+static QINLINE uint64_t qt_trace_clock(void)
+{
+# if (QTHREAD_ASSEMBLY_ARCH == QTHREAD_AMD64) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_IA32)
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+
+# else
+    return qt_timer_now();
+# endif
+}
+
+static QINLINE void qt_trace_record(qthread_worker_t *w,
+                                    uint32_t          type,
+                                    uint64_t          obj,
+                                    uint64_t          arg,
+                                    uint32_t          aux)
+{
+    qt_trace_ring_t  *r = w->trace;
+    const uint64_t    h = r->head;
+    qt_trace_event_t *e = &r->events[h & r->mask];
+
+    e->ts   = qt_trace_clock();
+    e->obj  = obj;
+    e->arg  = arg;
+    e->type = type;
+    e->aux  = aux;
+    COMPILER_FENCE;
+    r->head = h + 1;
+}
+
+# define QTHREAD_TRACE(w, type, obj, arg, aux) do {                            \
+        if (qt_trace_enabled) {                                                \
+            qt_trace_record((w), (type), (uint64_t)(uintptr_t)(obj),           \
+                            (uint64_t)(uintptr_t)(arg), (aux));                \
+        }                                                                      \
+} while (0)
+
+/* for the places that may be reached from outside of the workers, which
+ * aren't traced */
+# define QTHREAD_TRACE_HERE(type, obj, arg, aux) do {                          \
+        if (qt_trace_enabled) {                                                \
+            qthread_worker_t *w_ = qthread_internal_getworker();               \
+            if (w_ != NULL) {                                                  \
+                qt_trace_record(w_, (type), (uint64_t)(uintptr_t)(obj),        \
+                                (uint64_t)(uintptr_t)(arg), (aux));            \
+            }                                                                  \
+        }                                                                      \
+} while (0)
+
+/* for the synchronization events, which only name a word */
+# define QTHREAD_TRACE_SYNC(type, addr) QTHREAD_TRACE_HERE((type), (addr), 0, 0)
+
+/* for the scheduling loop: writes the dump that a signal asked for */
+# define QTHREAD_TRACE_POLL() do {                                             \
+        if (qt_trace_dump_requested) { qt_trace_internal_dump_requested(); }   \
+} while (0)
+
+#else /* ifdef QTHREAD_TRACING */
+
+# define qt_trace_subsystem_init()          do {} while (0)
+# define QTHREAD_TRACE(w, type, obj, arg, aux)   do {} while (0)
+# define QTHREAD_TRACE_HERE(type, obj, arg, aux) do {} while (0)
+# define QTHREAD_TRACE_SYNC(type, addr)          do {} while (0)
+# define QTHREAD_TRACE_POLL()                    do {} while (0)
+
+#endif /* ifdef QTHREAD_TRACING */
+
+#endif // ifndef QT_TRACE_H
+/* vim:set expandtab: */
@@ -18,6 +18,9 @@ typedef int (*qt_dict_key_equals_f)(void *,
 typedef int (*qt_dict_hash_f)(void *);
 typedef void (*qt_dict_cleanup_f)(void *,
                                   void *);
+typedef void (*qt_dict_visit_f)(void *key,
+                                void *value,
+                                void *arg);
 
 struct list_entry {
     void              *value;
@@ -41,6 +44,9 @@ typedef struct qt_dictionary_iterator qt_dictionary_iterator;
  *              and it can return any integer value.
  *
  * if my_key_equals (A, B) = 1, then my_hashcode(A) == my_hashcode(B)
+ *
+ * if both eq and hash are NULL, the keys are treated as integers (compared
+ *              by value, and hashed internally); 0 is not a valid key
  */
 qt_dictionary *qt_dictionary_create(qt_dict_key_equals_f eq,
                                     qt_dict_hash_f       hash,
@@ -98,6 +104,33 @@ void *qt_dictionary_get(qt_dictionary *dict,
 void *qt_dictionary_delete(qt_dictionary *dict,
                            void          *key);
 
+/*
+ *      Inserts the n key, value pairs keys[i], values[i] in the dictionary,
+ *      as if by qt_dictionary_put(), using all of the workers. The keys are
+ *      partitioned by hash so that each partition is inserted by one thread;
+ *      if a key appears more than once, the last of its values is kept.
+ *      returns:
+ *                      the number of pairs inserted (n, unless some insert
+ *                      failed because of an error)
+ *
+ */
+size_t qt_dictionary_put_bulk(qt_dictionary *dict,
+                              void         **keys,
+                              void         **values,
+                              size_t         n);
+
+/*
+ *      Calls fn(key, value, arg) for every entry in the dictionary, splitting
+ *      the dictionary's buckets across the workers (much as qt_loop_balance()
+ *      splits a range). fn is called concurrently, in no particular order,
+ *      and must not modify dict. Entries inserted or deleted concurrently may
+ *      or may not be visited.
+ *
+ */
+void qt_dictionary_parallel_for_each(qt_dictionary  *dict,
+                                     qt_dict_visit_f fn,
+                                     void           *arg);
+
 /*
  *      Creates a new iterator on the dictionary dict
  *      returns:
@@ -0,0 +1,144 @@
+#ifndef QT_ORDERED_DICT_H
+#define QT_ORDERED_DICT_H
+#include <stddef.h>
+
+#include <qthread/macros.h>
+#include <qthread/dictionary.h> /* for qt_dict_cleanup_f */
+
+Q_STARTCXX /* */
+
+typedef struct qt_ordered_dict qt_ordered_dict;
+typedef struct qt_ordered_dict_iterator qt_ordered_dict_iterator;
+
+typedef struct qt_ordered_dict_entry {
+    void *key;
+    void *value;
+} qt_ordered_dict_entry;
+
+/*
+ * the signature of the key comparison function is: int my_cmp(void* key1, void* key2)
+ *              and it should return a negative number, zero, or a positive
+ *              number if key1 is less than, equal to, or greater than key2
+ */
+typedef int (*qt_ordered_dict_cmp_f)(void *,
+                                     void *);
+typedef void (*qt_ordered_dict_visit_f)(void *key,
+                                        void *value,
+                                        void *arg);
+
+/*
+ *      Creates an ordered dictionary (a lock-free skiplist) which uses cmp to
+ *      order its keys. NULL is not a valid key; it is used to mean "unbounded"
+ *      in the range functions below.
+ *
+ *      cleanup (which may be NULL) is called as cleanup(key, NULL) once a
+ *      deleted entry can no longer be seen by any other thread, and as
+ *      cleanup(key, value) for every entry left in the dictionary when it is
+ *      destroyed. An iterator or range walk keeps the last entry it has
+ *      reached from being cleaned up until it moves past it, so cleanup may
+ *      free keys.
+ */
+qt_ordered_dict *qt_ordered_dict_create(qt_ordered_dict_cmp_f cmp,
+                                        qt_dict_cleanup_f     cleanup);
+
+/*
+ *      Destroys the dictionary d; there must be no concurrent users of d, and
+ *      its iterators must have been destroyed.
+ */
+void qt_ordered_dict_destroy(qt_ordered_dict *d);
+
+/*
+ *      Inserts a key, value pair in the dictionary, replacing the value if key
+ *      is already present
+ *      returns void*:
+ *                      ADDR - the value associated with key after the put
+ *                      NULL - if the insert failed because of an error
+ */
+void *qt_ordered_dict_put(qt_ordered_dict *d,
+                          void            *key,
+                          void            *value);
+
+/*
+ *      Inserts a key, value pair in the dictionary if key is not present
+ *      returns void*:
+ *                      ADDR - the value associated with key after the put
+ *                      (if key was present, the old value is returned, as
+ *                      opposed to "value")
+ *                      NULL - if the insert failed because of an error
+ */
+void *qt_ordered_dict_put_if_absent(qt_ordered_dict *d,
+                                    void            *key,
+                                    void            *value);
+
+/*
+ *      Gets a value from the dictionary for a given key
+ *      returns:
+ *                      item - if key was present in the dictionary
+ *                      NULL - if key was not present in the dictionary
+ */
+void *qt_ordered_dict_get(qt_ordered_dict *d,
+                          void            *key);
+
+/*
+ *      Removes a key,value pair from the dictionary
+ *      returns:
+ *                      item - if the item was present and successfully removed
+ *                      NULL - if the item identified by key was not present
+ */
+void *qt_ordered_dict_delete(qt_ordered_dict *d,
+                             void            *key);
+
+/*
+ *      Creates an iterator positioned just before the first entry whose key is
+ *      not less than key (or before the first entry, if key is NULL); the
+ *      first call to qt_ordered_dict_iterator_next() returns that entry.
+ *      returns:
+ *                      addr - address of new iterator
+ *                      NULL - if an error occurred
+ */
+qt_ordered_dict_iterator *qt_ordered_dict_lower_bound(qt_ordered_dict *d,
+                                                      void            *key);
+
+/*
+ *      Advances the iterator and retrieves the next entry, in key order
+ *      returns:
+ *                      addr - a snapshot of the next entry; it remains valid
+ *                              until the next call on this iterator
+ *                      NULL - if there are no more entries
+ *      Note: entries inserted or deleted concurrently may or may not be seen,
+ *            but keys are always returned in strictly increasing order.
+ */
+qt_ordered_dict_entry *qt_ordered_dict_iterator_next(qt_ordered_dict_iterator *it);
+
+/*
+ *      Destroys the iterator it
+ */
+void qt_ordered_dict_iterator_destroy(qt_ordered_dict_iterator *it);
+
+/*
+ *      Calls fn(key, value, arg) for every entry with lo <= key < hi, in key
+ *      order. A NULL lo or hi leaves that end of the range unbounded. fn may
+ *      itself use the dictionary.
+ */
+void qt_ordered_dict_range(qt_ordered_dict        *d,
+                           void                   *lo,
+                           void                   *hi,
+                           qt_ordered_dict_visit_f fn,
+                           void                   *arg);
+
+/*
+ *      Like qt_ordered_dict_range(), but splits [lo, hi) into sub-ranges
+ *      (using the skiplist's upper levels as splitters) and visits them in
+ *      parallel with qt_loop(). fn is called concurrently and in no particular
+ *      order across sub-ranges; within a sub-range, entries are visited in key
+ *      order.
+ */
+void qt_ordered_dict_range_parallel(qt_ordered_dict        *d,
+                                    void                   *lo,
+                                    void                   *hi,
+                                    qt_ordered_dict_visit_f fn,
+                                    void                   *arg);
+
+Q_ENDCXX /* */
+#endif // QT_ORDERED_DICT_H
+/* vim:set expandtab: */
@@ -41,6 +41,19 @@ void *qalloc_loadmap(const char *filename);
 /* This function sync's the mmap'd regions to disk. */
 void qalloc_checkpoint(void);
 
+/* This function sync's only the parts of the maps that have changed since
+ * they were last sync'd. It returns the number of 256 KiB chunks written.
+ *
+ * NOTE: only qalloc's own allocations and frees are tracked. Nothing watches
+ * the program's stores, so a write into an allocated block is NOT included
+ * unless it is reported with qalloc_dirty() after it is made; until then it
+ * is missing from every incremental checkpoint. Use qalloc_checkpoint() if
+ * the writes can't be reported. */
+size_t qalloc_checkpoint_dirty(void);
+void qalloc_dirty(void       *map,
+                  const void *addr,
+                  size_t      len);
+
 /* This function performs a checkpoint, and then un-maps all of the currently
  * mapped regions */
 void qalloc_cleanup(void);
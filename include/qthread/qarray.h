@@ -49,6 +49,11 @@ typedef void (*qa_cloop_f)(const size_t  startat,
                            const size_t  stopat,
                            const qarray *array,
                            void         *arg);
+/* orders two elements, like a qsort() comparison function */
+typedef int (*qa_cmp_f)(const void *a,
+                        const void *b);
+/* extracts an (unsigned) sort key from an element */
+typedef uint64_t (*qa_key_f)(const void *elem);
 
 qarray *qarray_create(const size_t count,
                       const size_t unit_size);
@@ -60,6 +65,13 @@ qarray *qarray_create_configured(const size_t         count,
                                  const char           tight,
                                  const int            seg_pages);
 
+/* flags for qarray_create_mapped() */
+#define QARRAY_MAP_RDONLY 0x0 /* the file is shared; writing to the array faults */
+#define QARRAY_MAP_COW    0x1 /* writes go to private copies of the pages */
+qarray *qarray_create_mapped(const char  *path,
+                             const size_t unit_size,
+                             const int    flags);
+
 void qarray_destroy(qarray *a);
 void qarray_iter(qarray      *a,
                  const size_t startat,
@@ -90,6 +102,18 @@ void qarray_iter_loopaccum(qarray      *a,
                            const size_t retsize,
                            qt_accum_f   acc);
 
+void qarray_sort(qarray  *a,
+                 qa_cmp_f cmp,
+                 qa_key_f key);
+void qarray_inclusive_scan(qarray    *a,
+                           qt_accum_f op);
+void qarray_exclusive_scan(qarray     *a,
+                           qt_accum_f  op,
+                           const void *identity);
+void qarray_reduce(const qarray *a,
+                   qt_accum_f    op,
+                   void         *ret);
+
 void qarray_set_shepof(qarray               *a,
                        const size_t          i,
                        qthread_shepherd_id_t shep);
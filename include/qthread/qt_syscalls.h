@@ -5,6 +5,7 @@
 #include <sys/socket.h>
 #include <sys/select.h>   /* for fd_set */
 #include <sys/resource.h> /* for struct rusage */
+#include <sys/uio.h>      /* for struct iovec */
 #include <poll.h>         /* for struct pollfd and nfds_t */
 
 #include <qthread/macros.h>
@@ -14,9 +15,16 @@ Q_STARTCXX /* */
 int qt_accept(int                       socket,
               struct sockaddr *restrict address,
               socklen_t *restrict       address_len);
+int qt_close(int filedes);
 int qt_connect(int                    socket,
                const struct sockaddr *address,
                socklen_t              address_len);
+ssize_t qt_copy_file_range(int          fd_in,
+                           off_t       *off_in,
+                           int          fd_out,
+                           off_t       *off_out,
+                           size_t       len,
+                           unsigned int flags);
 int qt_poll(struct pollfd fds[],
             nfds_t        nfds,
             int           timeout);
@@ -24,18 +32,75 @@ ssize_t qt_pread(int    filedes,
                  void  *buf,
                  size_t nbyte,
                  off_t  offset);
+ssize_t qt_preadv(int                 filedes,
+                  const struct iovec *iov,
+                  int                 iovcnt,
+                  off_t               offset);
+ssize_t qt_pread_fixed(int    filedes,
+                       void  *buf,
+                       size_t nbyte,
+                       off_t  offset,
+                       int    buf_index);
 ssize_t qt_pwrite(int         filedes,
                   const void *buf,
                   size_t      nbyte,
                   off_t       offset);
+ssize_t qt_pwritev(int                 filedes,
+                   const struct iovec *iov,
+                   int                 iovcnt,
+                   off_t               offset);
+ssize_t qt_pwrite_fixed(int         filedes,
+                        const void *buf,
+                        size_t      nbyte,
+                        off_t       offset,
+                        int         buf_index);
 ssize_t qt_read(int    filedes,
                 void  *buf,
                 size_t nbyte);
+ssize_t qt_readv(int                 filedes,
+                 const struct iovec *iov,
+                 int                 iovcnt);
+ssize_t qt_recv(int    socket,
+                void  *buffer,
+                size_t length,
+                int    flags);
+ssize_t qt_recvfrom(int                       socket,
+                    void *restrict            buffer,
+                    size_t                    length,
+                    int                       flags,
+                    struct sockaddr *restrict address,
+                    socklen_t *restrict       address_len);
+ssize_t qt_recvmsg(int            socket,
+                   struct msghdr *message,
+                   int            flags);
 int qt_select(int                      nfds,
               fd_set *restrict         readfds,
               fd_set *restrict         writefds,
               fd_set *restrict         errorfds,
               struct timeval *restrict timeout);
+ssize_t qt_send(int         socket,
+                const void *buffer,
+                size_t      length,
+                int         flags);
+ssize_t qt_sendfile(int    out_fd,
+                    int    in_fd,
+                    off_t *offset,
+                    size_t count);
+ssize_t qt_sendmsg(int                  socket,
+                   const struct msghdr *message,
+                   int                  flags);
+ssize_t qt_sendto(int                    socket,
+                  const void            *buffer,
+                  size_t                 length,
+                  int                    flags,
+                  const struct sockaddr *dest_addr,
+                  socklen_t              dest_len);
+ssize_t qt_splice(int          fd_in,
+                  off_t       *off_in,
+                  int          fd_out,
+                  off_t       *off_out,
+                  size_t       len,
+                  unsigned int flags);
 int   qt_system(const char *command);
 pid_t qt_wait4(pid_t          pid,
                int           *stat_loc,
@@ -44,18 +109,39 @@ pid_t qt_wait4(pid_t          pid,
 ssize_t qt_write(int         filedes,
                  const void *buf,
                  size_t      nbyte);
+ssize_t qt_writev(int                 filedes,
+                  const struct iovec *iov,
+                  int                 iovcnt);
+
+/* Registers buffers for qt_pread_fixed() and qt_pwrite_fixed(), which name
+ * them by their index in iov. Returns 0, or -1 with errno set. */
+int qt_io_register_buffers(const struct iovec *iov,
+                           unsigned            nr);
+int qt_io_unregister_buffers(void);
 
 #ifdef USE_HEADER_SYSCALLS
 # define accept(s, a, l)       qt_accept((s), (a), (l))
+# define close(f)              qt_close((f))
 # define connect(s, a, l)      qt_connect((s), (a), (l))
 # define poll(f, n, t)         qt_poll((f), (n), (t))
 # define pread(f, b, n, o)     qt_pread((f), (b), (n), (o))
 # define pwrite(f, b, n, o)    qt_pwrite((f), (b), (n), (o))
 # define read(f, b, n)         qt_read((f), (b), (n))
+# define readv(f, v, n)        qt_readv((f), (v), (n))
+# define recv(s, b, l, f)      qt_recv((s), (b), (l), (f))
+# define recvfrom(s, b, l, f, a, al) \
+    qt_recvfrom((s), (b), (l), (f), (a), (al))
+# define recvmsg(s, m, f)      qt_recvmsg((s), (m), (f))
 # define select(n, r, w, e, t) qt_select((n), (r), (w), (e), (t))
+# define send(s, b, l, f)      qt_send((s), (b), (l), (f))
+# define sendfile(o, i, f, c)  qt_sendfile((o), (i), (f), (c))
+# define sendmsg(s, m, f)      qt_sendmsg((s), (m), (f))
+# define sendto(s, b, l, f, d, dl) \
+    qt_sendto((s), (b), (l), (f), (d), (dl))
 # define system(c)             qt_system((c))
 # define wait4(p, s, o, r)     qt_wait4((p), (s), (o), (r))
 # define write(f, b, n)        qt_write((f), (b), (n))
+# define writev(f, v, n)       qt_writev((f), (v), (n))
 #endif // ifdef USE_HEADER_SYSCALLS
 
 Q_ENDCXX /* */
@@ -8,6 +8,7 @@
 #include <qthread/common.h>            /* important configuration options */
 
 #include <string.h>                    /* for memcpy() */
+#include <time.h>                      /* for struct timespec */
 
 #ifndef QTHREAD_NOALIGNCHECK
 # include <stdio.h>                    /* for fprintf() */
@@ -199,6 +200,11 @@ void qthread_enable_worker(qthread_worker_id_t worker);
 #define qthread_yield_near() do { COMPILER_FENCE; qthread_yield_(1); } while (0)
 void qthread_yield_(int);
 
+/* This function suspends the calling thread until the given absolute time on
+ * the CLOCK_MONOTONIC clock (see clock_gettime()), without occupying a worker
+ * or an I/O thread. Other threads run in the meantime. */
+int qthread_sleep_until(const struct timespec *deadline);
+
 /* this function flushes the spawncache */
 void qthread_flushsc(void);
 
@@ -374,10 +380,39 @@ enum introspective_state {
     CURRENT_WORKER,
     CURRENT_UNIQUE_WORKER,
     CURRENT_TEAM,
-    PARENT_TEAM
+    PARENT_TEAM,
+    IO_QUEUE_DEPTH,
+    IO_PROXIES,
+    IO_SYSCALLS,
+    IO_LATENCY_P50,
+    IO_LATENCY_P99
 };
 size_t qthread_readstate(const enum introspective_state type);
 
+/* per-worker event counters */
+typedef struct qthread_stats_s {
+    uint64_t tasks_spawned;
+    uint64_t tasks_run;        /* tasks started */
+    uint64_t tasks_blocked;    /* tasks that went back to their worker blocked */
+    uint64_t tasks_stolen;
+    uint64_t steal_attempts;
+    uint64_t steal_failures;
+    uint64_t feb_blocks;
+    uint64_t context_switches; /* swaps into a task */
+    uint64_t idle_ns;          /* time spent waiting for work */
+} qthread_stats_t;
+
+int  qthread_stats_enable(int enable);
+void qthread_stats_reset(void);
+int  qthread_stats_snapshot(qthread_stats_t *total,
+                            qthread_stats_t *per_worker);
+
+/* writes the scheduling event trace (--enable-profiling=trace builds) */
+int qthread_trace_dump(const char *path);
+
+/* writes the ready-queue latency histograms (--enable-profiling=latency) */
+int qthread_latency_dump(const char *path);
+
 /* Task team interface. */
 typedef enum qt_team_critical_section_e {
     BEGIN,
@@ -549,6 +584,23 @@ int qthread_readFE(aligned_t       *dest,
 int qthread_syncvar_readFE(uint64_t *restrict  dest,
                            syncvar_t *restrict src);
 
+/* These functions are the same as qthread_readFF(), qthread_readFE(), and
+ * qthread_writeEF(), except that they wait only until the given absolute time
+ * on the CLOCK_MONOTONIC clock. If that time comes first, they return
+ * QTHREAD_TIMEOUT, having changed neither the FEB state nor the data. */
+int qthread_readFF_timed(aligned_t             *dest,
+                         const aligned_t       *src,
+                         const struct timespec *deadline);
+int qthread_readFE_timed(aligned_t             *dest,
+                         const aligned_t       *src,
+                         const struct timespec *deadline);
+int qthread_writeEF_timed(aligned_t *restrict       dest,
+                          const aligned_t *restrict src,
+                          const struct timespec    *deadline);
+int qthread_writeEF_const_timed(aligned_t             *dest,
+                                aligned_t              src,
+                                const struct timespec *deadline);
+
 /* This function ignores the FEB state. Data is read from src and written to
  * dest.
  *
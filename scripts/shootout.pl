@@ -0,0 +1,232 @@
+#!/usr/bin/perl
+
+# Builds the library once for each scheduler, runs the benchmark suite
+# (test/benchmarks/bench.pl) against each build, and tabulates the medians
+# side by side, so that the scheduler for a workload can be picked from data.
+#
+# Each scheduler gets a build directory of its own under --build-dir, which is
+# kept between runs: only the first run configures and builds everything. With
+# --runtime, there is a single build with every scheduler in it
+# (--with-scheduler=runtime), and QT_SCHEDULER picks one for each run.
+
+use strict;
+use warnings;
+
+use Cwd qw/abs_path getcwd/;
+use File::Basename qw/dirname/;
+use JSON::PP;
+use POSIX qw/strftime/;
+
+my @all_schedulers = ('sherwood', 'nemesis', 'lifo', 'mutexfifo', 'mtsfifo', 'nottingham', 'distrib', 'loxley', 'loxleybase');
+
+# Collect command-line options
+my @schedulers;
+my $qt_src_dir = abs_path(dirname(abs_path($0)) . '/..');
+my $qt_bld_dir = '';
+my $configure_flags = '';
+my $make_flags = '';
+my $bench_flags = '';
+my $output = '';
+my $force_configure = 0;
+my $runtime = 0;
+my $print_info = 0;
+my $dry_run = 0;
+my $need_help = 0;
+
+while (@ARGV) {
+    my $flag = shift @ARGV;
+
+    if ($flag =~ m/--schedulers=(.*)/) {
+        @schedulers = split(/,/, $1);
+    } elsif ($flag =~ m/--source-dir=(.*)/) {
+        $qt_src_dir = $1;
+    } elsif ($flag =~ m/--build-dir=(.*)/) {
+        $qt_bld_dir = $1;
+    } elsif ($flag =~ m/--configure-flags=(.*)/) {
+        $configure_flags = $1;
+    } elsif ($flag =~ m/--make-flags=(.*)/) {
+        $make_flags = $1;
+    } elsif ($flag =~ m/--bench-flags=(.*)/) {
+        $bench_flags = $1;
+    } elsif ($flag =~ m/--output=(.*)/) {
+        $output = $1;
+    } elsif ($flag eq '--runtime') {
+        $runtime = 1;
+    } elsif ($flag eq '--force-configure') {
+        $force_configure = 1;
+    } elsif ($flag eq '--verbose' || $flag eq '-v') {
+        $print_info = 1;
+    } elsif ($flag eq '--dry-run') {
+        $dry_run = 1;
+    } elsif ($flag eq '--help' || $flag eq '-h') {
+        $need_help = 1;
+    } else {
+        print "Unsupported option '$flag'.\n";
+        exit(1);
+    }
+}
+
+if ($need_help) {
+    print "usage: perl shootout.pl [options]\n";
+    print "Options:\n";
+    print "\t--schedulers=<names>      comma-separated list of schedulers (default:\n";
+    print "\t                          " . join(',', @all_schedulers) . ").\n";
+    print "\t--source-dir=<dir>        absolute path to Qthreads source.\n";
+    print "\t--build-dir=<dir>         absolute path to the directory that the\n";
+    print "\t                          builds go in (default: <source>/build/shootout).\n";
+    print "\t--configure-flags=<flags> configure options for every build, in\n";
+    print "\t                          addition to --with-scheduler.\n";
+    print "\t--make-flags=<options>    options to pass to make (e.g. '-j 4').\n";
+    print "\t--bench-flags=<options>   options to pass to bench.pl, e.g.\n";
+    print "\t                          '--layouts=1x4,4x1 --repeat=20'.\n";
+    print "\t--output=<file>           write all the results, by scheduler, as JSON.\n";
+    print "\t--runtime                 build once, with every scheduler, and choose\n";
+    print "\t                          among them with QT_SCHEDULER.\n";
+    print "\t--force-configure         run `configure` again.\n";
+    print "\t--verbose\n";
+    print "\t--dry-run\n";
+    print "\t--help\n";
+    exit(1);
+}
+
+@schedulers = @all_schedulers unless (@schedulers);
+if (not $qt_src_dir =~ m/^\//) {
+    print "Specify full path for source dir '$qt_src_dir'\n";
+    exit(1);
+}
+if ($qt_bld_dir eq '') {
+    $qt_bld_dir = "$qt_src_dir/build/shootout";
+} elsif (not $qt_bld_dir =~ m/^\//) {
+    print "Specify full path for build dir '$qt_bld_dir'\n";
+    exit(1);
+}
+if (not -e "$qt_src_dir/configure") {
+    print "###\tGenerating configure script ...\n" if ($print_info);
+    my_system("cd $qt_src_dir && sh ./autogen.sh");
+}
+
+my %results;
+my @failures;
+foreach my $scheduler (@schedulers) {
+    my $result = run_scheduler($scheduler);
+
+    if (defined $result) {
+        $results{$scheduler} = $result;
+    } else {
+        push @failures, $scheduler;
+    }
+}
+exit(0) if ($dry_run);
+
+report();
+if ($output ne '') {
+    my %all = (
+        version    => 1,
+        date       => strftime('%Y-%m-%dT%H:%M:%S%z', localtime),
+        flags      => $configure_flags,
+        schedulers => \%results,
+    );
+    open(my $fh, '>', $output) or die "Cannot write $output: $!\n";
+    print $fh JSON::PP->new->pretty->canonical->encode(\%all);
+    close($fh);
+}
+exit(@failures ? 1 : 0);
+
+################################################################################
+
+sub run_scheduler {
+    my $scheduler = $_[0];
+    my $built_with = $runtime ? 'runtime' : $scheduler;
+    my $dir = "$qt_bld_dir/$built_with";
+    my $json = $runtime ? "$dir/bench-$scheduler.json" : "$dir/bench.json";
+    my $env = $runtime ? "--env=QT_SCHEDULER=$scheduler" : '';
+
+    print "### $scheduler: $dir\n";
+    my_system("mkdir -p $dir") if (not -e $dir);
+    if ($force_configure || not -e "$dir/config.status") {
+        print "###\tConfiguring ...\n";
+        if (my_system("cd $dir && $qt_src_dir/configure --with-scheduler=$built_with $configure_flags > build.configure.log 2>&1")) {
+            print "###\t$built_with does not configure here; see $dir/build.configure.log\n";
+            return undef;
+        }
+        # configure once per run at most
+        $force_configure = 0;
+    }
+    # the runtime build only has nottingham if the machine can run it
+    if ($runtime && $scheduler eq 'nottingham' && !$dry_run &&
+        my_system("grep -q QTHREAD_SCHEDULER_NOTTINGHAM $dir/include/config.h")) {
+        print "###\t$scheduler is not in this build\n";
+        return undef;
+    }
+    print "###\tBuilding ...\n";
+    if (my_system("cd $dir && make $make_flags -C src > build.make.log 2>&1")) {
+        print "###\t$scheduler does not build; see $dir/build.make.log\n";
+        return undef;
+    }
+    # bench builds the benchmarks it needs
+    print "###\tBenchmarking ...\n";
+    unlink($json);
+    my_system("cd $dir && make $make_flags -C test/benchmarks bench BENCH_OUTPUT=$json " .
+              "BENCH_FLAGS='--label=$scheduler $env $bench_flags' 2>&1 | tee build.bench.log");
+    return undef if ($dry_run);
+    if (not -e $json) {
+        print "###\t$scheduler did not benchmark; see $dir/build.bench.log\n";
+        return undef;
+    }
+    open(my $fh, '<', $json) or die "Cannot read $json: $!\n";
+    local $/;
+    my $result = JSON::PP->new->decode(<$fh>);
+    close($fh);
+    return $result;
+}
+
+# One row per benchmark and layout, one column per scheduler; the fastest
+# median in each row is starred.
+sub report {
+    my @names = grep { exists $results{$_} } @schedulers;
+    my %medians;
+    my @rows;
+
+    foreach my $scheduler (@names) {
+        foreach my $r (@{ $results{$scheduler}{results} }) {
+            my $row = "$r->{benchmark} $r->{layout}";
+
+            push @rows, $row unless exists $medians{$row};
+            $medians{$row}{$scheduler} = $r->{median};
+        }
+    }
+
+    print "\n" . '=' x 50;
+    print "\nMedian times, in seconds (* is the fastest):\n";
+    printf "%-16s %-8s", 'benchmark', 'layout';
+    printf " %11s", $_ foreach @names;
+    print "\n";
+    foreach my $row (@rows) {
+        my ($benchmark, $layout) = split(/ /, $row);
+        my ($best) = sort { $medians{$row}{$a} <=> $medians{$row}{$b} }
+                     grep { defined $medians{$row}{$_} } @names;
+
+        printf "%-16s %-8s", $benchmark, $layout;
+        foreach my $scheduler (@names) {
+            my $median = $medians{$row}{$scheduler};
+
+            if (not defined $median) {
+                printf " %11s", '-';
+            } else {
+                printf " %10.6f%s", $median, ($scheduler eq $best) ? '*' : ' ';
+            }
+        }
+        print "\n";
+    }
+    print "Not measured: @failures\n" if (@failures);
+    print '=' x 50 . "\n";
+}
+
+sub my_system {
+    my $command = $_[0];
+
+    print "\t\$ $command\n" if ($print_info);
+    return 0 if ($dry_run);
+    return system($command);
+}
+# vim:expandtab
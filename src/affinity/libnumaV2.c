@@ -3,16 +3,22 @@
 #endif
 
 #include <numa.h>
+#ifdef HAVE_NUMA_MOVE_PAGES
+# include <numaif.h>                    /* for MPOL_MF_MOVE */
+#endif
 #include <stdio.h>
 
 #include "qt_subsystems.h"
 #include "qt_asserts.h"
 #include "qt_affinity.h"
 #include "qt_debug.h"
+#include "qt_aligned_alloc.h"            /* for pagesize */
 
 #include "shepcomp.h"
 #include "shufflesheps.h"
 
+#define MIGRATE_BATCH 256 /* pages per move_pages() call */
+
 static struct bitmask *mccoy_bitmask = NULL;
 
 qthread_shepherd_id_t guess_num_shepherds(void);
@@ -46,6 +52,37 @@ void INTERNAL qt_affinity_mem_tonode(void  *addr,
     numa_tonode_memory(addr, bytes, node);
 }                                      /*}}} */
 
+void INTERNAL qt_affinity_mem_migrate(void  *addr,
+                                      size_t bytes,
+                                      int    node)
+{                                      /*{{{ */
+    /* the policy covers pages that have not been faulted in yet... */
+    numa_tonode_memory(addr, bytes, node);
+#ifdef HAVE_NUMA_MOVE_PAGES
+    /* ...and move_pages() takes care of the ones that have */
+    {
+        const uintptr_t first  = (uintptr_t)addr & ~(uintptr_t)(pagesize - 1);
+        const size_t    npages = ((uintptr_t)addr + bytes - first + pagesize - 1) / pagesize;
+        void          **pages  = MALLOC(MIGRATE_BATCH * sizeof(void *));
+        int            *nodes  = MALLOC(MIGRATE_BATCH * sizeof(int));
+        int            *status = MALLOC(MIGRATE_BATCH * sizeof(int));
+
+        assert(pages && nodes && status);
+        for (size_t done = 0; done < npages; done += MIGRATE_BATCH) {
+            const size_t batch = (npages - done < MIGRATE_BATCH) ? (npages - done) : MIGRATE_BATCH;
+            for (size_t i = 0; i < batch; i++) {
+                pages[i] = (void *)(first + (done + i) * pagesize);
+                nodes[i] = node;
+            }
+            numa_move_pages(0, batch, pages, nodes, status, MPOL_MF_MOVE);
+        }
+        FREE(status, MIGRATE_BATCH * sizeof(int));
+        FREE(nodes, MIGRATE_BATCH * sizeof(int));
+        FREE(pages, MIGRATE_BATCH * sizeof(void *));
+    }
+#endif /* ifdef HAVE_NUMA_MOVE_PAGES */
+}                                      /*}}} */
+
 void INTERNAL *qt_affinity_alloc(size_t bytes)
 {                                      /*{{{ */
     return numa_alloc(bytes);
@@ -17,6 +17,7 @@
 #include "qt_debug.h"
 #include "qt_asserts.h"
 #include "qt_barrier.h"
+#include "qt_trace.h"
 
 #if 0
 # define WTYPE syncvar_t
@@ -80,6 +81,7 @@ void API_FUNC qt_barrier_enter_id(qt_barrier_t *b,
     size_t   test;
     uint64_t value;
 
+    QTHREAD_TRACE_HERE(QT_TRACE_BARRIER, b, 0, id);
     parent     = ((id + 1) >> 1) - 1;
     leftchild  = ((id + 1) << 1) - 1;
     rightchild = leftchild + 1;
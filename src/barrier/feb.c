@@ -22,6 +22,7 @@
 #include "qt_debug.h"
 #include "qt_asserts.h"
 #include "qt_subsystems.h"
+#include "qt_trace.h"
 
 struct qt_barrier_s {
     aligned_t in_gate;
@@ -94,6 +95,7 @@ void API_FUNC qt_barrier_enter(qt_barrier_t *b)
 
     assert(qthread_library_initialized);
     qassert_retvoid(b);
+    QTHREAD_TRACE_HERE(QT_TRACE_BARRIER, b, 0, 0);
     /* pass through the in_gate */
     qthread_readFF(NULL, &b->in_gate);
     /* increment the blocker count */
@@ -22,6 +22,7 @@
 #include "qt_barrier.h"
 #include "qt_asserts.h"
 #include "qt_atomics.h"
+#include "qt_trace.h"
 #include "qthread/qthread.h"
 #include "qt_debug.h"
 #include "qt_visibility.h"
@@ -296,6 +297,7 @@ void API_FUNC qt_barrier_enter_id(qt_barrier_t *b,
 
     //    int64_t val = b->upLock[shep] + 1;
 
+    QTHREAD_TRACE_HERE(QT_TRACE_BARRIER, b, 0, id);
     if (b->activeSize <= 1) { return; }
     qtb_internal_up(b, id, val, 0);
 }                                      /*}}} */
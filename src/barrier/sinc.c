@@ -20,6 +20,7 @@
 #include "qt_visibility.h"
 #include "qt_debug.h"
 #include "qt_asserts.h"
+#include "qt_trace.h"
 
 /* The Datatype */
 struct qt_barrier_s {
@@ -73,6 +74,7 @@ void API_FUNC qt_barrier_resize(qt_barrier_t *restrict barrier,
 void API_FUNC qt_barrier_enter_id(qt_barrier_t *barrier,
                                   size_t        id)
 {
+    QTHREAD_TRACE_HERE(QT_TRACE_BARRIER, barrier, 0, id);
     qt_sinc_submit(barrier->sinc_1, NULL);
     qt_sinc_wait(barrier->sinc_1, NULL);
     if (id == 0) {
@@ -94,6 +96,7 @@ void API_FUNC qt_barrier_enter_id(qt_barrier_t *barrier,
 
 void API_FUNC qt_barrier_enter(qt_barrier_t *barrier)
 {
+    QTHREAD_TRACE_HERE(QT_TRACE_BARRIER, barrier, 0, 0);
     qt_sinc_submit(barrier->sinc_1, NULL);
     qt_sinc_wait(barrier->sinc_1, NULL);
     qt_sinc_reset(barrier->sinc_3, barrier->count); // should be only 1 reset not all
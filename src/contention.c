@@ -0,0 +1,428 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef QTHREAD_CONTENTION_PROFILING
+
+# ifndef _GNU_SOURCE
+#  define _GNU_SOURCE                  /* for dladdr() */
+# endif
+
+/* System Headers */
+# include <errno.h>
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# ifdef HAVE_EXECINFO_H
+#  include <execinfo.h>
+# endif
+# ifdef HAVE_DLADDR
+#  include <dlfcn.h>
+# endif
+
+/* Public Headers */
+# include "qthread/qthread.h"
+
+/* Internal Headers */
+# include "qt_contention.h"
+# include "qt_visibility.h"
+# include "qt_aligned_alloc.h"
+# include "qt_asserts.h"
+# include "qt_output_macros.h"
+# include "qt_debug.h"
+# include "qt_envariables.h"
+# include "qt_report.h"
+# include "qt_subsystems.h"
+# include "qt_timer_wheel.h"           /* for qt_timer_now() */
+# include "qthread_innards.h"          /* for qlib */
+
+# define NOINLINE __attribute__((noinline))
+
+/* waiters beyond this many aren't counted */
+# define MAX_WAITERS_COUNTED 65535
+
+int                   qt_contention_enabled        = 0;
+volatile sig_atomic_t qt_contention_dump_requested = 0;
+
+/* one per worker, in packed_worker_id order, each top_k entries long and
+ * cache-line aligned; only its worker writes to it */
+static char       *workers      = NULL;
+static size_t      worker_size  = 0;
+static size_t      nworkers     = 0;
+static uint32_t    top_k        = 0;
+static uint32_t    sample_every = 0;
+static const char *report_path  = NULL;
+
+static qt_contention_worker_t *sketch(size_t i)
+{   /*{{{*/
+    return (qt_contention_worker_t *)(workers + i * worker_size);
+} /*}}}*/
+
+static const char *function_name(void  *f,
+                                 char  *buf,
+                                 size_t len)
+{   /*{{{*/
+# ifdef HAVE_DLADDR
+    Dl_info info;
+# endif
+
+    if (f == NULL) {
+        return "(main)";
+    }
+# ifdef HAVE_DLADDR
+    if (dladdr(f, &info) && info.dli_sname) {
+        if (info.dli_saddr == f) {
+            return info.dli_sname;
+        }
+        snprintf(buf, len, "%s+%#lx", info.dli_sname,
+                 (unsigned long)((uintptr_t)f - (uintptr_t)info.dli_saddr));
+        return buf;
+    }
+# endif
+    snprintf(buf, len, "%p", f);
+    return buf;
+} /*}}}*/
+
+/* where the library was loaded, when it is a shared object of its own */
+static void *library_base = NULL;
+
+/* Whether pc is in the library's own FEB and syncvar code, or in anything
+ * else of ours that it went through to get there. When the library is a
+ * shared object, that's anything in it; when it is linked into the program,
+ * it's anything whose nearest exported symbol looks like one of ours. */
+static int in_library(void *pc)
+{   /*{{{*/
+# ifdef HAVE_DLADDR
+    Dl_info info;
+
+    if (dladdr(pc, &info)) {
+        if (library_base) {
+            return info.dli_fbase == library_base;
+        }
+        if (info.dli_sname) {
+            return (strncmp(info.dli_sname, "qthread_", 8) == 0) ||
+                   (strncmp(info.dli_sname, "qt_", 3) == 0);
+        }
+    }
+# endif
+    return 0;
+} /*}}}*/
+
+/* The first of e's return addresses that isn't in the library, or, failing
+ * that, the outermost one. */
+static void *call_site(const qt_contention_entry_t *e)
+{   /*{{{*/
+    for (uint32_t i = 0; i < e->nframes; ++i) {
+        if (!in_library(e->frames[i])) {
+            return e->frames[i];
+        }
+    }
+    return e->nframes ? e->frames[e->nframes - 1] : NULL;
+} /*}}}*/
+
+/* The return addresses above qt_contention_internal_wake(), innermost first;
+ * caller, the FEB or syncvar function that called it, will do if there is no
+ * backtrace(). */
+static NOINLINE uint32_t stack_frames(void **out,
+                                      void  *caller)
+{   /*{{{*/
+# ifdef HAVE_EXECINFO_H
+    void *frames[QT_CONTENTION_FRAMES + 2];
+    int   n = backtrace(frames, QT_CONTENTION_FRAMES + 2);
+
+    /* frames[0] is here, and frames[1] is qt_contention_internal_wake() */
+    if (n > 2) {
+        memcpy(out, frames + 2, (size_t)(n - 2) * sizeof(void *));
+        return (uint32_t)(n - 2);
+    }
+# endif
+    out[0] = caller;
+    return 1;
+} /*}}}*/
+
+void INTERNAL qt_contention_internal_block(qt_contention_sample_t   *s,
+                                           const void               *addr,
+                                           const qthread_addrstat_t *m)
+{   /*{{{*/
+    const qthread_addrres_t *const queues[] = { m->EFQ, m->FEQ, m->FFQ, m->FFWQ };
+    uint32_t                       waiters  = 0;
+
+    qthread_internal_getworker()->contention->countdown = sample_every;
+    for (size_t q = 0; q < sizeof(queues) / sizeof(queues[0]); ++q) {
+        for (const qthread_addrres_t *X = queues[q];
+             X && (waiters < MAX_WAITERS_COUNTED);
+             X = X->next) {
+            waiters++;
+        }
+    }
+    s->addr    = addr;
+    s->waiters = waiters;
+    s->start   = qt_timer_now();
+} /*}}}*/
+
+/* Space-saving: an (address, return addresses) pair that isn't in the
+ * sketch takes the place of the lightest one when the sketch is full,
+ * inheriting its weight as the error, so that nothing heavier than the
+ * lightest entry is ever lost. */
+void INTERNAL qt_contention_internal_wake(const qt_contention_sample_t *s,
+                                          void                         *f)
+{   /*{{{*/
+    const uint64_t          now = qt_timer_now();
+    const uint64_t          ns  = (now > s->start) ? now - s->start : 1;
+    qthread_worker_t       *w   = qthread_internal_getworker();
+    qt_contention_worker_t *c;
+    qt_contention_entry_t  *e = NULL;
+    void                   *frames[QT_CONTENTION_FRAMES];
+    uint32_t                nframes;
+
+    if (w == NULL) { return; }
+    c       = w->contention;
+    nframes = stack_frames(frames, __builtin_return_address(0));
+    for (uint32_t i = 0; i < c->used; ++i) {
+        if ((c->top[i].addr == s->addr) && (c->top[i].nframes == nframes) &&
+            (memcmp(c->top[i].frames, frames, nframes * sizeof(void *)) == 0)) {
+            e = &c->top[i];
+            break;
+        }
+    }
+    if (e == NULL) {
+        if (c->used < top_k) {
+            e = &c->top[c->used++];
+            memset(e, 0, sizeof(*e));
+        } else {
+            e = &c->top[0];
+            for (uint32_t i = 1; i < top_k; ++i) {
+                if (c->top[i].ns < e->ns) { e = &c->top[i]; }
+            }
+            e->error       = e->ns;
+            e->waits       = 0;
+            e->max_ns      = 0;
+            e->max_waiters = 0;
+        }
+        e->addr    = s->addr;
+        e->nframes = nframes;
+        memcpy(e->frames, frames, nframes * sizeof(void *));
+    }
+    e->f   = f;
+    e->ns += ns;
+    e->waits++;
+    if (ns > e->max_ns) { e->max_ns = ns; }
+    if (s->waiters > e->max_waiters) { e->max_waiters = s->waiters; }
+} /*}}}*/
+
+typedef struct {
+    const void            *addr;
+    uint64_t               ns, error, max_ns;
+    uint64_t               waits;
+    uint32_t               max_waiters;
+    qt_contention_entry_t *sites;     /* into the merged entries */
+    size_t                 nsites;
+} contention_addr_t;
+
+static int by_addr_then_site(const void *a,
+                             const void *b)
+{   /*{{{*/
+    const qt_contention_entry_t *x = a, *y = b;
+
+    if (x->addr != y->addr) {
+        return ((uintptr_t)x->addr < (uintptr_t)y->addr) ? -1 : 1;
+    }
+    if (x->site != y->site) {
+        return ((uintptr_t)x->site < (uintptr_t)y->site) ? -1 : 1;
+    }
+    return 0;
+} /*}}}*/
+
+static int entry_by_ns(const void *a,
+                       const void *b)
+{   /*{{{*/
+    const qt_contention_entry_t *x = a, *y = b;
+
+    return (x->ns < y->ns) ? 1 : (x->ns > y->ns) ? -1 : 0;
+} /*}}}*/
+
+static int addr_by_ns(const void *a,
+                      const void *b)
+{   /*{{{*/
+    const contention_addr_t *x = a, *y = b;
+
+    return (x->ns < y->ns) ? 1 : (x->ns > y->ns) ? -1 : 0;
+} /*}}}*/
+
+static void contention_report(FILE *out)
+{   /*{{{*/
+    const size_t           most = nworkers * top_k;
+    qt_contention_entry_t *all  = MALLOC(most * sizeof(qt_contention_entry_t));
+    contention_addr_t     *addrs;
+    size_t                 n = 0, nmerged = 0, naddrs = 0;
+
+    assert(all);
+    /* the workers may still be at it, if this is for a signal; an entry
+     * caught halfway through being replaced will be a little off */
+    for (size_t w = 0; w < nworkers; ++w) {
+        const qt_contention_worker_t *c    = sketch(w);
+        const uint32_t                used = *(volatile uint32_t *)&c->used;
+
+        memcpy(&all[n], c->top, used * sizeof(qt_contention_entry_t));
+        n += used;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        all[i].site = call_site(&all[i]);
+    }
+    /* the same pair may be in several workers' sketches, and under several
+     * sets of return addresses */
+    qsort(all, n, sizeof(qt_contention_entry_t), by_addr_then_site);
+    for (size_t i = 0; i < n; ++i) {
+        qt_contention_entry_t *d = &all[nmerged];
+
+        if ((nmerged > 0) && (all[i].addr == d[-1].addr) && (all[i].site == d[-1].site)) {
+            d--;
+            d->ns    += all[i].ns;
+            d->error += all[i].error;
+            d->waits += all[i].waits;
+            if (all[i].max_ns > d->max_ns) { d->max_ns = all[i].max_ns; }
+            if (all[i].max_waiters > d->max_waiters) { d->max_waiters = all[i].max_waiters; }
+        } else {
+            *d = all[i];
+            nmerged++;
+        }
+    }
+    addrs = MALLOC((nmerged + 1) * sizeof(contention_addr_t));
+    assert(addrs);
+    for (size_t i = 0; i < nmerged; ++i) {
+        contention_addr_t *a = &addrs[naddrs];
+
+        if ((naddrs > 0) && (all[i].addr == a[-1].addr)) {
+            a--;
+        } else {
+            memset(a, 0, sizeof(*a));
+            a->addr  = all[i].addr;
+            a->sites = &all[i];
+            naddrs++;
+        }
+        a->ns    += all[i].ns;
+        a->error += all[i].error;
+        a->waits += all[i].waits;
+        a->nsites++;
+        if (all[i].max_ns > a->max_ns) { a->max_ns = all[i].max_ns; }
+        if (all[i].max_waiters > a->max_waiters) { a->max_waiters = all[i].max_waiters; }
+    }
+    qsort(addrs, naddrs, sizeof(contention_addr_t), addr_by_ns);
+
+    fprintf(out, "QTHREADS: FEB and syncvar contention, hottest %lu addresses "
+            "(1 in %lu blocking waits sampled, %lu workers)\n",
+            (unsigned long)((naddrs < top_k) ? naddrs : top_k),
+            (unsigned long)sample_every, (unsigned long)nworkers);
+    fprintf(out, "%-18s %10s %14s %12s %12s %8s  %s\n",
+            "address", "waits", "blocked_us", "error_us", "max_us", "waiters",
+            "task function <- call site");
+    for (size_t i = 0; i < naddrs && i < top_k; ++i) {
+        const contention_addr_t *a = &addrs[i];
+
+        fprintf(out, "%-18p %10lu %14.3f %12.3f %12.3f %8u\n",
+                a->addr, (unsigned long)a->waits, a->ns / 1000.0,
+                a->error / 1000.0, a->max_ns / 1000.0, a->max_waiters);
+        qsort(a->sites, a->nsites, sizeof(qt_contention_entry_t), entry_by_ns);
+        for (size_t j = 0; j < a->nsites; ++j) {
+            const qt_contention_entry_t *e = &a->sites[j];
+            char                         fbuf[64], sbuf[64];
+
+            fprintf(out, "%-18s %10lu %14.3f %12.3f %12.3f %8u  %s <- %s\n", "",
+                    (unsigned long)e->waits, e->ns / 1000.0, e->error / 1000.0,
+                    e->max_ns / 1000.0, e->max_waiters,
+                    function_name(e->f, fbuf, sizeof(fbuf)),
+                    function_name(e->site, sbuf, sizeof(sbuf)));
+        }
+    }
+    FREE(addrs, (nmerged + 1) * sizeof(contention_addr_t));
+    FREE(all, most * sizeof(qt_contention_entry_t));
+} /*}}}*/
+
+static int contention_write(const char *path)
+{   /*{{{*/
+    FILE *out = stdout;
+
+    if ((path != NULL) && (path[0] != 0) && strcmp(path, "-")) {
+        out = fopen(path, "w");
+        if (out == NULL) {
+            print_warning("could not write contention report %s (%s)\n", path, strerror(errno));
+            return QTHREAD_THIRD_PARTY_ERROR;
+        }
+    }
+    contention_report(out);
+    if (out != stdout) {
+        fclose(out);
+    } else {
+        fflush(out);
+    }
+    return QTHREAD_SUCCESS;
+} /*}}}*/
+
+static qt_report_t report = { "contention report", contention_write,
+                               &qt_contention_dump_requested, 0, 0 };
+
+void INTERNAL qt_contention_internal_dump_requested(void)
+{   /*{{{*/
+    qt_report_dump_requested(&report, report_path);
+} /*}}}*/
+
+static void qt_contention_internal_teardown(void)
+{   /*{{{*/
+    /* the workers are all gone, so the sketches are quiet */
+    qt_contention_enabled = 0;
+    (void)contention_write(report_path);
+    qthread_internal_aligned_free(workers, CACHELINE_WIDTH);
+    workers  = NULL;
+    nworkers = 0;
+} /*}}}*/
+
+void INTERNAL qt_contention_subsystem_init(void)
+{   /*{{{*/
+    sample_every = (uint32_t)qt_internal_get_env_num("CONTENTION_SAMPLE", 16, 0);
+    if (sample_every == 0) {
+        return;                        /* QT_CONTENTION_SAMPLE=0 turns it off */
+    }
+    top_k       = (uint32_t)qt_internal_get_env_num("CONTENTION_TOP", 32, 1);
+    report_path = qt_internal_get_env_str("CONTENTION_REPORT", NULL);
+    nworkers    = qlib->nshepherds * qlib->nworkerspershep;
+    worker_size = sizeof(qt_contention_worker_t) + top_k * sizeof(qt_contention_entry_t);
+    worker_size = (worker_size + CACHELINE_WIDTH - 1) & ~(size_t)(CACHELINE_WIDTH - 1);
+    workers     = qthread_internal_aligned_alloc(nworkers * worker_size, CACHELINE_WIDTH);
+    assert(workers);
+    memset(workers, 0, nworkers * worker_size);
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        for (qthread_worker_id_t j = 0; j < qlib->nworkerspershep; ++j) {
+            qt_contention_worker_t *c = sketch(i * qlib->nworkerspershep + j);
+
+            c->countdown                             = sample_every;
+            qlib->shepherds[i].workers[j].contention = c;
+        }
+    }
+# ifdef HAVE_DLADDR
+    {
+        Dl_info info;
+
+        if (dladdr((void *)qt_contention_subsystem_init, &info) &&
+            info.dli_fname && strstr(info.dli_fname, ".so")) {
+            library_base = info.dli_fbase;
+        }
+    }
+# endif
+# ifdef HAVE_EXECINFO_H
+    {
+        void *frames[2];
+
+        /* the first backtrace() loads the unwinder, which is more than a
+         * qthread's stack should have to do */
+        (void)backtrace(frames, 2);
+    }
+# endif
+
+    qt_report_signal(&report, (int)qt_internal_get_env_num("CONTENTION_SIGNAL", 0, 0));
+    qt_contention_enabled = 1;
+    qthread_internal_cleanup(qt_contention_internal_teardown);
+} /*}}}*/
+
+#endif /* ifdef QTHREAD_CONTENTION_PROFILING */
+
+/* vim:set expandtab: */
@@ -0,0 +1,154 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <stdlib.h> /* for malloc/free/etc */
+
+/* Qthreads Headers */
+#include <qthread/qthread.h>
+#include <qthread/qloop.h>
+#include <qthread/dictionary.h>
+
+/* Internal Headers */
+#include "qt_asserts.h"
+#include "qt_debug.h"
+#include "qt_dictionary.h"
+
+/*
+ * Bulk insertion, shared by all of the dictionary backends. The keys are
+ * counting-sorted into partitions by the low bits of the backend's own hash
+ * (which are also what picks a key's bucket), and then each partition is
+ * inserted by a single thread. Threads thus mostly touch disjoint buckets,
+ * and repeated keys are inserted in their original order.
+ */
+
+#define PARTS_PER_WORKER 4
+#define BULK_MIN_PER_PART 64 /* below this, just insert serially */
+
+typedef struct {
+    qt_dictionary *dict;
+    void         **keys;
+    void         **values;
+    size_t         n;
+    size_t         nparts;   /* a power of two */
+    size_t         nchunks;  /* the input is scanned in this many pieces */
+    uint32_t      *part;     /* each key's partition */
+    size_t        *offsets;  /* nchunks x nparts; counts, then positions */
+    size_t        *order;    /* key indices, grouped by partition */
+    size_t        *starts;   /* nparts + 1 */
+    aligned_t      inserted;
+} bulk_t;
+
+#define CHUNK_START(b, c) ((b)->n * (c) / (b)->nchunks)
+
+static void bulk_count(const size_t startat,
+                       const size_t stopat,
+                       void        *arg)
+{   /*{{{*/
+    bulk_t        *b    = (bulk_t *)arg;
+    const uint64_t mask = b->nparts - 1;
+
+    for (size_t c = startat; c < stopat; ++c) {
+        size_t *counts = b->offsets + c * b->nparts;
+        for (size_t i = CHUNK_START(b, c); i < CHUNK_START(b, c + 1); ++i) {
+            uint32_t p = (uint32_t)(qt_dictionary_key_hash(b->dict, b->keys[i]) & mask);
+            b->part[i] = p;
+            counts[p]++;
+        }
+    }
+} /*}}}*/
+
+static void bulk_scatter(const size_t startat,
+                         const size_t stopat,
+                         void        *arg)
+{   /*{{{*/
+    bulk_t *b = (bulk_t *)arg;
+
+    for (size_t c = startat; c < stopat; ++c) {
+        size_t *pos = b->offsets + c * b->nparts;
+        for (size_t i = CHUNK_START(b, c); i < CHUNK_START(b, c + 1); ++i) {
+            b->order[pos[b->part[i]]++] = i;
+        }
+    }
+} /*}}}*/
+
+static void bulk_insert(const size_t startat,
+                        const size_t stopat,
+                        void        *arg)
+{   /*{{{*/
+    bulk_t   *b    = (bulk_t *)arg;
+    aligned_t done = 0;
+
+    for (size_t p = startat; p < stopat; ++p) {
+        for (size_t j = b->starts[p]; j < b->starts[p + 1]; ++j) {
+            const size_t i = b->order[j];
+            if (qt_dictionary_put(b->dict, b->keys[i], b->values[i]) != NULL) {
+                done++;
+            }
+        }
+    }
+    qthread_incr(&b->inserted, done);
+} /*}}}*/
+
+size_t qt_dictionary_put_bulk(qt_dictionary *dict,
+                              void         **keys,
+                              void         **values,
+                              size_t         n)
+{   /*{{{*/
+    bulk_t b;
+    size_t offset = 0;
+
+    assert(dict);
+    assert(keys || n == 0);
+    assert(values || n == 0);
+
+    qt_dictionary_reserve(dict, n);
+
+    b.dict     = dict;
+    b.keys     = keys;
+    b.values   = values;
+    b.n        = n;
+    b.inserted = 0;
+    b.nparts   = 1;
+    while (b.nparts < PARTS_PER_WORKER * qthread_num_workers()) {
+        b.nparts *= 2;
+    }
+    if (n < b.nparts * BULK_MIN_PER_PART) {
+        for (size_t i = 0; i < n; ++i) {
+            if (qt_dictionary_put(dict, keys[i], values[i]) != NULL) {
+                b.inserted++;
+            }
+        }
+        return b.inserted;
+    }
+    b.nchunks = b.nparts;
+    b.part    = MALLOC(n * sizeof(uint32_t));
+    b.order   = MALLOC(n * sizeof(size_t));
+    b.offsets = calloc(b.nchunks * b.nparts, sizeof(size_t));
+    b.starts  = MALLOC((b.nparts + 1) * sizeof(size_t));
+    assert(b.part && b.order && b.offsets && b.starts);
+
+    qt_loop(0, b.nchunks, bulk_count, &b);
+    /* turn the per-chunk counts into positions, partition by partition */
+    for (size_t p = 0; p < b.nparts; ++p) {
+        b.starts[p] = offset;
+        for (size_t c = 0; c < b.nchunks; ++c) {
+            const size_t count = b.offsets[c * b.nparts + p];
+            b.offsets[c * b.nparts + p] = offset;
+            offset                     += count;
+        }
+    }
+    b.starts[b.nparts] = offset;
+    assert(offset == n);
+    qt_loop(0, b.nchunks, bulk_scatter, &b);
+    qt_loop(0, b.nparts, bulk_insert, &b);
+
+    FREE(b.starts, (b.nparts + 1) * sizeof(size_t));
+    FREE(b.offsets, b.nchunks * b.nparts * sizeof(size_t));
+    FREE(b.order, n * sizeof(size_t));
+    FREE(b.part, n * sizeof(uint32_t));
+    return b.inserted;
+} /*}}}*/
+
+/* vim:set expandtab: */
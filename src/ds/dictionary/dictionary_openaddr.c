@@ -0,0 +1,912 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <stdlib.h> /* for malloc/free/etc */
+#include <stdio.h>  /* for printf() */
+#include <string.h> /* for memset() */
+
+/* Qthreads Headers */
+#include <qthread/qthread.h> /* for qthread_incr() and qthread_cas() */
+#include <qthread/qloop.h>
+#include <qthread/dictionary.h>
+
+/* Internal Headers */
+#include "qt_asserts.h"
+#include "qt_debug.h"
+#include "qt_atomics.h"
+#include "qt_aligned_alloc.h"
+#include "qt_dictionary.h"
+
+/*
+ * An open-addressing hash table whose buckets are each one cacheline. A
+ * bucket holds a few key/value slots, a one-byte tag (taken from the top of
+ * the hash) per slot so that lookups rarely have to compare keys, and an
+ * "overflow" flag recording that some key probed past it. A lookup starts at
+ * the key's home bucket and probes (triangularly) until it reaches a bucket
+ * whose overflow flag is clear.
+ *
+ * Each bucket has a sequence word, used as a seqlock: writers lock the home
+ * bucket of the key they are changing (which serializes all operations on
+ * that key) and whichever bucket they modify, while readers take no locks
+ * and simply retry if a bucket's sequence word changed under them.
+ *
+ * The table grows by doubling. Growing is incremental and cooperative: the
+ * old table's buckets are frozen and copied into the new table in chunks,
+ * and every writer that comes along copies a chunk before doing its own
+ * work. A frozen bucket never changes again, so readers keep using the old
+ * table until the last chunk is copied and the new table is published.
+ * Writers that run into a frozen bucket help finish the copy and retry in
+ * the new table. Old tables are kept (they add up to less than the current
+ * table) until the dictionary is destroyed, so readers never need to
+ * announce which table they are using.
+ *
+ * As in the other backends, the cleanup function is called on a deleted key
+ * right away; a concurrent lookup may still be comparing against it.
+ */
+
+#define OA_INIT_BUCKETS 64
+#define OA_CHUNK        64 /* buckets frozen and copied at a time */
+#define OA_MAX_PROBE    32 /* an insert probing further than this grows the table */
+
+/* the sequence word */
+#define OA_LOCKED  ((aligned_t)1)
+#define OA_FROZEN  ((aligned_t)2)
+#define OA_VERSION ((aligned_t)4)
+
+#define OA_SEQ(b) (*(volatile aligned_t *)&(b)->seq)
+
+#if (QTHREAD_ASSEMBLY_ARCH == QTHREAD_AMD64) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_IA32)
+/* loads are not reordered with loads, nor stores with stores */
+# define OA_ORDER_FENCE COMPILER_FENCE
+#else
+# define OA_ORDER_FENCE MACHINE_FENCE
+#endif
+
+typedef struct {
+    void *key;
+    void *value;
+} oa_slot_t;
+
+#define OA_HEADER_SIZE (2 * sizeof(aligned_t))
+#define OA_SLOTS_FIT   ((CACHELINE_WIDTH - OA_HEADER_SIZE) / sizeof(oa_slot_t))
+#define OA_SLOTS       ((OA_SLOTS_FIT < 1) ? 1 : ((OA_SLOTS_FIT > 7) ? 7 : OA_SLOTS_FIT))
+
+typedef struct {
+    aligned_t seq;            /* OA_LOCKED | OA_FROZEN | version */
+    uint8_t   overflow;       /* some key probed past this bucket */
+    uint8_t   tags[OA_SLOTS]; /* 0 means the slot is empty */
+    oa_slot_t slots[OA_SLOTS];
+} oa_bucket_t;
+
+typedef union {
+    oa_bucket_t b;
+    uint8_t     pad[(sizeof(oa_bucket_t) + CACHELINE_WIDTH - 1) & ~(CACHELINE_WIDTH - 1)];
+} oa_line_t;
+
+typedef struct oa_table_s {
+    oa_line_t                  *lines;
+    size_t                      mask;           /* number of buckets - 1 */
+    struct oa_table_s *volatile next;           /* the table being copied into */
+    struct oa_table_s          *prev;           /* the table this one replaced */
+    aligned_t                   chunks_claimed;
+    aligned_t                   chunks_done;
+} oa_table_t;
+
+#define OA_BUCKET(t, i) (&(t)->lines[(i)].b)
+#define OA_NCHUNKS(t)   (((t)->mask + OA_CHUNK) / OA_CHUNK)
+
+/* entries a table of n buckets holds before it is grown */
+#define OA_LOAD_LIMIT(n) (((n) * OA_SLOTS * 3) / 4)
+#define OA_ALLOCATING   ((oa_table_t *)1)
+
+/* triangular probing, which visits every bucket of a power-of-two table */
+#define OA_NEXT(t, i, probe) (((i) + (probe) + 1) & (t)->mask)
+
+/* the tag is never 0, which marks an empty slot */
+#define OA_TAG(h) ((uint8_t)(((h) >> 56) ? ((h) >> 56) : 1))
+
+#define COUNT_STRIDE (CACHELINE_WIDTH / sizeof(aligned_t))
+
+struct qt_dictionary {
+    oa_table_t *volatile table;
+    qt_dict_key_equals_f op_equals;
+    qt_dict_hash_f       op_hash;
+    qt_dict_cleanup_f    op_cleanup;
+    int                  int_keys; /* created without eq/hash functions */
+    aligned_t           *counts;   /* per-worker, may go negative */
+    size_t               ncounts;
+};
+
+struct qt_dictionary_iterator {
+    qt_dictionary *dict;
+    oa_table_t    *table;
+    long           bkt;  /* -1 before the first entry */
+    unsigned int   slot;
+    list_entry     crt;  /* copy of the current entry */
+};
+
+/* lookup results */
+#define OA_MISS   0
+#define OA_HIT    1
+#define OA_BUSY   2 /* another writer has the bucket locked */
+#define OA_FULL   3 /* the probe sequence is too long */
+#define OA_MOVING 4 /* the bucket is frozen, the table is being grown */
+
+/* who is looking */
+#define OA_READER 0
+#define OA_WRITER 1 /* holds some other bucket's lock */
+#define OA_OWNER  2 /* holds this bucket's lock */
+
+#define PUT_ALWAYS    0
+#define PUT_IF_ABSENT 1
+
+static QINLINE uint64_t oa_hash(const qt_dictionary *d,
+                                void                *key)
+{   /*{{{*/
+    if (d->int_keys) {
+        return qt_dict_mix64((uint64_t)(uintptr_t)key);
+    }
+    return qt_dict_mix64((uint64_t)(unsigned int)d->op_hash(key));
+} /*}}}*/
+
+static QINLINE int oa_equals(const qt_dictionary *d,
+                             void                *a,
+                             void                *b)
+{   /*{{{*/
+    return d->int_keys ? (a == b) : d->op_equals(a, b);
+} /*}}}*/
+
+static QINLINE aligned_t *oa_count(const qt_dictionary *d)
+{   /*{{{*/
+    qthread_worker_id_t wkr = qthread_worker_unique(NULL);
+
+    return d->counts + ((wkr == NO_WORKER) ? 0 : (wkr % d->ncounts)) * COUNT_STRIDE;
+} /*}}}*/
+
+static size_t oa_count_sum(const qt_dictionary *d)
+{   /*{{{*/
+    saligned_t sum = 0;
+
+    for (size_t i = 0; i < d->ncounts; ++i) {
+        sum += (saligned_t)d->counts[i * COUNT_STRIDE];
+    }
+    return (sum < 0) ? 0 : (size_t)sum;
+} /*}}}*/
+
+static oa_table_t *oa_table_alloc(size_t nbuckets)
+{   /*{{{*/
+    oa_table_t *t = MALLOC(sizeof(oa_table_t));
+
+    assert(t);
+    assert((nbuckets & (nbuckets - 1)) == 0);
+    t->lines = qthread_internal_aligned_alloc(nbuckets * sizeof(oa_line_t), CACHELINE_WIDTH);
+    assert(t->lines);
+    memset(t->lines, 0, nbuckets * sizeof(oa_line_t));
+    t->mask           = nbuckets - 1;
+    t->next           = NULL;
+    t->prev           = NULL;
+    t->chunks_claimed = 0;
+    t->chunks_done    = 0;
+    return t;
+} /*}}}*/
+
+static void oa_table_free(oa_table_t *t)
+{   /*{{{*/
+    qthread_internal_aligned_free(t->lines, CACHELINE_WIDTH);
+    FREE(t, sizeof(oa_table_t));
+} /*}}}*/
+
+/* Spins until b is locked by us (returning its unlocked sequence word in *s)
+ * or is found to be frozen. */
+static QINLINE int oa_lock(oa_bucket_t *b,
+                           aligned_t   *s)
+{   /*{{{*/
+    for (;;) {
+        aligned_t cur = OA_SEQ(b);
+        if (cur & OA_FROZEN) {
+            return OA_MOVING;
+        }
+        if (!(cur & OA_LOCKED) && (qthread_cas(&b->seq, cur, cur | OA_LOCKED) == cur)) {
+            *s = cur;
+            return OA_HIT;
+        }
+        SPINLOCK_BODY();
+    }
+} /*}}}*/
+
+/* Like oa_lock(), but for callers that already hold a lock, and so must not
+ * wait. */
+static QINLINE int oa_trylock(oa_bucket_t *b,
+                              aligned_t   *s)
+{   /*{{{*/
+    aligned_t cur = OA_SEQ(b);
+
+    if (cur & OA_FROZEN) {
+        return OA_MOVING;
+    }
+    if (!(cur & OA_LOCKED) && (qthread_cas(&b->seq, cur, cur | OA_LOCKED) == cur)) {
+        *s = cur;
+        return OA_HIT;
+    }
+    return OA_BUSY;
+} /*}}}*/
+
+static QINLINE void oa_unlock(oa_bucket_t *b,
+                              aligned_t    s,
+                              int          modified)
+{   /*{{{*/
+    OA_ORDER_FENCE;
+    OA_SEQ(b) = modified ? (s + OA_VERSION) : s;
+} /*}}}*/
+
+/* Looks for key in bucket b. On a hit, *slot and *value describe the entry;
+ * *more is set to b's overflow flag either way. */
+static QINLINE int oa_bucket_lookup(const qt_dictionary *d,
+                                    oa_bucket_t         *b,
+                                    void                *key,
+                                    uint8_t              tag,
+                                    int                  who,
+                                    unsigned int        *slot,
+                                    void               **value,
+                                    uint8_t             *more)
+{   /*{{{*/
+    for (;;) {
+        unsigned int n = 0;
+        unsigned int idx[OA_SLOTS];
+        void        *keys[OA_SLOTS];
+        void        *vals[OA_SLOTS];
+        uint8_t      ovf;
+        aligned_t    s = 0;
+
+        if (who != OA_OWNER) {
+            s = OA_SEQ(b);
+            if (s & OA_FROZEN) {
+                if (who == OA_WRITER) { return OA_MOVING; }
+            } else if (s & OA_LOCKED) {
+                if (who == OA_WRITER) { return OA_BUSY; }
+                SPINLOCK_BODY();
+                continue;
+            }
+            OA_ORDER_FENCE;
+        }
+        for (unsigned int j = 0; j < OA_SLOTS; ++j) {
+            if (b->tags[j] == tag) {
+                idx[n]  = j;
+                keys[n] = b->slots[j].key;
+                vals[n] = b->slots[j].value;
+                n++;
+            }
+        }
+        ovf = b->overflow;
+        if (who != OA_OWNER) {
+            OA_ORDER_FENCE;
+            if (OA_SEQ(b) != s) { continue; }
+        }
+        *more = ovf;
+        for (unsigned int c = 0; c < n; ++c) {
+            if (oa_equals(d, keys[c], key)) {
+                *slot  = idx[c];
+                *value = vals[c];
+                return OA_HIT;
+            }
+        }
+        return OA_MISS;
+    }
+} /*}}}*/
+
+/* Inserts an entry that is known to be absent into a table that nobody else
+ * is reading yet; used to copy entries into a new table. */
+static void oa_raw_insert(const qt_dictionary *d,
+                          oa_table_t          *t,
+                          void                *key,
+                          void                *value)
+{   /*{{{*/
+    const uint64_t h   = oa_hash(d, key);
+    const uint8_t  tag = OA_TAG(h);
+    size_t         i   = h & t->mask;
+
+    for (size_t probe = 0;; ++probe) {
+        oa_bucket_t *b = OA_BUCKET(t, i);
+        aligned_t    s;
+
+        oa_lock(b, &s);
+        for (unsigned int j = 0; j < OA_SLOTS; ++j) {
+            if (b->tags[j] == 0) {
+                b->slots[j].key   = key;
+                b->slots[j].value = value;
+                b->tags[j]        = tag;
+                oa_unlock(b, s, 1);
+                return;
+            }
+        }
+        b->overflow = 1;
+        oa_unlock(b, s, 1);
+        i = OA_NEXT(t, i, probe);
+    }
+} /*}}}*/
+
+/* Starts growing t to nbuckets buckets, unless that has already been
+ * started. */
+static void oa_grow(oa_table_t *t,
+                    size_t      nbuckets)
+{   /*{{{*/
+    oa_table_t *n;
+
+    if (t->next != NULL) { return; }
+    if (qthread_cas_ptr(&t->next, NULL, OA_ALLOCATING) != NULL) { return; }
+    n = oa_table_alloc(nbuckets);
+    MACHINE_FENCE;
+    t->next = n;
+} /*}}}*/
+
+/* Copies one chunk of t into its successor. Returns 0 if there were no
+ * chunks left to claim. */
+static int oa_help_chunk(qt_dictionary *d,
+                         oa_table_t    *t)
+{   /*{{{*/
+    const size_t nchunks = OA_NCHUNKS(t);
+    oa_table_t  *n;
+    size_t       c;
+
+    if (t->chunks_claimed >= nchunks) { return 0; }
+    c = qthread_incr(&t->chunks_claimed, 1);
+    if (c >= nchunks) { return 0; }
+    while ((n = t->next) == OA_ALLOCATING) {
+        SPINLOCK_BODY();
+    }
+    assert(n != NULL);
+    for (size_t i = c * OA_CHUNK; i < (c + 1) * OA_CHUNK && i <= t->mask; ++i) {
+        oa_bucket_t *b = OA_BUCKET(t, i);
+
+        /* freeze: the bucket stays locked from now on */
+        for (;;) {
+            aligned_t s = OA_SEQ(b);
+            assert(!(s & OA_FROZEN));
+            if (!(s & OA_LOCKED) &&
+                (qthread_cas(&b->seq, s, s | OA_LOCKED | OA_FROZEN) == s)) {
+                break;
+            }
+            SPINLOCK_BODY();
+        }
+        for (unsigned int j = 0; j < OA_SLOTS; ++j) {
+            if (b->tags[j] != 0) {
+                oa_raw_insert(d, n, b->slots[j].key, b->slots[j].value);
+            }
+        }
+    }
+    if (qthread_incr(&t->chunks_done, 1) == nchunks - 1) {
+        /* that was the last one; publish the new table */
+        n->prev = t;
+        MACHINE_FENCE;
+        d->table = n;
+    }
+    return 1;
+} /*}}}*/
+
+/* Helps copy t until its successor has been published. */
+static void oa_help_all(qt_dictionary *d,
+                        oa_table_t    *t)
+{   /*{{{*/
+    while (oa_help_chunk(d, t)) ;
+    while (d->table == t) {
+        SPINLOCK_BODY();
+    }
+} /*}}}*/
+
+/* Makes one attempt at a put in table t. Returns OA_HIT when done (with the
+ * result in *ret), otherwise the reason to retry. */
+static int oa_try_put(qt_dictionary *d,
+                      oa_table_t    *t,
+                      uint64_t       h,
+                      void          *key,
+                      void          *value,
+                      char           put_type,
+                      void         **ret)
+{   /*{{{*/
+    const uint8_t tag  = OA_TAG(h);
+    const size_t  home = h & t->mask;
+    oa_bucket_t  *hb   = OA_BUCKET(t, home);
+    oa_bucket_t  *b;
+    aligned_t     hs, bs;
+    size_t        i, probe;
+    unsigned int  slot;
+    void         *found;
+    uint8_t       more;
+    int           rc;
+
+    if ((rc = oa_lock(hb, &hs)) != OA_HIT) { return rc; }
+
+    /* Is the key already here? Only holders of the home bucket's lock can
+     * change this key's entry, so what we find stays put. */
+    i = home;
+    for (probe = 0; probe <= t->mask; ++probe) {
+        b  = OA_BUCKET(t, i);
+        rc = oa_bucket_lookup(d, b, key, tag, (b == hb) ? OA_OWNER : OA_WRITER, &slot, &found, &more);
+        if (rc == OA_HIT) {
+            if (put_type == PUT_IF_ABSENT) {
+                oa_unlock(hb, hs, 0);
+                *ret = found;
+                return OA_HIT;
+            }
+            if (b != hb) {
+                if ((rc = oa_trylock(b, &bs)) != OA_HIT) {
+                    oa_unlock(hb, hs, 0);
+                    return rc;
+                }
+            }
+            b->slots[slot].value = value;
+            if (b != hb) { oa_unlock(b, bs, 1); }
+            oa_unlock(hb, hs, b == hb);
+            *ret = value;
+            return OA_HIT;
+        } else if (rc != OA_MISS) {
+            oa_unlock(hb, hs, 0);
+            return rc;
+        }
+        if (!more) { break; }
+        i = OA_NEXT(t, i, probe);
+    }
+
+    /* No; claim the first free slot. */
+    i = home;
+    for (probe = 0; probe < OA_MAX_PROBE && probe <= t->mask; ++probe) {
+        b = OA_BUCKET(t, i);
+        if (b != hb) {
+            if ((rc = oa_trylock(b, &bs)) != OA_HIT) {
+                oa_unlock(hb, hs, 0);
+                return rc;
+            }
+        }
+        for (slot = 0; slot < OA_SLOTS; ++slot) {
+            if (b->tags[slot] == 0) { break; }
+        }
+        if (slot < OA_SLOTS) {
+            b->slots[slot].key   = key;
+            b->slots[slot].value = value;
+            b->tags[slot]        = tag;
+            if (b != hb) { oa_unlock(b, bs, 1); }
+            oa_unlock(hb, hs, 1);
+            qthread_incr(oa_count(d), 1);
+            if ((b != hb) && (oa_count_sum(d) > OA_LOAD_LIMIT(t->mask + 1))) {
+                oa_grow(t, 2 * (t->mask + 1));
+            }
+            *ret = value;
+            return OA_HIT;
+        }
+        /* The overflow flag has to be set before the entry is visible; it
+         * only ever goes from 0 to 1, so an unlocked bucket can be marked
+         * safely. */
+        b->overflow = 1;
+        if (b != hb) { oa_unlock(b, bs, 0); }
+        i = OA_NEXT(t, i, probe);
+    }
+    oa_unlock(hb, hs, 1);
+    return OA_FULL;
+} /*}}}*/
+
+static void *oa_put(qt_dictionary *d,
+                    void          *key,
+                    void          *value,
+                    char           put_type)
+{   /*{{{*/
+    const uint64_t h = oa_hash(d, key);
+
+    for (;;) {
+        oa_table_t *t = d->table;
+        void       *ret;
+
+        if (t->next != NULL) {
+            oa_help_chunk(d, t);
+        }
+        switch (oa_try_put(d, t, h, key, value, put_type, &ret)) {
+            case OA_HIT:
+                return ret;
+
+            case OA_FULL:
+                oa_grow(t, 2 * (t->mask + 1));
+            /* fall through */
+            case OA_MOVING:
+                oa_help_all(d, t);
+                break;
+            case OA_BUSY:
+                SPINLOCK_BODY();
+                break;
+        }
+    }
+} /*}}}*/
+
+qt_dictionary *qt_dictionary_create(qt_dict_key_equals_f eq,
+                                    qt_dict_hash_f       hash,
+                                    qt_dict_cleanup_f    cleanup)
+{   /*{{{*/
+    qt_dictionary *d = MALLOC(sizeof(qt_dictionary));
+
+    assert(d);
+    assert((eq == NULL) == (hash == NULL));
+    d->op_equals  = eq;
+    d->op_hash    = hash;
+    d->op_cleanup = cleanup;
+    d->int_keys   = (eq == NULL && hash == NULL);
+    d->ncounts    = qthread_num_workers();
+    d->counts     = qthread_internal_aligned_alloc(d->ncounts * COUNT_STRIDE * sizeof(aligned_t), CACHELINE_WIDTH);
+    assert(d->counts);
+    memset(d->counts, 0, d->ncounts * COUNT_STRIDE * sizeof(aligned_t));
+    d->table = oa_table_alloc(OA_INIT_BUCKETS);
+    return d;
+} /*}}}*/
+
+void qt_dictionary_destroy(qt_dictionary *d)
+{   /*{{{*/
+    oa_table_t *t;
+
+    /* finish any copy that is still under way */
+    while ((t = d->table)->next != NULL) {
+        oa_help_all(d, t);
+    }
+    if (d->op_cleanup) {
+        for (size_t i = 0; i <= t->mask; ++i) {
+            oa_bucket_t *b = OA_BUCKET(t, i);
+            for (unsigned int j = 0; j < OA_SLOTS; ++j) {
+                if (b->tags[j] != 0) {
+                    d->op_cleanup(b->slots[j].key, b->slots[j].value);
+                }
+            }
+        }
+    }
+    while (t != NULL) {
+        oa_table_t *prev = t->prev;
+        oa_table_free(t);
+        t = prev;
+    }
+    qthread_internal_aligned_free(d->counts, CACHELINE_WIDTH);
+    FREE(d, sizeof(qt_dictionary));
+} /*}}}*/
+
+void *qt_dictionary_put(qt_dictionary *dict,
+                        void          *key,
+                        void          *value)
+{   /*{{{*/
+    return oa_put(dict, key, value, PUT_ALWAYS);
+} /*}}}*/
+
+void *qt_dictionary_put_if_absent(qt_dictionary *dict,
+                                  void          *key,
+                                  void          *value)
+{   /*{{{*/
+    return oa_put(dict, key, value, PUT_IF_ABSENT);
+} /*}}}*/
+
+void *qt_dictionary_get(qt_dictionary *dict,
+                        void          *key)
+{   /*{{{*/
+    const uint64_t    h   = oa_hash(dict, key);
+    const uint8_t     tag = OA_TAG(h);
+    const oa_table_t *t   = dict->table;
+    size_t            i   = h & t->mask;
+
+    for (size_t probe = 0; probe <= t->mask; ++probe) {
+        unsigned int slot;
+        void        *value;
+        uint8_t      more;
+
+        if (oa_bucket_lookup(dict, OA_BUCKET(t, i), key, tag, OA_READER, &slot, &value, &more) == OA_HIT) {
+            return value;
+        }
+        if (!more) { break; }
+        i = OA_NEXT(t, i, probe);
+    }
+    return NULL;
+} /*}}}*/
+
+/* Makes one attempt at a delete in table t; see oa_try_put(). */
+static int oa_try_delete(qt_dictionary *d,
+                         oa_table_t    *t,
+                         uint64_t       h,
+                         void          *key,
+                         void         **ret)
+{   /*{{{*/
+    const uint8_t tag  = OA_TAG(h);
+    const size_t  home = h & t->mask;
+    oa_bucket_t  *hb   = OA_BUCKET(t, home);
+    size_t        i    = home;
+    aligned_t     hs, bs;
+    int           rc;
+
+    if ((rc = oa_lock(hb, &hs)) != OA_HIT) { return rc; }
+    for (size_t probe = 0; probe <= t->mask; ++probe) {
+        oa_bucket_t *b = OA_BUCKET(t, i);
+        unsigned int slot;
+        void        *found;
+        uint8_t      more;
+
+        rc = oa_bucket_lookup(d, b, key, tag, (b == hb) ? OA_OWNER : OA_WRITER, &slot, &found, &more);
+        if (rc == OA_HIT) {
+            if (b != hb) {
+                if ((rc = oa_trylock(b, &bs)) != OA_HIT) {
+                    oa_unlock(hb, hs, 0);
+                    return rc;
+                }
+            }
+            *ret                 = found;
+            key                  = b->slots[slot].key;
+            b->tags[slot]        = 0;
+            b->slots[slot].key   = NULL;
+            b->slots[slot].value = NULL;
+            if (b != hb) { oa_unlock(b, bs, 1); }
+            oa_unlock(hb, hs, b == hb);
+            qthread_incr(oa_count(d), -1);
+            if (d->op_cleanup != NULL) {
+                d->op_cleanup(key, NULL);
+            }
+            return OA_HIT;
+        } else if (rc != OA_MISS) {
+            oa_unlock(hb, hs, 0);
+            return rc;
+        }
+        if (!more) { break; }
+        i = OA_NEXT(t, i, probe);
+    }
+    oa_unlock(hb, hs, 0);
+    *ret = NULL;
+    return OA_HIT;
+} /*}}}*/
+
+void *qt_dictionary_delete(qt_dictionary *dict,
+                           void          *key)
+{   /*{{{*/
+    const uint64_t h = oa_hash(dict, key);
+
+    for (;;) {
+        oa_table_t *t = dict->table;
+        void       *ret;
+
+        if (t->next != NULL) {
+            oa_help_chunk(dict, t);
+        }
+        switch (oa_try_delete(dict, t, h, key, &ret)) {
+            case OA_HIT:
+                return ret;
+
+            case OA_MOVING:
+                oa_help_all(dict, t);
+                break;
+            default:
+                SPINLOCK_BODY();
+                break;
+        }
+    }
+} /*}}}*/
+
+uint64_t INTERNAL qt_dictionary_key_hash(qt_dictionary *dict,
+                                         void          *key)
+{   /*{{{*/
+    return oa_hash(dict, key);
+} /*}}}*/
+
+void INTERNAL qt_dictionary_reserve(qt_dictionary *dict,
+                                    size_t         n)
+{   /*{{{*/
+    for (;;) {
+        oa_table_t *t        = dict->table;
+        size_t      want     = oa_count_sum(dict) + n;
+        size_t      nbuckets = t->mask + 1;
+
+        if ((t->next == NULL) && (want <= OA_LOAD_LIMIT(nbuckets))) { return; }
+        while (OA_LOAD_LIMIT(nbuckets) < want) {
+            nbuckets *= 2;
+        }
+        oa_grow(t, nbuckets);
+        oa_help_all(dict, t);
+    }
+} /*}}}*/
+
+/* Copies the entries of b out under its seqlock; returns how many. */
+static unsigned int oa_bucket_snapshot(oa_bucket_t *b,
+                                       void       **keys,
+                                       void       **vals)
+{   /*{{{*/
+    for (;;) {
+        unsigned int n = 0;
+        aligned_t    s;
+
+        while (((s = OA_SEQ(b)) & (OA_LOCKED | OA_FROZEN)) == OA_LOCKED) {
+            SPINLOCK_BODY();
+        }
+        OA_ORDER_FENCE;
+        for (unsigned int j = 0; j < OA_SLOTS; ++j) {
+            if (b->tags[j] != 0) {
+                keys[n] = b->slots[j].key;
+                vals[n] = b->slots[j].value;
+                n++;
+            }
+        }
+        OA_ORDER_FENCE;
+        if (OA_SEQ(b) == s) { return n; }
+    }
+} /*}}}*/
+
+typedef struct {
+    const oa_table_t *table;
+    qt_dict_visit_f   fn;
+    void             *arg;
+} oa_visit_t;
+
+static void oa_visit_buckets(const size_t startat,
+                             const size_t stopat,
+                             void        *arg)
+{   /*{{{*/
+    const oa_visit_t *v = (const oa_visit_t *)arg;
+
+    for (size_t i = startat; i < stopat; ++i) {
+        void        *keys[OA_SLOTS];
+        void        *vals[OA_SLOTS];
+        unsigned int n = oa_bucket_snapshot(OA_BUCKET(v->table, i), keys, vals);
+
+        for (unsigned int j = 0; j < n; ++j) {
+            v->fn(keys[j], vals[j], v->arg);
+        }
+    }
+} /*}}}*/
+
+void qt_dictionary_parallel_for_each(qt_dictionary  *dict,
+                                     qt_dict_visit_f fn,
+                                     void           *arg)
+{   /*{{{*/
+    oa_visit_t v;
+
+    assert(dict);
+    assert(fn);
+    /* a table that is being copied is still complete */
+    v.table = dict->table;
+    v.fn    = fn;
+    v.arg   = arg;
+    qt_loop_balance(0, v.table->mask + 1, oa_visit_buckets, &v);
+} /*}}}*/
+
+qt_dictionary_iterator *qt_dictionary_iterator_create(qt_dictionary *dict)
+{   /*{{{*/
+    if (dict == NULL) {
+        return ERROR;
+    }
+    qt_dictionary_iterator *it = MALLOC(sizeof(qt_dictionary_iterator));
+    if (it == NULL) {
+        return ERROR;
+    }
+    it->dict  = dict;
+    it->table = dict->table;
+    it->bkt   = -1;
+    it->slot  = 0;
+    memset(&it->crt, 0, sizeof(list_entry));
+    return it;
+} /*}}}*/
+
+void qt_dictionary_iterator_destroy(qt_dictionary_iterator *it)
+{   /*{{{*/
+    if (it == NULL) { return; }
+    FREE(it, sizeof(qt_dictionary_iterator));
+} /*}}}*/
+
+list_entry *qt_dictionary_iterator_next(qt_dictionary_iterator *it)
+{   /*{{{*/
+    const oa_table_t *t;
+    size_t            i;
+    unsigned int      j;
+
+    if ((it == NULL) || (it->dict == NULL)) {
+        return ERROR;
+    }
+    t = it->table;
+    if (it->bkt > (long)t->mask) {
+        return NULL;
+    }
+    if (it->bkt < 0) {
+        i = 0;
+        j = 0;
+    } else {
+        i = it->bkt;
+        j = it->slot + 1;
+    }
+    for (; i <= t->mask; ++i, j = 0) {
+        oa_bucket_t *b = OA_BUCKET(t, i);
+        for (;;) {
+            aligned_t    s;
+            unsigned int k;
+
+            while (((s = OA_SEQ(b)) & (OA_LOCKED | OA_FROZEN)) == OA_LOCKED) {
+                SPINLOCK_BODY();
+            }
+            OA_ORDER_FENCE;
+            for (k = j; k < OA_SLOTS && b->tags[k] == 0; ++k) ;
+            if (k < OA_SLOTS) {
+                it->crt.key        = b->slots[k].key;
+                it->crt.value      = b->slots[k].value;
+            }
+            OA_ORDER_FENCE;
+            if (OA_SEQ(b) != s) { continue; }
+            if (k < OA_SLOTS) {
+                it->crt.hashed_key = oa_hash(it->dict, it->crt.key);
+                it->bkt            = i;
+                it->slot           = k;
+                return &it->crt;
+            }
+            break;
+        }
+    }
+    it->bkt  = t->mask + 1;
+    it->slot = 0;
+    return NULL;
+} /*}}}*/
+
+list_entry *qt_dictionary_iterator_get(const qt_dictionary_iterator *it)
+{   /*{{{*/
+    if ((it == NULL) || (it->dict == NULL)) {
+        return ERROR;
+    }
+    if ((it->bkt < 0) || (it->bkt > (long)it->table->mask)) {
+        return NULL;
+    }
+    return (list_entry *)&it->crt;
+} /*}}}*/
+
+qt_dictionary_iterator *qt_dictionary_end(qt_dictionary *dict)
+{   /*{{{*/
+    qt_dictionary_iterator *it = qt_dictionary_iterator_create(dict);
+
+    if ((it == NULL) || (it == ERROR)) {
+        return NULL;
+    }
+    it->bkt = it->table->mask + 1;
+    return it;
+} /*}}}*/
+
+int qt_dictionary_iterator_equals(qt_dictionary_iterator *a,
+                                  qt_dictionary_iterator *b)
+{   /*{{{*/
+    if ((a == NULL) || (b == NULL)) {
+        return a == b;
+    }
+    return (a->dict == b->dict) && (a->table == b->table) &&
+           (a->bkt == b->bkt) && (a->slot == b->slot);
+} /*}}}*/
+
+qt_dictionary_iterator *qt_dictionary_iterator_copy(qt_dictionary_iterator *b)
+{   /*{{{*/
+    if (b == NULL) {
+        return NULL;
+    }
+    qt_dictionary_iterator *ret = qt_dictionary_iterator_create(b->dict);
+    if ((ret == NULL) || (ret == ERROR)) {
+        return NULL;
+    }
+    ret->table = b->table;
+    ret->bkt   = b->bkt;
+    ret->slot  = b->slot;
+    ret->crt   = b->crt;
+    return ret;
+} /*}}}*/
+
+void qt_dictionary_printbuckets(qt_dictionary *dict)
+{   /*{{{*/
+    const oa_table_t *t          = dict->table;
+    size_t            used       = 0;
+    size_t            overflowed = 0;
+    size_t            total      = 0;
+
+    for (size_t i = 0; i <= t->mask; ++i) {
+        oa_bucket_t *b     = OA_BUCKET(t, i);
+        unsigned int no_el = 0;
+        for (unsigned int j = 0; j < OA_SLOTS; ++j) {
+            if (b->tags[j] != 0) { no_el++; }
+        }
+        if (no_el > 0) { used++; }
+        if (b->overflow) { overflowed++; }
+        total += no_el;
+    }
+    printf("allocated_buckets = %lu (%u slots each); used_buckets = %lu; overflowed_buckets = %lu; total elements = %lu;\n",
+           (unsigned long)(t->mask + 1), (unsigned int)OA_SLOTS, (unsigned long)used,
+           (unsigned long)overflowed, (unsigned long)total);
+} /*}}}*/
+
+/* vim:set expandtab: */
@@ -10,6 +10,7 @@
 /* Qthreads Headers */
 #include <qthread/qthread.h> /* for qthread_incr() and qthread_cas() */
 #include <qthread/qpool.h>
+#include <qthread/qloop.h>
 #include <qthread/dictionary.h>
 
 /* Internal Headers */
@@ -17,6 +18,7 @@
 #include "qt_debug.h"
 #include "qt_atomics.h"
 #include "qt_aligned_alloc.h"
+#include "qt_dictionary.h" /* for the integer key functions */
 
 /*
  * The hash table in this file is based on the work by Ori Shalev and Nir Shavit
@@ -452,6 +454,10 @@ static inline qt_hash qt_hash_create(qt_dict_key_equals_f eq,
 
     tmp = MALLOC(sizeof(qt_dictionary));
     assert(tmp);
+    if ((eq == NULL) && (hash == NULL)) {
+        eq   = qt_dict_int_equals;
+        hash = qt_dict_int_hash;
+    }
     tmp->op_equals  = eq;
     tmp->op_hash    = hash;
     tmp->op_cleanup = cleanup;
@@ -556,6 +562,88 @@ void qt_dictionary_destroy(qt_dictionary *d)
  * }
  */
 
+uint64_t INTERNAL qt_dictionary_key_hash(qt_dictionary *dict,
+                                         void          *key)
+{
+    uint64_t lkey = (uint64_t)(uintptr_t)(dict->op_hash(key));
+
+    HASH_KEY(lkey);
+    return lkey;
+}
+
+void INTERNAL qt_dictionary_reserve(qt_dictionary *dict,
+                                    size_t         n)
+{
+    size_t csize = dict->size;
+
+    // growing is just a matter of using more buckets
+    while ((dict->count + n) / csize > MAX_LOAD && 2 * csize <= hard_max_buckets) {
+        qthread_cas(&dict->size, csize, 2 * csize);
+        csize = dict->size;
+    }
+}
+
+typedef struct {
+    qt_dictionary  *dict;
+    size_t          nsegs;
+    qt_dict_visit_f fn;
+    void           *arg;
+} segment_visit_t;
+
+/*
+ * Every key whose hash is congruent to seg modulo nsegs (a power of two) is
+ * found in one stretch of the list, which starts at bucket seg's dummy node;
+ * the first node from another residue class ends it.
+ */
+static void visit_segments(const size_t startat,
+                           const size_t stopat,
+                           void        *arg)
+{
+    const segment_visit_t *v    = (const segment_visit_t *)arg;
+    qt_hash                h    = v->dict;
+    const uint64_t         mask = v->nsegs - 1;
+
+    for (size_t seg = startat; seg < stopat; seg++) {
+        marked_ptr_t cur;
+
+        if (h->B[seg] == UNINITIALIZED) {
+            initialize_bucket(h, seg);
+        }
+        for (cur = (marked_ptr_t)(PTR_OF(h->B[seg])->next); PTR_OF(cur) != NULL;
+             cur = (marked_ptr_t)(PTR_OF(cur)->next)) {
+            hash_entry *e  = PTR_OF(cur);
+            so_key_t    hk = e->hashed_key;
+
+            if ((REVERSE(hk) & mask) != seg) {
+                break;
+            }
+            // regular (non-dummy) keys have the low bit set
+            if ((hk & 1) && !MARK_OF((marked_ptr_t)(e->next))) {
+                v->fn(e->key, e->value, v->arg);
+            }
+        }
+    }
+}
+
+void qt_dictionary_parallel_for_each(qt_dictionary  *dict,
+                                     qt_dict_visit_f fn,
+                                     void           *arg)
+{
+    segment_visit_t v;
+    size_t          nsegs = 1;
+
+    assert(dict);
+    assert(fn);
+    while (nsegs < 4 * qthread_num_workers() && 2 * nsegs <= hard_max_buckets) {
+        nsegs *= 2;
+    }
+    v.dict  = dict;
+    v.nsegs = nsegs;
+    v.fn    = fn;
+    v.arg   = arg;
+    qt_loop_balance(0, nsegs, visit_segments, &v);
+}
+
 struct qt_dictionary_iterator {
     qt_dictionary *dict;
     list_entry    *crt; // =NULL if iterator is newly created or reached the end; =crt elem otherwise.
@@ -3,10 +3,12 @@
 #include <stdio.h>
 #include <limits.h>          // using CHAR_BIT
 #include <qthread/qthread.h> // using CAS_ptr, qthread_worker_unique and qthread_num_workers
+#include <qthread/qloop.h>   // using qt_loop_balance
 #include <56reader-rwlock.h> // using rwlock_*
 
 #include "qt_asserts.h"
 #include "qt_debug.h"
+#include "qt_dictionary.h" /* for the integer key functions */
 
 struct qt_dictionary {
     qt_dict_key_equals_f op_equals;
@@ -111,6 +113,10 @@ qt_dictionary *qt_dictionary_create(qt_dict_key_equals_f eq,
 {
     assert(qthread_library_initialized && "Need to initialize qthreads before using the dictionary");
     qt_dictionary *ret = (qt_dictionary *)MALLOC(sizeof(qt_dictionary));
+    if ((eq == NULL) && (hash == NULL)) {
+        eq   = qt_dict_int_equals;
+        hash = qt_dict_int_hash;
+    }
     ret->op_equals  = eq;
     ret->op_hash    = hash;
     ret->op_cleanup = cleanup;
@@ -365,6 +371,56 @@ void *qt_dictionary_delete(qt_dictionary *dict,
     return to_ret;
 }
 
+uint64_t INTERNAL qt_dictionary_key_hash(qt_dictionary *dict,
+                                         void          *key)
+{
+    int hash = dict->op_hash(key);
+
+    return (uint64_t)DICT_ABS(hash);
+}
+
+void INTERNAL qt_dictionary_reserve(qt_dictionary *dict,
+                                    size_t         n)
+{
+    // the number of buckets is fixed
+}
+
+typedef struct {
+    qt_dictionary  *dict;
+    qt_dict_visit_f fn;
+    void           *arg;
+} bucket_visit_t;
+
+static void visit_buckets(const size_t startat,
+                          const size_t stopat,
+                          void        *arg)
+{
+    const bucket_visit_t *v    = (const bucket_visit_t *)arg;
+    qt_dictionary        *dict = v->dict;
+
+    rlock(dict->lock);
+    for (size_t i = startat; i < stopat; i++) {
+        for (list_entry *walk = dict->content[i]; walk != NULL; walk = walk->next) {
+            v->fn(walk->key, walk->value, v->arg);
+        }
+    }
+    runlock(dict->lock);
+}
+
+void qt_dictionary_parallel_for_each(qt_dictionary  *dict,
+                                     qt_dict_visit_f fn,
+                                     void           *arg)
+{
+    bucket_visit_t v;
+
+    assert(dict);
+    assert(fn);
+    v.dict = dict;
+    v.fn   = fn;
+    v.arg  = arg;
+    qt_loop_balance(0, NO_BUCKETS, visit_buckets, &v);
+}
+
 qt_dictionary_iterator *qt_dictionary_iterator_create(qt_dictionary *dict)
 {
     if((dict == NULL) || (dict->content == NULL)) {
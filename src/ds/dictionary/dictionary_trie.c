@@ -12,10 +12,12 @@
 /* Installed Headers */
 #include <qthread/dictionary.h>
 #include <qthread/qthread.h>
+#include <qthread/qloop.h>
 
 /* Internal Headers */
 #include "qt_asserts.h"
 #include "qt_debug.h"
+#include "qt_dictionary.h" /* for the integer key functions */
 #ifdef EBUG
 # define DEBUG(x) x
 #else
@@ -99,6 +101,10 @@ static inline qt_hash qt_hash_create(qt_dict_key_equals_f eq,
 {
     qt_hash tmp = MALLOC(sizeof(qt_dictionary));
 
+    if ((eq == NULL) && (hash == NULL)) {
+        eq   = qt_dict_int_equals;
+        hash = qt_dict_int_hash;
+    }
     tmp->op_equals  = eq;
     tmp->op_hash    = hash;
     tmp->op_cleanup = cleanup;
@@ -636,6 +642,72 @@ size_t qt_dictionary_count(qt_dictionary *h)
  * }
  */
 
+uint64_t INTERNAL qt_dictionary_key_hash(qt_dictionary *dict,
+                                         void          *key)
+{
+    uint64_t lkey = (uint64_t)(uintptr_t)(dict->op_hash(key));
+
+    HASH_KEY(lkey);
+    return lkey;
+}
+
+void INTERNAL qt_dictionary_reserve(qt_dictionary *dict,
+                                    size_t         n)
+{
+    // spines are added as they are needed
+}
+
+typedef struct {
+    qt_dictionary  *dict;
+    qt_dict_visit_f fn;
+    void           *arg;
+} spine_visit_t;
+
+static void visit_element(const spine_visit_t *v,
+                          spine_element_t      el)
+{
+    if (el.e == NULL) {
+        return;
+    }
+    if (SPINE_PTR_TEST(el)) { // spine
+        spine_t *spine = SPINE_PTR(v->dict, el);
+        if (spine != NULL) {
+            for (size_t i = 0; i < SPINE_LENGTH; ++i) {
+                visit_element(v, spine->elements[i]);
+            }
+        }
+    } else {
+        for (hash_entry *e = el.e; e != NULL; e = e->next) {
+            v->fn(e->key, e->value, v->arg);
+        }
+    }
+}
+
+static void visit_base(const size_t startat,
+                       const size_t stopat,
+                       void        *arg)
+{
+    const spine_visit_t *v = (const spine_visit_t *)arg;
+
+    for (size_t i = startat; i < stopat; ++i) {
+        visit_element(v, v->dict->base[i]);
+    }
+}
+
+void qt_dictionary_parallel_for_each(qt_dictionary  *dict,
+                                     qt_dict_visit_f fn,
+                                     void           *arg)
+{
+    spine_visit_t v;
+
+    assert(dict);
+    assert(fn);
+    v.dict = dict;
+    v.fn   = fn;
+    v.arg  = arg;
+    qt_loop_balance(0, BASE_SPINE_LENGTH, visit_base, &v);
+}
+
 struct qt_dictionary_iterator {
     qt_dictionary *dict;
     list_entry    *crt; // =NULL if iterator is newly created or reached the end; =crt elem otherwise.
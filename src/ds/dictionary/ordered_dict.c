@@ -0,0 +1,829 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <stdlib.h> /* for malloc/free/etc */
+
+/* Qthreads Headers */
+#include <qthread/qthread.h> /* for qthread_incr() and qthread_cas() */
+#include <qthread/qpool.h>
+#include <qthread/qloop.h>
+#include <qthread/hash.h> /* for qt_hash64() */
+#include <qthread/ordered_dict.h>
+
+/* Internal Headers */
+#include "qt_asserts.h"
+#include "qt_debug.h"
+#include "qt_atomics.h"
+#include "qt_hazardptrs.h"
+#include "qt_subsystems.h" /* for qthread_internal_cleanup_late() */
+
+/*
+ * A lock-free skiplist, following the design in Fraser's "Practical
+ * Lock-Freedom" (and Herlihy & Shavit's "The Art of Multiprocessor
+ * Programming"), with memory reclamation done through hazard pointers as
+ * described by Michael in "Hazard Pointers: Safe Memory Reclamation for
+ * Lock-Free Objects".
+ *
+ * A node is deleted by marking its next pointers, top level first; whoever
+ * marks level 0 owns the deletion. Marked nodes are unlinked ("snipped") by
+ * any traversal that passes them. Because a node may be linked into its upper
+ * levels after it has been marked, each node counts the levels it is linked
+ * into (plus one for its inserter); it is handed to the hazard pointer layer
+ * only when that count drops to zero.
+ *
+ * Iterators and range walks resume each batch from the last key they copied
+ * out. That key belongs to a node that may be deleted (and its key cleaned up)
+ * in the meantime, so they hold an extra reference to the node - a "pin" -
+ * until they have moved past it.
+ */
+
+#define ODICT_MAX_LEVEL     24
+#define ODICT_RETIRE_MAX    8  /* nodes an operation may unlink before flushing */
+#define ODICT_BATCH         64 /* entries copied out per hazard-protected walk */
+#define ODICT_SPLITS_PER_WKR 4 /* sub-ranges per worker in a parallel range */
+
+/* hazard pointer slots */
+#define HP_SUCC 0
+#define HP_CURR 1
+#define HP_PRED 2
+
+typedef uintptr_t marked_ptr_t;
+
+#define MARK_OF(x) ((x) & 1)
+#define PTR_OF(x)  ((odict_node_t *)((x) & ~(marked_ptr_t)1))
+
+typedef struct odict_node_s {
+    void             *key;
+    void             *value;
+    qt_dict_cleanup_f cleanup;
+    aligned_t         refs;   /* levels linked, +1 while being inserted */
+    unsigned int      height;
+    marked_ptr_t      next[]; /* height entries */
+} odict_node_t;
+
+struct qt_ordered_dict {
+    odict_node_t         *head;
+    aligned_t             level;  /* highest level that may be in use */
+    qt_ordered_dict_cmp_f op_cmp;
+    qt_dict_cleanup_f     op_cleanup;
+    uint64_t             *seeds;  /* per-worker height generators */
+    size_t                nseeds;
+};
+
+struct qt_ordered_dict_iterator {
+    qt_ordered_dict      *dict;
+    void                 *resume;    /* where the next batch starts */
+    odict_node_t         *pinned;    /* the node resume belongs to, if any */
+    int                   exclusive; /* whether resume itself is skipped */
+    int                   done;
+    size_t                count;
+    size_t                pos;
+    qt_ordered_dict_entry batch[ODICT_BATCH];
+};
+
+typedef struct {
+    odict_node_t *nodes[ODICT_RETIRE_MAX];
+    unsigned int  count;
+} odict_retire_t;
+
+#define SEED_STRIDE (CACHELINE_WIDTH / sizeof(uint64_t))
+
+/* one pool per node height */
+static qpool **odict_node_pools = NULL;
+
+static void odict_internal_cleanup(void)
+{   /*{{{*/
+    for (unsigned int i = 0; i < ODICT_MAX_LEVEL; ++i) {
+        qpool_destroy(odict_node_pools[i]);
+    }
+    FREE(odict_node_pools, ODICT_MAX_LEVEL * sizeof(qpool *));
+    odict_node_pools = NULL;
+} /*}}}*/
+
+static void odict_init_pools(void)
+{   /*{{{*/
+    if (odict_node_pools == NULL) {
+        switch ((uintptr_t)qthread_cas_ptr(&odict_node_pools, NULL, (void *)1)) {
+            case 0: /* I won, I will allocate */
+            {
+                qpool **pools = MALLOC(ODICT_MAX_LEVEL * sizeof(qpool *));
+                assert(pools);
+                for (unsigned int i = 0; i < ODICT_MAX_LEVEL; ++i) {
+                    pools[i] = qpool_create(sizeof(odict_node_t) + (i + 1) * sizeof(marked_ptr_t));
+                }
+                qthread_internal_cleanup_late(odict_internal_cleanup);
+                MACHINE_FENCE;
+                odict_node_pools = pools;
+                break;
+            }
+            case 1:
+                while (odict_node_pools == (void *)1) {
+                    SPINLOCK_BODY();
+                }
+                break;
+        }
+    }
+} /*}}}*/
+
+static odict_node_t *odict_node_alloc(unsigned int height)
+{   /*{{{*/
+    odict_node_t *n = qpool_alloc(odict_node_pools[height - 1]);
+
+    assert(n);
+    n->height = height;
+    n->refs   = 1;
+    return n;
+} /*}}}*/
+
+/* this is the hazard pointer layer's free function */
+static void odict_node_free(void *p)
+{   /*{{{*/
+    odict_node_t *n = (odict_node_t *)p;
+
+    if (n->cleanup) {
+        n->cleanup(n->key, NULL);
+    }
+    qpool_free(odict_node_pools[n->height - 1], n);
+} /*}}}*/
+
+static QINLINE void odict_protect(unsigned int  which,
+                                  odict_node_t *n)
+{   /*{{{*/
+    hazardous_ptr(which, n);
+    MACHINE_FENCE; /* publish before re-validating */
+} /*}}}*/
+
+/* Drops one reference to n; the last reference queues it for reclamation. */
+static QINLINE void odict_release(odict_node_t   *n,
+                                  odict_retire_t *r)
+{   /*{{{*/
+    if (qthread_incr(&n->refs, -1) == 1) {
+        assert(r->count < ODICT_RETIRE_MAX);
+        r->nodes[r->count++] = n;
+    }
+} /*}}}*/
+
+/* Hands queued nodes to the hazard pointer layer and drops our hazard
+ * pointers. Nothing found during the operation may be used afterward. */
+static void odict_finish(odict_retire_t *r)
+{   /*{{{*/
+    if (r->count == 0) {
+        hazardous_ptr(HP_SUCC, NULL);
+        hazardous_ptr(HP_CURR, NULL);
+        hazardous_ptr(HP_PRED, NULL);
+        return;
+    }
+    for (unsigned int i = 0; i < r->count; ++i) {
+        hazardous_release_node(odict_node_free, r->nodes[i]);
+    }
+    r->count = 0;
+}   /*}}}*/
+
+/* Takes an extra reference to n, which must be hazard-protected, unless it
+ * has already been unlinked everywhere. Returns 0 in that case. */
+static QINLINE int odict_pin(odict_node_t *n)
+{   /*{{{*/
+    aligned_t refs = n->refs;
+
+    while (refs != 0) {
+        const aligned_t prev = qthread_cas(&n->refs, refs, refs + 1);
+        if (prev == refs) { return 1; }
+        refs = prev;
+    }
+    return 0;
+} /*}}}*/
+
+static QINLINE void odict_unpin(odict_node_t   *n,
+                                odict_retire_t *r)
+{   /*{{{*/
+    odict_release(n, r);
+    if (r->count == ODICT_RETIRE_MAX) {
+        odict_finish(r);
+    }
+} /*}}}*/
+
+/* for pins held outside of any operation */
+static void odict_unpin_all(odict_node_t **nodes,
+                            size_t         count)
+{   /*{{{*/
+    odict_retire_t r;
+
+    r.count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        odict_unpin(nodes[i], &r);
+    }
+    odict_finish(&r);
+} /*}}}*/
+
+static QINLINE void odict_unpin_one(odict_node_t *n)
+{   /*{{{*/
+    if (n != NULL) {
+        odict_unpin_all(&n, 1);
+    }
+} /*}}}*/
+
+/* NULL is "minus infinity" as a search key */
+static QINLINE int odict_before(const qt_ordered_dict *d,
+                                const odict_node_t    *n,
+                                void                  *key)
+{   /*{{{*/
+    return (key != NULL) && (d->op_cmp(n->key, key) < 0);
+} /*}}}*/
+
+/*
+ * Searches for key from the top level down to level "stop", unlinking marked
+ * nodes along the way. On return, preds[l] < key <= succs[l] for every level
+ * l >= stop, and preds[stop]/succs[stop] are hazard-protected. Returns 1 if
+ * succs[stop] holds key.
+ */
+static int odict_find(qt_ordered_dict *d,
+                      void            *key,
+                      unsigned int     stop,
+                      odict_node_t   **preds,
+                      odict_node_t   **succs,
+                      odict_retire_t  *r)
+{   /*{{{*/
+    odict_node_t *pred;
+    odict_node_t *curr = NULL;
+
+retry:
+    pred = d->head;
+    for (int l = (int)d->level; l >= (int)stop; --l) {
+        curr = PTR_OF(pred->next[l]);
+        odict_protect(HP_CURR, curr);
+        if (pred->next[l] != (marked_ptr_t)curr) { goto retry; }
+        while (curr != NULL) {
+            const marked_ptr_t succ_raw = curr->next[l];
+            odict_node_t      *succ     = PTR_OF(succ_raw);
+
+            odict_protect(HP_SUCC, succ);
+            if (MARK_OF(succ_raw)) {
+                /* curr->next[l] is frozen once marked, so succ is safe as long
+                 * as curr is still linked behind pred */
+                if (qthread_cas(&pred->next[l], (marked_ptr_t)curr, (marked_ptr_t)succ) != (marked_ptr_t)curr) {
+                    goto retry;
+                }
+                odict_release(curr, r);
+                hazardous_ptr(HP_CURR, succ);
+                curr = succ;
+                if (r->count == ODICT_RETIRE_MAX) {
+                    odict_finish(r);
+                    goto retry;
+                }
+                continue;
+            }
+            if (curr->next[l] != succ_raw) { continue; }
+            if (!odict_before(d, curr, key)) { break; }
+            hazardous_ptr(HP_PRED, curr);
+            hazardous_ptr(HP_CURR, succ);
+            pred = curr;
+            curr = succ;
+        }
+        preds[l] = pred;
+        succs[l] = curr;
+    }
+    return (curr != NULL) && (key != NULL) && (d->op_cmp(curr->key, key) == 0);
+} /*}}}*/
+
+static unsigned int odict_random_height(qt_ordered_dict *d)
+{   /*{{{*/
+    qthread_worker_id_t wkr  = qthread_worker_unique(NULL);
+    uint64_t           *seed = d->seeds + ((wkr == NO_WORKER) ? 0 : (wkr % d->nseeds)) * SEED_STRIDE;
+    uint64_t            x    = *seed;
+    unsigned int        h    = 1;
+
+    /* xorshift64; races on the shared non-worker slot only cost randomness */
+    x    ^= x << 13;
+    x    ^= x >> 7;
+    x    ^= x << 17;
+    *seed = x;
+    while ((x & 1) && h < ODICT_MAX_LEVEL) {
+        h++;
+        x >>= 1;
+    }
+    return h;
+} /*}}}*/
+
+static void odict_raise_level(qt_ordered_dict *d,
+                              aligned_t        level)
+{   /*{{{*/
+    aligned_t cur = d->level;
+
+    while (cur < level) {
+        aligned_t prev = qthread_cas(&d->level, cur, level);
+        if (prev == cur) { break; }
+        cur = prev;
+    }
+} /*}}}*/
+
+qt_ordered_dict *qt_ordered_dict_create(qt_ordered_dict_cmp_f cmp,
+                                        qt_dict_cleanup_f     cleanup)
+{   /*{{{*/
+    qt_ordered_dict *d;
+
+    qassert_ret((cmp != NULL), NULL);
+    odict_init_pools();
+    qassert_ret((odict_node_pools != NULL), NULL);
+
+    d = MALLOC(sizeof(qt_ordered_dict));
+    qassert_ret((d != NULL), NULL);
+    d->op_cmp     = cmp;
+    d->op_cleanup = cleanup;
+    d->level      = 0;
+    d->head       = odict_node_alloc(ODICT_MAX_LEVEL);
+    d->head->key  = NULL;
+    d->head->value   = NULL;
+    d->head->cleanup = NULL;
+    for (unsigned int i = 0; i < ODICT_MAX_LEVEL; ++i) {
+        d->head->next[i] = (marked_ptr_t)NULL;
+    }
+    d->nseeds = qthread_num_workers();
+    d->seeds  = MALLOC(d->nseeds * SEED_STRIDE * sizeof(uint64_t));
+    assert(d->seeds);
+    for (size_t i = 0; i < d->nseeds; ++i) {
+        d->seeds[i * SEED_STRIDE] = qt_hash64(i + 1) | 1;
+    }
+    return d;
+} /*}}}*/
+
+void qt_ordered_dict_destroy(qt_ordered_dict *d)
+{   /*{{{*/
+    odict_node_t *n;
+
+    assert(d);
+    /* unlink whatever deletions left behind, top down, so that every node
+     * left at level 0 is live and every node freed here is freed once */
+    for (int l = (int)d->level; l >= 0; --l) {
+        odict_node_t *pred = d->head;
+        while ((n = PTR_OF(pred->next[l])) != NULL) {
+            if (MARK_OF(n->next[l])) {
+                pred->next[l] = (marked_ptr_t)PTR_OF(n->next[l]);
+                if (--n->refs == 0) {
+                    odict_node_free(n);
+                }
+            } else {
+                pred = n;
+            }
+        }
+    }
+    n = PTR_OF(d->head->next[0]);
+    while (n != NULL) {
+        odict_node_t *next = PTR_OF(n->next[0]);
+        if (n->cleanup) {
+            n->cleanup(n->key, n->value);
+        }
+        qpool_free(odict_node_pools[n->height - 1], n);
+        n = next;
+    }
+    qpool_free(odict_node_pools[ODICT_MAX_LEVEL - 1], d->head);
+    FREE(d->seeds, d->nseeds * SEED_STRIDE * sizeof(uint64_t));
+    FREE(d, sizeof(qt_ordered_dict));
+} /*}}}*/
+
+#define PUT_ALWAYS    0
+#define PUT_IF_ABSENT 1
+
+static void *qt_ordered_dict_put_helper(qt_ordered_dict *d,
+                                        void            *key,
+                                        void            *value,
+                                        char             put_type)
+{   /*{{{*/
+    odict_node_t  *preds[ODICT_MAX_LEVEL];
+    odict_node_t  *succs[ODICT_MAX_LEVEL];
+    odict_node_t  *node = NULL;
+    odict_retire_t r;
+    unsigned int   height;
+    void          *ret;
+
+    qassert_ret((d != NULL), NULL);
+    qassert_ret((key != NULL), NULL);
+    r.count = 0;
+    height  = odict_random_height(d);
+    odict_raise_level(d, height - 1);
+
+    while (1) {
+        if (odict_find(d, key, 0, preds, succs, &r)) {
+            odict_node_t *found = succs[0];
+            if (put_type == PUT_ALWAYS) {
+                void *crt_val = found->value;
+                void *prev;
+                while ((prev = qthread_cas_ptr(&found->value, crt_val, value)) != crt_val) {
+                    crt_val = prev;
+                }
+                ret = value;
+            } else {
+                ret = found->value;
+            }
+            if (node != NULL) { /* never published */
+                qpool_free(odict_node_pools[height - 1], node);
+            }
+            odict_finish(&r);
+            return ret;
+        }
+        if (node == NULL) {
+            node          = odict_node_alloc(height);
+            node->key     = key;
+            node->value   = value;
+            node->cleanup = d->op_cleanup;
+        }
+        for (unsigned int l = 0; l < height; ++l) {
+            node->next[l] = (marked_ptr_t)succs[l];
+        }
+        node->refs = 2; /* the inserter, and level 0 */
+        if (qthread_cas(&preds[0]->next[0], (marked_ptr_t)succs[0], (marked_ptr_t)node) == (marked_ptr_t)succs[0]) {
+            break;
+        }
+    }
+    ret = value;
+
+    /* The node is now in the dictionary; the inserter's reference keeps it
+     * from being reclaimed while its upper levels are linked. Each level is
+     * re-searched so that the predecessor we CAS on is hazard-protected. */
+    for (unsigned int l = 1; l < height; ++l) {
+        while (1) {
+            marked_ptr_t old;
+
+            odict_find(d, key, l, preds, succs, &r);
+            if (MARK_OF(node->next[0])) { goto linked; } /* deleted already */
+            old = node->next[l];
+            if (MARK_OF(old)) { goto linked; }
+            if ((old != (marked_ptr_t)succs[l]) &&
+                (qthread_cas(&node->next[l], old, (marked_ptr_t)succs[l]) != old)) {
+                goto linked; /* only a deleter changes it, by marking it */
+            }
+            qthread_incr(&node->refs, 1);
+            if (qthread_cas(&preds[l]->next[l], (marked_ptr_t)succs[l], (marked_ptr_t)node) == (marked_ptr_t)succs[l]) {
+                break;
+            }
+            qthread_incr(&node->refs, -1);
+        }
+    }
+linked:
+    if (MARK_OF(node->next[0])) {
+        /* a delete may have finished unlinking before we linked a level */
+        odict_find(d, key, 0, preds, succs, &r);
+    }
+    odict_release(node, &r);
+    odict_finish(&r);
+    return ret;
+} /*}}}*/
+
+void *qt_ordered_dict_put(qt_ordered_dict *d,
+                          void            *key,
+                          void            *value)
+{   /*{{{*/
+    return qt_ordered_dict_put_helper(d, key, value, PUT_ALWAYS);
+} /*}}}*/
+
+void *qt_ordered_dict_put_if_absent(qt_ordered_dict *d,
+                                    void            *key,
+                                    void            *value)
+{   /*{{{*/
+    return qt_ordered_dict_put_helper(d, key, value, PUT_IF_ABSENT);
+} /*}}}*/
+
+void *qt_ordered_dict_get(qt_ordered_dict *d,
+                          void            *key)
+{   /*{{{*/
+    odict_node_t  *preds[ODICT_MAX_LEVEL];
+    odict_node_t  *succs[ODICT_MAX_LEVEL];
+    odict_retire_t r;
+    void          *ret = NULL;
+
+    qassert_ret((d != NULL), NULL);
+    qassert_ret((key != NULL), NULL);
+    r.count = 0;
+    if (odict_find(d, key, 0, preds, succs, &r)) {
+        ret = succs[0]->value;
+    }
+    odict_finish(&r);
+    return ret;
+} /*}}}*/
+
+void *qt_ordered_dict_delete(qt_ordered_dict *d,
+                             void            *key)
+{   /*{{{*/
+    odict_node_t  *preds[ODICT_MAX_LEVEL];
+    odict_node_t  *succs[ODICT_MAX_LEVEL];
+    odict_retire_t r;
+    void          *ret = NULL;
+
+    qassert_ret((d != NULL), NULL);
+    qassert_ret((key != NULL), NULL);
+    r.count = 0;
+    if (odict_find(d, key, 0, preds, succs, &r)) {
+        odict_node_t *victim = succs[0];
+        int           mine   = 0;
+
+        for (int l = (int)victim->height - 1; l >= 1; --l) {
+            marked_ptr_t n;
+            do {
+                n = victim->next[l];
+                if (MARK_OF(n)) { break; }
+            } while (qthread_cas(&victim->next[l], n, n | 1) != n);
+        }
+        while (1) {
+            const marked_ptr_t n = victim->next[0];
+            if (MARK_OF(n)) { break; } /* somebody else deleted it */
+            if (qthread_cas(&victim->next[0], n, n | 1) == n) {
+                mine = 1;
+                ret  = victim->value;
+                break;
+            }
+        }
+        if (mine) {
+            /* unlink it from every level */
+            odict_find(d, key, 0, preds, succs, &r);
+        }
+    }
+    odict_finish(&r);
+    return ret;
+} /*}}}*/
+
+/*
+ * Copies up to max live entries at the given level, in order, starting with
+ * the first key >= lo (> lo if exclusive) and stopping before hi. Returns the
+ * number copied; fewer than max means the range is exhausted. lo and hi must
+ * stay valid throughout: they are the caller's own keys, or keys of nodes it
+ * has pinned.
+ *
+ * If pins is given, every node copied is pinned and listed there. Otherwise,
+ * if last is given, the node of the last entry copied is pinned and returned
+ * there (NULL if nothing was copied), so that the next batch can start from
+ * its key. Either way, the caller unpins them.
+ */
+static size_t odict_collect(qt_ordered_dict       *d,
+                            unsigned int           level,
+                            void                  *lo,
+                            int                    exclusive,
+                            void                  *hi,
+                            qt_ordered_dict_entry *buf,
+                            size_t                 max,
+                            odict_node_t         **pins,
+                            odict_node_t         **last)
+{   /*{{{*/
+    odict_node_t  *preds[ODICT_MAX_LEVEL];
+    odict_node_t  *succs[ODICT_MAX_LEVEL];
+    odict_retire_t r;
+    odict_node_t  *pinned = NULL;  /* the last node copied, once pinned */
+    odict_node_t  *prev;           /* the last node copied, if not */
+    size_t         count;
+    void          *const first_lo        = lo;
+    const int      first_exclusive = exclusive;
+
+    r.count = 0;
+again:
+    count = 0;
+    lo    = first_lo;
+restart:
+    {
+        odict_node_t *curr;
+
+        exclusive = (count > 0) ? 1 : first_exclusive;
+        prev      = NULL;
+        odict_find(d, lo, level, preds, succs, &r);
+        curr = succs[level];
+        while (curr != NULL && count < max) {
+            const marked_ptr_t succ_raw = curr->next[level];
+            odict_node_t      *succ     = PTR_OF(succ_raw);
+
+            odict_protect(HP_SUCC, succ);
+            if (curr->next[level] != succ_raw) { continue; }
+            if (MARK_OF(succ_raw)) {
+                /* curr may no longer be linked, so succ may not be safe; let
+                 * odict_find() unlink it and pick up where we left off */
+                if (count > 0) {
+                    if (pins != NULL) {
+                        lo = pins[count - 1]->key;
+                    } else {
+                        if ((prev != NULL) && !odict_pin(prev)) { goto lost; }
+                        if (prev != NULL) {
+                            if (pinned) { odict_unpin(pinned, &r); }
+                            pinned = prev;
+                        }
+                        lo = pinned->key;
+                    }
+                }
+                goto restart;
+            }
+            if ((hi != NULL) && (d->op_cmp(curr->key, hi) >= 0)) {
+                break;
+            }
+            if (!exclusive || (d->op_cmp(curr->key, lo) != 0)) {
+                if ((pins == NULL) || odict_pin(curr)) {
+                    if (pins != NULL) { pins[count] = curr; }
+                    buf[count].key   = curr->key;
+                    buf[count].value = curr->value;
+                    count++;
+                    /* keep it safe to pin until the next one is copied */
+                    hazardous_ptr(HP_PRED, curr);
+                    prev = curr;
+                }
+            }
+            exclusive = 0;
+            hazardous_ptr(HP_CURR, succ);
+            curr = succ;
+        }
+    }
+    if ((pins == NULL) && (last != NULL)) {
+        if (prev != NULL) {
+            if (!odict_pin(prev)) { goto lost; }
+            if (pinned) { odict_unpin(pinned, &r); }
+            pinned = prev;
+        }
+        *last = pinned;
+    } else if (pinned) {
+        odict_unpin(pinned, &r);
+    }
+    odict_finish(&r);
+    return count;
+
+lost:
+    /* the last node copied was deleted before it could be pinned, so there
+     * is no safe key to resume from but the one we started with */
+    if (pinned) {
+        odict_unpin(pinned, &r);
+        pinned = NULL;
+    }
+    goto again;
+} /*}}}*/
+
+qt_ordered_dict_iterator *qt_ordered_dict_lower_bound(qt_ordered_dict *d,
+                                                      void            *key)
+{   /*{{{*/
+    qt_ordered_dict_iterator *it;
+
+    qassert_ret((d != NULL), NULL);
+    it = MALLOC(sizeof(qt_ordered_dict_iterator));
+    qassert_ret((it != NULL), NULL);
+    it->dict      = d;
+    it->resume    = key;
+    it->pinned    = NULL;
+    it->exclusive = 0;
+    it->done      = 0;
+    it->count     = 0;
+    it->pos       = 0;
+    return it;
+} /*}}}*/
+
+qt_ordered_dict_entry *qt_ordered_dict_iterator_next(qt_ordered_dict_iterator *it)
+{   /*{{{*/
+    qassert_ret((it != NULL), NULL);
+    if (it->pos == it->count) {
+        odict_node_t *last;
+
+        if (it->done) { return NULL; }
+        it->count = odict_collect(it->dict, 0, it->resume, it->exclusive, NULL,
+                                  it->batch, ODICT_BATCH, NULL, &last);
+        it->pos = 0;
+        odict_unpin_one(it->pinned);
+        it->pinned = last;
+        if (it->count < ODICT_BATCH) { it->done = 1; }
+        if (it->count == 0) { return NULL; }
+        it->resume    = it->batch[it->count - 1].key;
+        it->exclusive = 1;
+    }
+    return &it->batch[it->pos++];
+} /*}}}*/
+
+void qt_ordered_dict_iterator_destroy(qt_ordered_dict_iterator *it)
+{   /*{{{*/
+    if (it == NULL) { return; }
+    odict_unpin_one(it->pinned);
+    FREE(it, sizeof(qt_ordered_dict_iterator));
+} /*}}}*/
+
+void qt_ordered_dict_range(qt_ordered_dict        *d,
+                           void                   *lo,
+                           void                   *hi,
+                           qt_ordered_dict_visit_f fn,
+                           void                   *arg)
+{   /*{{{*/
+    qt_ordered_dict_entry batch[ODICT_BATCH];
+    odict_node_t         *pinned    = NULL;
+    int                   exclusive = 0;
+    size_t                count;
+
+    qassert_retvoid((d != NULL));
+    qassert_retvoid((fn != NULL));
+    do {
+        odict_node_t *last;
+
+        count = odict_collect(d, 0, lo, exclusive, hi, batch, ODICT_BATCH, NULL, &last);
+        odict_unpin_one(pinned);
+        pinned = last;
+        /* no hazard pointers are held here, so fn may do as it pleases */
+        for (size_t i = 0; i < count; ++i) {
+            fn(batch[i].key, batch[i].value, arg);
+        }
+        if (count > 0) {
+            lo        = batch[count - 1].key;
+            exclusive = 1;
+        }
+    } while (count == ODICT_BATCH);
+    odict_unpin_one(pinned);
+} /*}}}*/
+
+typedef struct {
+    qt_ordered_dict        *dict;
+    void                   *lo;
+    void                   *hi;
+    void                  **splits;
+    size_t                  nsplits;
+    qt_ordered_dict_visit_f fn;
+    void                   *arg;
+} odict_range_args_t;
+
+static void odict_range_chunk(const size_t startat,
+                              const size_t stopat,
+                              void        *arg_)
+{   /*{{{*/
+    odict_range_args_t *a = (odict_range_args_t *)arg_;
+
+    for (size_t i = startat; i < stopat; ++i) {
+        void *lo = (i == 0) ? a->lo : a->splits[i - 1];
+        void *hi = (i == a->nsplits) ? a->hi : a->splits[i];
+        qt_ordered_dict_range(a->dict, lo, hi, a->fn, a->arg);
+    }
+} /*}}}*/
+
+void qt_ordered_dict_range_parallel(qt_ordered_dict        *d,
+                                    void                   *lo,
+                                    void                   *hi,
+                                    qt_ordered_dict_visit_f fn,
+                                    void                   *arg)
+{   /*{{{*/
+    const size_t          target   = qthread_num_workers() * ODICT_SPLITS_PER_WKR;
+    const size_t          maxsplit = target * 4;
+    qt_ordered_dict_entry batch[ODICT_BATCH];
+    odict_node_t         *pins[ODICT_BATCH];
+    odict_range_args_t    args;
+    size_t                nsplits = 0;
+    void                **splits  = NULL;
+    odict_node_t        **nodes   = NULL; /* pinned, so the splits stay valid */
+
+    qassert_retvoid((d != NULL));
+    qassert_retvoid((fn != NULL));
+    if (target > 1) {
+        splits = MALLOC(maxsplit * sizeof(void *));
+        qassert_retvoid((splits != NULL));
+        nodes = MALLOC(maxsplit * sizeof(odict_node_t *));
+        qassert_retvoid((nodes != NULL));
+        /* Each level of a skiplist is (roughly) an evenly spaced sample of the
+         * one below it, so the first level from the top with enough keys in
+         * [lo, hi) provides splitters for similarly sized sub-ranges. */
+        for (int l = (int)d->level; l >= 1; --l) {
+            void         *from      = lo;
+            int           exclusive = 0;
+            size_t        count;
+            odict_node_t *skipped = NULL;
+
+            odict_unpin_all(nodes, nsplits);
+            nsplits = 0;
+            do {
+                size_t want = maxsplit - nsplits;
+                if (want > ODICT_BATCH) { want = ODICT_BATCH; }
+                count = odict_collect(d, l, from, exclusive, hi, batch, want, pins, NULL);
+                for (size_t i = 0; i < count; ++i) {
+                    /* the first key may be lo itself; it splits nothing */
+                    if ((nsplits == 0) && (lo != NULL) && (d->op_cmp(batch[i].key, lo) == 0)) {
+                        skipped = pins[i];
+                        continue;
+                    }
+                    nodes[nsplits]    = pins[i];
+                    splits[nsplits++] = batch[i].key;
+                }
+                if (count > 0) {
+                    from      = batch[count - 1].key;
+                    exclusive = 1;
+                }
+            } while (count == ODICT_BATCH && nsplits < maxsplit);
+            odict_unpin_one(skipped);
+            if (nsplits >= target) { break; }
+        }
+    }
+    if (nsplits == 0) {
+        if (splits) {
+            FREE(splits, maxsplit * sizeof(void *));
+            FREE(nodes, maxsplit * sizeof(odict_node_t *));
+        }
+        qt_ordered_dict_range(d, lo, hi, fn, arg);
+        return;
+    }
+
+    args.dict    = d;
+    args.lo      = lo;
+    args.hi      = hi;
+    args.splits  = splits;
+    args.nsplits = nsplits;
+    args.fn      = fn;
+    args.arg     = arg;
+    qt_loop(0, nsplits + 1, odict_range_chunk, &args);
+    odict_unpin_all(nodes, nsplits);
+    FREE(splits, maxsplit * sizeof(void *));
+    FREE(nodes, maxsplit * sizeof(odict_node_t *));
+} /*}}}*/
+
+/* vim:set expandtab: */
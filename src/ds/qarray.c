@@ -3,9 +3,15 @@
 #endif
 
 /* System Headers */
+#include <stdio.h>                     /* for fprintf() */
 #include <stdlib.h>                    /* for calloc() */
+#include <strings.h>                   /* for strcasecmp() */
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <sys/stat.h>                  /* for fstat() */
+#include <fcntl.h>                     /* for open() */
+#include <unistd.h>                    /* for close() */
+#include <errno.h>
 #ifdef QTHREAD_USE_VALGRIND
 # include <valgrind/memcheck.h>
 #else
@@ -24,9 +30,47 @@
 #include "qt_aligned_alloc.h"
 #include "qt_gcd.h"                    /* for qt_lcm() */
 #include "qt_int_ceil.h"
+#include "qt_envariables.h"
+
+/* values of QT_QARRAY_HUGEPAGES */
+enum {
+    QA_HUGE_NONE = 0,
+    QA_HUGE_TRANSPARENT,               /* madvise(MADV_HUGEPAGE) */
+    QA_HUGE_EXPLICIT                   /* MAP_HUGETLB, else transparent */
+};
+/* values of QA_MAPPING() */
+enum {
+    QA_MAP_DEFAULT = 0,                /* from the affinity layer or aligned_alloc */
+    QA_MAP_ANON,                       /* mmap()ed and huge-page aligned */
+    QA_MAP_FILE                        /* mmap()ed straight from a file */
+};
+/* what a qarray * really points to: the public part, and how its body was
+ * allocated, which is nobody else's business */
+typedef struct {
+    qarray        pub;
+    unsigned char mapping;
+} qarray_private_t;
+#define QA_MAPPING(a) (((qarray_private_t *)(uintptr_t)(a))->mapping)
+#define QA_HUGEPAGE_SIZE ((size_t)2 * 1024 * 1024)
+/* the smallest segment of a file-backed array */
+#define QA_MAPPED_SEGMENT_BYTES QA_HUGEPAGE_SIZE
+/* how much of each segment coming into the prefetch window is prefetched,
+ * for arrays in memory */
+#define QA_PREFETCH_BYTES       (8 * CACHELINE_WIDTH)
+/* values of QT_QARRAY_PREFETCH */
+enum {
+    QA_PREFETCH_NONE = 0,
+    QA_PREFETCH_MAPPED,                /* only file-backed arrays */
+    QA_PREFETCH_ALL
+};
 
 static unsigned short pageshift                  = 0;
 static aligned_t     *chunk_distribution_tracker = NULL;
+static int            hugepages                  = -1; /* -1 until read */
+static unsigned char  first_touch                = 1;
+static int            prefetch_mode              = QA_PREFETCH_MAPPED;
+static size_t         prefetch_distance          = 1;
+static size_t         prefetch_depth             = 4;
 
 /* local funcs */
 /* this function is for DIST *ONLY*; it returns a pointer to the location that
@@ -144,18 +188,94 @@ static void qarray_free_cdt(void)
     }
 }                                      /*}}} */
 
-static qarray *qarray_create_internal(const size_t         count,
-                                      const size_t         obj_size,
-                                      const distribution_t d,
-                                      const char           tight,
-                                      const int            seg_pages)
-{                               /*{{{ */
-    size_t  segment_count;      /* number of segments allocated */
-    qarray *ret = NULL;
+static void qarray_internal_read_env(void)
+{                                      /*{{{ */
+    const char *str = qt_internal_get_env_str("QARRAY_HUGEPAGES", "no");
 
-    qassert_ret((count > 0), NULL);
-    qassert_ret((obj_size > 0), NULL);
+    first_touch = qt_internal_get_env_bool("QARRAY_FIRST_TOUCH", 1);
+    prefetch_distance = qt_internal_get_env_num("QARRAY_PREFETCH_DISTANCE", 1, 0);
+    prefetch_depth    = qt_internal_get_env_num("QARRAY_PREFETCH_DEPTH", 4, 1);
+    {
+        const char *pf = qt_internal_get_env_str("QARRAY_PREFETCH", "mapped");
+
+        if ((pf == NULL) || !strcasecmp(pf, "mapped")) {
+            prefetch_mode = QA_PREFETCH_MAPPED;
+        } else if (!strcasecmp(pf, "all") || !strcasecmp(pf, "yes")) {
+            prefetch_mode = QA_PREFETCH_ALL;
+        } else {
+            if (strcasecmp(pf, "no") && strcasecmp(pf, "none")) {
+                fprintf(stderr, "unparsable QARRAY_PREFETCH (%s)\n", pf);
+            }
+            prefetch_mode = QA_PREFETCH_NONE;
+        }
+    }
+    if (str == NULL) {
+        hugepages = QA_HUGE_NONE;
+    } else if (!strcasecmp(str, "transparent") || !strcasecmp(str, "thp") ||
+        !strcasecmp(str, "yes")) {
+        hugepages = QA_HUGE_TRANSPARENT;
+    } else if (!strcasecmp(str, "explicit") || !strcasecmp(str, "hugetlb")) {
+        hugepages = QA_HUGE_EXPLICIT;
+    } else {
+        if (strcasecmp(str, "no") && strcasecmp(str, "none")) {
+            fprintf(stderr, "unparsable QARRAY_HUGEPAGES (%s)\n", str);
+        }
+        hugepages = QA_HUGE_NONE;
+    }
+}                                      /*}}} */
 
+static QINLINE size_t qarray_internal_huge_len(const size_t bytes)
+{                                      /*{{{ */
+    return (bytes + QA_HUGEPAGE_SIZE - 1) & ~(QA_HUGEPAGE_SIZE - 1);
+}                                      /*}}} */
+
+/* Maps a huge-page aligned array body, so that each (huge-page sized) segment
+ * can be backed by huge pages on its own node. Returns NULL if that cannot be
+ * done here, in which case the caller falls back to a normal allocation. */
+static char *qarray_internal_alloc_huge(const size_t bytes)
+{                                      /*{{{ */
+#if defined(HAVE_MMAP) && defined(HAVE_MUNMAP) && defined(MAP_ANONYMOUS)
+    const size_t len = qarray_internal_huge_len(bytes);
+    char        *ret;
+    size_t       head;
+
+# if HAVE_DECL_MAP_HUGETLB
+    if (hugepages == QA_HUGE_EXPLICIT) {
+        ret = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ret != MAP_FAILED) {
+            return ret;
+        }
+        qthread_debug(QARRAY_DETAILS,
+                      "qarray_create(): no explicit huge pages, trying transparent ones\n");
+    }
+# endif
+    /* over-allocate, then trim down to a huge page boundary */
+    ret = mmap(NULL, len + QA_HUGEPAGE_SIZE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ret == MAP_FAILED) {
+        return NULL;
+    }
+    head = (QA_HUGEPAGE_SIZE - ((uintptr_t)ret & (QA_HUGEPAGE_SIZE - 1))) &
+           (QA_HUGEPAGE_SIZE - 1);
+    if (head != 0) {
+        munmap(ret, head);
+    }
+    munmap(ret + head + len, QA_HUGEPAGE_SIZE - head);
+    ret += head;
+# if defined(HAVE_MADVISE) && HAVE_DECL_MADV_HUGEPAGE
+    madvise(ret, len, MADV_HUGEPAGE);
+# endif
+    return ret;
+
+#else
+    return NULL;
+#endif /* if defined(HAVE_MMAP) && defined(HAVE_MUNMAP) && defined(MAP_ANONYMOUS) */
+}                                      /*}}} */
+
+/* the bookkeeping every kind of qarray needs before it's created */
+static int qarray_internal_setup(void)
+{                                      /*{{{ */
     if (pageshift == 0) {
         size_t tmp = pagesize;
         while (tmp != 0) {
@@ -163,17 +283,103 @@ static qarray *qarray_create_internal(const size_t         count,
             tmp >>= 1;
         }
     }
-
+    if (hugepages < 0) {
+        qarray_internal_read_env();
+    }
     if (chunk_distribution_tracker == NULL) {
         aligned_t *tmp = calloc(qthread_num_shepherds(), sizeof(aligned_t));
-        qassert_ret((tmp != NULL), NULL);
+        if (tmp == NULL) {
+            return -1;
+        }
         if (qthread_cas_ptr(&(chunk_distribution_tracker), NULL, tmp) != NULL) {
             FREE(tmp, qthread_num_shepherds() * sizeof(aligned_t));
         } else {
             atexit(qarray_free_cdt);
         }
     }
-    ret = calloc(1, sizeof(qarray));
+    return 0;
+}                                      /*}}} */
+
+struct qarray_touch_args {
+    qarray                      *a;
+    const qthread_shepherd_id_t *owners;
+    size_t                       segment_count;
+    qthread_shepherd_id_t        shep;
+    qthread_worker_id_t          worker, nworkers;
+    aligned_t                   *donecount;
+};
+
+/* runs on arg->shep, and faults in (a share of) the segments that shepherd
+ * owns, so that the pages land on its node */
+static aligned_t qarray_toucher(void *arg_)
+{                                      /*{{{ */
+    const struct qarray_touch_args *arg = (const struct qarray_touch_args *)arg_;
+    qarray                         *a   = arg->a;
+    size_t                          mine = 0;
+
+    for (size_t segment = 0; segment < arg->segment_count; segment++) {
+        char *seghead;
+
+        if ((arg->owners[segment] != arg->shep) ||
+            (mine++ % arg->nworkers != arg->worker)) {
+            continue;
+        }
+        seghead = a->base_ptr + (segment * a->segment_bytes);
+        for (size_t off = 0; off < a->segment_bytes; off += pagesize) {
+            ((volatile char *)seghead)[off] = 0;
+        }
+        if (a->dist_type == DIST) {
+            qarray_internal_segment_shep_write(a, seghead, arg->shep);
+        }
+    }
+    qthread_incr(arg->donecount, 1);
+    return 0;
+}                                      /*}}} */
+
+static void qarray_internal_first_touch(qarray                      *a,
+                                        const qthread_shepherd_id_t *owners,
+                                        const size_t                 segment_count)
+{                                      /*{{{ */
+    aligned_t                donecount  = 0;
+    size_t                   num_spawns = 0;
+    struct qarray_touch_args args       = { a, owners, segment_count, 0, 0, 0, &donecount };
+
+    for (qthread_shepherd_id_t s = 0; s < qthread_num_shepherds(); s++) {
+        if ((a->dist_type == ALL_SAME) && (s != a->dist_specific.dist_shep)) {
+            continue;
+        }
+        args.shep     = s;
+        args.nworkers = qthread_num_workers_local(s);
+        for (args.worker = 0; args.worker < args.nworkers; args.worker++) {
+            qthread_fork_copyargs_to(qarray_toucher, &args, sizeof(args), NULL, s);
+            num_spawns++;
+        }
+    }
+    while (donecount < num_spawns) {
+        qthread_yield();
+    }
+}                                      /*}}} */
+
+static qarray *qarray_create_internal(const size_t         count,
+                                      const size_t         obj_size,
+                                      const distribution_t d,
+                                      const char           tight,
+                                      const int            seg_pages)
+{                               /*{{{ */
+    size_t                 segment_count; /* number of segments allocated */
+    size_t                 dflt_seg_bytes;
+    qarray                *ret    = NULL;
+    qthread_shepherd_id_t *owners = NULL; /* for first-touch placement */
+
+    qassert_ret((count > 0), NULL);
+    qassert_ret((obj_size > 0), NULL);
+    qassert_ret((qarray_internal_setup() == 0), NULL);
+
+    /* with huge pages, segments are whole huge pages, so that each one can be
+     * placed on its own node */
+    dflt_seg_bytes = (hugepages != QA_HUGE_NONE) ? QA_HUGEPAGE_SIZE : 16 * pagesize;
+
+    ret = calloc(1, sizeof(qarray_private_t));
     qassert_goto((ret != NULL), badret_exit);
 
     ret->count = count;
@@ -205,9 +411,12 @@ static qarray *qarray_create_internal(const size_t         count,
         case FIXED_HASH:
         default:
             if (seg_pages == 0) {
-                ret->segment_bytes = 16 * pagesize;
+                ret->segment_bytes = dflt_seg_bytes;
                 if (ret->unit_size > ret->segment_bytes) {
                     ret->segment_bytes = qt_lcm(ret->unit_size, pagesize);
+                    if (hugepages != QA_HUGE_NONE) {
+                        ret->segment_bytes = qarray_internal_huge_len(ret->segment_bytes);
+                    }
                 }
             } else {
                 ret->segment_bytes = seg_pages * pagesize;
@@ -227,7 +436,7 @@ static qarray *qarray_create_internal(const size_t         count,
              * by 1 (thus providing space for the shepherd identifier, as long
              * as the unit-size is bigger than a shepherd identifier). */
             if (seg_pages == 0) {
-                ret->segment_bytes = 16 * pagesize;
+                ret->segment_bytes = dflt_seg_bytes;
             } else {
                 ret->segment_bytes = seg_pages * pagesize;
             }
@@ -235,8 +444,10 @@ static qarray *qarray_create_internal(const size_t         count,
             if ((ret->segment_bytes - (ret->segment_size * ret->unit_size)) <
                 4) {
                 ret->segment_size--;
-                /* avoid wasting too much memory */
-                if (ret->unit_size > pagesize) {
+                /* avoid wasting too much memory (unless that would split a
+                 * huge page) */
+                if ((ret->unit_size > pagesize) &&
+                    ((hugepages == QA_HUGE_NONE) || (seg_pages != 0))) {
                     ret->segment_bytes -=
                         (ret->unit_size / pagesize) * pagesize;
                     if (ret->unit_size % pagesize == 0) {
@@ -322,6 +533,13 @@ static qarray *qarray_create_internal(const size_t         count,
         default:
             ret->dist_specific.dist_shep = NO_SHEPHERD;
     }
+    if (hugepages != QA_HUGE_NONE) {
+        ret->base_ptr = qarray_internal_alloc_huge(segment_count * ret->segment_bytes);
+        if (ret->base_ptr != NULL) {
+            QA_MAPPING(ret) = QA_MAP_ANON;
+            goto body_allocated;
+        }
+    }
 #ifdef QTHREAD_HAVE_MEM_AFFINITY
     switch (d) {
         case ALL_LOCAL:
@@ -359,8 +577,16 @@ static qarray *qarray_create_internal(const size_t         count,
       /* For speed, we want page-aligned memory, if we can get it */
     ret->base_ptr = qthread_internal_aligned_alloc(segment_count * ret->segment_bytes, pagesize);
 #endif  /* ifdef QTHREAD_HAVE_MEM_AFFINITY */
+body_allocated:
     qassert_goto((ret->base_ptr != NULL), badret_exit);
 
+    /* Nothing has touched the body yet; unless that's pointless (or turned
+     * off), each segment's pages get faulted in by its own shepherd, once
+     * every segment has been assigned one. */
+    if (first_touch && (qthread_num_shepherds() > 1)) {
+        owners = MALLOC(segment_count * sizeof(qthread_shepherd_id_t));
+    }
+
     /********************************************
     * Assign locations, maintain segment_count *
     ********************************************/
@@ -412,11 +638,6 @@ static qarray *qarray_create_internal(const size_t         count,
                     assert(ret->dist_type == ALL_SAME);
                     target_shep = ret->dist_specific.dist_shep;
             }
-            if (ret->dist_type == DIST) {
-                char *seghead =
-                    qarray_elem_nomigrate(ret, segment * ret->segment_size);
-                qarray_internal_segment_shep_write(ret, seghead, target_shep);
-            }
             assert(target_shep < max_sheps);
             qthread_debug(QARRAY_DETAILS,
                           "qarray_create(): segment %i assigned to shep %i\n",
@@ -435,9 +656,20 @@ static qarray *qarray_create_internal(const size_t         count,
                 }
             }
 #endif      /* ifdef QTHREAD_HAVE_MEM_AFFINITY */
+            if (owners != NULL) {
+                owners[segment] = target_shep;
+            } else if (ret->dist_type == DIST) {
+                char *seghead =
+                    qarray_elem_nomigrate(ret, segment * ret->segment_size);
+                qarray_internal_segment_shep_write(ret, seghead, target_shep);
+            }
             qthread_incr(&chunk_distribution_tracker[target_shep], 1);
         }
     }
+    if (owners != NULL) {
+        qarray_internal_first_touch(ret, owners, segment_count);
+        FREE(owners, segment_count * sizeof(qthread_shepherd_id_t));
+    }
 #if defined(HAVE_MADVISE) && HAVE_DECL_MADV_ACCESS_LWP
     madvise(ret->base_ptr, segment_count * ret->segment_bytes, MADV_ACCESS_LWP);
 #endif
@@ -455,7 +687,7 @@ static qarray *qarray_create_internal(const size_t         count,
         if (ret->base_ptr) {
             free(ret->base_ptr);
         }
-        FREE(ret, sizeof(qarray));
+        FREE(ret, sizeof(qarray_private_t));
     }
     return NULL;
 }                                      /*}}} */
@@ -493,6 +725,90 @@ qarray *qarray_create_configured(const size_t         count,
     return qarray_create_internal(count, obj_size, d, tight, seg_pages);
 }                                      /*}}} */
 
+/* The file's contents become the array's elements, in order, so segments
+ * must be exactly a whole number of elements with no room for anything else;
+ * they are also a whole number of pages, so that each shepherd's share of the
+ * file is made of whole pages. The segments are distributed FIXED_FIELDS, so
+ * that each shepherd streams through one long stretch of the file. */
+qarray *qarray_create_mapped(const char  *path,
+                             const size_t unit_size,
+                             const int    flags)
+{                                      /*{{{ */
+#if defined(HAVE_MMAP) && defined(HAVE_MUNMAP)
+    struct stat st;
+    qarray     *ret;
+    size_t      segment_count, segment;
+    int         fd, saved_errno;
+
+    qassert_ret((path != NULL), NULL);
+    qassert_ret((unit_size > 0), NULL);
+    qassert_ret((qarray_internal_setup() == 0), NULL);
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0) {
+        saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+    if ((st.st_size < (off_t)unit_size) || (st.st_size % unit_size != 0)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    ret = calloc(1, sizeof(qarray_private_t));
+    if (ret == NULL) {
+        close(fd);
+        return NULL;
+    }
+    ret->count         = (size_t)st.st_size / unit_size;
+    ret->unit_size     = unit_size;
+    ret->segment_bytes = qt_lcm(unit_size, pagesize);
+    if (ret->segment_bytes < QA_MAPPED_SEGMENT_BYTES) {
+        ret->segment_bytes *= QT_CEIL_RATIO(QA_MAPPED_SEGMENT_BYTES, ret->segment_bytes);
+    }
+    ret->segment_size = ret->segment_bytes / unit_size;
+    ret->dist_type    = FIXED_FIELDS;
+    segment_count     = QT_CEIL_RATIO(ret->count, ret->segment_size);
+    ret->dist_specific.stripes.segs_per_shep = segment_count / qthread_num_shepherds();
+    if (ret->dist_specific.stripes.segs_per_shep == 0) {
+        ret->dist_specific.stripes.segs_per_shep = 1;
+    }
+    ret->dist_specific.stripes.extras = segment_count % qthread_num_shepherds();
+
+    if (flags & QARRAY_MAP_COW) {
+        ret->base_ptr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE, fd, 0);
+    } else {
+        ret->base_ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED,
+                             fd, 0);
+    }
+    saved_errno = errno;
+    close(fd);
+    if (ret->base_ptr == MAP_FAILED) {
+        FREE(ret, sizeof(qarray_private_t));
+        errno = saved_errno;
+        return NULL;
+    }
+    QA_MAPPING(ret) = QA_MAP_FILE;
+    for (segment = 0; segment < segment_count; segment++) {
+        qthread_incr(&chunk_distribution_tracker
+                     [qarray_internal_shepof_segidx(ret, segment)], 1);
+    }
+    qthread_debug(QARRAY_DETAILS,
+                  "qarray_create_mapped(): %i segments of %i bytes\n",
+                  (int)segment_count, (int)ret->segment_bytes);
+    return ret;
+
+#else
+    errno = ENOSYS;
+    return NULL;
+#endif /* if defined(HAVE_MMAP) && defined(HAVE_MUNMAP) */
+}                                      /*}}} */
+
 void qarray_destroy(qarray *a)
 {                                      /*{{{ */
     qassert_retvoid((a != NULL));
@@ -535,14 +851,27 @@ void qarray_destroy(qarray *a)
                                ((a->count % a->segment_size) ? 1 : 0)));
             break;
     }
+    if (QA_MAPPING(a) == QA_MAP_ANON) {
+#ifdef HAVE_MUNMAP
+        munmap(a->base_ptr,
+               qarray_internal_huge_len(a->segment_bytes *
+                                        (a->count / a->segment_size +
+                                         ((a->count % a->segment_size) ? 1 : 0))));
+#endif
+    } else if (QA_MAPPING(a) == QA_MAP_FILE) {
+#ifdef HAVE_MUNMAP
+        munmap(a->base_ptr, a->count * a->unit_size);
+#endif
+    } else {
 #ifdef QTHREAD_HAVE_MEM_AFFINITY
-    qt_affinity_free(a->base_ptr,
-                     a->segment_bytes * (a->count / a->segment_size +
-                                         ((a->count % a->segment_size) ? 1 : 0)));
+        qt_affinity_free(a->base_ptr,
+                         a->segment_bytes * (a->count / a->segment_size +
+                                             ((a->count % a->segment_size) ? 1 : 0)));
 #else
-    qthread_internal_aligned_free(a->base_ptr, pagesize);
+        qthread_internal_aligned_free(a->base_ptr, pagesize);
 #endif
-    FREE(a, sizeof(qarray));
+    }
+    FREE(a, sizeof(qarray_private_t));
 }                                      /*}}} */
 
 qthread_shepherd_id_t qarray_shepof(const qarray *a,
@@ -622,6 +951,34 @@ struct qarray_constfunc_wrapper_args {
     const size_t  startat, stopat;
 };
 
+/* for FIXED_FIELDS: clips [*count, *max_count), which must overlap shep's
+ * segments, to the part of it on shep */
+static void qarray_internal_fields_range(const qarray               *a,
+                                         const qthread_shepherd_id_t shep,
+                                         size_t                     *count,
+                                         size_t                     *max_count)
+{                                      /*{{{ */
+    const size_t segment_size  = a->segment_size;
+    const size_t extras        = a->dist_specific.stripes.extras;
+    const size_t segs_per_shep = a->dist_specific.stripes.segs_per_shep;
+    size_t       first, segs_on_this_shep = segs_per_shep;
+
+    /* this relies on sheps being zero-indexed */
+    if (shep < extras) {
+        first = shep * segment_size * (segs_per_shep + 1);
+        segs_on_this_shep++;
+    } else {
+        first = (extras * segment_size * (segs_per_shep + 1)) +
+                ((shep - extras) * segment_size * segs_per_shep);
+    }
+    if (*count < first) {
+        *count = first;
+    }
+    if (*max_count > first + (segment_size * segs_on_this_shep)) {
+        *max_count = first + (segment_size * segs_on_this_shep);
+    }
+}                                      /*}}} */
+
 static aligned_t qarray_strider(const struct qarray_func_wrapper_args *arg)
 {                                      /*{{{ */
     const size_t                segment_size = arg->a->segment_size;
@@ -739,6 +1096,109 @@ qarray_strider_exit:
     return 0;
 }                                      /*}}} */
 
+#if defined(HAVE_MADVISE) && defined(MADV_WILLNEED) && defined(MADV_SEQUENTIAL)
+# define QA_ADVISE
+/* gives the kernel advice about the pages holding elements [first, last) */
+static void qarray_internal_advise(const qarray *a,
+                                   const size_t  first,
+                                   const size_t  last,
+                                   const int     advice)
+{                                      /*{{{ */
+    char *start = a->base_ptr + (first * a->unit_size);
+    char *end   = a->base_ptr + (last * a->unit_size);
+
+    start = (char *)((uintptr_t)start & ~(uintptr_t)(pagesize - 1));
+    if (end > start) {
+        madvise(start, end - start, advice);
+    }
+}                                      /*}}} */
+
+#endif
+
+static QINLINE int qarray_internal_prefetching(const qarray *a)
+{                                      /*{{{ */
+    return (prefetch_distance > 0) &&
+           ((prefetch_mode == QA_PREFETCH_ALL) ||
+            ((prefetch_mode == QA_PREFETCH_MAPPED) && (QA_MAPPING(a) == QA_MAP_FILE)));
+}                                      /*}}} */
+
+/* Starts bringing in elements [first, last), which are about to come into the
+ * prefetch window, without waiting for them: a file-backed array asks the
+ * kernel to start reading them, and anything else prefetches the first few
+ * cache lines (the hardware prefetcher takes it from there). */
+static void qarray_internal_prefetch(const qarray *a,
+                                     const size_t  first,
+                                     size_t        last)
+{                                      /*{{{ */
+    if (last > a->count) {
+        last = a->count;
+    }
+    if (first >= last) {
+        return;
+    }
+    if (QA_MAPPING(a) == QA_MAP_FILE) {
+#ifdef QA_ADVISE
+        qarray_internal_advise(a, first, last, MADV_WILLNEED);
+#endif
+    } else {
+#ifdef __GNUC__
+        const char  *head  = qarray_elem_nomigrate(a, first);
+        const size_t bytes = (last - first) * a->unit_size;
+
+        for (size_t off = 0; off < bytes && off < QA_PREFETCH_BYTES;
+             off += CACHELINE_WIDTH) {
+            __builtin_prefetch(head + off);
+        }
+#endif
+    }
+}                                      /*}}} */
+
+/* For arrays whose range on this shepherd is contiguous: runs the loop over
+ * [count, max_count) a segment at a time, keeping a window of
+ * prefetch_depth segments, prefetch_distance segments ahead of the one being
+ * worked on, on its way in. */
+static void qarray_internal_prefetch_loop(qarray      *a,
+                                          size_t       count,
+                                          const size_t max_count,
+                                          qa_loop_f    ql,
+                                          void        *arg)
+{                                      /*{{{ */
+    const size_t segment_size = a->segment_size;
+    const size_t ahead        = prefetch_distance * segment_size;
+    const size_t depth        = prefetch_depth * segment_size;
+    size_t       seg_start    = count - (count % segment_size);
+
+#ifdef QA_ADVISE
+    if (QA_MAPPING(a) == QA_MAP_FILE) {
+        qarray_internal_advise(a, count, max_count, MADV_SEQUENTIAL);
+    }
+#endif
+    /* the window, but for the segment that comes in with the first step */
+    if (max_count - seg_start > ahead) {
+        qarray_internal_prefetch(a, seg_start + ahead,
+                                 (max_count - seg_start - ahead > depth - segment_size) ?
+                                 seg_start + ahead + depth - segment_size : max_count);
+    }
+    while (count < max_count) {
+        size_t stop = seg_start + segment_size;
+
+        if (stop > max_count) {
+            stop = max_count;
+        }
+        /* what comes into the window now */
+        if (max_count - seg_start > ahead + depth - segment_size) {
+            size_t next = seg_start + ahead + depth - segment_size;
+
+            qarray_internal_prefetch(a, next,
+                                     (max_count - next > segment_size) ?
+                                     next + segment_size : max_count);
+        }
+        ql(count, stop, a, arg);
+        count     = stop;
+        seg_start = stop;
+    }
+}                                      /*}}} */
+
 static aligned_t qarray_loop_strider(const struct qarray_func_wrapper_args *arg)
 {                                      /*{{{ */
     const size_t                segment_size = arg->a->segment_size;
@@ -764,23 +1224,7 @@ static aligned_t qarray_loop_strider(const struct qarray_func_wrapper_args *arg)
             if ((shep < start_shep) || (shep > stop_shep)) {
                 goto qarray_loop_strider_exit;
             }
-            if (shep != start_shep) {
-                /* count isn't *my* starting point, but I am within the
-                 * range of interest, so find my starting point. */
-                /* this relies on sheps being zero-indexed */
-                count =
-                    shep * segment_size *
-                    arg->a->dist_specific.stripes.segs_per_shep;
-            }
-            {
-                size_t last_count_on_my_shep =
-                    ((shep +
-                      1) * segment_size *
-                     arg->a->dist_specific.stripes.segs_per_shep) - 1;
-                if (max_count > last_count_on_my_shep) {
-                    max_count = last_count_on_my_shep;
-                }
-            }
+            qarray_internal_fields_range(arg->a, shep, &count, &max_count);
             break;
         }
         default:
@@ -808,12 +1252,34 @@ static aligned_t qarray_loop_strider(const struct qarray_func_wrapper_args *arg)
          * loop function directly */
         case ALL_SAME:
         case FIXED_FIELDS:
-            ql(count, max_count, arg->a, arg->arg);
+            if (qarray_internal_prefetching(arg->a)) {
+                qarray_internal_prefetch_loop(arg->a, count, max_count, ql,
+                                              arg->arg);
+            } else {
+                ql(count, max_count, arg->a, arg->arg);
+            }
             goto qarray_loop_strider_exit;
         default:                       /* aka NOT the special case */
             break;
     }
+    if ((dist_type == FIXED_HASH) && qarray_internal_prefetching(arg->a)) {
+        /* this shepherd's segments are a stride apart */
+        const size_t stride = segment_size * qthread_num_shepherds();
+
+        for (size_t k = prefetch_distance; k + 1 < prefetch_distance + prefetch_depth; k++) {
+            qarray_internal_prefetch(arg->a, count + k * stride,
+                                     count + k * stride + segment_size);
+        }
+    }
     while (1) {
+        if ((dist_type == FIXED_HASH) && qarray_internal_prefetching(arg->a)) {
+            const size_t next = count + (prefetch_distance + prefetch_depth - 1) *
+                                segment_size * qthread_num_shepherds();
+
+            if (next < max_count) {
+                qarray_internal_prefetch(arg->a, next, next + segment_size);
+            }
+        }
         {
             const size_t max_offset =
                 ((max_count - count) >
@@ -876,23 +1342,7 @@ static aligned_t qarray_loopaccum_strider(const struct qarray_accumfunc_wrapper_
             if ((shep < start_shep) || (shep > stop_shep)) {
                 goto qarray_loop_strider_exit;
             }
-            if (shep != start_shep) {
-                /* count isn't *my* starting point, but I am within the
-                 * range of interest, so find my starting point. */
-                /* this relies on sheps being zero-indexed */
-                count =
-                    shep * segment_size *
-                    arg->a->dist_specific.stripes.segs_per_shep;
-            }
-            {
-                size_t last_count_on_my_shep =
-                    ((shep +
-                      1) * segment_size *
-                     arg->a->dist_specific.stripes.segs_per_shep) - 1;
-                if (max_count > last_count_on_my_shep) {
-                    max_count = last_count_on_my_shep;
-                }
-            }
+            qarray_internal_fields_range(arg->a, shep, &count, &max_count);
             break;
         }
         default:
@@ -1388,13 +1838,13 @@ void qarray_set_shepof(qarray               *a,
                 unsigned int target_node =
                     qthread_internal_shep_to_node(shep);
                 if (target_node != QTHREAD_NO_NODE) {
-                    size_t num_segments = a->count / a->segment_size;
-                    size_t array_size   = a->segment_bytes * num_segments;
-                    qt_affinity_mem_tonode(a->base_ptr, array_size, target_node);
+                    qt_affinity_mem_migrate(a->base_ptr,
+                                            a->segment_bytes * segment_count,
+                                            target_node);
                 }
 #elif defined(HAVE_MADVISE) && HAVE_DECL_MADV_ACCESS_LWP
                 madvise(a->base_ptr,
-                        (a->count / a->segment_size) * a->segment_bytes, MADV_ACCESS_LWP);
+                        segment_count * a->segment_bytes, MADV_ACCESS_LWP);
 #endif      /* ifdef QTHREAD_HAVE_MEM_AFFINITY */
                 qthread_incr(&chunk_distribution_tracker[shep],
                              segment_count);
@@ -1418,9 +1868,9 @@ void qarray_set_shepof(qarray               *a,
                 unsigned int target_node =
                     qthread_internal_shep_to_node(shep);
                 if (target_node != QTHREAD_NO_NODE) {
-                    qt_affinity_mem_tonode(a->base_ptr +
-                                           (a->segment_bytes * segment),
-                                           a->segment_bytes, target_node);
+                    qt_affinity_mem_migrate(a->base_ptr +
+                                            (a->segment_bytes * segment),
+                                            a->segment_bytes, target_node);
                 }
 #elif defined(HAVE_MADVISE) && HAVE_DECL_MADV_ACCESS_LWP
                 madvise(a->base_ptr + (a->segment_bytes * (i / a->segment_size)),
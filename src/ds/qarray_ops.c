@@ -0,0 +1,628 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* Public Headers */
+#include "qthread/qthread.h"
+#include "qthread/qarray.h"
+
+/* Local Headers */
+#include "qt_asserts.h"
+#include "qt_debug.h"
+
+/*
+ * Whole-array sort, scan, and reduce. Everything that can be done a segment
+ * at a time (sorting, totalling, and scanning a segment) is done by a task on
+ * the shepherd that owns the segment; only the sort's merge phase, and the
+ * copy back out of it, move elements between segments.
+ */
+
+#define QA_SEGS(a)       (((a)->count + (a)->segment_size - 1) / (a)->segment_size)
+#define QA_SEGHEAD(a, s) ((a)->base_ptr + ((s) * (a)->segment_bytes))
+#define QA_SEGLEN(a, s)  ((((s) + 1) * (a)->segment_size > (a)->count) ? \
+                          ((a)->count - (s) * (a)->segment_size) :        \
+                          (a)->segment_size)
+
+#define QA_INSERTION_SORT  16 /* runs this short are insertion-sorted */
+#define QA_BUCKETS_PER_WKR 4
+
+typedef void (*qa_seg_f)(qarray *a,
+                         size_t  seg,
+                         void   *arg);
+
+struct qa_seg_args {
+    qarray               *a;
+    qa_seg_f              func;
+    void                 *arg;
+    qthread_shepherd_id_t shep;
+    qthread_worker_id_t   worker, nworkers;
+};
+
+static aligned_t qa_seg_worker(void *arg_)
+{                                      /*{{{ */
+    const struct qa_seg_args *arg   = (const struct qa_seg_args *)arg_;
+    const size_t              nsegs = QA_SEGS(arg->a);
+    size_t                    mine  = 0;
+
+    for (size_t seg = 0; seg < nsegs; seg++) {
+        if (qarray_shepof(arg->a, seg * arg->a->segment_size) != arg->shep) {
+            continue;
+        }
+        if (mine++ % arg->nworkers == arg->worker) {
+            arg->func(arg->a, seg, arg->arg);
+        }
+    }
+    return 0;
+}                                      /*}}} */
+
+/* calls func(a, seg, arg) for every segment of a, on the shepherd that owns
+ * that segment (spread across that shepherd's workers), and waits for them */
+static void qa_foreach_segment(qarray  *a,
+                               qa_seg_f func,
+                               void    *arg)
+{                                      /*{{{ */
+    const qthread_shepherd_id_t nsheps     = qthread_num_shepherds();
+    size_t                      max_spawns = 0;
+    size_t                      num_spawns = 0;
+    struct qa_seg_args         *args;
+    aligned_t                  *rets;
+
+    for (qthread_shepherd_id_t s = 0; s < nsheps; s++) {
+        max_spawns += qthread_num_workers_local(s);
+    }
+    args = MALLOC(max_spawns * sizeof(struct qa_seg_args));
+    rets = MALLOC(max_spawns * sizeof(aligned_t));
+    assert(args && rets);
+    for (qthread_shepherd_id_t s = 0; s < nsheps; s++) {
+        const qthread_worker_id_t nworkers = qthread_num_workers_local(s);
+
+        if ((a->dist_type == ALL_SAME) && (s != a->dist_specific.dist_shep)) {
+            continue;
+        }
+        for (qthread_worker_id_t w = 0; w < nworkers; w++) {
+            struct qa_seg_args *sa = &args[num_spawns];
+
+            sa->a        = a;
+            sa->func     = func;
+            sa->arg      = arg;
+            sa->shep     = s;
+            sa->worker   = w;
+            sa->nworkers = nworkers;
+            qthread_fork_to(qa_seg_worker, sa, &rets[num_spawns], s);
+            num_spawns++;
+        }
+    }
+    for (size_t i = 0; i < num_spawns; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    FREE(rets, max_spawns * sizeof(aligned_t));
+    FREE(args, max_spawns * sizeof(struct qa_seg_args));
+}                                      /*}}} */
+
+/* Copies elements around. This is used instead of memcpy() because elements
+ * are usually small, and because the tasks it runs in have small stacks: with
+ * lazy binding, the first call to memcpy() from this library goes through the
+ * dynamic linker's resolver, which saves the vector registers on the stack,
+ * and that is enough to overflow one. */
+static QINLINE void qa_copy(void       *dst,
+                            const void *src,
+                            size_t      bytes)
+{                                      /*{{{ */
+    if ((((uintptr_t)dst | (uintptr_t)src | bytes) & (sizeof(aligned_t) - 1)) == 0) {
+        aligned_t       *d = (aligned_t *)dst;
+        const aligned_t *s = (const aligned_t *)src;
+
+        for (size_t i = 0; i < bytes / sizeof(aligned_t); i++) {
+            d[i] = s[i];
+        }
+    } else {
+        char       *d = (char *)dst;
+        const char *s = (const char *)src;
+
+        for (size_t i = 0; i < bytes; i++) {
+            d[i] = s[i];
+        }
+    }
+}                                      /*}}} */
+
+/*************
+ * Sorting   *
+ *************/
+
+typedef struct {
+    qa_cmp_f cmp;
+    qa_key_f key;
+    size_t   width;
+} qa_order_t;
+
+static QINLINE int qa_compare(const qa_order_t *o,
+                              const void       *x,
+                              const void       *y)
+{                                      /*{{{ */
+    if (o->key != NULL) {
+        const uint64_t kx = o->key(x);
+        const uint64_t ky = o->key(y);
+
+        if (kx != ky) {
+            return (kx < ky) ? -1 : 1;
+        }
+        if (o->cmp == NULL) {
+            return 0;
+        }
+    }
+    return o->cmp(x, y);
+}                                      /*}}} */
+
+/* stable merge sort of the n elements at base; tmp must hold n/2 elements
+ * (and at least one) */
+static void qa_msort(char             *base,
+                     const size_t      n,
+                     char             *tmp,
+                     const qa_order_t *o)
+{                                      /*{{{ */
+    const size_t w = o->width;
+
+    if (n <= QA_INSERTION_SORT) {
+        for (size_t i = 1; i < n; i++) {
+            size_t j = i;
+
+            while (j > 0 && qa_compare(o, base + (j - 1) * w, base + i * w) > 0) {
+                j--;
+            }
+            if (j != i) {
+                qa_copy(tmp, base + i * w, w);
+                for (size_t k = i; k > j; k--) {
+                    qa_copy(base + k * w, base + (k - 1) * w, w);
+                }
+                qa_copy(base + j * w, tmp, w);
+            }
+        }
+    } else {
+        const size_t h = n / 2;
+        char        *left, *right, *out;
+
+        qa_msort(base, h, tmp, o);
+        qa_msort(base + h * w, n - h, tmp, o);
+        if (qa_compare(o, base + (h - 1) * w, base + h * w) <= 0) {
+            return;                    /* already in order */
+        }
+        /* merge the left half (moved out to tmp) with the right half (in
+         * place); the output never overtakes the right half's cursor */
+        qa_copy(tmp, base, h * w);
+        left  = tmp;
+        right = base + h * w;
+        out   = base;
+        while (left < tmp + h * w && right < base + n * w) {
+            if (qa_compare(o, right, left) < 0) {
+                qa_copy(out, right, w);
+                right += w;
+            } else {
+                qa_copy(out, left, w);
+                left += w;
+            }
+            out += w;
+        }
+        qa_copy(out, left, (tmp + h * w) - left);
+    }
+}                                      /*}}} */
+
+/* the first of the n elements at base that orders after key */
+static size_t qa_upper_bound(const char       *base,
+                             size_t            lo,
+                             size_t            hi,
+                             const void       *key,
+                             const qa_order_t *o)
+{                                      /*{{{ */
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+
+        if (qa_compare(o, base + mid * o->width, key) > 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}                                      /*}}} */
+
+/* A sample sort: each segment is sorted locally, and contributes evenly-spaced
+ * samples from which the bucket splitters are chosen. Every bucket then
+ * merges its piece of each segment into a scratch copy of the array (at the
+ * bucket's final position), and each segment is copied back from there. */
+typedef struct {
+    qa_order_t order;
+    size_t     nsegs;
+    size_t     nbuckets;
+    char      *samples;                /* nsegs x (nbuckets - 1) elements */
+    char      *splitters;              /* nbuckets - 1 elements */
+    size_t    *bounds;                 /* nsegs x (nbuckets + 1) */
+    size_t    *bstart;                 /* nbuckets + 1 */
+    char      *scratch;                /* count elements */
+} qa_sort_t;
+
+#define QA_BOUND(s, seg, b) ((s)->bounds[(seg) * ((s)->nbuckets + 1) + (b)])
+
+static void qa_sort_segment(qarray *a,
+                            size_t  seg,
+                            void   *arg)
+{                                      /*{{{ */
+    qa_sort_t   *s    = (qa_sort_t *)arg;
+    const size_t w    = a->unit_size;
+    const size_t len  = QA_SEGLEN(a, seg);
+    const size_t tmpn = (len / 2) + 1;
+    char        *head = QA_SEGHEAD(a, seg);
+    char        *tmp  = MALLOC(tmpn * w);
+
+    assert(tmp);
+    qa_msort(head, len, tmp, &s->order);
+    FREE(tmp, tmpn * w);
+    if (s->samples != NULL) {
+        char *samples = s->samples + seg * (s->nbuckets - 1) * w;
+
+        for (size_t k = 1; k < s->nbuckets; k++) {
+            qa_copy(samples + (k - 1) * w, head + (k * len / s->nbuckets) * w, w);
+        }
+    }
+}                                      /*}}} */
+
+static void qa_sort_partition(qarray *a,
+                              size_t  seg,
+                              void   *arg)
+{                                      /*{{{ */
+    qa_sort_t   *s    = (qa_sort_t *)arg;
+    const size_t len  = QA_SEGLEN(a, seg);
+    const char  *head = QA_SEGHEAD(a, seg);
+
+    QA_BOUND(s, seg, 0) = 0;
+    for (size_t b = 1; b < s->nbuckets; b++) {
+        QA_BOUND(s, seg, b) =
+            qa_upper_bound(head, QA_BOUND(s, seg, b - 1), len,
+                           s->splitters + (b - 1) * a->unit_size, &s->order);
+    }
+    QA_BOUND(s, seg, s->nbuckets) = len;
+}                                      /*}}} */
+
+struct qa_merge_args {
+    qarray    *a;
+    qa_sort_t *s;
+    size_t     bucket;
+};
+
+/* is the head of run x ahead of the head of run y? (ties go to the earlier
+ * segment, which keeps the merge deterministic) */
+static QINLINE int qa_run_before(const qarray    *a,
+                                 const qa_sort_t *s,
+                                 const size_t    *pos,
+                                 size_t           x,
+                                 size_t           y)
+{                                      /*{{{ */
+    const int c = qa_compare(&s->order, QA_SEGHEAD(a, x) + pos[x] * a->unit_size,
+                             QA_SEGHEAD(a, y) + pos[y] * a->unit_size);
+
+    return (c < 0) || ((c == 0) && (x < y));
+}                                      /*}}} */
+
+static void qa_heap_down(const qarray    *a,
+                         const qa_sort_t *s,
+                         const size_t    *pos,
+                         size_t          *heap,
+                         size_t           n,
+                         size_t           i)
+{                                      /*{{{ */
+    while (2 * i + 1 < n) {
+        size_t c = 2 * i + 1;
+
+        if ((c + 1 < n) && qa_run_before(a, s, pos, heap[c + 1], heap[c])) {
+            c++;
+        }
+        if (!qa_run_before(a, s, pos, heap[c], heap[i])) {
+            break;
+        }
+        {
+            size_t t = heap[c];
+
+            heap[c] = heap[i];
+            heap[i] = t;
+        }
+        i = c;
+    }
+}                                      /*}}} */
+
+static aligned_t qa_sort_merge(void *arg_)
+{                                      /*{{{ */
+    const struct qa_merge_args *arg   = (const struct qa_merge_args *)arg_;
+    qarray                     *a     = arg->a;
+    qa_sort_t                  *s     = arg->s;
+    const size_t                b     = arg->bucket;
+    const size_t                w     = a->unit_size;
+    size_t                     *pos   = MALLOC(s->nsegs * sizeof(size_t));
+    size_t                     *heap  = MALLOC(s->nsegs * sizeof(size_t));
+    char                       *out   = s->scratch + s->bstart[b] * w;
+    size_t                      nruns = 0;
+
+    assert(pos && heap);
+    for (size_t seg = 0; seg < s->nsegs; seg++) {
+        pos[seg] = QA_BOUND(s, seg, b);
+        if (pos[seg] < QA_BOUND(s, seg, b + 1)) {
+            heap[nruns++] = seg;
+        }
+    }
+    for (size_t i = nruns / 2; i > 0; i--) {
+        qa_heap_down(a, s, pos, heap, nruns, i - 1);
+    }
+    while (nruns > 0) {
+        const size_t seg = heap[0];
+
+        qa_copy(out, QA_SEGHEAD(a, seg) + pos[seg] * w, w);
+        out += w;
+        if (++pos[seg] == QA_BOUND(s, seg, b + 1)) {
+            heap[0] = heap[--nruns];
+        }
+        qa_heap_down(a, s, pos, heap, nruns, 0);
+    }
+    assert(out == s->scratch + s->bstart[b + 1] * w);
+    FREE(heap, s->nsegs * sizeof(size_t));
+    FREE(pos, s->nsegs * sizeof(size_t));
+    return 0;
+}                                      /*}}} */
+
+static void qa_sort_copyback(qarray *a,
+                             size_t  seg,
+                             void   *arg)
+{                                      /*{{{ */
+    qa_sort_t *s = (qa_sort_t *)arg;
+
+    qa_copy(QA_SEGHEAD(a, seg),
+            s->scratch + seg * a->segment_size * a->unit_size,
+            QA_SEGLEN(a, seg) * a->unit_size);
+}                                      /*}}} */
+
+void qarray_sort(qarray  *a,
+                 qa_cmp_f cmp,
+                 qa_key_f key)
+{                                      /*{{{ */
+    qa_sort_t             s;
+    size_t                w, nsamples;
+    char                 *tmp;
+    aligned_t            *rets;
+    struct qa_merge_args *margs;
+
+    qassert_retvoid((a != NULL));
+    qassert_retvoid((cmp != NULL || key != NULL));
+    w             = a->unit_size;
+    s.order.cmp   = cmp;
+    s.order.key   = key;
+    s.order.width = w;
+    s.nsegs       = QA_SEGS(a);
+    s.samples     = NULL;
+    if (s.nsegs == 1) {
+        s.nbuckets = 1;
+        qa_foreach_segment(a, qa_sort_segment, &s);
+        return;
+    }
+    s.nbuckets = QA_BUCKETS_PER_WKR * qthread_num_workers();
+    if (s.nbuckets > s.nsegs) {
+        s.nbuckets = s.nsegs;
+    }
+    nsamples  = s.nsegs * (s.nbuckets - 1);
+    s.samples = MALLOC(nsamples * w);
+    assert(s.samples);
+
+    /* 1: sort each segment where it lives, and sample it */
+    qa_foreach_segment(a, qa_sort_segment, &s);
+
+    /* 2: pick the splitters */
+    tmp = MALLOC((nsamples / 2 + 1) * w);
+    assert(tmp);
+    qa_msort(s.samples, nsamples, tmp, &s.order);
+    FREE(tmp, (nsamples / 2 + 1) * w);
+    s.splitters = MALLOC((s.nbuckets - 1) * w);
+    assert(s.splitters);
+    for (size_t b = 0; b < s.nbuckets - 1; b++) {
+        qa_copy(s.splitters + b * w,
+                s.samples + ((b + 1) * nsamples / s.nbuckets) * w, w);
+    }
+    FREE(s.samples, nsamples * w);
+
+    /* 3: split each segment into buckets, and find where each bucket goes */
+    s.bounds = MALLOC(s.nsegs * (s.nbuckets + 1) * sizeof(size_t));
+    s.bstart = MALLOC((s.nbuckets + 1) * sizeof(size_t));
+    assert(s.bounds && s.bstart);
+    qa_foreach_segment(a, qa_sort_partition, &s);
+    s.bstart[0] = 0;
+    for (size_t b = 0; b < s.nbuckets; b++) {
+        s.bstart[b + 1] = s.bstart[b];
+        for (size_t seg = 0; seg < s.nsegs; seg++) {
+            s.bstart[b + 1] += QA_BOUND(&s, seg, b + 1) - QA_BOUND(&s, seg, b);
+        }
+    }
+    assert(s.bstart[s.nbuckets] == a->count);
+
+    /* 4: merge each bucket, near where most of it will end up */
+    s.scratch = MALLOC(a->count * w);
+    rets      = MALLOC(s.nbuckets * sizeof(aligned_t));
+    margs     = MALLOC(s.nbuckets * sizeof(struct qa_merge_args));
+    assert(s.scratch && rets && margs);
+    for (size_t b = 0; b < s.nbuckets; b++) {
+        margs[b].a      = a;
+        margs[b].s      = &s;
+        margs[b].bucket = b;
+        if (s.bstart[b] < s.bstart[b + 1]) {
+            const size_t mid = (s.bstart[b] + s.bstart[b + 1]) / 2;
+
+            qthread_fork_to(qa_sort_merge, &margs[b], &rets[b],
+                            qarray_shepof(a, mid));
+        }
+    }
+    for (size_t b = 0; b < s.nbuckets; b++) {
+        if (s.bstart[b] < s.bstart[b + 1]) {
+            qthread_readFF(NULL, &rets[b]);
+        }
+    }
+    FREE(margs, s.nbuckets * sizeof(struct qa_merge_args));
+    FREE(rets, s.nbuckets * sizeof(aligned_t));
+
+    /* 5: copy each segment back from the scratch copy */
+    qa_foreach_segment(a, qa_sort_copyback, &s);
+
+    FREE(s.scratch, a->count * w);
+    FREE(s.bstart, (s.nbuckets + 1) * sizeof(size_t));
+    FREE(s.bounds, s.nsegs * (s.nbuckets + 1) * sizeof(size_t));
+    FREE(s.splitters, (s.nbuckets - 1) * w);
+}                                      /*}}} */
+
+/***********************
+ * Scans and reduction *
+ ***********************/
+
+/* A scan is done in three passes: each segment is totalled where it lives,
+ * the totals are scanned serially (in segment order, so op need only be
+ * associative), and then each segment is scanned where it lives, starting
+ * from the total of all the segments before it. */
+typedef struct {
+    qt_accum_f op;
+    char      *totals;                 /* nsegs elements */
+    char      *carries;                /* nsegs elements; carries[0] is the
+                                        * identity (exclusive scans only) */
+    int        inclusive;
+    int        need_last;              /* does the last segment need a total? */
+} qa_scan_t;
+
+static void qa_segment_total(qarray *a,
+                             size_t  seg,
+                             void   *arg)
+{                                      /*{{{ */
+    qa_scan_t   *s    = (qa_scan_t *)arg;
+    const size_t w    = a->unit_size;
+    const size_t len  = QA_SEGLEN(a, seg);
+    const char  *head = QA_SEGHEAD(a, seg);
+    char        *tot  = s->totals + seg * w;
+
+    if (!s->need_last && (seg + 1 == QA_SEGS(a))) {
+        return;
+    }
+    qa_copy(tot, head, w);
+    for (size_t i = 1; i < len; i++) {
+        s->op(tot, head + i * w);
+    }
+}                                      /*}}} */
+
+static void qa_segment_scan(qarray *a,
+                            size_t  seg,
+                            void   *arg)
+{                                      /*{{{ */
+    qa_scan_t   *s       = (qa_scan_t *)arg;
+    const size_t w       = a->unit_size;
+    const size_t len     = QA_SEGLEN(a, seg);
+    char        *head    = QA_SEGHEAD(a, seg);
+    char        *running = MALLOC(2 * w);
+    char        *tmp     = running + w;
+
+    assert(running);
+    if (s->inclusive) {
+        size_t i = 0;
+
+        if (seg == 0) {
+            qa_copy(running, head, w);
+            i = 1;
+        } else {
+            qa_copy(running, s->carries + seg * w, w);
+        }
+        for (; i < len; i++) {
+            s->op(running, head + i * w);
+            qa_copy(head + i * w, running, w);
+        }
+    } else {
+        qa_copy(running, s->carries + seg * w, w);
+        for (size_t i = 0; i < len; i++) {
+            qa_copy(tmp, head + i * w, w);
+            qa_copy(head + i * w, running, w);
+            s->op(running, tmp);
+        }
+    }
+    FREE(running, 2 * w);
+}                                      /*}}} */
+
+static void qa_scan(qarray     *a,
+                    qt_accum_f  op,
+                    const void *identity)
+{                                      /*{{{ */
+    const size_t nsegs = QA_SEGS(a);
+    const size_t w     = a->unit_size;
+    qa_scan_t    s;
+
+    s.op        = op;
+    s.inclusive = (identity == NULL);
+    s.need_last = 0;
+    s.totals    = MALLOC(nsegs * w);
+    s.carries   = MALLOC(nsegs * w);
+    assert(s.totals && s.carries);
+
+    if (nsegs > 1) {
+        qa_foreach_segment(a, qa_segment_total, &s);
+    }
+    if (s.inclusive) {
+        if (nsegs > 1) {
+            qa_copy(s.carries + w, s.totals, w);
+        }
+        for (size_t seg = 2; seg < nsegs; seg++) {
+            qa_copy(s.carries + seg * w, s.carries + (seg - 1) * w, w);
+            op(s.carries + seg * w, s.totals + (seg - 1) * w);
+        }
+    } else {
+        qa_copy(s.carries, identity, w);
+        for (size_t seg = 1; seg < nsegs; seg++) {
+            qa_copy(s.carries + seg * w, s.carries + (seg - 1) * w, w);
+            op(s.carries + seg * w, s.totals + (seg - 1) * w);
+        }
+    }
+    qa_foreach_segment(a, qa_segment_scan, &s);
+
+    FREE(s.carries, nsegs * w);
+    FREE(s.totals, nsegs * w);
+}                                      /*}}} */
+
+void qarray_inclusive_scan(qarray    *a,
+                           qt_accum_f op)
+{                                      /*{{{ */
+    qassert_retvoid((a != NULL));
+    qassert_retvoid((op != NULL));
+    qa_scan(a, op, NULL);
+}                                      /*}}} */
+
+void qarray_exclusive_scan(qarray     *a,
+                           qt_accum_f  op,
+                           const void *identity)
+{                                      /*{{{ */
+    qassert_retvoid((a != NULL));
+    qassert_retvoid((op != NULL));
+    qassert_retvoid((identity != NULL));
+    qa_scan(a, op, identity);
+}                                      /*}}} */
+
+void qarray_reduce(const qarray *a,
+                   qt_accum_f    op,
+                   void         *ret)
+{                                      /*{{{ */
+    size_t    nsegs, w;
+    qa_scan_t s;
+
+    qassert_retvoid((a != NULL));
+    qassert_retvoid((op != NULL));
+    qassert_retvoid((ret != NULL));
+    nsegs       = QA_SEGS(a);
+    w           = a->unit_size;
+    s.op        = op;
+    s.need_last = 1;
+    s.totals    = MALLOC(nsegs * w);
+    assert(s.totals);
+    /* segments are only read */
+    qa_foreach_segment((qarray *)a, qa_segment_total, &s);
+    qa_copy(ret, s.totals, w);
+    for (size_t seg = 1; seg < nsegs; seg++) {
+        op(ret, s.totals + seg * w);
+    }
+    FREE(s.totals, nsegs * w);
+}                                      /*}}} */
+
+/* vim:set expandtab: */
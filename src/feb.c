@@ -6,6 +6,7 @@
 #include "qthread/qthread.h"
 
 /* System Headers */
+#include <stddef.h> /* for offsetof() */
 
 /* Qthread Headers */
 #include <qthread/hash.h>
@@ -30,6 +31,10 @@
 #include "qt_eurekas.h" // for qthread_internal_assassinate() (used in taskfilter)
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_output_macros.h"
+#include "qt_timer_wheel.h"
+#include "qt_trace.h"
+#include "qt_latency.h"
+#include "qt_contention.h"
 
 /********************************************************************
  * Local Variables
@@ -64,8 +69,18 @@ typedef struct {
     void           *b;
     blocker_type    type;
     int             retval;
+    uint64_t        deadline;
 } qthread_feb_blocker_t;
 
+/* a timed FEB wait's timer, and where to find its waiter when it expires */
+typedef struct {
+    qt_timer_t         timer; /* must be first */
+    void              *maddr;
+    int                lockbin;
+    size_t             queue; /* the offset of the waiter's queue in m */
+    qthread_addrres_t *X;
+} qthread_feb_timeout_t;
+
 /********************************************************************
  * Local Prototypes
  *********************************************************************/
@@ -85,6 +100,15 @@ static QINLINE void qthread_gotlock_empty_inner(qthread_shepherd_t *shep,
                                                 void               *maddr,
                                                 const uint_fast8_t  recursive,
                                                 qthread_addrres_t **precond_tasks);
+static QINLINE int qthread_readFF_internal(aligned_t *restrict       dest,
+                                           const aligned_t *restrict src,
+                                           const uint64_t            deadline);
+static QINLINE int qthread_readFE_internal(aligned_t *restrict       dest,
+                                           const aligned_t *restrict src,
+                                           const uint64_t            deadline);
+static QINLINE int qthread_writeEF_internal(aligned_t *restrict       dest,
+                                            const aligned_t *restrict src,
+                                            const uint64_t            deadline);
 
 /********************************************************************
  * Shared Globals
@@ -169,10 +193,24 @@ void INTERNAL qt_feb_subsystem_init(uint_fast8_t need_sync)
     qthread_internal_cleanup_late(qt_feb_subsystem_shutdown);
 }
 
+/* addresses that have (or recently had) FEB state, for the live statistics
+ * page; the stripes are counted one after another, not all at once */
+size_t INTERNAL qt_feb_subsystem_entries(void)
+{
+    size_t n = 0;
+
+    for (unsigned i = 0; i < QTHREAD_LOCKING_STRIPES; i++) {
+        n += qt_hash_count(FEBs[i]);
+    }
+    return n;
+}
+
 static inline void qt_feb_schedule(qthread_t          *waiter,
                                    qthread_shepherd_t *shep)
 {
     qthread_debug(FEB_DETAILS, "waiter(%p:%i), shep(%p:%i): setting waiter to 'RUNNING'\n", waiter, (int)waiter->thread_id, shep, (int)shep->shepherd_id);
+    QTHREAD_TRACE_HERE(QT_TRACE_WAKE, waiter, 0, 0);
+    QTHREAD_LATENCY_READY(waiter, QT_LATENCY_FEB);
     waiter->thread_state = QTHREAD_STATE_RUNNING;
     if ((waiter->flags & QTHREAD_UNSTEALABLE) && (waiter->rdata->shepherd_ptr != shep)) {
         qthread_debug(FEB_DETAILS, "waiter(%p:%i), shep(%p:%i): enqueueing waiter in target_shep's ready queue (%p:%i)\n", waiter, (int)waiter->thread_id, shep, (int)shep->shepherd_id, waiter->rdata->shepherd_ptr, waiter->rdata->shepherd_ptr->shepherd_id);
@@ -195,13 +233,13 @@ static aligned_t qthread_feb_blocker_thread(void *arg)
 
     switch (a->type) {
         case READFE:
-            a->retval = qthread_readFE(a->a, a->b);
+            a->retval = qthread_readFE_internal(a->a, a->b, a->deadline);
             break;
         case READFE_NB:
             a->retval = qthread_readFE_nb(a->a, a->b);
             break;
         case READFF:
-            a->retval = qthread_readFF(a->a, a->b);
+            a->retval = qthread_readFF_internal(a->a, a->b, a->deadline);
             break;
         case READFF_NB:
             a->retval = qthread_readFF_nb(a->a, a->b);
@@ -210,7 +248,7 @@ static aligned_t qthread_feb_blocker_thread(void *arg)
             a->retval = qthread_purge_to(a->a, a->b);
             break;
         case WRITEEF:
-            a->retval = qthread_writeEF(a->a, a->b);
+            a->retval = qthread_writeEF_internal(a->a, a->b, a->deadline);
             break;
         case WRITEEF_NB:
             a->retval = qthread_writeEF_nb(a->a, a->b);
@@ -232,11 +270,12 @@ static aligned_t qthread_feb_blocker_thread(void *arg)
     return 0;
 }                                      /*}}} */
 
-static int qthread_feb_blocker_func(void        *dest,
-                                    void        *src,
-                                    blocker_type t)
+static int qthread_feb_blocker_func_until(void          *dest,
+                                          void          *src,
+                                          blocker_type   t,
+                                          const uint64_t deadline)
 {   /*{{{*/
-    qthread_feb_blocker_t args = { PTHREAD_MUTEX_INITIALIZER, dest, src, t, QTHREAD_SUCCESS };
+    qthread_feb_blocker_t args = { PTHREAD_MUTEX_INITIALIZER, dest, src, t, QTHREAD_SUCCESS, deadline };
 
     pthread_mutex_lock(&args.lock);
     qthread_fork(qthread_feb_blocker_thread, &args, NULL);
@@ -246,6 +285,13 @@ static int qthread_feb_blocker_func(void        *dest,
     return args.retval;
 } /*}}}*/
 
+static int qthread_feb_blocker_func(void        *dest,
+                                    void        *src,
+                                    blocker_type t)
+{   /*{{{*/
+    return qthread_feb_blocker_func_until(dest, src, t, 0);
+} /*}}}*/
+
 #define QTHREAD_CHOOSE_STRIPE2(addr) (qt_hash64((uint64_t)(uintptr_t)addr) & (QTHREAD_LOCKING_STRIPES - 1))
 // #define QTHREAD_CHOOSE_STRIPE2(addr) QTHREAD_CHOOSE_STRIPE(addr)
 /* The lock ordering in these functions is very particular, and is designed to
@@ -374,6 +420,96 @@ got_m:
     }
 }                      /*}}} */
 
+/* Timed waits. The waiter arms a timer while it still holds m's lock, so the
+ * timer's callback, which needs that lock to take the waiter off m's queue,
+ * cannot get to it until the waiter has switched out. Whoever takes the waiter
+ * off the queue first - the callback, or an FEB operation on the address -
+ * is the one who wakes it. */
+static int qthread_feb_timeout_expire(qt_timer_t *t)
+{                      /*{{{ */
+    qthread_feb_timeout_t *const to     = (qthread_feb_timeout_t *)t;
+    qthread_t *const             waiter = t->waiter;
+    qthread_addrstat_t          *m;
+    qthread_addrres_t          **pp;
+    int                          removeable;
+
+#ifdef LOCK_FREE_FEBS
+    do {
+        m = qt_hash_get(FEBs[to->lockbin], to->maddr);
+        if (!m) { break; }
+        hazardous_ptr(0, m);
+        if (m != qt_hash_get(FEBs[to->lockbin], to->maddr)) { continue; }
+        if (!m->valid) { continue; }
+        QTHREAD_FASTLOCK_LOCK(&m->lock);
+        if (!m->valid) {
+            QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+            continue;
+        }
+        break;
+    } while(1);
+#else /* ifdef LOCK_FREE_FEBS */
+    qt_hash_lock(FEBs[to->lockbin]);
+    {
+        m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[to->lockbin], to->maddr);
+        if (m) {
+            QTHREAD_FASTLOCK_LOCK(&m->lock);
+        }
+    }
+    qt_hash_unlock(FEBs[to->lockbin]);
+#endif /* ifdef LOCK_FREE_FEBS */
+    if (m == NULL) {
+        return 0;
+    }
+    for (pp = (qthread_addrres_t **)((char *)m + to->queue); *pp != NULL; pp = &((*pp)->next)) {
+        /* X may have been freed and reused; but not by this waiter */
+        if ((*pp == to->X) && (to->X->waiter == waiter)) {
+            break;
+        }
+    }
+    if (*pp == NULL) {
+        QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+        return 0;
+    }
+    *pp = to->X->next;
+    FREE_ADDRRES(to->X);
+    removeable = ((m->full == 1) && (m->EFQ == NULL) && (m->FEQ == NULL) && (m->FFQ == NULL) && (m->FFWQ == NULL));
+    QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+    if (removeable) {
+        qthread_FEB_remove(to->maddr);
+    }
+    qthread_debug(FEB_BEHAVIOR, "maddr=%p: timed out waiting (tid %u)\n", to->maddr, waiter->thread_id);
+    QTHREAD_LATENCY_READY(waiter, QT_LATENCY_TIMER);
+    waiter->thread_state = QTHREAD_STATE_RUNNING;
+    qt_threadqueue_enqueue(waiter->rdata->shepherd_ptr->ready, waiter);
+    return 1;
+}                      /*}}} */
+
+/* m must be locked, and X must be on the queue at the given offset in m */
+static QINLINE void qthread_feb_timeout_arm(qthread_feb_timeout_t *to,
+                                            qthread_t             *me,
+                                            void                  *maddr,
+                                            const int              lockbin,
+                                            const size_t           queue,
+                                            qthread_addrres_t     *X,
+                                            const uint64_t         deadline)
+{                      /*{{{ */
+    to->timer.deadline = deadline;
+    to->timer.waiter   = me;
+    to->timer.expire   = qthread_feb_timeout_expire;
+    to->timer.arg      = NULL;
+    to->maddr          = maddr;
+    to->lockbin        = lockbin;
+    to->queue          = queue;
+    to->X              = X;
+    qt_timer_arm(me->rdata->shepherd_ptr, &to->timer);
+}                      /*}}} */
+
+/* Returns nonzero if the wait timed out */
+static QINLINE int qthread_feb_timeout_disarm(qthread_feb_timeout_t *to)
+{                      /*{{{ */
+    return !qt_timer_cancel(&to->timer) && (to->timer.state == QT_TIMER_FIRED);
+}                      /*}}} */
+
 static QINLINE void qthread_precond_launch(qthread_shepherd_t *shep,
                                            qthread_addrres_t  *precond_tasks)
 {   /*{{{*/
@@ -385,6 +521,8 @@ static QINLINE void qthread_precond_launch(qthread_shepherd_t *shep,
             precond_head = precond_head->next;
             FREE_ADDRRES(precond_free);
             if (qthread_check_feb_preconds(precond_head->waiter) != 1) {
+                QTHREAD_TRACE_HERE(QT_TRACE_WAKE, precond_head->waiter, 0, 0);
+                QTHREAD_LATENCY_READY(precond_head->waiter, QT_LATENCY_FEB);
                 if (precond_head->waiter->target_shepherd == NO_SHEPHERD) {
                     qt_threadqueue_enqueue(shep->ready, precond_head->waiter);
                 } else {
@@ -660,6 +798,7 @@ int API_FUNC qthread_empty(const aligned_t *dest)
         qthread_gotlock_empty(shep, m, (void *)alignedaddr);
     }
     qthread_debug(FEB_BEHAVIOR, "dest=%p (tid=%i): success\n", dest, qthread_id());
+    QTHREAD_TRACE_SYNC(QT_TRACE_EMPTY, alignedaddr);
     return QTHREAD_SUCCESS;
 }                      /*}}} */
 
@@ -681,6 +820,7 @@ int API_FUNC qthread_fill(const aligned_t *dest)
     }
     qthread_debug(FEB_CALLS, "dest=%p (tid=%i)\n", dest, qthread_id());
     QALIGN(dest, alignedaddr);
+    QTHREAD_TRACE_SYNC(QT_TRACE_FILL, alignedaddr);
     /* lock hash */
     QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 #ifdef LOCK_FREE_FEBS
@@ -742,6 +882,7 @@ int API_FUNC qthread_writeF(aligned_t *restrict       dest,
     }
     qthread_debug(FEB_BEHAVIOR, "tid %u dest=%p src=%p...\n", (shep->current) ? (shep->current->thread_id) : UINT_MAX, dest, src);
     QALIGN(dest, alignedaddr);
+    QTHREAD_TRACE_SYNC(QT_TRACE_FILL, alignedaddr);
     QTHREAD_FEB_UNIQUERECORD2(feb, dest, shep);
     QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 #ifdef LOCK_FREE_FEBS
@@ -884,6 +1025,7 @@ int API_FUNC qthread_purge_to(aligned_t *restrict       dest,
         qthread_gotlock_empty(shep, m, (void *)alignedaddr);
     }
     qthread_debug(FEB_BEHAVIOR, "dest=%p src=%p (tid=%i): success\n", dest, src, qthread_id());
+    QTHREAD_TRACE_SYNC(QT_TRACE_EMPTY, alignedaddr);
     return QTHREAD_SUCCESS;
 }                      /*}}} */
 
@@ -905,8 +1047,9 @@ int API_FUNC qthread_purge(aligned_t *dest)
  * 3 - the destination's FEB state gets changed from empty to full
  */
 
-int API_FUNC qthread_writeEF(aligned_t *restrict       dest,
-                             const aligned_t *restrict src)
+static QINLINE int qthread_writeEF_internal(aligned_t *restrict       dest,
+                                            const aligned_t *restrict src,
+                                            const uint64_t            deadline)
 {                      /*{{{ */
     aligned_t *alignedaddr;
 
@@ -920,7 +1063,7 @@ int API_FUNC qthread_writeEF(aligned_t *restrict       dest,
     assert(qthread_library_initialized);
 
     if (!me) {
-        return qthread_feb_blocker_func(dest, (void *)src, WRITEEF);
+        return qthread_feb_blocker_func_until(dest, (void *)src, WRITEEF, deadline);
     }
     qthread_debug(FEB_CALLS, "dest=%p, src=%p(%u) (tid=%i)\n", dest, src, (unsigned)*src, me->thread_id);
     QTHREAD_FEB_UNIQUERECORD(feb, dest, me);
@@ -990,6 +1133,18 @@ got_m:
     /* by this point m is locked */
     if (m->full == 1) {            /* full, thus, we must block */
         QTHREAD_WAIT_TIMER_DECLARATION;
+        QTHREAD_CONTENTION_DECLARATION;
+        qthread_feb_timeout_t timeout;
+
+        if (deadline && (deadline <= qt_timer_now())) {
+            const int removeable = ((m->EFQ == NULL) && (m->FEQ == NULL) && (m->FFQ == NULL) && (m->FFWQ == NULL));
+            QTHREAD_FASTLOCK_UNLOCK(&(m->lock));
+            if (removeable) {
+                qthread_FEB_remove(alignedaddr);
+            }
+            QTHREAD_FEB_TIMER_STOP(febblock, me);
+            return QTHREAD_TIMEOUT;
+        }
         X = ALLOC_ADDRRES();
         if (X == NULL) {
             qthread_debug(FEB_DETAILS, "dest=%p, src=%p (tid=%i): MALLOC ERROR!!!!!!!!!!!!!!!!!!!!!!\n", dest, src, me->thread_id);
@@ -1000,28 +1155,63 @@ got_m:
         X->waiter = me;
         X->next   = m->EFQ;
         m->EFQ    = X;
+        if (deadline) {
+            qthread_feb_timeout_arm(&timeout, me, alignedaddr, lockbin, offsetof(qthread_addrstat_t, EFQ), X, deadline);
+        }
         qthread_debug(FEB_DETAILS, "dest=%p, src=%p (tid=%i): back to parent (m=%p, X=%p, slice=%u)\n", dest, src, me->thread_id, m, X, lockbin);
         me->thread_state          = QTHREAD_STATE_FEB_BLOCKED;
         me->rdata->blockedon.addr = m;
+        QTHREAD_CONTENTION_BLOCK(alignedaddr, m);
         QTHREAD_WAIT_TIMER_START();
         qthread_back_to_master(me);
         QTHREAD_WAIT_TIMER_STOP(me, febwait);
+        QTHREAD_CONTENTION_WAKE(me);
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
+        if (deadline && qthread_feb_timeout_disarm(&timeout)) {
+            qthread_debug(FEB_BEHAVIOR, "dest=%p, src=%p (tid=%i): timed out\n", dest, src, me->thread_id);
+            QTHREAD_FEB_TIMER_STOP(febblock, me);
+            return QTHREAD_TIMEOUT;
+        }
         qthread_debug(FEB_BEHAVIOR, "dest=%p, src=%p (tid=%i): succeeded after waiting\n", dest, src, me->thread_id);
+        QTHREAD_TRACE_SYNC(QT_TRACE_FILL, alignedaddr);
     } else {
         if (dest && (dest != src)) {
             *(aligned_t *)dest = *(aligned_t *)src;
             MACHINE_FENCE;
         }
         qthread_debug(FEB_BEHAVIOR, "dest=%p, src=%p (tid=%i): succeeded! waking waiters...\n", dest, src, me->thread_id);
+        QTHREAD_TRACE_SYNC(QT_TRACE_FILL, alignedaddr);
         qthread_gotlock_fill(me->rdata->shepherd_ptr, m, alignedaddr);
     }
     QTHREAD_FEB_TIMER_STOP(febblock, me);
     return QTHREAD_SUCCESS;
 }                      /*}}} */
 
+int API_FUNC qthread_writeEF(aligned_t *restrict       dest,
+                             const aligned_t *restrict src)
+{                      /*{{{ */
+    return qthread_writeEF_internal(dest, src, 0);
+}                      /*}}} */
+
+int API_FUNC qthread_writeEF_timed(aligned_t *restrict       dest,
+                                   const aligned_t *restrict src,
+                                   const struct timespec    *deadline)
+{                      /*{{{ */
+    if (deadline == NULL) {
+        return QTHREAD_BADARGS;
+    }
+    return qthread_writeEF_internal(dest, src, qt_timer_deadline(deadline));
+}                      /*}}} */
+
+int API_FUNC qthread_writeEF_const_timed(aligned_t             *dest,
+                                         aligned_t              src,
+                                         const struct timespec *deadline)
+{                      /*{{{ */
+    return qthread_writeEF_timed(dest, &src, deadline);
+}                      /*}}} */
+
 int API_FUNC qthread_writeEF_const(aligned_t *dest,
                                    aligned_t  src)
 {                      /*{{{ */
@@ -1084,6 +1274,7 @@ int INTERNAL qthread_writeEF_nb(aligned_t *restrict       dest,
             MACHINE_FENCE;
         }
         qthread_debug(FEB_BEHAVIOR, "tid %u succeeded on %p=%p\n", me->thread_id, dest, src);
+        QTHREAD_TRACE_SYNC(QT_TRACE_FILL, alignedaddr);
         qthread_gotlock_fill(me->rdata->shepherd_ptr, m, alignedaddr);
     }
     return QTHREAD_SUCCESS;
@@ -1156,6 +1347,7 @@ int API_FUNC qthread_writeFF(aligned_t *restrict       dest,
         qthread_debug(FEB_BEHAVIOR, "dest=%p, src=%p (tid=%u): non-blocking success!\n", dest, src, me->thread_id);
     } else if (m->full != 1) {         /* not full... so we must block */
         QTHREAD_WAIT_TIMER_DECLARATION;
+        QTHREAD_CONTENTION_DECLARATION;
         X = ALLOC_ADDRRES();
         if (X == NULL) {
             QTHREAD_FASTLOCK_UNLOCK(&m->lock);
@@ -1168,9 +1360,11 @@ int API_FUNC qthread_writeFF(aligned_t *restrict       dest,
         qthread_debug(FEB_DETAILS, "dest=%p, src=%p (tid=%u): back to parent\n", dest, src, me->thread_id);
         me->thread_state          = QTHREAD_STATE_FEB_BLOCKED;
         me->rdata->blockedon.addr = m;
+        QTHREAD_CONTENTION_BLOCK(alignedaddr, m);
         QTHREAD_WAIT_TIMER_START();
         qthread_back_to_master(me);
         QTHREAD_WAIT_TIMER_STOP(me, febwait);
+        QTHREAD_CONTENTION_WAKE(me);
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
@@ -1184,6 +1378,7 @@ int API_FUNC qthread_writeFF(aligned_t *restrict       dest,
         QTHREAD_FASTLOCK_UNLOCK(&m->lock);
     }
     QTHREAD_FEB_TIMER_STOP(febblock, me);
+    QTHREAD_TRACE_SYNC(QT_TRACE_FILL, alignedaddr);
     return QTHREAD_SUCCESS;
 }                      /*}}} */
 
@@ -1199,8 +1394,9 @@ int API_FUNC qthread_writeFF_const(aligned_t *dest,
  * 2 - data is copied from src to destination
  */
 
-int API_FUNC qthread_readFF(aligned_t *restrict       dest,
-                            const aligned_t *restrict src)
+static QINLINE int qthread_readFF_internal(aligned_t *restrict       dest,
+                                           const aligned_t *restrict src,
+                                           const uint64_t            deadline)
 {                      /*{{{ */
     const aligned_t *alignedaddr;
 
@@ -1214,7 +1410,7 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
     assert(qthread_library_initialized);
 
     if (!me) {
-        return qthread_feb_blocker_func(dest, (void *)src, READFF);
+        return qthread_feb_blocker_func_until(dest, (void *)src, READFF, deadline);
     }
     qthread_debug(FEB_CALLS, "dest=%p, src=%p (tid=%u)\n", dest, src, me->thread_id);
     QTHREAD_FEB_UNIQUERECORD(feb, src, me);
@@ -1255,6 +1451,14 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
         qthread_debug(FEB_BEHAVIOR, "dest=%p, src=%p (tid=%u): non-blocking success!\n", dest, src, me->thread_id);
     } else if (m->full != 1) {         /* not full... so we must block */
         QTHREAD_WAIT_TIMER_DECLARATION;
+        QTHREAD_CONTENTION_DECLARATION;
+        qthread_feb_timeout_t timeout;
+
+        if (deadline && (deadline <= qt_timer_now())) {
+            QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+            QTHREAD_FEB_TIMER_STOP(febblock, me);
+            return QTHREAD_TIMEOUT;
+        }
         X = ALLOC_ADDRRES();
         if (X == NULL) {
             QTHREAD_FASTLOCK_UNLOCK(&m->lock);
@@ -1264,15 +1468,25 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
         X->waiter = me;
         X->next   = m->FFQ;
         m->FFQ    = X;
+        if (deadline) {
+            qthread_feb_timeout_arm(&timeout, me, (void *)alignedaddr, lockbin, offsetof(qthread_addrstat_t, FFQ), X, deadline);
+        }
         qthread_debug(FEB_DETAILS, "dest=%p, src=%p (tid=%u): back to parent\n", dest, src, me->thread_id);
         me->thread_state          = QTHREAD_STATE_FEB_BLOCKED;
         me->rdata->blockedon.addr = m;
+        QTHREAD_CONTENTION_BLOCK(alignedaddr, m);
         QTHREAD_WAIT_TIMER_START();
         qthread_back_to_master(me);
         QTHREAD_WAIT_TIMER_STOP(me, febwait);
+        QTHREAD_CONTENTION_WAKE(me);
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
+        if (deadline && qthread_feb_timeout_disarm(&timeout)) {
+            qthread_debug(FEB_BEHAVIOR, "dest=%p, src=%p (tid=%u): timed out\n", dest, src, me->thread_id);
+            QTHREAD_FEB_TIMER_STOP(febblock, me);
+            return QTHREAD_TIMEOUT;
+        }
         qthread_debug(FEB_BEHAVIOR, "dest=%p, src=%p (tid=%u): succeeded after waiting\n", dest, src, me->thread_id);
     } else {                   /* exists AND is empty... weird, but that's life */
         if (dest && (dest != src)) {
@@ -1283,9 +1497,26 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
         QTHREAD_FASTLOCK_UNLOCK(&m->lock);
     }
     QTHREAD_FEB_TIMER_STOP(febblock, me);
+    QTHREAD_TRACE_SYNC(QT_TRACE_READ, alignedaddr);
     return QTHREAD_SUCCESS;
 }                      /*}}} */
 
+int API_FUNC qthread_readFF(aligned_t *restrict       dest,
+                            const aligned_t *restrict src)
+{                      /*{{{ */
+    return qthread_readFF_internal(dest, src, 0);
+}                      /*}}} */
+
+int API_FUNC qthread_readFF_timed(aligned_t             *dest,
+                                  const aligned_t       *src,
+                                  const struct timespec *deadline)
+{                      /*{{{ */
+    if (deadline == NULL) {
+        return QTHREAD_BADARGS;
+    }
+    return qthread_readFF_internal(dest, src, qt_timer_deadline(deadline));
+}                      /*}}} */
+
 int INTERNAL qthread_readFF_nb(aligned_t *restrict       dest,
                                const aligned_t *restrict src)
 {                      /*{{{ */
@@ -1352,6 +1583,7 @@ got_m:
         qthread_debug(FEB_BEHAVIOR, "tid %u succeeded on %p=%p\n", me->thread_id, dest, src);
         QTHREAD_FASTLOCK_UNLOCK(&m->lock);
     }
+    QTHREAD_TRACE_SYNC(QT_TRACE_READ, alignedaddr);
     return QTHREAD_SUCCESS;
 }                      /*}}} */
 
@@ -1361,8 +1593,9 @@ got_m:
  * 3 - the src's FEB bits get changed from full to empty
  */
 
-int API_FUNC qthread_readFE(aligned_t *restrict       dest,
-                            const aligned_t *restrict src)
+static QINLINE int qthread_readFE_internal(aligned_t *restrict       dest,
+                                           const aligned_t *restrict src,
+                                           const uint64_t            deadline)
 {                      /*{{{ */
     const aligned_t *alignedaddr;
 
@@ -1375,7 +1608,7 @@ int API_FUNC qthread_readFE(aligned_t *restrict       dest,
     assert(qthread_library_initialized);
 
     if (!me) {
-        return qthread_feb_blocker_func(dest, (void *)src, READFE);
+        return qthread_feb_blocker_func_until(dest, (void *)src, READFE, deadline);
     }
     assert(me->rdata);
     qthread_debug(FEB_CALLS, "dest=%p, src=%p (tid=%i)\n", dest, src, me->thread_id);
@@ -1436,8 +1669,16 @@ got_m:
     /* by this point m is locked */
     if (m->full == 0) {            /* empty, thus, we must block */
         QTHREAD_WAIT_TIMER_DECLARATION;
-        qthread_addrres_t *X = ALLOC_ADDRRES();
+        QTHREAD_CONTENTION_DECLARATION;
+        qthread_addrres_t    *X;
+        qthread_feb_timeout_t timeout;
 
+        if (deadline && (deadline <= qt_timer_now())) {
+            QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+            QTHREAD_FEB_TIMER_STOP(febblock, me);
+            return QTHREAD_TIMEOUT;
+        }
+        X = ALLOC_ADDRRES();
         if (X == NULL) {
             QTHREAD_FASTLOCK_UNLOCK(&m->lock);
             return QTHREAD_MALLOC_ERROR;
@@ -1446,16 +1687,26 @@ got_m:
         X->waiter = me;
         X->next   = m->FEQ;
         m->FEQ    = X;
+        if (deadline) {
+            qthread_feb_timeout_arm(&timeout, me, (void *)alignedaddr, lockbin, offsetof(qthread_addrstat_t, FEQ), X, deadline);
+        }
         qthread_debug(FEB_DETAILS, "back to parent\n");
         me->thread_state = QTHREAD_STATE_FEB_BLOCKED;
         /* so that the shepherd will unlock it */
         me->rdata->blockedon.addr = m;
+        QTHREAD_CONTENTION_BLOCK(alignedaddr, m);
         QTHREAD_WAIT_TIMER_START();
         qthread_back_to_master(me);
         QTHREAD_WAIT_TIMER_STOP(me, febwait);
+        QTHREAD_CONTENTION_WAKE(me);
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
+        if (deadline && qthread_feb_timeout_disarm(&timeout)) {
+            qthread_debug(FEB_BEHAVIOR, "tid %u timed out on %p\n", me->thread_id, src);
+            QTHREAD_FEB_TIMER_STOP(febblock, me);
+            return QTHREAD_TIMEOUT;
+        }
         qthread_debug(FEB_BEHAVIOR, "tid %u succeeded on %p=%p after waiting\n", me->thread_id, dest, src);
     } else {                   /* full, thus IT IS OURS! MUAHAHAHA! */
         if (dest && (dest != src)) {
@@ -1466,9 +1717,26 @@ got_m:
         qthread_gotlock_empty(me->rdata->shepherd_ptr, m, (void *)alignedaddr);
     }
     QTHREAD_FEB_TIMER_STOP(febblock, me);
+    QTHREAD_TRACE_SYNC(QT_TRACE_READ, alignedaddr);
     return QTHREAD_SUCCESS;
 }                      /*}}} */
 
+int API_FUNC qthread_readFE(aligned_t *restrict       dest,
+                            const aligned_t *restrict src)
+{                      /*{{{ */
+    return qthread_readFE_internal(dest, src, 0);
+}                      /*}}} */
+
+int API_FUNC qthread_readFE_timed(aligned_t             *dest,
+                                  const aligned_t       *src,
+                                  const struct timespec *deadline)
+{                      /*{{{ */
+    if (deadline == NULL) {
+        return QTHREAD_BADARGS;
+    }
+    return qthread_readFE_internal(dest, src, qt_timer_deadline(deadline));
+}                      /*}}} */
+
 /* the way this works is that:
  * 1 - src's FEB state is ignored
  * 2 - data is copied from src to destination
@@ -1560,6 +1828,7 @@ int INTERNAL qthread_readFE_nb(aligned_t *restrict       dest,
         qthread_debug(FEB_BEHAVIOR, "tid %u succeeded on %p=%p\n", me->thread_id, dest, src);
         qthread_gotlock_empty(me->rdata->shepherd_ptr, m, (void *)alignedaddr);
     }
+    QTHREAD_TRACE_SYNC(QT_TRACE_READ, alignedaddr);
     return QTHREAD_SUCCESS;
 }                      /*}}} */
 
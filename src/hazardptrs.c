@@ -42,7 +42,9 @@ static void hazardptr_internal_teardown(void)
 
 void INTERNAL initialize_hazardptrs(void)
 {/*{{{*/
-    freelist_max = qthread_num_shepherds() * qlib->nworkerspershep + 7;
+    /* a scan can only retain as many entries as there are hazard pointers,
+     * so the freelist must be longer than that to guarantee progress */
+    freelist_max = qthread_num_shepherds() * qlib->nworkerspershep * HAZARD_PTRS_PER_SHEP + 7;
     for (qthread_shepherd_id_t i = 0; i < qthread_num_shepherds(); ++i) {
         for (qthread_worker_id_t j = 0; j < qlib->nworkerspershep; ++j) {
             memset(qlib->shepherds[i].workers[j].hazard_ptrs, 0, sizeof(uintptr_t) * HAZARD_PTRS_PER_SHEP);
@@ -5,6 +5,7 @@
 /* System Headers */
 #include <qthread/qthread-int.h>       /* for uint64_t */
 #include <stdio.h>                     /* for fprintf() */
+#include <errno.h>
 #include <stdlib.h>                    /* for abort() */
 #include <sys/time.h>                  /* for gettimeofday() */
 #ifdef HAVE_SYS_SYSCALL_H
@@ -25,6 +26,12 @@
 #include <sys/uio.h>
 /* - select(2) */
 #include <sys/select.h>
+/* - sendfile(2) */
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
+/* - splice(2) */
+#include <fcntl.h>
 /* - wait4(2) */
 #include <sys/time.h>
 #include <sys/resource.h>
@@ -39,18 +46,29 @@
 #include "qt_debug.h"
 #include "qt_envariables.h"
 #include "qt_subsystems.h"
-
+#include "qt_latency.h"
+/* Each shepherd has its own queue of jobs for the proxy pthreads. Proxies are
+ * spawned by the shepherd whose queue needs them, so they inherit its worker's
+ * CPU binding, and they serve that queue first; when it is empty, they steal
+ * from the others before going to sleep. The first io_worker_min proxies of
+ * each queue stay around for good, so bursty I/O doesn't keep paying for
+ * pthread_create(); any beyond that exit after waiting IO_TIMEOUT for work. */
 typedef struct {
     qt_blocking_queue_node_t *head;
     qt_blocking_queue_node_t *tail;
     saligned_t                length;
+    saligned_t                proxies; /* homed on this queue */
+    saligned_t                idle;    /* ...and looking for work */
+    saligned_t                wakeups; /* signals the idle ones have yet to see */
     pthread_mutex_t           lock;
     pthread_cond_t            notempty;
 } qt_blocking_queue_t;
 
-static qt_blocking_queue_t theQueue;
-static saligned_t          io_worker_count = -1;
-static saligned_t          io_worker_max   = 10;
+static qt_blocking_queue_t *queues  = NULL;
+static int                  nqueues = 0;
+static saligned_t           io_worker_count = -1;
+static saligned_t           io_worker_max   = 10;
+static saligned_t           io_worker_min   = 1; // per queue
 #if !defined(UNPOOLED)
 qt_mpool syscall_job_pool = NULL;
 #endif
@@ -58,13 +76,21 @@ static unsigned long timeout    = 100; // in microseconds
 static int           proxy_exit = 0;
 TLS_DECL_INIT(qthread_t *, IO_task_struct);
 
+/* How long proxied calls took, from being queued to being done; bucket b
+ * counts those that took less than 2^(b+1) microseconds (and at least 2^b) */
+#define IO_LATENCY_BUCKETS 32
+static aligned_t io_latency[IO_LATENCY_BUCKETS];
+
 static void qt_blocking_subsystem_internal_stopwork(void)
 {   /*{{{*/
     proxy_exit = 1;
     MACHINE_FENCE;
+    for (int q = 0; q < nqueues; q++) {
+        QTHREAD_LOCK(&queues[q].lock);
+        QTHREAD_COND_BCAST(queues[q].notempty);
+        QTHREAD_UNLOCK(&queues[q].lock);
+    }
     while (io_worker_count != 0) SPINLOCK_BODY();
-    QTHREAD_LOCK(&theQueue.lock);
-    QTHREAD_UNLOCK(&theQueue.lock);
 } /*}}}*/
 
 static void qt_blocking_subsystem_internal_freemem(void)
@@ -72,14 +98,21 @@ static void qt_blocking_subsystem_internal_freemem(void)
 #if !defined(UNPOOLED)
     qt_mpool_destroy(syscall_job_pool);
 #endif
-    QTHREAD_DESTROYLOCK(&theQueue.lock);
-    QTHREAD_DESTROYCOND(&theQueue.notempty);
+    for (int q = 0; q < nqueues; q++) {
+        QTHREAD_DESTROYLOCK(&queues[q].lock);
+        QTHREAD_DESTROYCOND(&queues[q].notempty);
+    }
+    FREE(queues, nqueues * sizeof(qt_blocking_queue_t));
+    queues  = NULL;
+    nqueues = 0;
 } /*}}}*/
 
-static void *qt_blocking_subsystem_proxy_thread(void *QUNUSED(arg))
+static void *qt_blocking_subsystem_proxy_thread(void *arg)
 {   /*{{{*/
+    const int home = (int)(intptr_t)arg;
+
     while (proxy_exit == 0) {
-        if (qt_process_blocking_call()) {
+        if (qt_process_blocking_call(home)) {
             break;
         }
         COMPILER_FENCE;
@@ -89,18 +122,35 @@ static void *qt_blocking_subsystem_proxy_thread(void *QUNUSED(arg))
     return 0;
 } /*}}}*/
 
-static void qt_blocking_subsystem_spawnworker(void)
+/* Returns zero if there are io_worker_max proxies already; the queues don't
+ * share a lock, so the count is claimed atomically. Must be called with the
+ * home queue locked. */
+static int qt_blocking_subsystem_spawnworker(int home)
 {   /*{{{*/
-    int       r;
-    pthread_t thr;
+    int        r;
+    pthread_t  thr;
+    saligned_t count = io_worker_count;
+
+    for (;;) {
+        saligned_t prev;
 
-    if ((r = pthread_create(&thr, NULL, qt_blocking_subsystem_proxy_thread, NULL)) != 0) {
+        if (count >= io_worker_max) {
+            return 0;
+        }
+        prev = qthread_cas(&io_worker_count, count, count + 1);
+        if (prev == count) {
+            break;
+        }
+        count = prev;
+    }
+    if ((r = pthread_create(&thr, NULL, qt_blocking_subsystem_proxy_thread, (void *)(intptr_t)home)) != 0) {
         fprintf(stderr, "qt_blocking_subsystem_init: pthread_create() failed (%d)\n", r);
         perror("qt_blocking_subsystem_init spawning proxy thread");
         abort();
     }
-    (void)qthread_incr(&io_worker_count, 1);
+    queues[home].proxies++;
     pthread_detach(thr);
+    return 1;
 } /*}}}*/
 
 void INTERNAL qt_blocking_subsystem_init(void)
@@ -108,14 +158,31 @@ void INTERNAL qt_blocking_subsystem_init(void)
 #if !defined(UNPOOLED)
     syscall_job_pool = qt_mpool_create(sizeof(qt_blocking_queue_node_t));
 #endif
-    theQueue.head   = NULL;
-    theQueue.tail   = NULL;
+    nqueues = qlib->nshepherds;
+    queues  = MALLOC(nqueues * sizeof(qt_blocking_queue_t));
+    assert(queues);
+    for (int q = 0; q < nqueues; q++) {
+        queues[q].head    = NULL;
+        queues[q].tail    = NULL;
+        queues[q].length  = 0;
+        queues[q].proxies = 0;
+        queues[q].idle    = 0;
+        queues[q].wakeups = 0;
+        qassert(pthread_mutex_init(&queues[q].lock, NULL), 0);
+        qassert(pthread_cond_init(&queues[q].notempty, NULL), 0);
+    }
+    for (int b = 0; b < IO_LATENCY_BUCKETS; b++) {
+        io_latency[b] = 0;
+    }
     io_worker_count = 0;
+    proxy_exit      = 0;
     io_worker_max   = qt_internal_get_env_num("MAX_IO_WORKERS", 10, 1);
+    io_worker_min   = qt_internal_get_env_num("MIN_IO_WORKERS", 1, 0);
     timeout         = qt_internal_get_env_num("IO_TIMEOUT", 100, 100);
     TLS_INIT(IO_task_struct);
-    qassert(pthread_mutex_init(&theQueue.lock, NULL), 0);
-    qassert(pthread_cond_init(&theQueue.notempty, NULL), 0);
+    qt_io_reactor_init();
+    qt_io_uring_init();
+    qt_timer_wheel_init();
     /* thread(s) must be stopped *before* shepherds die, to keep them from
      * trying to push orphan threads into shepherd queues */
     qthread_internal_cleanup_early(qt_blocking_subsystem_internal_stopwork);
@@ -124,57 +191,168 @@ void INTERNAL qt_blocking_subsystem_init(void)
     qthread_internal_cleanup(qt_blocking_subsystem_internal_freemem);
 } /*}}}*/
 
-int INTERNAL qt_process_blocking_call(void)
+/* must be called with q locked */
+static qt_blocking_queue_node_t *qt_blocking_queue_pop(qt_blocking_queue_t *q)
 {   /*{{{*/
-    qt_blocking_queue_node_t *item;
+    qt_blocking_queue_node_t *item = q->head;
 
-    QTHREAD_LOCK(&theQueue.lock);
-    while (theQueue.head == NULL) {
-        struct timeval  tv;
-        struct timespec ts;
-        int             ret;
+    if (item != NULL) {
+        q->head = item->next;
+        if (q->tail == item) {
+            q->tail = q->head;
+        }
+        q->length--;
+        qthread_debug(IO_DETAILS, "dequeue... head = %p, .tail = %p, item:%p, thread:%p, rdata:%p\n", q->head, q->tail, item, item->thread, item->thread->rdata);
+    }
+    return item;
+} /*}}}*/
 
-        COMPILER_FENCE;
-        gettimeofday(&tv, NULL);
-        ts.tv_sec  = tv.tv_sec;
-        ts.tv_nsec = (tv.tv_usec + timeout) * 1000;
-        ret        = pthread_cond_timedwait(&theQueue.notempty, &theQueue.lock, &ts);
-        switch(ret) {
-            case ETIMEDOUT:
-                qthread_debug(IO_BEHAVIOR, "condwait timed out\n");
-                if (theQueue.head == NULL) {
-                    qthread_debug(IO_BEHAVIOR, "------------------------------------- exit()\n");
-#ifdef QTHREAD_DEBUG
-                    unsigned ct = qthread_incr(&io_worker_count, -1);
-                    qthread_debug(IO_BEHAVIOR, "worker_count post exit is %u\n", (unsigned)ct - 1);
-#else
-                    (void)qthread_incr(&io_worker_count, -1);
-#endif
-                    QTHREAD_UNLOCK(&theQueue.lock);
-                    return 1;
-                } else {
-                    QTHREAD_UNLOCK(&theQueue.lock);
-                    return 0;
-                }
+/* Takes a job from some other shepherd's queue; the scan starts just past
+ * home, so thieves spread out. The victim is locked for real (not tried):
+ * an idle proxy that missed the job would sleep with it still queued. Must be
+ * called with no queue locked. */
+static qt_blocking_queue_node_t *qt_blocking_queue_steal(int home)
+{   /*{{{*/
+    for (int i = 1; i < nqueues; i++) {
+        qt_blocking_queue_t      *victim = &queues[(home + i) % nqueues];
+        qt_blocking_queue_node_t *item;
+
+        if (victim->head == NULL) {
+            continue;
+        }
+        QTHREAD_LOCK(&victim->lock);
+        item = qt_blocking_queue_pop(victim);
+        QTHREAD_UNLOCK(&victim->lock);
+        if (item != NULL) {
+            qthread_debug(IO_DETAILS, "proxy of queue %i stole %p\n", home, item);
+            return item;
+        }
+    }
+    return NULL;
+} /*}}}*/
+
+/* Wakes a proxy that is looking for work and that nobody has woken yet; must
+ * be called with q locked. */
+static int qt_blocking_queue_wake(qt_blocking_queue_t *q)
+{   /*{{{*/
+    if (q->idle > q->wakeups) {
+        q->wakeups++;
+        QTHREAD_COND_SIGNAL(q->notempty);
+        return 1;
+    }
+    return 0;
+} /*}}}*/
+
+static void qt_blocking_latency_record(uint64_t ns)
+{   /*{{{*/
+    uint64_t us = ns / 1000;
+    int      b  = 0;
 
-            case EINVAL:
-                /* chances are, this is because ts is in the past */
-                qthread_debug(IO_DETAILS, "condwait returned EINVAL\n");
+    while ((us >>= 1) != 0 && b < IO_LATENCY_BUCKETS - 1) {
+        b++;
+    }
+    (void)qthread_incr(&io_latency[b], 1);
+} /*}}}*/
+
+/* Returns the number of jobs waiting for a proxy */
+size_t INTERNAL qt_blocking_subsystem_queue_depth(void)
+{   /*{{{*/
+    size_t depth = 0;
+
+    for (int q = 0; q < nqueues; q++) {
+        depth += queues[q].length;
+    }
+    return depth;
+} /*}}}*/
+
+size_t INTERNAL qt_blocking_subsystem_proxies(void)
+{   /*{{{*/
+    return (io_worker_count > 0) ? io_worker_count : 0;
+} /*}}}*/
+
+/* Returns the number of proxied calls so far, or, if pct is nonzero, the
+ * upper bound (in microseconds) of the latency of pct percent of them. */
+size_t INTERNAL qt_blocking_subsystem_latency(unsigned int pct)
+{   /*{{{*/
+    aligned_t total = 0, sum = 0;
+
+    for (int b = 0; b < IO_LATENCY_BUCKETS; b++) {
+        total += io_latency[b];
+    }
+    if ((pct == 0) || (total == 0)) {
+        return total;
+    }
+    for (int b = 0; b < IO_LATENCY_BUCKETS; b++) {
+        sum += io_latency[b];
+        if (sum * 100 >= total * pct) {
+            return (size_t)1 << (b + 1);
+        }
+    }
+    return (size_t)1 << IO_LATENCY_BUCKETS;
+} /*}}}*/
+
+int INTERNAL qt_process_blocking_call(int home)
+{   /*{{{*/
+    qt_blocking_queue_t      *q = &queues[home];
+    qt_blocking_queue_node_t *item;
+
+    QTHREAD_LOCK(&q->lock);
+    item = qt_blocking_queue_pop(q);
+    if (item == NULL) {
+        /* announce that we're idle before looking elsewhere, so that work
+         * queued while we look gets us a wakeup rather than going unnoticed */
+        q->idle++;
+        while (item == NULL && proxy_exit == 0) {
+            int ret = 0;
+
+            QTHREAD_UNLOCK(&q->lock);
+            item = qt_blocking_queue_steal(home);
+            QTHREAD_LOCK(&q->lock);
+            if (item != NULL) {
+                break;
+            }
+            if ((item = qt_blocking_queue_pop(q)) != NULL) {
                 break;
+            }
+            if (q->wakeups > 0) {
+                q->wakeups--;
+                continue;
+            }
+            if (q->proxies <= io_worker_min) {
+                ret = pthread_cond_wait(&q->notempty, &q->lock);
+            } else {
+                struct timeval  tv;
+                struct timespec ts;
 
-            default:
+                COMPILER_FENCE;
+                gettimeofday(&tv, NULL);
+                ts.tv_sec  = tv.tv_sec + (tv.tv_usec + timeout) / 1000000;
+                ts.tv_nsec = ((tv.tv_usec + timeout) % 1000000) * 1000;
+                ret        = pthread_cond_timedwait(&q->notempty, &q->lock, &ts);
+            }
+            if (q->wakeups > 0) {
+                q->wakeups--;
+            } else if ((ret == ETIMEDOUT) && (q->head == NULL) &&
+                       (q->proxies > io_worker_min)) {
+                qthread_debug(IO_BEHAVIOR, "------------------------------------- exit()\n");
                 break;
+            }
+        }
+        q->idle--;
+        if (item == NULL) {
+            /* proxy_exit, or nothing to do for a while */
+            q->proxies--;
+#ifdef QTHREAD_DEBUG
+            unsigned ct = qthread_incr(&io_worker_count, -1);
+            qthread_debug(IO_BEHAVIOR, "worker_count post exit is %u\n", (unsigned)ct - 1);
+#else
+            (void)qthread_incr(&io_worker_count, -1);
+#endif
+            QTHREAD_UNLOCK(&q->lock);
+            return 1;
         }
     }
-    item = theQueue.head;
-    assert(item != NULL);
-    theQueue.head = item->next;
-    if (theQueue.tail == item) {
-        theQueue.tail = theQueue.head;
-    }
-    theQueue.length--;
-    qthread_debug(IO_DETAILS, "dequeue... theQueue.head = %p, .tail = %p, item:%p, thread:%p, rdata:%p\n", theQueue.head, theQueue.tail, item, item->thread, item->thread->rdata);
-    QTHREAD_UNLOCK(&theQueue.lock);
+    QTHREAD_UNLOCK(&q->lock);
     item->next = NULL;
     /* do something with <item> */
     switch(item->op) {
@@ -248,6 +426,7 @@ int INTERNAL qt_process_blocking_call(void)
             break;
         }
         case PREAD:
+        case PREAD_FIXED:
         {
             int   fd;
             off_t offset;
@@ -267,8 +446,69 @@ int INTERNAL qt_process_blocking_call(void)
 #endif
             break;
         }
-        /* case RECV:
-         * case RECVFROM: */
+        case READV:
+        {
+            int fd, iovcnt;
+            memcpy(&fd, &item->args[0], sizeof(int));
+            memcpy(&iovcnt, &item->args[2], sizeof(int));
+#if HAVE_SYSCALL && HAVE_DECL_SYS_READV
+            item->ret = syscall(SYS_readv,
+                                fd,
+                                (const struct iovec *)item->args[1],
+                                iovcnt);
+#else
+            item->ret = readv(fd,
+                              (const struct iovec *)item->args[1],
+                              iovcnt);
+#endif
+            break;
+        }
+        case RECV:
+        case RECVFROM:
+        {
+            int    socket, flags;
+            size_t length;
+            memcpy(&socket, &item->args[0], sizeof(int));
+            memcpy(&length, &item->args[2], sizeof(size_t));
+            memcpy(&flags, &item->args[3], sizeof(int));
+            if (item->op == RECV) {
+                item->args[4] = item->args[5] = 0;
+            }
+#if HAVE_SYSCALL && HAVE_DECL_SYS_RECVFROM
+            item->ret = syscall(SYS_recvfrom,
+                                socket,
+                                (void *)item->args[1],
+                                length,
+                                flags,
+                                (struct sockaddr *)item->args[4],
+                                (socklen_t *)item->args[5]);
+#else
+            item->ret = recvfrom(socket,
+                                 (void *)item->args[1],
+                                 length,
+                                 flags,
+                                 (struct sockaddr *)item->args[4],
+                                 (socklen_t *)item->args[5]);
+#endif
+            break;
+        }
+        case RECVMSG:
+        {
+            int socket, flags;
+            memcpy(&socket, &item->args[0], sizeof(int));
+            memcpy(&flags, &item->args[2], sizeof(int));
+#if HAVE_SYSCALL && HAVE_DECL_SYS_RECVMSG
+            item->ret = syscall(SYS_recvmsg,
+                                socket,
+                                (struct msghdr *)item->args[1],
+                                flags);
+#else
+            item->ret = recvmsg(socket,
+                                (struct msghdr *)item->args[1],
+                                flags);
+#endif
+            break;
+        }
         case SELECT:
         {
             int nfds;
@@ -289,8 +529,55 @@ int INTERNAL qt_process_blocking_call(void)
 #endif      /* if HAVE_DECL_SYS_SELECT */
             break;
         }
-        /* case SEND:
-         * case SENDTO: */
+        case SEND:
+        case SENDTO:
+        {
+            int       socket, flags;
+            size_t    length;
+            socklen_t dest_len = 0;
+            memcpy(&socket, &item->args[0], sizeof(int));
+            memcpy(&length, &item->args[2], sizeof(size_t));
+            memcpy(&flags, &item->args[3], sizeof(int));
+            if (item->op == SENDTO) {
+                memcpy(&dest_len, &item->args[5], sizeof(socklen_t));
+            } else {
+                item->args[4] = 0;
+            }
+#if HAVE_SYSCALL && HAVE_DECL_SYS_SENDTO
+            item->ret = syscall(SYS_sendto,
+                                socket,
+                                (const void *)item->args[1],
+                                length,
+                                flags,
+                                (const struct sockaddr *)item->args[4],
+                                dest_len);
+#else
+            item->ret = sendto(socket,
+                               (const void *)item->args[1],
+                               length,
+                               flags,
+                               (const struct sockaddr *)item->args[4],
+                               dest_len);
+#endif
+            break;
+        }
+        case SENDMSG:
+        {
+            int socket, flags;
+            memcpy(&socket, &item->args[0], sizeof(int));
+            memcpy(&flags, &item->args[2], sizeof(int));
+#if HAVE_SYSCALL && HAVE_DECL_SYS_SENDMSG
+            item->ret = syscall(SYS_sendmsg,
+                                socket,
+                                (const struct msghdr *)item->args[1],
+                                flags);
+#else
+            item->ret = sendmsg(socket,
+                                (const struct msghdr *)item->args[1],
+                                flags);
+#endif
+            break;
+        }
         /* case SIGWAIT: */
         case SYSTEM:
 #if HAVE_SYSCALL && HAVE_DECL_SYS_SYSTEM
@@ -331,7 +618,26 @@ int INTERNAL qt_process_blocking_call(void)
                               (const void *)item->args[1],
                               (size_t)item->args[2]);
 #endif
+            break;
+        case WRITEV:
+        {
+            int fd, iovcnt;
+            memcpy(&fd, &item->args[0], sizeof(int));
+            memcpy(&iovcnt, &item->args[2], sizeof(int));
+#if HAVE_SYSCALL && HAVE_DECL_SYS_WRITEV
+            item->ret = syscall(SYS_writev,
+                                fd,
+                                (const struct iovec *)item->args[1],
+                                iovcnt);
+#else
+            item->ret = writev(fd,
+                               (const struct iovec *)item->args[1],
+                               iovcnt);
+#endif
+            break;
+        }
         case PWRITE:
+        case PWRITE_FIXED:
 #if HAVE_SYSCALL && HAVE_DECL_SYS_PWRITE
             item->ret = syscall(SYS_pwrite,
                                 (int)item->args[0],
@@ -345,6 +651,98 @@ int INTERNAL qt_process_blocking_call(void)
                                (off_t)item->args[3]);
 #endif
             break;
+        case PREADV:
+        case PWRITEV:
+        {
+            int   fd;
+            off_t offset;
+            memcpy(&fd, &item->args[0], sizeof(int));
+            memcpy(&offset, &item->args[3], sizeof(off_t));
+            if (item->op == PREADV) {
+                item->ret = preadv(fd,
+                                   (const struct iovec *)item->args[1],
+                                   (int)item->args[2],
+                                   offset);
+            } else {
+                item->ret = pwritev(fd,
+                                    (const struct iovec *)item->args[1],
+                                    (int)item->args[2],
+                                    offset);
+            }
+            break;
+        }
+#ifdef QTHREAD_LINUX_SENDFILE
+        case SENDFILE:
+        {
+            /* the whole count, in one trip through the queue */
+            int    out_fd, in_fd;
+            size_t count, moved = 0;
+            memcpy(&out_fd, &item->args[0], sizeof(int));
+            memcpy(&in_fd, &item->args[1], sizeof(int));
+            memcpy(&count, &item->args[3], sizeof(size_t));
+            item->ret = 0;
+            while (moved < count) {
+                ssize_t ret = sendfile(out_fd, in_fd, (off_t *)item->args[2], count - moved);
+                if (ret <= 0) {
+                    if ((ret < 0) && (moved == 0)) {
+                        item->ret = -1;
+                    }
+                    break;
+                }
+                moved += ret;
+            }
+            if (item->ret == 0) {
+                item->ret = moved;
+            }
+            break;
+        }
+#endif  /* ifdef QTHREAD_LINUX_SENDFILE */
+#ifdef HAVE_SPLICE
+        case SPLICE:
+        {
+            int          fd_in, fd_out;
+            size_t       len;
+            unsigned int flags;
+            memcpy(&fd_in, &item->args[0], sizeof(int));
+            memcpy(&fd_out, &item->args[2], sizeof(int));
+            memcpy(&len, &item->args[4], sizeof(size_t));
+            memcpy(&flags, &item->args[5], sizeof(unsigned int));
+            item->ret = splice(fd_in, (loff_t *)item->args[1],
+                               fd_out, (loff_t *)item->args[3],
+                               len, flags);
+            break;
+        }
+#endif  /* ifdef HAVE_SPLICE */
+#ifdef HAVE_COPY_FILE_RANGE
+        case COPY_FILE_RANGE:
+        {
+            /* like SENDFILE, the whole range or an error */
+            int          fd_in, fd_out;
+            size_t       len, moved = 0;
+            unsigned int flags;
+            memcpy(&fd_in, &item->args[0], sizeof(int));
+            memcpy(&fd_out, &item->args[2], sizeof(int));
+            memcpy(&len, &item->args[4], sizeof(size_t));
+            memcpy(&flags, &item->args[5], sizeof(unsigned int));
+            item->ret = 0;
+            while (moved < len) {
+                ssize_t ret = copy_file_range(fd_in, (loff_t *)item->args[1],
+                                              fd_out, (loff_t *)item->args[3],
+                                              len - moved, flags);
+                if (ret <= 0) {
+                    if ((ret < 0) && (moved == 0)) {
+                        item->ret = -1;
+                    }
+                    break;
+                }
+                moved += ret;
+            }
+            if (item->ret == 0) {
+                item->ret = moved;
+            }
+            break;
+        }
+#endif  /* ifdef HAVE_COPY_FILE_RANGE */
         case USER_DEFINED:
         {
             qt_context_t my_context;
@@ -357,40 +755,82 @@ int INTERNAL qt_process_blocking_call(void)
             break;
         }
     }
-    /* and now, re-queue */
-    qt_threadqueue_enqueue(item->thread->rdata->shepherd_ptr->ready, item->thread);
-    FREE_SYSCALLJOB(item);
+    item->err = errno;
+    qt_blocking_latency_record(qt_timer_now() - item->queued);
+    /* and now, re-queue on the task's own shepherd; the job belongs to the
+     * thread that made it, except for user-defined actions, which have no one
+     * else to free them */
+    {
+        qthread_t *t = item->thread;
+
+        if (item->op == USER_DEFINED) {
+            FREE_SYSCALLJOB(item);
+        }
+        QTHREAD_LATENCY_READY(t, QT_LATENCY_IO);
+        qt_threadqueue_enqueue(t->rdata->shepherd_ptr->ready, t);
+    }
     return 0;
 } /*}}}*/
 
 void INTERNAL qt_blocking_subsystem_enqueue(qt_blocking_queue_node_t *job)
 {   /*{{{*/
     qt_blocking_queue_node_t *prev;
+    qt_blocking_queue_t      *q;
+    int                       home;
 
     qthread_debug(IO_FUNCTIONS, "entering, job = %p, thread:%p, rdata:%p\n", job, job->thread, job->thread->rdata);
     assert(job->next == NULL);
     assert(job->thread->rdata);
-    QTHREAD_LOCK(&theQueue.lock);
-    qthread_debug(IO_DETAILS, "1) theQueue.head = %p, .tail = %p, job = %p\n", theQueue.head, theQueue.tail, job);
-    prev          = theQueue.tail;
-    theQueue.tail = job;
+    if (job->op == SLEEP_UNTIL) {
+        qt_timer_arm(job->thread->rdata->shepherd_ptr, (qt_timer_t *)job->args[0]);
+        return;
+    } else if (job->op == FD_READY) {
+        if (qt_io_reactor_register(job)) {
+            return;
+        }
+        /* the reactor can't take it, so a proxy poll()s for it instead */
+        job->op = POLL;
+    } else if (qt_io_uring_submit(job)) {
+        return;
+    }
+    job->queued = qt_timer_now();
+    home        = job->thread->rdata->shepherd_ptr->shepherd_id;
+    q           = &queues[home];
+    QTHREAD_LOCK(&q->lock);
+    qthread_debug(IO_DETAILS, "1) queue %i head = %p, .tail = %p, job = %p\n", home, q->head, q->tail, job);
+    prev    = q->tail;
+    q->tail = job;
     if (prev == NULL) {
-        theQueue.head = job;
+        q->head = job;
     } else {
         prev->next = job;
     }
-    theQueue.length++;
-    qthread_debug(IO_DETAILS, "2) theQueue.head = %p, .tail = %p, job = %p\n", theQueue.head, theQueue.tail, job);
-    if (io_worker_count < theQueue.length) {
-        if (io_worker_count < io_worker_max) {
-            qthread_debug(IO_DETAILS, "++++++++++++++++++++ I think I oughta spawn a worker\n");
-            qt_blocking_subsystem_spawnworker();
-        }
+    q->length++;
+    qthread_debug(IO_DETAILS, "2) queue %i head = %p, .tail = %p, job = %p\n", home, q->head, q->tail, job);
+    if (qt_blocking_queue_wake(q)) {
+        QTHREAD_UNLOCK(&q->lock);
+    } else if (qt_blocking_subsystem_spawnworker(home)) {
+        qthread_debug(IO_DETAILS, "++++++++++++++++++++ spawned a worker\n");
+        QTHREAD_UNLOCK(&q->lock);
     } else {
-        qthread_debug(IO_DETAILS, "Queue is %u long, there are %u workers\n", (unsigned)theQueue.length, (unsigned)io_worker_count);
-        QTHREAD_COND_SIGNAL(theQueue.notempty);
+        QTHREAD_UNLOCK(&q->lock);
+        /* no more proxies allowed; get an idle one from elsewhere to steal it */
+        for (int i = 1; i < nqueues; i++) {
+            qt_blocking_queue_t *other = &queues[(home + i) % nqueues];
+            int                  woke;
+
+            if (other->idle == 0) {
+                continue;
+            }
+            QTHREAD_LOCK(&other->lock);
+            woke = qt_blocking_queue_wake(other);
+            QTHREAD_UNLOCK(&other->lock);
+            if (woke) {
+                break;
+            }
+        }
+        qthread_debug(IO_DETAILS, "Queue %i is %u long, there are %u workers\n", home, (unsigned)q->length, (unsigned)io_worker_count);
     }
-    QTHREAD_UNLOCK(&theQueue.lock);
     qthread_debug(IO_FUNCTIONS, "exiting, job = %p\n", job);
 } /*}}}*/
 
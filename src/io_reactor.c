@@ -0,0 +1,288 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <qthread/qthread-int.h>       /* for uint64_t */
+#include <poll.h>                      /* for struct pollfd */
+#include <errno.h>
+#ifdef HAVE_SYS_EPOLL_H
+# include <fcntl.h>                    /* for fcntl() and O_NONBLOCK */
+# include <unistd.h>                   /* for close() */
+# include <sys/stat.h>                 /* for fstat() */
+# include <sys/resource.h>             /* for getrlimit() */
+# include <sys/epoll.h>
+#endif
+
+/* Internal Headers */
+#include "qt_io.h"
+#include "qt_macros.h"
+#include "qt_asserts.h"
+#include "qthread_innards.h" /* for qlib */
+#include "qt_threadqueues.h"
+#include "qt_debug.h"
+#include "qt_envariables.h"
+#include "qt_subsystems.h"
+#include "qt_latency.h"
+
+/*
+ * The I/O reactor. A task that calls qt_read() & co. on a non-blocking socket
+ * or pipe makes the call itself, and if the call would block, the task parks
+ * in its shepherd's epoll set instead of occupying a proxy pthread. Idle
+ * workers poll their shepherd's set (qt_io_reactor_idle(), called from the
+ * schedulers' dequeue loops), as do busy ones every QT_IO_BUSY_POLL tasks
+ * (qt_io_reactor_tick(), from the scheduling loop), and make the tasks whose
+ * fds are ready runnable again; those tasks then retry the call. Regular files, blocking fds, and
+ * everything else still go through the proxy pool in io.c.
+ *
+ * Whether an fd refers to a file on disk is looked up once, and remembered
+ * until the fd is closed through qt_close() (or close(), where that is
+ * intercepted) or comes back from qt_accept(). Whether anything else is in
+ * non-blocking mode is checked on every call, with one fcntl(): it may have
+ * been changed since, or the fd closed behind our back and its number reused,
+ * and running a call that blocks on a worker stalls everything queued there.
+ */
+
+saligned_t qt_io_reactor_parked = 0; /* tasks parked in all of the sets */
+
+#ifdef HAVE_SYS_EPOLL_H
+
+# define REACTOR_BATCH 64 /* events handled per poll */
+
+typedef struct {
+    int        epfd;
+    saligned_t parked;  /* tasks parked in this set */
+    aligned_t  polling; /* a worker is polling this set */
+    uint32_t   padding[CACHELINE_WIDTH / sizeof(uint32_t)];
+} qt_io_reactor_t;
+
+static qt_io_reactor_t *reactors = NULL;
+
+enum {
+    FD_UNKNOWN = 0,
+    FD_FILE,     /* regular file, block device or directory */
+    FD_STREAM,   /* anything else, in blocking mode when last seen */
+    FD_POLLABLE  /* anything else, in non-blocking mode when last seen */
+};
+
+# define FD_CLASSES_MAX (1 << 20)
+
+static uint8_t *fd_classes  = NULL; /* what each fd is, indexed by fd */
+static size_t   fd_nclasses = 0;
+
+static void qt_io_reactor_internal_teardown(void)
+{   /*{{{*/
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        close(reactors[i].epfd);
+    }
+    FREE(reactors, qlib->nshepherds * sizeof(qt_io_reactor_t));
+    reactors             = NULL;
+    qt_io_reactor_parked = 0;
+    free(fd_classes);
+    fd_classes  = NULL;
+    fd_nclasses = 0;
+} /*}}}*/
+
+void INTERNAL qt_io_reactor_init(void)
+{   /*{{{*/
+    if (!qt_internal_get_env_bool("IO_REACTOR", 1)) {
+        qthread_debug(IO_BEHAVIOR, "reactor disabled; all I/O goes to the proxies\n");
+        return;
+    }
+    reactors = MALLOC(qlib->nshepherds * sizeof(qt_io_reactor_t));
+    assert(reactors);
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        reactors[i].epfd    = epoll_create1(EPOLL_CLOEXEC);
+        reactors[i].parked  = 0;
+        reactors[i].polling = 0;
+        if (reactors[i].epfd < 0) {
+            qthread_debug(IO_BEHAVIOR, "epoll_create1() failed (%i); reactor disabled\n", errno);
+            while (i-- > 0) {
+                close(reactors[i].epfd);
+            }
+            FREE(reactors, qlib->nshepherds * sizeof(qt_io_reactor_t));
+            reactors = NULL;
+            return;
+        }
+    }
+    {
+        struct rlimit rl;
+
+        /* fds beyond the table are classified on every call instead */
+        if ((getrlimit(RLIMIT_NOFILE, &rl) == 0) && (rl.rlim_cur < FD_CLASSES_MAX)) {
+            fd_nclasses = (size_t)rl.rlim_cur;
+        } else {
+            fd_nclasses = FD_CLASSES_MAX;
+        }
+        fd_classes = calloc(fd_nclasses, sizeof(uint8_t));
+        if (fd_classes == NULL) {
+            fd_nclasses = 0;
+        }
+    }
+    /* like the proxies' queue, this must outlive the shepherds */
+    qthread_internal_cleanup(qt_io_reactor_internal_teardown);
+} /*}}}*/
+
+int INTERNAL qt_io_reactor_pollable(int fd)
+{   /*{{{*/
+    const int cached = (fd >= 0) && ((size_t)fd < fd_nclasses);
+    uint8_t   cls    = cached ? fd_classes[fd] : FD_UNKNOWN;
+    int       flags;
+
+    if (reactors == NULL) {
+        return 0;
+    }
+    if (cls == FD_FILE) {
+        return 0;
+    } else if (cls == FD_UNKNOWN) {
+        struct stat st;
+
+        if (fstat(fd, &st) != 0) {
+            return 0;
+        }
+        /* readiness means nothing for files on disk: reading them "blocks"
+         * no matter what epoll says, so they stay with the proxies */
+        if (S_ISREG(st.st_mode) || S_ISBLK(st.st_mode) || S_ISDIR(st.st_mode)) {
+            cls = FD_FILE;
+        }
+    }
+    if (cls != FD_FILE) {
+        flags = fcntl(fd, F_GETFL);
+        if (flags < 0) {
+            return 0;
+        }
+        cls = (flags & O_NONBLOCK) ? FD_POLLABLE : FD_STREAM;
+    }
+    if (cached) {
+        fd_classes[fd] = cls;
+    }
+    return cls == FD_POLLABLE;
+} /*}}}*/
+
+void INTERNAL qt_io_reactor_forget(int fd)
+{   /*{{{*/
+    if ((fd >= 0) && ((size_t)fd < fd_nclasses)) {
+        fd_classes[fd] = FD_UNKNOWN;
+    }
+} /*}}}*/
+
+int INTERNAL qt_io_reactor_register(qt_blocking_queue_node_t *job)
+{   /*{{{*/
+    qt_io_reactor_t    *r;
+    struct pollfd      *pfd = (struct pollfd *)job->args[0];
+    struct epoll_event  ev;
+
+    assert(job->op == FD_READY);
+    assert(reactors);
+    r = &reactors[job->thread->rdata->shepherd_ptr->shepherd_id];
+
+    ev.events   = EPOLLONESHOT;
+    ev.events  |= (pfd->events & POLLIN) ? EPOLLIN : 0;
+    ev.events  |= (pfd->events & POLLOUT) ? EPOLLOUT : 0;
+    ev.data.ptr = job;
+    /* count the task before it can possibly be woken */
+    (void)qthread_incr(&r->parked, 1);
+    (void)qthread_incr(&qt_io_reactor_parked, 1);
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, pfd->fd, &ev) != 0) {
+        /* most likely EEXIST: another task on this shepherd is already
+         * waiting on this fd, and a set holds each fd only once */
+        qthread_debug(IO_DETAILS, "epoll_ctl(ADD, %i) failed (%i)\n", pfd->fd, errno);
+        (void)qthread_incr(&r->parked, -1);
+        (void)qthread_incr(&qt_io_reactor_parked, -1);
+        return 0;
+    }
+    qthread_debug(IO_DETAILS, "parked thread %p on fd %i\n", job->thread, pfd->fd);
+    return 1;
+} /*}}}*/
+
+int INTERNAL qt_io_reactor_poll(qthread_shepherd_t *shep)
+{   /*{{{*/
+    qt_io_reactor_t   *r;
+    struct epoll_event evs[REACTOR_BATCH];
+    int                n;
+
+    if ((reactors == NULL) || (shep == NULL)) {
+        return 0;
+    }
+    r = &reactors[shep->shepherd_id];
+    if ((r->parked == 0) || (qthread_cas(&r->polling, 0, 1) != 0)) {
+        return 0;
+    }
+    n = epoll_wait(r->epfd, evs, REACTOR_BATCH, 0);
+    for (int i = 0; i < n; ++i) {
+        qt_blocking_queue_node_t *job = (qt_blocking_queue_node_t *)evs[i].data.ptr;
+        struct pollfd            *pfd = (struct pollfd *)job->args[0];
+        qthread_t                *t   = job->thread;
+
+        pfd->revents = (short)(((evs[i].events & EPOLLIN) ? POLLIN : 0) |
+                               ((evs[i].events & EPOLLOUT) ? POLLOUT : 0) |
+                               ((evs[i].events & EPOLLERR) ? POLLERR : 0) |
+                               ((evs[i].events & EPOLLHUP) ? POLLHUP : 0));
+        /* the task re-registers if it has to wait again */
+        (void)epoll_ctl(r->epfd, EPOLL_CTL_DEL, pfd->fd, NULL);
+        (void)qthread_incr(&r->parked, -1);
+        (void)qthread_incr(&qt_io_reactor_parked, -1);
+        /* from here on, job belongs to the task again */
+        qthread_debug(IO_DETAILS, "fd %i ready, waking thread %p\n", pfd->fd, t);
+        QTHREAD_LATENCY_READY(t, QT_LATENCY_IO);
+        qt_threadqueue_enqueue(t->rdata->shepherd_ptr->ready, t);
+    }
+    r->polling = 0;
+    return (n > 0) ? n : 0;
+} /*}}}*/
+
+#else /* ifdef HAVE_SYS_EPOLL_H */
+
+void INTERNAL qt_io_reactor_init(void)
+{}
+
+int INTERNAL qt_io_reactor_pollable(int QUNUSED(fd))
+{
+    return 0;
+}
+
+void INTERNAL qt_io_reactor_forget(int QUNUSED(fd))
+{}
+
+int INTERNAL qt_io_reactor_register(qt_blocking_queue_node_t *QUNUSED(job))
+{
+    return 0;
+}
+
+int INTERNAL qt_io_reactor_poll(qthread_shepherd_t *QUNUSED(shep))
+{
+    return 0;
+}
+
+#endif /* ifdef HAVE_SYS_EPOLL_H */
+
+void INTERNAL qt_io_reactor_wait(int   fd,
+                                 short events)
+{   /*{{{*/
+    qthread_t                *me  = qthread_internal_self();
+    qt_blocking_queue_node_t *job = ALLOC_SYSCALLJOB();
+    struct pollfd             pfd;
+    nfds_t                    nfds    = 1;
+    int                       timeout = -1;
+
+    assert(job);
+    assert(me->rdata);
+    pfd.fd      = fd;
+    pfd.events  = events;
+    pfd.revents = 0;
+    job->next   = NULL;
+    job->thread = me;
+    job->op     = FD_READY;
+    /* laid out as a POLL job, so the proxies can take it over if the
+     * reactor can't (see qt_blocking_subsystem_enqueue()) */
+    job->args[0] = (uintptr_t)&pfd;
+    memcpy(&job->args[1], &nfds, sizeof(nfds_t));
+    memcpy(&job->args[2], &timeout, sizeof(int));
+
+    me->rdata->blockedon.io = job;
+    me->thread_state        = QTHREAD_STATE_SYSCALL;
+    qthread_back_to_master(me);
+    FREE_SYSCALLJOB(job);
+} /*}}}*/
+
+/* vim:set expandtab: */
@@ -0,0 +1,377 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <qthread/qthread-int.h>       /* for uint64_t */
+#include <errno.h>
+#include <sys/uio.h>                   /* for struct iovec */
+#ifdef QTHREAD_USE_IO_URING
+# include <string.h>                   /* for memset() */
+# include <unistd.h>                   /* for syscall() and close() */
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+#endif
+
+/* Public Headers */
+#include "qthread/qt_syscalls.h"
+
+/* Internal Headers */
+#include "qt_io.h"
+#include "qt_macros.h"
+#include "qt_asserts.h"
+#include "qthread_innards.h" /* for qlib */
+#include "qt_threadqueues.h"
+#include "qt_debug.h"
+#include "qt_envariables.h"
+#include "qt_subsystems.h"
+#include "qt_latency.h"
+
+/*
+ * io_uring submission for file I/O. Each shepherd has a ring. When a task's
+ * read/write job reaches qt_blocking_subsystem_enqueue() (i.e. once the task
+ * has switched out), it becomes an SQE in the ring of the shepherd the task
+ * last ran on, and the task stays parked until its CQE shows up. Whichever
+ * worker publishes an SQE hands everything published so far to the kernel in
+ * one io_uring_enter(), unless another worker is already doing so, in which
+ * case that worker picks it up. Completions are reaped, in batches and
+ * without a system call, by the idle workers (through qt_io_reactor_idle(),
+ * which counts in-flight SQEs as parked tasks), and every so often by busy
+ * ones (through qt_io_reactor_tick()). When a ring is missing or
+ * full, the job goes to the proxy pthreads as before.
+ */
+
+#ifdef QTHREAD_USE_IO_URING
+
+typedef struct {
+    int                   fd;
+    /* the submission queue */
+    unsigned             *sq_head;
+    unsigned             *sq_tail;
+    unsigned              sq_mask;
+    unsigned              sq_entries;
+    unsigned             *sq_array;
+    struct io_uring_sqe  *sqes;
+    QTHREAD_FASTLOCK_TYPE sq_lock;
+    aligned_t             submitting;
+    /* the completion queue */
+    unsigned             *cq_head;
+    unsigned             *cq_tail;
+    unsigned              cq_mask;
+    unsigned              cq_entries;
+    struct io_uring_cqe  *cqes;
+    aligned_t             reaping;
+    saligned_t            inflight;
+    /* the mappings, for teardown */
+    void                 *sq_ring;
+    size_t                sq_ring_size;
+    void                 *cq_ring;
+    size_t                cq_ring_size;
+    size_t                sqes_size;
+    uint32_t              padding[CACHELINE_WIDTH / sizeof(uint32_t)];
+} qt_io_ring_t;
+
+static qt_io_ring_t *rings = NULL;
+
+static int qt_io_ring_setup(qt_io_ring_t *r,
+                            unsigned      entries)
+{   /*{{{*/
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) {
+        return -1;
+    }
+    if ((p.features & IORING_FEAT_RW_CUR_POS) == 0) {
+        /* then plain read() and write() can't be expressed */
+        close(r->fd);
+        return -1;
+    }
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_size    = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sq_ring      = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    r->cq_ring      = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    r->sqes         = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if ((r->sq_ring == MAP_FAILED) || (r->cq_ring == MAP_FAILED) || (r->sqes == MAP_FAILED)) {
+        if (r->sq_ring != MAP_FAILED) { munmap(r->sq_ring, r->sq_ring_size); }
+        if (r->cq_ring != MAP_FAILED) { munmap(r->cq_ring, r->cq_ring_size); }
+        if (r->sqes != MAP_FAILED) { munmap(r->sqes, r->sqes_size); }
+        close(r->fd);
+        return -1;
+    }
+    r->sq_head    = (unsigned *)((char *)r->sq_ring + p.sq_off.head);
+    r->sq_tail    = (unsigned *)((char *)r->sq_ring + p.sq_off.tail);
+    r->sq_mask    = *(unsigned *)((char *)r->sq_ring + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->sq_array   = (unsigned *)((char *)r->sq_ring + p.sq_off.array);
+    r->cq_head    = (unsigned *)((char *)r->cq_ring + p.cq_off.head);
+    r->cq_tail    = (unsigned *)((char *)r->cq_ring + p.cq_off.tail);
+    r->cq_mask    = *(unsigned *)((char *)r->cq_ring + p.cq_off.ring_mask);
+    r->cq_entries = p.cq_entries;
+    r->cqes       = (struct io_uring_cqe *)((char *)r->cq_ring + p.cq_off.cqes);
+    QTHREAD_FASTLOCK_INIT(r->sq_lock);
+    r->submitting = 0;
+    r->reaping    = 0;
+    r->inflight   = 0;
+    return 0;
+} /*}}}*/
+
+static void qt_io_ring_teardown(qt_io_ring_t *r)
+{   /*{{{*/
+    munmap(r->sqes, r->sqes_size);
+    munmap(r->cq_ring, r->cq_ring_size);
+    munmap(r->sq_ring, r->sq_ring_size);
+    close(r->fd);
+    QTHREAD_FASTLOCK_DESTROY(r->sq_lock);
+} /*}}}*/
+
+static void qt_io_uring_internal_teardown(void)
+{   /*{{{*/
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        qt_io_ring_teardown(&rings[i]);
+    }
+    FREE(rings, qlib->nshepherds * sizeof(qt_io_ring_t));
+    rings = NULL;
+} /*}}}*/
+
+void INTERNAL qt_io_uring_init(void)
+{   /*{{{*/
+    unsigned entries;
+
+    if (!qt_internal_get_env_bool("IO_URING", 1)) {
+        qthread_debug(IO_BEHAVIOR, "io_uring disabled; file I/O goes to the proxies\n");
+        return;
+    }
+    entries = (unsigned)qt_internal_get_env_num("IO_URING_ENTRIES", 256, 1);
+    rings   = MALLOC(qlib->nshepherds * sizeof(qt_io_ring_t));
+    assert(rings);
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        if (qt_io_ring_setup(&rings[i], entries) != 0) {
+            qthread_debug(IO_BEHAVIOR, "io_uring_setup() failed (%i); using the proxies\n", errno);
+            while (i-- > 0) {
+                qt_io_ring_teardown(&rings[i]);
+            }
+            FREE(rings, qlib->nshepherds * sizeof(qt_io_ring_t));
+            rings = NULL;
+            return;
+        }
+    }
+    /* like the proxies' queue, this must outlive the shepherds */
+    qthread_internal_cleanup(qt_io_uring_internal_teardown);
+} /*}}}*/
+
+/* Hands every published SQE to the kernel. If someone else is already in
+ * io_uring_enter(), they will notice ours when they come back out. */
+static void qt_io_ring_flush(qt_io_ring_t *r)
+{   /*{{{*/
+    for (;;) {
+        MACHINE_FENCE;
+        if (*r->sq_head == *r->sq_tail) {
+            return;
+        }
+        if (qthread_cas(&r->submitting, 0, 1) != 0) {
+            return;
+        }
+        (void)syscall(__NR_io_uring_enter, r->fd, r->sq_entries, 0, 0, NULL, 0);
+        r->submitting = 0;
+    }
+} /*}}}*/
+
+int INTERNAL qt_io_uring_submit(qt_blocking_queue_node_t *job)
+{   /*{{{*/
+    qt_io_ring_t        *r;
+    struct io_uring_sqe *sqe;
+    unsigned             tail;
+    int                  fd;
+
+    if (rings == NULL) {
+        return 0;
+    }
+    switch (job->op) {
+        case READ: case WRITE: case PREAD: case PWRITE:
+        case PREADV: case PWRITEV: case PREAD_FIXED: case PWRITE_FIXED:
+            break;
+        default:
+            return 0;
+    }
+    r = &rings[job->thread->rdata->shepherd_ptr->shepherd_id];
+    memcpy(&fd, &job->args[0], sizeof(int));
+
+    QTHREAD_FASTLOCK_LOCK(&r->sq_lock);
+    tail = *r->sq_tail;
+    if ((tail - *r->sq_head >= r->sq_entries) || (r->inflight >= (saligned_t)r->cq_entries)) {
+        /* no room; rather than wait, let a proxy do it */
+        QTHREAD_FASTLOCK_UNLOCK(&r->sq_lock);
+        return 0;
+    }
+    sqe = &r->sqes[tail & r->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd        = fd;
+    sqe->user_data = (uint64_t)(uintptr_t)job;
+    switch (job->op) {
+        case READ:
+        case WRITE:
+            sqe->opcode = (job->op == READ) ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->addr   = (uint64_t)job->args[1];
+            sqe->len    = (uint32_t)job->args[2];
+            sqe->off    = (uint64_t)-1; /* the current file position */
+            break;
+        case PREAD:
+        case PWRITE:
+        case PREADV:
+        case PWRITEV:
+        case PREAD_FIXED:
+        case PWRITE_FIXED:
+        {
+            off_t offset;
+
+            memcpy(&offset, &job->args[3], sizeof(off_t));
+            sqe->opcode = (job->op == PREAD) ? IORING_OP_READ :
+                          (job->op == PWRITE) ? IORING_OP_WRITE :
+                          (job->op == PREADV) ? IORING_OP_READV :
+                          (job->op == PWRITEV) ? IORING_OP_WRITEV :
+                          (job->op == PREAD_FIXED) ? IORING_OP_READ_FIXED :
+                          IORING_OP_WRITE_FIXED;
+            sqe->addr = (uint64_t)job->args[1];
+            sqe->len  = (uint32_t)job->args[2]; /* bytes, or iovecs */
+            sqe->off  = (uint64_t)offset;
+            if ((job->op == PREAD_FIXED) || (job->op == PWRITE_FIXED)) {
+                sqe->buf_index = (uint16_t)job->args[4];
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    r->sq_array[tail & r->sq_mask] = tail & r->sq_mask;
+    (void)qthread_incr(&r->inflight, 1);
+    (void)qthread_incr(&qt_io_reactor_parked, 1);
+    MACHINE_FENCE; /* the SQE must be visible before the tail moves */
+    *r->sq_tail = tail + 1;
+    QTHREAD_FASTLOCK_UNLOCK(&r->sq_lock);
+
+    qthread_debug(IO_DETAILS, "queued job %p (op %i) for thread %p\n", job, (int)job->op, job->thread);
+    qt_io_ring_flush(r);
+    return 1;
+} /*}}}*/
+
+int INTERNAL qt_io_uring_reap(qthread_shepherd_t *shep)
+{   /*{{{*/
+    qt_io_ring_t *r;
+    qthread_t    *woken[64];
+    unsigned      head, tail;
+    int           n = 0;
+
+    if ((rings == NULL) || (shep == NULL)) {
+        return 0;
+    }
+    r = &rings[shep->shepherd_id];
+    if ((r->inflight == 0) || (qthread_cas(&r->reaping, 0, 1) != 0)) {
+        return 0;
+    }
+    /* pick up anything a submitter left behind */
+    qt_io_ring_flush(r);
+    head = *r->cq_head;
+    MACHINE_FENCE;
+    tail = *r->cq_tail;
+    if (head == tail) {
+        /* some completions are only posted once the kernel gets a chance to
+         * run the submitting thread's task work, so give it one */
+        (void)syscall(__NR_io_uring_enter, r->fd, 0, 0, IORING_ENTER_GETEVENTS, NULL, 0);
+        MACHINE_FENCE;
+        tail = *r->cq_tail;
+    }
+    while (head != tail && n < 64) {
+        struct io_uring_cqe      *cqe = &r->cqes[head & r->cq_mask];
+        qt_blocking_queue_node_t *job = (qt_blocking_queue_node_t *)(uintptr_t)cqe->user_data;
+
+        if (cqe->res < 0) {
+            job->ret = -1;
+            job->err = -cqe->res;
+        } else {
+            job->ret = cqe->res;
+        }
+        woken[n++] = job->thread;
+        head++;
+    }
+    MACHINE_FENCE; /* done reading those CQEs */
+    *r->cq_head = head;
+    (void)qthread_incr(&r->inflight, -n);
+    (void)qthread_incr(&qt_io_reactor_parked, -n);
+    r->reaping = 0;
+    for (int i = 0; i < n; ++i) {
+        QTHREAD_LATENCY_READY(woken[i], QT_LATENCY_IO);
+        qt_threadqueue_enqueue(woken[i]->rdata->shepherd_ptr->ready, woken[i]);
+    }
+    return n;
+} /*}}}*/
+
+int qt_io_register_buffers(const struct iovec *iov,
+                           unsigned            nr)
+{   /*{{{*/
+    if (rings == NULL) {
+        return 0;
+    }
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        if (syscall(__NR_io_uring_register, rings[i].fd, IORING_REGISTER_BUFFERS, iov, nr) != 0) {
+            int err = errno;
+
+            while (i-- > 0) {
+                (void)syscall(__NR_io_uring_register, rings[i].fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+            }
+            errno = err;
+            return -1;
+        }
+    }
+    return 0;
+} /*}}}*/
+
+int qt_io_unregister_buffers(void)
+{   /*{{{*/
+    int ret = 0;
+
+    if (rings == NULL) {
+        return 0;
+    }
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        if (syscall(__NR_io_uring_register, rings[i].fd, IORING_UNREGISTER_BUFFERS, NULL, 0) != 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+} /*}}}*/
+
+#else /* ifdef QTHREAD_USE_IO_URING */
+
+void INTERNAL qt_io_uring_init(void)
+{}
+
+int INTERNAL qt_io_uring_submit(qt_blocking_queue_node_t *QUNUSED(job))
+{
+    return 0;
+}
+
+int INTERNAL qt_io_uring_reap(qthread_shepherd_t *QUNUSED(shep))
+{
+    return 0;
+}
+
+/* without a ring, the fixed-buffer calls are ordinary preads and pwrites,
+ * and there is nothing to register */
+int qt_io_register_buffers(const struct iovec *QUNUSED(iov),
+                           unsigned            QUNUSED(nr))
+{
+    return 0;
+}
+
+int qt_io_unregister_buffers(void)
+{
+    return 0;
+}
+
+#endif /* ifdef QTHREAD_USE_IO_URING */
+
+/* vim:set expandtab: */
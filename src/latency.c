@@ -0,0 +1,217 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Public Headers */
+#include "qthread/qthread.h"
+
+/* Internal Headers */
+#include "qt_latency.h"
+#include "qt_visibility.h"
+#include "qt_aligned_alloc.h"
+#include "qt_asserts.h"
+#include "qt_output_macros.h"
+#include "qt_debug.h"
+#include "qt_envariables.h"
+#include "qt_report.h"
+#include "qt_subsystems.h"
+#include "qthread_innards.h"           /* for qlib */
+
+#ifdef QTHREAD_LATENCY_PROFILING
+
+int qt_latency_enabled = 0;
+
+static const char *const kind_names[QT_LATENCY_KINDS] = {
+    NULL, "spawn", "feb", "queue", "io", "timer"
+};
+
+/* one per worker, in packed_worker_id order; only its worker writes to it */
+static qt_latency_worker_t *workers     = NULL;
+static size_t               nworkers    = 0;
+static const char          *report_path = NULL;
+
+/* the smallest and largest values that land in bucket i */
+static uint64_t bucket_low(unsigned i)
+{   /*{{{*/
+    unsigned e;
+
+    if (i < QT_LATENCY_SUB) {
+        return i;
+    }
+    e = i / QT_LATENCY_SUB + QT_LATENCY_SUB_BITS - 1;
+    return (uint64_t)(QT_LATENCY_SUB + i % QT_LATENCY_SUB) << (e - QT_LATENCY_SUB_BITS);
+} /*}}}*/
+
+static uint64_t bucket_high(unsigned i)
+{   /*{{{*/
+    return (i + 1 < QT_LATENCY_BUCKETS) ? bucket_low(i + 1) - 1 : UINT64_MAX;
+} /*}}}*/
+
+static void hist_merge(qt_latency_hist_t       *dst,
+                       const qt_latency_hist_t *src)
+{   /*{{{*/
+    const volatile qt_latency_hist_t *s = src;  /* its worker may be adding to it */
+
+    dst->count += s->count;
+    dst->sum   += s->sum;
+    if (s->max > dst->max) { dst->max = s->max; }
+    for (unsigned i = 0; i < QT_LATENCY_BUCKETS; ++i) {
+        dst->bucket[i] += s->bucket[i];
+    }
+} /*}}}*/
+
+/* The upper end of the bucket that holds the q'th quantile, which is never
+ * more than 1/16 too high, and never more than the largest value seen. The
+ * counts may be a little ahead of h->count while the workers are running. */
+static uint64_t hist_quantile(const qt_latency_hist_t *h,
+                              double                   q)
+{   /*{{{*/
+    uint64_t rank = (uint64_t)(q * h->count + 0.5);
+    uint64_t seen = 0;
+
+    if (rank == 0) { rank = 1; }
+    for (unsigned i = 0; i < QT_LATENCY_BUCKETS; ++i) {
+        seen += h->bucket[i];
+        if (seen >= rank) {
+            const uint64_t high = bucket_high(i);
+
+            return (high < h->max) ? high : h->max;
+        }
+    }
+    return h->max;
+} /*}}}*/
+
+static void latency_write_row(FILE                    *out,
+                              const char              *name,
+                              const qt_latency_hist_t *h)
+{   /*{{{*/
+    fprintf(out, "%-8s %12lu", name, (unsigned long)h->count);
+    if (h->count == 0) {
+        fprintf(out, " %12s %12s %12s %12s %12s %12s\n", "-", "-", "-", "-", "-", "-");
+        return;
+    }
+    fprintf(out, " %12.3f %12.3f %12.3f %12.3f %12.3f %12.3f\n",
+            h->sum / 1000.0 / h->count,
+            hist_quantile(h, 0.50) / 1000.0,
+            hist_quantile(h, 0.90) / 1000.0,
+            hist_quantile(h, 0.99) / 1000.0,
+            hist_quantile(h, 0.999) / 1000.0,
+            h->max / 1000.0);
+} /*}}}*/
+
+static void latency_report(FILE *out)
+{   /*{{{*/
+    qt_latency_hist_t *merged;
+    qt_latency_hist_t *all;
+    const size_t       size = (QT_LATENCY_KINDS + 1) * sizeof(qt_latency_hist_t);
+
+    merged = MALLOC(size);
+    assert(merged);
+    memset(merged, 0, size);
+    all = &merged[QT_LATENCY_KINDS];
+    for (size_t w = 0; w < nworkers; ++w) {
+        for (int k = 1; k < QT_LATENCY_KINDS; ++k) {
+            hist_merge(&merged[k], &workers[w].hist[k]);
+        }
+    }
+    for (int k = 1; k < QT_LATENCY_KINDS; ++k) {
+        hist_merge(all, &merged[k]);
+    }
+
+    fprintf(out, "QTHREADS: time from ready to running, in microseconds (%lu workers)\n",
+            (unsigned long)nworkers);
+    fprintf(out, "%-8s %12s %12s %12s %12s %12s %12s %12s\n",
+            "source", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for (int k = 1; k < QT_LATENCY_KINDS; ++k) {
+        latency_write_row(out, kind_names[k], &merged[k]);
+    }
+    latency_write_row(out, "all", all);
+
+    /* the histograms themselves, for plotting or for merging across runs */
+    fprintf(out, "%-8s %20s %20s %12s\n", "bucket", "low_ns", "high_ns", "count");
+    for (int k = 1; k < QT_LATENCY_KINDS; ++k) {
+        for (unsigned i = 0; i < QT_LATENCY_BUCKETS; ++i) {
+            if (merged[k].bucket[i]) {
+                fprintf(out, "%-8s %20llu %20llu %12llu\n", kind_names[k],
+                        (unsigned long long)bucket_low(i),
+                        (unsigned long long)bucket_high(i),
+                        (unsigned long long)merged[k].bucket[i]);
+            }
+        }
+    }
+    FREE(merged, size);
+} /*}}}*/
+
+static int latency_write(const char *path)
+{   /*{{{*/
+    FILE *out = stdout;
+
+    if ((path != NULL) && (path[0] != 0) && strcmp(path, "-")) {
+        out = fopen(path, "w");
+        if (out == NULL) {
+            print_warning("could not write latency report %s (%s)\n", path, strerror(errno));
+            return QTHREAD_THIRD_PARTY_ERROR;
+        }
+    }
+    latency_report(out);
+    if (out != stdout) {
+        fclose(out);
+    } else {
+        fflush(out);
+    }
+    return QTHREAD_SUCCESS;
+} /*}}}*/
+
+static qt_report_t report = { "latency report", latency_write, NULL, 0, 0 };
+
+static void qt_latency_internal_teardown(void)
+{   /*{{{*/
+    (void)latency_write(report_path);
+    qthread_internal_aligned_free(workers, CACHELINE_WIDTH);
+    workers            = NULL;
+    nworkers           = 0;
+    qt_latency_enabled = 0;
+} /*}}}*/
+
+void INTERNAL qt_latency_subsystem_init(void)
+{   /*{{{*/
+    if (!qt_internal_get_env_bool("LATENCY", 1)) {
+        return;
+    }
+    report_path = qt_internal_get_env_str("LATENCY_REPORT", NULL);
+    nworkers    = qlib->nshepherds * qlib->nworkerspershep;
+    workers     = qthread_internal_aligned_alloc(nworkers * sizeof(qt_latency_worker_t), CACHELINE_WIDTH);
+    assert(workers);
+    memset(workers, 0, nworkers * sizeof(qt_latency_worker_t));
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        for (qthread_worker_id_t j = 0; j < qlib->nworkerspershep; ++j) {
+            qlib->shepherds[i].workers[j].latency = &workers[i * qlib->nworkerspershep + j];
+        }
+    }
+    qt_latency_enabled = 1;
+    qthread_internal_cleanup(qt_latency_internal_teardown);
+} /*}}}*/
+
+int API_FUNC qthread_latency_dump(const char *path)
+{   /*{{{*/
+    if (workers == NULL) {
+        return QTHREAD_NOT_ALLOWED;
+    }
+    return qt_report_dump(&report, path ? path : report_path);
+} /*}}}*/
+
+#else /* ifdef QTHREAD_LATENCY_PROFILING */
+
+int API_FUNC qthread_latency_dump(const char *path)
+{   /*{{{*/
+    return QTHREAD_NOT_ALLOWED;
+} /*}}}*/
+
+#endif /* ifdef QTHREAD_LATENCY_PROFILING */
+
+/* vim:set expandtab: */
@@ -43,6 +43,9 @@
 
 typedef struct threadlocal_cache_s qt_mpool_threadlocal_cache_t;
 
+/* bytes of blocks held by all of the pools, for the live statistics page */
+static aligned_t pool_bytes = 0;
+
 #ifdef TLS
 static TLS_DECL_INIT(qt_mpool_threadlocal_cache_t *, pool_caches);
 static TLS_DECL_INIT(uintptr_t, pool_cache_count);
@@ -371,6 +374,7 @@ void INTERNAL *qt_mpool_alloc(qt_mpool pool)
             pool->alloc_list[pool->alloc_list_pos] = p;
             pool->alloc_list_pos++;
             QTHREAD_FASTLOCK_UNLOCK(&pool->pool_lock);
+            qthread_incr(&pool_bytes, pool->alloc_size);
             /* store the block for later allocation */
             tc->block = p;
             tc->i     = 1;
@@ -452,6 +456,7 @@ void INTERNAL qt_mpool_destroy(qt_mpool pool)
         while (p && i < (pagesize / sizeof(void *) - 1)) {
             qt_mpool_internal_aligned_free(p,
                                            pool->alignment);
+            qthread_incr(&pool_bytes, -(int64_t)pool->alloc_size);
             i++;
             p = pool->alloc_list[i];
         }
@@ -476,4 +481,9 @@ void INTERNAL qt_mpool_destroy(qt_mpool pool)
     FREE(pool, sizeof(struct qt_mpool_s));
 }                                      /*}}} */
 
+size_t INTERNAL qt_mpool_subsystem_bytes(void)
+{                                      /*{{{ */
+    return pool_bytes;
+}                                      /*}}} */
+
 /* vim:set expandtab: */
@@ -0,0 +1,550 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef QTHREAD_PERF_COUNTERS
+
+# ifndef _GNU_SOURCE
+#  define _GNU_SOURCE                  /* for dladdr() */
+# endif
+
+/* System Headers */
+# include <errno.h>
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/perf_event.h>
+# ifdef HAVE_DLADDR
+#  include <dlfcn.h>
+# endif
+
+/* Public Headers */
+# include "qthread/qthread.h"
+
+/* Internal Headers */
+# include "qt_visibility.h"
+# include "qt_perf_counters.h"
+# include "qt_asserts.h"
+# include "qt_output_macros.h"
+# include "qt_debug.h"
+# include "qt_envariables.h"
+# include "qt_subsystems.h"
+# include "qthread_innards.h"         /* for qlib */
+
+typedef struct {
+    const char *name;
+    uint32_t    type;
+    uint64_t    config;
+} perf_event_name_t;
+
+# define LLC_READ_MISS (PERF_COUNT_HW_CACHE_LL |                  \
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |      \
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/* what QT_PERF_EVENTS may name; anything else has to be a raw event, "rNNNN" */
+static const perf_event_name_t known_events[] = {
+    { "cycles",                  PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES              },
+    { "instructions",            PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS            },
+    { "llc-misses",              PERF_TYPE_HW_CACHE, LLC_READ_MISS                         },
+    { "cache-misses",            PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES            },
+    { "stalled-cycles",          PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND  },
+    { "stalled-cycles-frontend", PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND },
+    { "branch-misses",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES           },
+    { "task-clock",              PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK              },
+    { "page-faults",             PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS             },
+    { "context-switches",        PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES        }
+};
+
+# define DEFAULT_EVENTS  "cycles,instructions,llc-misses,stalled-cycles"
+# define FALLBACK_EVENTS "task-clock,page-faults"
+
+/* the events that opened when they were tried out at startup; every worker
+ * opens all of them, in this order, with the first one leading the group */
+static perf_event_name_t events[QT_PERF_MAX_EVENTS];
+static char              event_labels[QT_PERF_MAX_EVENTS][24];
+static int               nevents = 0;
+
+/* one per worker, in packed_worker_id order */
+static qt_perf_worker_t *workers     = NULL;
+static size_t            nworkers    = 0;
+static const char       *report_path = NULL;
+static aligned_t         open_failed = 0;
+
+static int perf_open(const perf_event_name_t *e,
+                     int                      group_fd)
+{   /*{{{*/
+    struct perf_event_attr attr;
+    unsigned long          flags = 0;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = e->type;
+    attr.config         = e->config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    if (group_fd == -1) {
+        attr.read_format = PERF_FORMAT_GROUP |
+                           PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+    }
+# ifdef PERF_FLAG_FD_CLOEXEC
+    flags = PERF_FLAG_FD_CLOEXEC;
+# endif
+    /* pid 0, cpu -1: the calling thread, wherever it runs */
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, flags);
+} /*}}}*/
+
+/* A PERF_FORMAT_GROUP read: nr, time enabled, time running, then the
+ * values in the order the events were opened. */
+static int perf_read_group(qt_perf_worker_t *p,
+                           uint64_t         *values)
+{   /*{{{*/
+    uint64_t buf[3 + QT_PERF_MAX_EVENTS];
+    ssize_t  len = read(p->fds[0], buf, sizeof(buf));
+
+    if ((len < (ssize_t)(3 * sizeof(uint64_t))) || (buf[0] != (uint64_t)nevents)) {
+        return 0;
+    }
+    p->enabled = buf[1];
+    p->running = buf[2];
+    memcpy(values, buf + 3, nevents * sizeof(uint64_t));
+    return 1;
+} /*}}}*/
+
+/* The count the kernel saved in the event's page, plus what its PMU counter
+ * has counted since, as perf_event_open(2) describes; the kernel bumps lock
+ * whenever it changes the page, so a read that spans that is done over.
+ * Returns 0 if the event isn't on a PMU counter just now (a software event,
+ * or a multiplexed one that's been switched out), or if user code may not
+ * run rdpmc, leaving it to read(). */
+static int perf_rdpmc(const struct perf_event_mmap_page *pc,
+                      uint64_t                          *value)
+{   /*{{{*/
+# if (QTHREAD_ASSEMBLY_ARCH == QTHREAD_AMD64) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_IA32)
+    uint32_t seq, idx, lo, hi;
+    uint16_t width;
+    int64_t  count;
+
+    do {
+        seq = pc->lock;
+        COMPILER_FENCE;
+        idx   = pc->index;
+        width = pc->pmc_width;
+        if (!pc->cap_user_rdpmc || (idx == 0) || (width == 0) || (width > 64)) {
+            return 0;
+        }
+        count = pc->offset;
+        __asm__ __volatile__ ("rdpmc" : "=a" (lo), "=d" (hi) : "c" (idx - 1));
+        /* the counter is width bits wide, and signed */
+        count += (int64_t)((((uint64_t)hi << 32) | lo) << (64 - width)) >> (64 - width);
+        COMPILER_FENCE;
+    } while (pc->lock != seq);
+    *value = (uint64_t)count;
+    return 1;
+
+# else
+    return 0;
+# endif
+} /*}}}*/
+
+static int perf_read(qt_perf_worker_t *p,
+                     uint64_t         *values)
+{   /*{{{*/
+    for (int i = 0; i < nevents; ++i) {
+        if ((p->pages[i] == NULL) || !perf_rdpmc(p->pages[i], &values[i])) {
+            return perf_read_group(p, values);
+        }
+    }
+    /* as of the last time the kernel scheduled the group, which is good
+     * enough for telling whether it was multiplexed */
+    p->enabled = ((const struct perf_event_mmap_page *)p->pages[0])->time_enabled;
+    p->running = ((const struct perf_event_mmap_page *)p->pages[0])->time_running;
+    return 1;
+} /*}}}*/
+
+static int parse_event(const char        *name,
+                       size_t             len,
+                       perf_event_name_t *e)
+{   /*{{{*/
+    for (size_t i = 0; i < sizeof(known_events) / sizeof(known_events[0]); ++i) {
+        if ((strlen(known_events[i].name) == len) &&
+            (strncmp(known_events[i].name, name, len) == 0)) {
+            *e = known_events[i];
+            return 1;
+        }
+    }
+    if ((len > 1) && (name[0] == 'r')) {
+        char  hex[20];
+        char *end;
+
+        if (len - 1 < sizeof(hex)) {
+            memcpy(hex, name + 1, len - 1);
+            hex[len - 1] = 0;
+            e->name   = NULL;
+            e->type   = PERF_TYPE_RAW;
+            e->config = strtoull(hex, &end, 16);
+            if (*end == 0) { return 1; }
+        }
+    }
+    return 0;
+} /*}}}*/
+
+/* Tries each event in the list on the calling thread, and keeps the ones that
+ * open. Returns how many were kept. */
+static int choose_events(const char *list,
+                         int         quiet)
+{   /*{{{*/
+    const char *s = list;
+
+    nevents = 0;
+    while (*s && (nevents < QT_PERF_MAX_EVENTS)) {
+        size_t            len = strcspn(s, ",");
+        perf_event_name_t e;
+        int               fd;
+
+        if (len == 0) {
+            s++;
+            continue;
+        }
+        if (!parse_event(s, len, &e)) {
+            print_warning("unknown perf event \"%.*s\" in QT_PERF_EVENTS\n", (int)len, s);
+        } else if ((fd = perf_open(&e, -1)) < 0) {
+            if (!quiet) {
+                print_warning("perf event \"%.*s\" is not available (%s)\n",
+                              (int)len, s, strerror(errno));
+            }
+        } else {
+            close(fd);
+            snprintf(event_labels[nevents], sizeof(event_labels[0]), "%.*s", (int)len, s);
+            events[nevents] = e;
+            nevents++;
+        }
+        s += len;
+    }
+    return nevents;
+} /*}}}*/
+
+void INTERNAL qt_perf_worker_start(qthread_worker_t *w)
+{   /*{{{*/
+    qt_perf_worker_t *p;
+    int               fds[QT_PERF_MAX_EVENTS];
+    const long        pagesize = sysconf(_SC_PAGESIZE);
+
+    if (workers == NULL) { return; }
+    p = &workers[w->shepherd->shepherd_id * qlib->nworkerspershep + w->worker_id];
+    for (int i = 0; i < nevents; ++i) {
+        fds[i] = perf_open(&events[i], (i == 0) ? -1 : fds[0]);
+        if (fds[i] < 0) {
+            /* the group won't fit on this CPU's counters, say; no use
+             * reporting the same thing for every worker */
+            if (qthread_incr(&open_failed, 1) == 0) {
+                print_warning("could not open the perf counters on a worker (%s: %s); "
+                              "it will not be counted\n",
+                              event_labels[i], strerror(errno));
+            }
+            while (i-- > 0) {
+                close(fds[i]);
+            }
+            return;
+        }
+    }
+    for (int i = 0; i < nevents; ++i) {
+        p->fds[i]   = fds[i];
+        p->pages[i] = mmap(NULL, (size_t)pagesize, PROT_READ, MAP_SHARED, fds[i], 0);
+        if (p->pages[i] == MAP_FAILED) {
+            p->pages[i] = NULL;        /* so it is read() every time */
+        }
+    }
+    p->mask = 63;
+    p->used = 0;
+    p->table = MALLOC((p->mask + 1) * sizeof(qt_perf_entry_t));
+    assert(p->table);
+    memset(p->table, 0, (p->mask + 1) * sizeof(qt_perf_entry_t));
+    w->perf = p;
+} /*}}}*/
+
+static qt_perf_entry_t *table_slot(qt_perf_entry_t *table,
+                                   size_t           mask,
+                                   void            *f)
+{   /*{{{*/
+    size_t i = (((uintptr_t)f >> 4) * 0x9E3779B97F4A7C15ULL) & mask;
+
+    while (table[i].used && (table[i].f != f)) {
+        i = (i + 1) & mask;
+    }
+    return &table[i];
+} /*}}}*/
+
+static qt_perf_entry_t *table_find(qt_perf_worker_t *p,
+                                   void             *f)
+{   /*{{{*/
+    qt_perf_entry_t *e = table_slot(p->table, p->mask, f);
+
+    if (!e->used) {
+        if (2 * (p->used + 1) > p->mask + 1) {
+            const size_t     oldsize = p->mask + 1;
+            qt_perf_entry_t *old     = p->table;
+
+            p->mask  = 2 * oldsize - 1;
+            p->table = MALLOC(2 * oldsize * sizeof(qt_perf_entry_t));
+            assert(p->table);
+            memset(p->table, 0, 2 * oldsize * sizeof(qt_perf_entry_t));
+            for (size_t i = 0; i < oldsize; ++i) {
+                if (old[i].used) {
+                    *table_slot(p->table, p->mask, old[i].f) = old[i];
+                }
+            }
+            FREE(old, oldsize * sizeof(qt_perf_entry_t));
+            e = table_slot(p->table, p->mask, f);
+        }
+        e->used = 1;
+        e->f    = f;
+        p->used++;
+    }
+    return e;
+} /*}}}*/
+
+void INTERNAL qt_perf_internal_begin(qt_perf_worker_t *p)
+{   /*{{{*/
+    if (!perf_read(p, p->start)) {
+        memset(p->start, 0, sizeof(p->start));
+    }
+} /*}}}*/
+
+void INTERNAL qt_perf_internal_end(qt_perf_worker_t *p,
+                                   void             *f,
+                                   int               done)
+{   /*{{{*/
+    uint64_t         now[QT_PERF_MAX_EVENTS];
+    qt_perf_entry_t *e = table_find(p, f);
+
+    e->slices++;
+    e->tasks += (done != 0);
+    if (perf_read(p, now)) {
+        for (int i = 0; i < nevents; ++i) {
+            e->count[i] += now[i] - p->start[i];
+        }
+    }
+} /*}}}*/
+
+static const char *function_name(void  *f,
+                                 char  *buf,
+                                 size_t len)
+{   /*{{{*/
+# ifdef HAVE_DLADDR
+    Dl_info info;
+# endif
+
+    if (f == NULL) {
+        return "(main)";
+    }
+# ifdef HAVE_DLADDR
+    if (dladdr(f, &info) && info.dli_sname) {
+        if (info.dli_saddr == f) {
+            return info.dli_sname;
+        }
+        snprintf(buf, len, "%s+%#lx", info.dli_sname,
+                 (unsigned long)((uintptr_t)f - (uintptr_t)info.dli_saddr));
+        return buf;
+    }
+# endif
+    snprintf(buf, len, "%p", f);
+    return buf;
+} /*}}}*/
+
+static int event_index(uint32_t type,
+                       uint64_t config)
+{   /*{{{*/
+    for (int i = 0; i < nevents; ++i) {
+        if ((events[i].type == type) && (events[i].config == config)) {
+            return i;
+        }
+    }
+    return -1;
+} /*}}}*/
+
+static int by_first_count(const void *a,
+                          const void *b)
+{   /*{{{*/
+    const qt_perf_entry_t *x = a, *y = b;
+
+    if (x->count[0] != y->count[0]) {
+        return (x->count[0] < y->count[0]) ? 1 : -1;
+    }
+    return (x->slices < y->slices) ? 1 : (x->slices > y->slices) ? -1 : 0;
+} /*}}}*/
+
+static void perf_write_row(FILE                  *out,
+                           const char            *name,
+                           const qt_perf_entry_t *e,
+                           int                    cyc,
+                           int                    ins,
+                           int                    llc,
+                           int                    stall)
+{   /*{{{*/
+    fprintf(out, "%-32s %10lu %10lu", name, (unsigned long)e->slices, (unsigned long)e->tasks);
+    for (int i = 0; i < nevents; ++i) {
+        fprintf(out, " %16llu", (unsigned long long)e->count[i]);
+    }
+    if ((cyc >= 0) && (ins >= 0)) {
+        fprintf(out, " %6.2f", e->count[cyc] ? (double)e->count[ins] / e->count[cyc] : 0.0);
+    }
+    if ((llc >= 0) && (ins >= 0)) {
+        fprintf(out, " %7.2f", e->count[ins] ? 1000.0 * e->count[llc] / e->count[ins] : 0.0);
+    }
+    if ((stall >= 0) && (cyc >= 0)) {
+        fprintf(out, " %6.1f%%", e->count[cyc] ? 100.0 * e->count[stall] / e->count[cyc] : 0.0);
+    }
+    fprintf(out, "\n");
+} /*}}}*/
+
+static void perf_report(FILE *out)
+{   /*{{{*/
+    qt_perf_worker_t merged;
+    qt_perf_entry_t  total;
+    qt_perf_entry_t *rows;
+    size_t           nrows = 0, counted = 0;
+    uint64_t         enabled = 0, running = 0;
+    const int        cyc   = event_index(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    const int        ins   = event_index(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    int              llc   = event_index(PERF_TYPE_HW_CACHE, LLC_READ_MISS);
+    const int        stall = event_index(PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND);
+
+    if (llc < 0) {
+        llc = event_index(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    }
+    memset(&merged, 0, sizeof(merged));
+    memset(&total, 0, sizeof(total));
+    merged.mask  = 63;
+    merged.table = MALLOC((merged.mask + 1) * sizeof(qt_perf_entry_t));
+    assert(merged.table);
+    memset(merged.table, 0, (merged.mask + 1) * sizeof(qt_perf_entry_t));
+    for (size_t w = 0; w < nworkers; ++w) {
+        const qt_perf_worker_t *p = &workers[w];
+
+        if (p->table == NULL) { continue; }
+        counted++;
+        enabled += p->enabled;
+        running += p->running;
+        for (size_t i = 0; i <= p->mask; ++i) {
+            const qt_perf_entry_t *src = &p->table[i];
+            qt_perf_entry_t       *dst;
+
+            if (!src->used) { continue; }
+            dst          = table_find(&merged, src->f);
+            dst->slices += src->slices;
+            dst->tasks  += src->tasks;
+            for (int j = 0; j < nevents; ++j) {
+                dst->count[j] += src->count[j];
+            }
+        }
+    }
+    rows = MALLOC((merged.used + 1) * sizeof(qt_perf_entry_t));
+    assert(rows);
+    for (size_t i = 0; i <= merged.mask; ++i) {
+        if (merged.table[i].used) {
+            rows[nrows++] = merged.table[i];
+            total.slices += merged.table[i].slices;
+            total.tasks  += merged.table[i].tasks;
+            for (int j = 0; j < nevents; ++j) {
+                total.count[j] += merged.table[i].count[j];
+            }
+        }
+    }
+    qsort(rows, nrows, sizeof(qt_perf_entry_t), by_first_count);
+
+    fprintf(out, "QTHREADS: perf counters by task function (%lu functions, %lu of %lu workers counted)\n",
+            (unsigned long)nrows, (unsigned long)counted, (unsigned long)nworkers);
+    fprintf(out, "%-32s %10s %10s", "function", "slices", "tasks");
+    for (int i = 0; i < nevents; ++i) {
+        fprintf(out, " %16s", event_labels[i]);
+    }
+    if ((cyc >= 0) && (ins >= 0)) { fprintf(out, " %6s", "IPC"); }
+    if ((llc >= 0) && (ins >= 0)) { fprintf(out, " %7s", "MPKI"); }
+    if ((stall >= 0) && (cyc >= 0)) { fprintf(out, " %7s", "stall"); }
+    fprintf(out, "\n");
+    for (size_t i = 0; i < nrows; ++i) {
+        char buf[64];
+
+        perf_write_row(out, function_name(rows[i].f, buf, sizeof(buf)), &rows[i],
+                       cyc, ins, llc, stall);
+    }
+    perf_write_row(out, "total", &total, cyc, ins, llc, stall);
+    if (running < enabled) {
+        fprintf(out, "QTHREADS: the counters were multiplexed and only counted %.1f%% of the time\n",
+                100.0 * running / enabled);
+    }
+    FREE(rows, (merged.used + 1) * sizeof(qt_perf_entry_t));
+    FREE(merged.table, (merged.mask + 1) * sizeof(qt_perf_entry_t));
+} /*}}}*/
+
+static void qt_perf_internal_teardown(void)
+{   /*{{{*/
+    FILE      *out      = stdout;
+    const long pagesize = sysconf(_SC_PAGESIZE);
+
+    if ((report_path != NULL) && (report_path[0] != 0) && strcmp(report_path, "-")) {
+        out = fopen(report_path, "w");
+        if (out == NULL) {
+            print_warning("could not write perf report %s (%s)\n", report_path, strerror(errno));
+        }
+    }
+    if (out != NULL) {
+        perf_report(out);
+        if (out != stdout) {
+            fclose(out);
+        } else {
+            fflush(out);
+        }
+    }
+    for (size_t i = 0; i < nworkers; ++i) {
+        if (workers[i].table != NULL) {
+            /* closing the leader leaves the rest of the group open */
+            for (int j = 0; j < nevents; ++j) {
+                if (workers[i].pages[j] != NULL) {
+                    munmap(workers[i].pages[j], (size_t)pagesize);
+                }
+                close(workers[i].fds[j]);
+            }
+            FREE(workers[i].table, (workers[i].mask + 1) * sizeof(qt_perf_entry_t));
+        }
+    }
+    FREE(workers, nworkers * sizeof(qt_perf_worker_t));
+    workers  = NULL;
+    nworkers = 0;
+} /*}}}*/
+
+void INTERNAL qt_perf_subsystem_init(void)
+{   /*{{{*/
+    const char *list = qt_internal_get_env_str("PERF_EVENTS", NULL);
+
+    if ((list != NULL) && (list[0] == 0)) {
+        return;                        /* QT_PERF_EVENTS= turns it off */
+    } else if (list == NULL) {
+        /* virtual machines often have no PMU at all; count what the kernel
+         * can rather than nothing */
+        if (choose_events(DEFAULT_EVENTS, 1) == 0) {
+            print_warning("no hardware perf counters are available; counting %s instead\n",
+                          FALLBACK_EVENTS);
+            choose_events(FALLBACK_EVENTS, 0);
+        }
+    } else if (choose_events(list, 0) == 0) {
+        print_warning("none of the events in QT_PERF_EVENTS can be counted; not counting\n");
+    }
+    if (nevents == 0) {
+        return;
+    }
+    report_path = qt_internal_get_env_str("PERF_REPORT", NULL);
+    nworkers    = qlib->nshepherds * qlib->nworkerspershep;
+    workers     = MALLOC(nworkers * sizeof(qt_perf_worker_t));
+    assert(workers);
+    memset(workers, 0, nworkers * sizeof(qt_perf_worker_t));
+    qthread_internal_cleanup(qt_perf_internal_teardown);
+} /*}}}*/
+
+#endif /* ifdef QTHREAD_PERF_COUNTERS */
+
+/* vim:set expandtab: */
@@ -14,11 +14,14 @@
 #ifdef HAVE_INTTYPES_H
 # include <inttypes.h>                 /* for funky print statements */
 #endif
+#include <stdint.h>                    /* for uint64_t */
 #include <string.h>                    /* for memset() */
+#include <stddef.h>                    /* for offsetof() */
 #include <errno.h>
 
 #include "qt_asserts.h"
 #include "qt_int_ceil.h"
+#include "qt_macros.h"                 /* for TLS_DECL() */
 
 #ifndef PTHREAD_MUTEX_SMALL_ENOUGH
 # warning The pthread_mutex_t structure is either too big or hasn't been checked. If you're compiling by hand, you can probably ignore this warning, or define PTHREAD_MUTEX_SMALL_ENOUGH to make it go away.
@@ -40,7 +43,7 @@
 
 #define SMALLBLOCK_SLICE_SIZE  64
 #define SMALLBLOCK_SLICE_COUNT (1920 / SMALLBLOCK_SLICE_SIZE)
-#define SMALLBLOCK_BITMAP_LEN  (SMALLBLOCK_SLICE_COUNT / 8) + (((SMALLBLOCK_SLICE_COUNT % 8) > 0) ? 1 : 0)
+#define SMALLBLOCK_BITMAP_LEN  ((SMALLBLOCK_SLICE_COUNT / 8) + (((SMALLBLOCK_SLICE_COUNT % 8) > 0) ? 1 : 0))
 typedef char smallslice_t[SMALLBLOCK_SLICE_SIZE];
 typedef struct smallblock_s {
     struct smallblock_s *next;
@@ -52,7 +55,7 @@ typedef struct smallblock_s {
 smallblock_t;
 
 #define BIGBLOCK_ENTRY_COUNT (1920 / (sizeof(void *) + sizeof(unsigned int)))
-#define BIGBLOCK_BITMAP_LEN  (BIGBLOCK_ENTRY_COUNT / 8) + (((BIGBLOCK_ENTRY_COUNT % 8) > 0) ? 1 : 0)
+#define BIGBLOCK_BITMAP_LEN  ((BIGBLOCK_ENTRY_COUNT / 8) + (((BIGBLOCK_ENTRY_COUNT % 8) > 0) ? 1 : 0))
 typedef struct bigblock_header_s {
     struct bigblock_header_s *next;
     pthread_mutex_t           lock __attribute__ ((packed));
@@ -64,11 +67,67 @@ typedef struct bigblock_header_s {
     } entries[BIGBLOCK_ENTRY_COUNT] /*__attribute__ ((packed))*/;
 } bigblock_header_t;
 
+/* each of these must be exactly one basic block */
+typedef char qalloc_smallblock_size_check[(sizeof(smallblock_t) == 2048) ? 1 : -1];
+typedef char qalloc_bigblock_size_check[(sizeof(bigblock_header_t) == 2048) ? 1 : -1];
+
+/* Dynamic maps record which layout of the structures above they were made
+ * with in the top byte of their stream count. Maps made before smallblocks
+ * were exactly one basic block have none: their smallblocks were 2056 bytes
+ * apart, with slices at offset 130 (the bitmap is where it always was). Such
+ * a map that has smallblocks in it keeps that layout, and new smallblocks in
+ * it are put where the old code would have put them; one without any is
+ * simply stamped with the current layout. */
+#define QALLOC_DYN_LAYOUT       1
+#define QALLOC_OLD_SB_SLICES    (offsetof(smallblock_t, slices) + 2)
+#define QALLOC_OLD_SB_STRIDE    ((QALLOC_OLD_SB_SLICES + sizeof(smallslice_t) * SMALLBLOCK_SLICE_COUNT + \
+                                  sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+#define QALLOC_LAYOUT_SHIFT     (sizeof(void *) * 8 - 8)
+#define QALLOC_LAYOUT_OF(word)  ((uintptr_t)(word) >> QALLOC_LAYOUT_SHIFT)
+#define QALLOC_STREAMS_OF(word) ((uintptr_t)(word) & ~((uintptr_t)0xff << QALLOC_LAYOUT_SHIFT))
+
+/* Bits are numbered from the top of each byte down, in every bitmap here. */
+#define QALLOC_BIT(i) ((unsigned char)(0x80 >> ((i) & 7)))
+
+/* Checkpointing state. For incremental checkpoints, each map is divided into
+ * chunks, and a chunk is marked dirty when something in it may have changed
+ * since it was last flushed. A checkpoint writes the data chunks, then the
+ * chunks holding the map's header (its bitmap and list heads), so the header
+ * on disk never claims blocks whose contents were not yet flushed. Each
+ * checkpoint is bracketed by writes of a small record file next to the map,
+ * so a checkpoint that was interrupted can be detected when the map is
+ * loaded again. That is all the record can do: the maps are MAP_SHARED, and
+ * the kernel writes their dirty pages back whenever it likes, so after a
+ * crash the file may hold a mix of old and new contents whether or not a
+ * checkpoint was running. Making that consistent would take a log of the
+ * old contents of every page before it is first written, which we have no
+ * way to catch. */
+#define QALLOC_CHUNK_SHIFT    18       /* 256 KiB */
+#define QALLOC_FLUSHERS       8
+#define QALLOC_PARALLEL_FLUSH (8 << 20)
+#define QALLOC_RECORD_MAGIC   UINT64_C(0x51414c4c4f43434b) /* "QALLOCCK" */
+
+struct qalloc_ckpt_s {
+    unsigned char *dirty;
+    size_t         chunks;
+    size_t         metalen;            /* bytes of header at the front of the map */
+    char          *recordfile;
+    unsigned long  epoch;
+};
+
+typedef struct {
+    uint64_t magic;
+    uint64_t epoch;                    /* the most recent checkpoint begun */
+    uint64_t committed;                /* the most recent checkpoint finished */
+} qalloc_record_t;
+
+/* the fields up to and including ckpt are common to both kinds of map */
 struct dynmapinfo_s {
     char                 dynflag;
     void                *map;
     struct dynmapinfo_s *next;
     size_t               size;  /* filesize */
+    struct qalloc_ckpt_s ckpt;
     size_t               streamcount;
     pthread_mutex_t     *stream_locks;
     smallblock_t       **smallblocks;
@@ -77,20 +136,31 @@ struct dynmapinfo_s {
     size_t               bitmaplength;
     pthread_mutex_t     *bitmap_lock;
     void                *base;
+    size_t               blocks; /* how many of the bitmap's bits are real */
+    unsigned long        gen;
+    size_t               sb_stride; /* smallblock spacing: 2048, unless old */
+    size_t               sb_slices; /* where a smallblock's slices start */
 };
 
+/* the bytes of a smallblock that are in use */
+#define QALLOC_SB_LEN(m) ((m)->sb_slices + sizeof(smallslice_t) * SMALLBLOCK_SLICE_COUNT)
+#define QALLOC_SB_SLICE(m, sb, i) \
+    ((void *)((char *)(sb) + (m)->sb_slices + (i) * SMALLBLOCK_SLICE_SIZE))
+
 struct mapinfo_s {
-    char              dynflag;
-    void             *map;
-    struct mapinfo_s *next;
-    size_t            size;     /* filesize */
-    size_t            streamcount;
-    void           ***streams;
-    pthread_mutex_t  *stream_locks;
+    char                 dynflag;
+    void                *map;
+    struct mapinfo_s    *next;
+    size_t               size;  /* filesize */
+    struct qalloc_ckpt_s ckpt;
+    size_t               streamcount;
+    void              ***streams;
+    pthread_mutex_t     *stream_locks;
 };
 
 static struct mapinfo_s    *mmaps    = NULL;
 static struct dynmapinfo_s *dynmmaps = NULL;
+static unsigned long        dynmgen  = 0;
 
 #if defined(HAVE_FSTAT64) && defined(HAVE_LSEEK64)
 # define fstat fstat64
@@ -107,6 +177,120 @@ typedef struct stat statstruct_t;
 #define QALLOC_LOCK(l)   qassert(pthread_mutex_lock(l), 0)
 #define QALLOC_UNLOCK(l) qassert(pthread_mutex_unlock(l), 0)
 
+#define QALLOC_DIRTY(m, addr, len) \
+    qalloc_mark_dirty(&(m)->ckpt, (m)->map, (addr), (len))
+
+static inline void qalloc_mark_dirty(struct qalloc_ckpt_s *c,
+                                     const void           *map,
+                                     const void           *addr,
+                                     size_t                len)
+{                                      /*{{{ */
+    size_t chunk = (size_t)((const char *)addr - (const char *)map) >> QALLOC_CHUNK_SHIFT;
+    size_t last  = (size_t)((const char *)addr + len - 1 - (const char *)map) >> QALLOC_CHUNK_SHIFT;
+
+    for (; chunk <= last; ++chunk) {
+        if ((((volatile unsigned char *)c->dirty)[chunk / 8] & QALLOC_BIT(chunk)) == 0) {
+            __sync_fetch_and_or(c->dirty + chunk / 8, QALLOC_BIT(chunk));
+        }
+    }
+}                                      /*}}} */
+
+static int qalloc_write_record(struct qalloc_ckpt_s *c,
+                               unsigned long         epoch,
+                               unsigned long         committed)
+{                                      /*{{{ */
+    qalloc_record_t r;
+    int             fd;
+
+    r.magic     = QALLOC_RECORD_MAGIC;
+    r.epoch     = epoch;
+    r.committed = committed;
+    fd          = open(c->recordfile, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        perror("opening checkpoint record");
+        return -1;
+    }
+    if ((pwrite(fd, &r, sizeof(r), 0) != sizeof(r)) || (fsync(fd) != 0)) {
+        perror("writing checkpoint record");
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}                                      /*}}} */
+
+static void qalloc_ckpt_init(struct qalloc_ckpt_s *c,
+                             size_t                size,
+                             size_t                metalen,
+                             const char           *filename)
+{                                      /*{{{ */
+    qalloc_record_t r;
+    int             fd;
+
+    c->chunks     = (size + (1 << QALLOC_CHUNK_SHIFT) - 1) >> QALLOC_CHUNK_SHIFT;
+    c->dirty      = (unsigned char *)calloc(QT_CEIL_DIV8(c->chunks), 1);
+    c->metalen    = metalen;
+    c->recordfile = (char *)malloc(strlen(filename) + sizeof(".ckpt"));
+    c->epoch      = 0;
+    if ((c->dirty == NULL) || (c->recordfile == NULL)) {
+        perror("malloc");
+        abort();
+    }
+    sprintf(c->recordfile, "%s.ckpt", filename);
+    fd = open(c->recordfile, O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    if ((read(fd, &r, sizeof(r)) == sizeof(r)) &&
+        (r.magic == QALLOC_RECORD_MAGIC)) {
+        c->epoch = (unsigned long)r.epoch;
+        if (r.epoch != r.committed) {
+            fprintf(stderr,
+                    "qalloc: checkpoint %lu of %s did not finish; its contents are those of checkpoint %lu plus whatever else reached the disk\n",
+                    (unsigned long)r.epoch, filename,
+                    (unsigned long)r.committed);
+        }
+    }
+    close(fd);
+}                                      /*}}} */
+
+static void qalloc_ckpt_fini(struct qalloc_ckpt_s *c)
+{                                      /*{{{ */
+    free(c->dirty);
+    free(c->recordfile);
+}                                      /*}}} */
+
+/* The old code claimed one block for each smallblock, but put it at its
+ * number times the old stride, so it straddles two blocks that are not
+ * always the one it claimed. This claims both, so that nothing else is ever
+ * put on top of it. Returns -1 if a smallblock is somewhere none could be. */
+static int qalloc_adopt_old_smallblocks(struct dynmapinfo_s *m,
+                                        const char          *filename)
+{                                      /*{{{ */
+    for (size_t s = 0; s < m->streamcount; ++s) {
+        smallblock_t *sb;
+
+        for (sb = m->smallblocks[s]; sb != NULL; sb = sb->next) {
+            const size_t rel = (size_t)((char *)sb - (char *)m->base);
+            size_t       b;
+
+            if (((char *)sb < (char *)m->base) || (rel % m->sb_stride != 0) ||
+                (rel + QALLOC_SB_LEN(m) > m->blocks * 2048)) {
+                fprintf(stderr, "qalloc: %s has a smallblock at %p, where none can be\n",
+                        filename, (void *)sb);
+                return -1;
+            }
+            for (b = rel / 2048; b <= (rel + QALLOC_SB_LEN(m) - 1) / 2048; ++b) {
+                if ((m->bitmap[b / 8] & QALLOC_BIT(b)) == 0) {
+                    m->bitmap[b / 8] |= QALLOC_BIT(b);
+                    QALLOC_DIRTY(m, m->bitmap + b / 8, 1);
+                }
+            }
+        }
+    }
+    return 0;
+}                                      /*}}} */
+
 static inline void *qalloc_getfile(const off_t filesize,
                                    void       *addr,
                                    const char *filename,
@@ -206,6 +390,8 @@ void *qalloc_makestatmap(const off_t  filesize,
         mi->streamcount  = streams;
         mi->next         = mmaps;
         mmaps            = mi;
+        qalloc_ckpt_init(&mi->ckpt, mi->size, (size_t)(base - (char *)ret),
+                         filename);
         /* initialize the streams */
         for (i = 0; i < streams; ++i) {
             ptr[3 + i] = (void *)(base + (itemsize * i));
@@ -252,6 +438,9 @@ void *qalloc_makestatmap(const off_t  filesize,
         m->streamcount  = streams;
         m->next         = mmaps;
         mmaps           = m;
+        qalloc_ckpt_init(&m->ckpt, m->size,
+                         (size_t)((char *)(m->stream_locks + streams) - (char *)ret),
+                         filename);
         return m;
     }
     /* this will never happen, it's just to make pgCC shut up */
@@ -278,7 +467,7 @@ void *qalloc_makedynmap(const off_t  filesize,
         /* save the base address, so relocation can be detected (or corrected) */
         ptr[0]           = mi->map = ret;
         ptr[1]           = 0;          /* dynamic */
-        ptr[2]           = (void *)streams;
+        ptr[2]           = (void *)(streams | ((uintptr_t)QALLOC_DYN_LAYOUT << QALLOC_LAYOUT_SHIFT));
         mi->streamcount  = streams;
         mi->size         = (size_t)filesize;
         mi->smallblocks  = (smallblock_t **)(ptr + 3);
@@ -288,6 +477,10 @@ void *qalloc_makedynmap(const off_t  filesize,
         mi->bitmap       = (unsigned char *)(mi->bitmap_lock + 1);
         mi->bitmaplength = QT_CEIL_DIV8(filesize/2048);
         mi->base         = ((char *)(mi->bitmap)) + mi->bitmaplength;
+        mi->blocks       = ((char *)ret + filesize - (char *)mi->base) / 2048;
+        mi->gen          = __sync_add_and_fetch(&dynmgen, 1);
+        mi->sb_stride    = sizeof(smallblock_t);
+        mi->sb_slices    = offsetof(smallblock_t, slices);
         /* initialize the streams */
         for (i = 0; i < streams; ++i) {
             mi->smallblocks[i] = NULL; /* the smallblock pointer */
@@ -299,6 +492,10 @@ void *qalloc_makedynmap(const off_t  filesize,
         qassert(pthread_mutex_init(mi->bitmap_lock, NULL), 0);
         mi->next = dynmmaps;
         dynmmaps = mi;
+        qalloc_ckpt_init(&mi->ckpt, mi->size,
+                         (size_t)((char *)mi->base - (char *)ret), filename);
+        /* so far, only the header has been written */
+        qalloc_mark_dirty(&mi->ckpt, ret, ret, mi->ckpt.metalen);
         return mi;
     } else if (set != ret) {
         /* asked for it somewhere that it didn't appear */
@@ -308,6 +505,26 @@ void *qalloc_makedynmap(const off_t  filesize,
     } else {
         /* reloading an existing file in the correct place */
         struct dynmapinfo_s *m;
+        void               **ptr    = (void **)ret;
+        const uintptr_t      layout = QALLOC_LAYOUT_OF(ptr[2]);
+        int                  old_sbs = 0;
+
+        if (layout == 0) {
+            /* an old map keeps its old smallblocks, if it has any */
+            for (size_t i = 0; i < streams; ++i) {
+                if (((smallblock_t **)(ptr + 3))[i] != NULL) {
+                    old_sbs = 1;
+                }
+            }
+            if (!old_sbs) {
+                ptr[2] = (void *)(streams | ((uintptr_t)QALLOC_DYN_LAYOUT << QALLOC_LAYOUT_SHIFT));
+            }
+        } else if (layout != QALLOC_DYN_LAYOUT) {
+            fprintf(stderr, "qalloc: %s has unknown layout %u\n", filename,
+                    (unsigned int)layout);
+            munmap(ret, (size_t)filesize);
+            return NULL;
+        }
         m               = (struct dynmapinfo_s *)malloc(sizeof(struct dynmapinfo_s));
         m->dynflag      = 1;
         m->map          = ret;
@@ -320,9 +537,25 @@ void *qalloc_makedynmap(const off_t  filesize,
         m->bitmap       = (unsigned char *)(m->bitmap_lock + 1);
         m->bitmaplength = QT_CEIL_DIV8(filesize/2048);
         m->base         = ((char *)(m->bitmap)) + m->bitmaplength;
+        m->blocks       = ((char *)ret + filesize - (char *)m->base) / 2048;
+        m->gen          = __sync_add_and_fetch(&dynmgen, 1);
+        m->sb_stride    = old_sbs ? QALLOC_OLD_SB_STRIDE : sizeof(smallblock_t);
+        m->sb_slices    = old_sbs ? QALLOC_OLD_SB_SLICES : offsetof(smallblock_t, slices);
+        qalloc_ckpt_init(&m->ckpt, m->size,
+                         (size_t)((char *)m->base - (char *)ret), filename);
+        if (old_sbs && (qalloc_adopt_old_smallblocks(m, filename) != 0)) {
+            qalloc_ckpt_fini(&m->ckpt);
+            free(m);
+            munmap(ret, (size_t)filesize);
+            return NULL;
+        }
 
         m->next  = dynmmaps;
         dynmmaps = m;
+        if ((layout == 0) && !old_sbs) {
+            /* the layout stamped on it above */
+            QALLOC_DIRTY(m, ptr + 2, sizeof(void *));
+        }
         return m;
     }
     /* this will never happen, it's just to make pgCC shut up */
@@ -360,7 +593,7 @@ void *qalloc_loadmap(const char *filename)
                                   (size_t)(header[1]), (size_t)(header[2]));
     } else {
         return qalloc_makedynmap(filesize, header[0], filename,
-                                 (size_t)(header[2]));
+                                 (size_t)QALLOC_STREAMS_OF(header[2]));
     }
 }                                      /*}}} */
 
@@ -376,6 +609,7 @@ void qalloc_cleanup(void)
         }
         m     = mmaps;
         mmaps = mmaps->next;
+        qalloc_ckpt_fini(&m->ckpt);
         free(m);
     }
     while (dynmmaps) {
@@ -387,20 +621,92 @@ void qalloc_cleanup(void)
         }
         m        = dynmmaps;
         dynmmaps = dynmmaps->next;
+        qalloc_ckpt_fini(&m->ckpt);
         free(m);
     }
 }                                      /*}}} */
 
+/* Threads are spread across a map's streams round-robin, in the order they
+ * first allocate, rather than by hashing pthread_self() (which, being an
+ * address, tends to put every thread in the same stream). */
+static size_t qalloc_next_stream = 0;
+
+/* Each thread remembers, for the last few dynamic maps it used, the
+ * smallblock it last carved a slice out of, so that most small allocations
+ * are one atomic on that block's bitmap. Maps are told apart by generation
+ * rather than by address, since a map's info may be reused after cleanup. */
+#define QALLOC_CACHED_MAPS 4
+typedef struct {
+    struct dynmapinfo_s *map;
+    unsigned long        gen;
+    smallblock_t        *sb;
+} qalloc_cache_entry_t;
+
+typedef struct {
+    size_t               stream;
+    unsigned int         victim;
+    qalloc_cache_entry_t entries[QALLOC_CACHED_MAPS];
+} qalloc_cache_t;
+
+static TLS_DECL_INIT(qalloc_cache_t *, qalloc_cache);
+static pthread_once_t qalloc_cache_once = PTHREAD_ONCE_INIT;
+
+static void qalloc_cache_init(void)
+{                                      /*{{{ */
+    TLS_INIT2(qalloc_cache, free);
+}                                      /*}}} */
+
+static qalloc_cache_t *qalloc_get_cache(void)
+{                                      /*{{{ */
+    qalloc_cache_t *c;
+
+    qassert(pthread_once(&qalloc_cache_once, qalloc_cache_init), 0);
+    c = (qalloc_cache_t *)TLS_GET(qalloc_cache);
+    if (c == NULL) {
+        c = (qalloc_cache_t *)calloc(1, sizeof(qalloc_cache_t));
+        if (c == NULL) {
+            return NULL;
+        }
+        c->stream = __sync_fetch_and_add(&qalloc_next_stream, 1);
+        TLS_SET(qalloc_cache, c);
+    }
+    return c;
+}                                      /*}}} */
+
+static inline size_t qalloc_stream(size_t streamcount)
+{                                      /*{{{ */
+    qalloc_cache_t *c = qalloc_get_cache();
+
+    return c ? c->stream % streamcount : 0;
+}                                      /*}}} */
+
+static inline qalloc_cache_entry_t *qalloc_cache_lookup(qalloc_cache_t      *c,
+                                                        struct dynmapinfo_s *m)
+{                                      /*{{{ */
+    qalloc_cache_entry_t *e;
+    unsigned int          i;
+
+    for (i = 0; i < QALLOC_CACHED_MAPS; ++i) {
+        if ((c->entries[i].map == m) && (c->entries[i].gen == m->gen)) {
+            return c->entries + i;
+        }
+    }
+    e      = c->entries + (c->victim++ % QALLOC_CACHED_MAPS);
+    e->map = m;
+    e->gen = m->gen;
+    e->sb  = NULL;
+    return e;
+}                                      /*}}} */
+
 /* this is inefficient in the case of running out of memory because of malloc
  * imbalance (i.e. one thread is making all of the qalloc_malloc() calls).
  * Could probably do more aggressive memory stealing from the next stream if
  * that becomes a problem */
 void *qalloc_statmalloc(struct mapinfo_s *m)
 {                                      /*{{{ */
-    pthread_t me          = pthread_self();
-    size_t    stream      = (size_t)me % m->streamcount;
-    size_t    firststream = stream;
-    void    **ret         = NULL;
+    size_t stream      = qalloc_stream(m->streamcount);
+    size_t firststream = stream;
+    void **ret         = NULL;
 
     while (ret == NULL) {
         QALLOC_LOCK(m->stream_locks + stream);
@@ -415,380 +721,325 @@ void *qalloc_statmalloc(struct mapinfo_s *m)
             }
         }
     }
+    QALLOC_DIRTY(m, m->streams + stream, sizeof(void *));
+    QALLOC_DIRTY(m, ret, (size_t)((void **)m->map)[1]);
     return ret;
 }                                      /*}}} */
 
-static inline void qalloc_unmarkbits(unsigned char *array,
-                                     size_t         startbit,
-                                     size_t         count)
-{                                      /*{{{ */
-    size_t endbit = startbit + count - 1;
+/* The bitmaps (the map's, and each smallblock's and bigblock header's) are
+ * claimed and released with atomic ors and ands, rather than under the locks
+ * the on-disk structures still carry. The bit order is what it always was,
+ * so existing maps load unchanged. */
 
-    if (startbit / 8 == endbit / 8) {
-        /* unmarking bits within a byte */
-        unsigned char bitmask;
+static inline int qalloc_bit_isset(const unsigned char *array,
+                                   size_t               bit)
+{                                      /*{{{ */
+    return (((volatile const unsigned char *)array)[bit / 8] & QALLOC_BIT(bit)) != 0;
+}                                      /*}}} */
 
-        bitmask              = 0xff >> (startbit - ((startbit / 8) * 8));
-        bitmask             &= 0xff & (0xff80 >> (endbit - ((endbit / 8) * 8)));
-        array[startbit / 8] &= ~bitmask;
-    } else {
-        size_t i;
+/* the mask, within its byte, of count bits starting at bit (which must not
+ * run past the end of the byte) */
+static inline unsigned char qalloc_bytemask(size_t bit,
+                                            size_t count)
+{                                      /*{{{ */
+    const size_t shift = bit & 7;
 
-        /* unmark the last part of startbyte */
-        array[startbit / 8] &=
-            0xff & ~(0xff >> (startbit - ((startbit / 8) * 8)));
-        /* unmark all bytes inbetween start and end bytes */
-        for (i = startbit / 8 + 1; i <= endbit / 8 - 1; i++) {
-            array[i] = 0;
-        }
-        /* unmark the first part of the endbyte */
-        array[endbit / 8] &=
-            0xff & ~(0xff80 >> (endbit - ((endbit / 8) * 8)));
-    }
+    return (unsigned char)((0xff >> shift) & (0xff << (8 - shift - count)));
 }                                      /*}}} */
 
-static inline void qalloc_markbits(unsigned char *array,
-                                   size_t         startbit,
-                                   size_t         endbit)
+static inline void qalloc_release_bits(unsigned char *array,
+                                       size_t         startbit,
+                                       size_t         count)
 {                                      /*{{{ */
-    if (startbit / 8 == endbit / 8) {
-        /* marking bits within a byte */
-        unsigned char bitmask;
+    while (count > 0) {
+        size_t n = 8 - (startbit & 7);
 
-        bitmask              = 0xff >> (startbit - ((startbit / 8) * 8));
-        bitmask             &= 0xff & (0xff80 >> (endbit - ((endbit / 8) * 8)));
-        array[startbit / 8] |= bitmask;
-    } else {
-        size_t i;
-
-        /* mark the last part of startbyte */
-        array[startbit / 8] |= 0xff >> (startbit - ((startbit / 8) * 8));
-        /* mark all bytes inbetween start and end bytes */
-        for (i = startbit / 8 + 1; i <= endbit / 8 - 1; i++) {
-            array[i] = 0xff;
-        }
-        /* mark the first part of the endbyte */
-        array[endbit / 8] |= 0xff & (0xff80 >> (endbit - ((endbit / 8) * 8)));
-    }
-}                                      /*}}} */
-
-/* this function finds the first 0 bit in the array, toggles it, and returns
- * the index of the toggled bit. if no 0 bits are in the array, it returns
- * (a_len * 8 + 8) */
-static inline size_t qalloc_findmark_bit(unsigned char *array,
-                                         size_t         bits)
-{                                      /*{{{ */
-    size_t i;
-    size_t bytes = bits / 8;
-
-    for (i = 0; i < bytes && array[i] == 0xff; ++i) ;
-    if (i == bytes) {
-        return bytes * 8 + 8;
-    } else if ((array[i] & 0x80) == 0) {
-        array[i] |= 0x80;
-        return i * 8;
-    } else if ((array[i] & 0x40) == 0) {
-        array[i] |= 0x40;
-        return i * 8 + 1;
-    } else if ((array[i] & 0x20) == 0) {
-        array[i] |= 0x20;
-        return i * 8 + 2;
-    } else if ((array[i] & 0x10) == 0) {
-        array[i] |= 0x10;
-        return i * 8 + 3;
-    } else if ((array[i] & 0x08) == 0) {
-        array[i] |= 0x08;
-        return i * 8 + 4;
-    } else if ((array[i] & 0x04) == 0) {
-        array[i] |= 0x04;
-        return i * 8 + 5;
-    } else if ((array[i] & 0x02) == 0) {
-        array[i] |= 0x02;
-        return i * 8 + 6;
-    } else if ((array[i] & 0x01) == 0) {
-        array[i] |= 0x01;
-        return i * 8 + 7;
-    }
-    /* this should never happen */
-    return (size_t)-1;
+        if (n > count) {
+            n = count;
+        }
+        __sync_fetch_and_and(array + startbit / 8,
+                             (unsigned char)~qalloc_bytemask(startbit, n));
+        startbit += n;
+        count    -= n;
+    }
 }                                      /*}}} */
 
-/* this function is identical to qalloc_findmark_bit, except that it searches
- * for a string of count 0 bits, and returns the index of the first one found. */
-static inline size_t qalloc_findmark_bits(unsigned char *array,
-                                          size_t         a_len,
-                                          size_t         count)
+/* this function finds the first 0 bit among the first bits of the array,
+ * claims it, and returns its index; if there are none, it returns
+ * (size_t)-1. Whole words of 1s are skipped at a time. */
+static size_t qalloc_claim_bit(unsigned char *array,
+                               size_t         bits)
 {                                      /*{{{ */
-    size_t byte     = 0;
-    size_t startbit = (size_t)-1;       /* all FF's, no matter what size architecture */
+    const size_t bytes = QT_CEIL_DIV8(bits);
+    size_t       i     = 0;
 
-    if (count < 8) {
-        for (byte = 0; byte < a_len; ++byte) {
-            char mask = (0xff00 >> count) & 0xff;
-            char bit  = 0;
+    while (i < bytes) {
+        unsigned char b;
 
-            while (!mask & 0x1) {
-                char xorbyte = mask ^ array[byte];
+        if (((uintptr_t)(array + i) & 7) == 0) {
+            while (i + 8 <= bytes) {
+                uint64_t w;
 
-                if ((array[byte] & xorbyte) == array[byte]) {
-                    startbit = byte * 8 + bit;
-                    qalloc_markbits(array, startbit, startbit + count - 1);
-                    return startbit;
+                memcpy(&w, array + i, sizeof(w));
+                if (w != UINT64_MAX) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+                    /* the first byte with a 0 in it */
+                    i += (size_t)__builtin_ctzll(~w) / 8;
+#endif
+                    break;
                 }
-                mask >>= 1;
-                bit++;
+                i += 8;
+            }
+            if (i >= bytes) {
+                break;
             }
         }
-        return (size_t)-1;             /* all FF's, no matter what size architecture */
-    } else {
-        long int left_to_find;
+        b = ((volatile unsigned char *)array)[i];
+        while (b != 0xff) {
+            /* the highest 0 bit is the lowest-numbered free one */
+            const size_t bit = (size_t)__builtin_clz(~b & 0xffu) -
+                               (sizeof(unsigned int) * 8 - 8);
 
-stageone:
-        left_to_find = (long int)count;
-        /* step 1: find bytes ending in 0's: */
-        for (; byte < a_len; ++byte) {
-            char available = 0;
-
-            if (array[byte] & 0x1) {
-                continue;
-            } else if (!(array[byte] & 0xff)) {
-                available = 8;
-            } else if (!(array[byte] & 0x7f)) {
-                available = 7;
-            } else if (!(array[byte] & 0x3f)) {
-                available = 6;
-            } else if (!(array[byte] & 0x1f)) {
-                available = 5;
-            } else if (!(array[byte] & 0x0f)) {
-                available = 4;
-            } else if (!(array[byte] & 0x07)) {
-                available = 3;
-            } else if (!(array[byte] & 0x03)) {
-                available = 2;
-            } else if (!(array[byte] & 0x01)) {
-                available = 1;
+            if (i * 8 + bit >= bits) {
+                break;
             }
-            if (available != 0) {
-                /* got a live one! */
-                startbit      = (byte * 8) + (8 - available);
-                left_to_find -= available;
-                if (left_to_find == 0) {
-                    array[byte] = 0xff;
-                    return startbit;
-                } else if (left_to_find < 8) {
-                    goto stagethree;
-                } else {
-                    goto stagetwo;
-                }
+            b = __sync_fetch_and_or(array + i, QALLOC_BIT(bit));
+            if ((b & QALLOC_BIT(bit)) == 0) {
+                return i * 8 + bit;
             }
         }
-        return (size_t)-1;             /* all FF's, no matter what size architecture */
+        i++;
+    }
+    return (size_t)-1;
+}                                      /*}}} */
 
-stagetwo:
-        byte++;
-        /* step 2: make sure we have enough blank bytes next */
-        for (; byte < a_len; ++byte) {
-            if (array[byte] == 0) {
-                left_to_find -= 8;
-                if (left_to_find < 8) {
-                    goto stagethree;
-                }
-            } else {
-                goto stageone;
+/* this function is like qalloc_claim_bit, except that it finds and claims a
+ * string of count 0 bits, and returns the index of the first one. A string
+ * that someone else claims part of first is given back and the search goes
+ * on past it. */
+static size_t qalloc_claim_bits(unsigned char *array,
+                                size_t         bits,
+                                size_t         count)
+{                                      /*{{{ */
+    size_t start = 0;
+
+    if (count == 1) {
+        return qalloc_claim_bit(array, bits);
+    }
+    while (start + count <= bits) {
+        size_t bit, n;
+
+        if (((start & 7) == 0) &&
+            (((volatile unsigned char *)array)[start / 8] == 0xff)) {
+            start += 8;
+            continue;
+        }
+        /* find a string that looks clear... */
+        for (bit = start; bit < start + count; ++bit) {
+            if (qalloc_bit_isset(array, bit)) {
+                break;
             }
         }
-        return (size_t)-1;             /* all FF's, no matter what size architecture */
+        if (bit < start + count) {
+            start = bit + 1;
+            continue;
+        }
+        /* ...and claim it a byte at a time */
+        for (bit = start; bit < start + count; bit += n) {
+            unsigned char mask, old;
 
-stagethree:
-        byte++;
-        /* step 3: make sure the last byte has enough blanks */
-        if (array[byte] & (0xff & (0xff00 >> left_to_find))) {
-            /* not enough */
-            goto stageone;
-        } else {
-            /* huzzah! we found enough space! */
-            qalloc_markbits(array, startbit, startbit + count - 1);
-            return startbit;
+            n = 8 - (bit & 7);
+            if (n > start + count - bit) {
+                n = start + count - bit;
+            }
+            mask = qalloc_bytemask(bit, n);
+            old  = __sync_fetch_and_or(array + bit / 8, mask);
+            if (old & mask) {
+                /* lost a race: give back what we got */
+                __sync_fetch_and_and(array + bit / 8,
+                                     (unsigned char)~(mask & ~old));
+                qalloc_release_bits(array, start, bit - start);
+                break;
+            }
         }
+        if (bit >= start + count) {
+            return start;
+        }
+        start = bit + 1;
     }
+    return (size_t)-1;
 }                                      /*}}} */
 
-static inline smallblock_t *qalloc_find_smallblock_entry(struct dynmapinfo_s
-                                                                *m,
-                                                         size_t  stream,
-                                                         size_t *offset)
+/* takes a slice from the first smallblock on the list that has one */
+static inline void *qalloc_smallblock_list_claim(struct dynmapinfo_s *m,
+                                                 smallblock_t        *sb,
+                                                 smallblock_t       **found)
 {                                      /*{{{ */
-    smallblock_t *sb;
-
-    QALLOC_LOCK(m->stream_locks + stream);
-    sb = m->smallblocks[stream];
-    if (sb) {
-        QALLOC_LOCK(&sb->lock);
-    }
-    QALLOC_UNLOCK(m->stream_locks + stream);
-    /* chase down a smallblock slice */
-    while (sb != NULL &&
-           ((*offset =
-                 qalloc_findmark_bit(sb->bitmap,
-                                     SMALLBLOCK_SLICE_COUNT)) >
-            SMALLBLOCK_SLICE_COUNT)) {
-        smallblock_t *sb_prev = sb;
+    for (; sb != NULL; sb = sb->next) {
+        size_t offset = qalloc_claim_bit(sb->bitmap, SMALLBLOCK_SLICE_COUNT);
 
-        sb = sb->next;
-        if (sb) {
-            QALLOC_LOCK(&sb->lock);
+        if (offset != (size_t)-1) {
+            *found = sb;
+            return QALLOC_SB_SLICE(m, sb, offset);
         }
-        QALLOC_UNLOCK(&sb_prev->lock);
     }
-    return sb;
+    return NULL;
 }                                      /*}}} */
 
-static inline bigblock_header_t *qalloc_find_bigblock_header_entry(struct
-                                                                   dynmapinfo_s
-                                                                   *m,
-                                                                   size_t
-                                                                   stream,
-                                                                   size_t *
-                                                                   offset)
+/* Claims the blocks for a new smallblock, and returns where it goes. In the
+ * current layout that is one block; an old-layout smallblock straddles two,
+ * and must start on a multiple of its stride, which three blocks in a row
+ * always have room for (the one of the three it doesn't touch is given
+ * back). */
+static smallblock_t *qalloc_smallblock_place(struct dynmapinfo_s *m)
 {                                      /*{{{ */
-    bigblock_header_t *bbh;
+    size_t offset, pos;
 
-    QALLOC_LOCK(m->stream_locks + stream); {
-        bbh = m->bigblocks[stream];
-        if (bbh) {
-            QALLOC_LOCK(&bbh->lock);
+    if (m->sb_stride == 2048) {
+        offset = qalloc_claim_bit(m->bitmap, m->blocks);
+        if (offset == (size_t)-1) {
+            return NULL;
         }
+        QALLOC_DIRTY(m, m->bitmap + offset / 8, 1);
+        return (smallblock_t *)((char *)m->base + offset * 2048);
     }
-    QALLOC_UNLOCK(m->stream_locks + stream);
-    /* chase down a block entry */
-    while (bbh != NULL &&
-           ((*offset =
-                 qalloc_findmark_bit(bbh->bitmap,
-                                     BIGBLOCK_ENTRY_COUNT)) >
-            BIGBLOCK_ENTRY_COUNT)) {
-        bigblock_header_t *bbh_prev = bbh;
+    offset = qalloc_claim_bits(m->bitmap, m->blocks, 3);
+    if (offset == (size_t)-1) {
+        return NULL;
+    }
+    pos = (offset * 2048 + m->sb_stride - 1) / m->sb_stride * m->sb_stride;
+    if (pos / 2048 == offset) {
+        qalloc_release_bits(m->bitmap, offset + 2, 1);
+    } else {
+        qalloc_release_bits(m->bitmap, offset, 1);
+    }
+    QALLOC_DIRTY(m, m->bitmap + offset / 8, 2);
+    return (smallblock_t *)((char *)m->base + pos);
+}                                      /*}}} */
 
-        bbh = bbh->next;
-        if (bbh) {
-            QALLOC_LOCK(&bbh->lock);
+static inline bigblock_header_t *qalloc_bigblock_list_claim(bigblock_header_t *bbh,
+                                                            size_t            *offset)
+{                                      /*{{{ */
+    for (; bbh != NULL; bbh = bbh->next) {
+        *offset = qalloc_claim_bit(bbh->bitmap, BIGBLOCK_ENTRY_COUNT);
+        if (*offset != (size_t)-1) {
+            return bbh;
         }
-        QALLOC_UNLOCK(&bbh_prev->lock);
     }
-    return bbh;
+    return NULL;
 }                                      /*}}} */
 
-void *qalloc_dynmalloc(struct dynmapinfo_s *m,
-                       size_t               size)
+/* The per-stream lists are only ever pushed onto, and blocks on them are
+ * never handed back to the map, so they can be walked without locks. */
+#define QALLOC_PUSH(head, item) do {                                   \
+        __typeof__(item) qalloc_push_old_;                             \
+        do {                                                           \
+            qalloc_push_old_ = *(head);                                \
+            (item)->next     = qalloc_push_old_;                       \
+        } while (!__sync_bool_compare_and_swap((head), qalloc_push_old_, (item))); \
+} while (0)
+
+static void *qalloc_dynmalloc_small(struct dynmapinfo_s *m)
 {                                      /*{{{ */
-    pthread_t me     = pthread_self();
-    size_t    stream = (size_t)me % m->streamcount;
-    size_t    original_stream;
-    void     *ret = NULL;
-
-    original_stream = stream;
-    if (size <= 64) {
-        size_t        offset = 0;
-        smallblock_t *sb     = NULL;
-
-        sb = qalloc_find_smallblock_entry(m, stream, &offset);
-        while (sb == NULL) {
-            /* allocate a new smallblock */
-            QALLOC_LOCK(m->bitmap_lock);
-            offset = qalloc_findmark_bit(m->bitmap, m->bitmaplength * 8);
-            QALLOC_UNLOCK(m->bitmap_lock);
-            if (offset > m->bitmaplength * 8) {
-                /* could not allocate a new smallblock... */
-                if ((m->streamcount > 1) &&
-                    ((stream + 1) % m->streamcount != original_stream)) {
-                    /* ...so we'll try the other streams */
-                    stream = (stream + 1) % m->streamcount;
-                    sb     = qalloc_find_smallblock_entry(m, stream, &offset);
-                } else {
-                    /* either we don't have multiple streams, or we've searched
-                     * all of them, thus, the only thing we can do is return
-                     * NULL */
-                    return NULL;
-                }
-            } else {
-                sb            = ((smallblock_t *)(m->base)) + offset;
-                sb->bitmap[0] = 0;
-                sb->bitmap[1] = 0;
-                qassert(pthread_mutex_init(&sb->lock, NULL), 0);
-                QALLOC_LOCK(m->stream_locks + stream);
-                sb->next               = m->smallblocks[stream];
-                m->smallblocks[stream] = sb;
-                QALLOC_LOCK(&sb->lock);
-                QALLOC_UNLOCK(m->stream_locks + stream);
-                /* we just created it, so we can do a shortcut: we know none of the
-                 * slices are taken, we'll just take the first one */
-                sb->bitmap[0] = 0x80;
-                offset        = 0;
-            }
+    qalloc_cache_t       *c      = qalloc_get_cache();
+    qalloc_cache_entry_t *e      = c ? qalloc_cache_lookup(c, m) : NULL;
+    const size_t          stream = c ? c->stream % m->streamcount : 0;
+    smallblock_t         *sb     = NULL;
+    size_t                offset, s, i;
+    void                 *ret;
+
+    /* the fast path: the block this thread used last */
+    if (e && e->sb) {
+        offset = qalloc_claim_bit(e->sb->bitmap, SMALLBLOCK_SLICE_COUNT);
+        if (offset != (size_t)-1) {
+            QALLOC_DIRTY(m, e->sb, QALLOC_SB_LEN(m));
+            return QALLOC_SB_SLICE(m, e->sb, offset);
         }
-        ret = sb->slices + offset;
-        QALLOC_UNLOCK(&sb->lock);
-    } else {
-        /* a BIG allocation */
-        size_t             offset, blocks = QT_CEIL_POW2(size, 11);
-        bigblock_header_t *bbh = NULL;
-
-        /* lock the bitmap */
-        QALLOC_LOCK(m->bitmap_lock); {
-            /* find the necessary free block(s) and mark them in-use */
-            if (blocks > 1) {
-                offset =
-                    qalloc_findmark_bits(m->bitmap, m->bitmaplength, blocks);
-            } else {
-                offset = qalloc_findmark_bit(m->bitmap, m->bitmaplength * 8);
+    }
+    /* then anything on this thread's stream */
+    ret = qalloc_smallblock_list_claim(m, m->smallblocks[stream], &sb);
+    if (ret == NULL) {
+        /* then a new smallblock */
+        sb = qalloc_smallblock_place(m);
+        if (sb != NULL) {
+            memset(sb->bitmap, 0, SMALLBLOCK_BITMAP_LEN);
+            /* we just created it, so we can do a shortcut: we know none of
+             * the slices are taken, we'll just take the first one */
+            sb->bitmap[0] = QALLOC_BIT(0);
+            /* and the bits past the last slice are never free */
+            for (i = SMALLBLOCK_SLICE_COUNT; i < SMALLBLOCK_BITMAP_LEN * 8; ++i) {
+                sb->bitmap[i / 8] |= QALLOC_BIT(i);
             }
+            qassert(pthread_mutex_init(&sb->lock, NULL), 0);
+            QALLOC_PUSH(m->smallblocks + stream, sb);
+            QALLOC_DIRTY(m, m->smallblocks + stream, sizeof(void *));
+            ret = QALLOC_SB_SLICE(m, sb, 0);
         }
-        QALLOC_UNLOCK(m->bitmap_lock);
-        if (offset > m->bitmaplength * 8) {
-            /* trying other streams won't help, because the bitmap isn't
-             * stream-specific (bottleneck!) */
-            return NULL;
+    }
+    /* and, failing that, the other streams' smallblocks */
+    for (s = 1; ret == NULL && s < m->streamcount; ++s) {
+        ret = qalloc_smallblock_list_claim(m, m->smallblocks[(stream + s) % m->streamcount], &sb);
+    }
+    if (ret) {
+        QALLOC_DIRTY(m, sb, QALLOC_SB_LEN(m));
+        if (e) {
+            e->sb = sb;
         }
-        ret = ((bigblock_header_t *)(m->base)) + offset;
-        bbh = qalloc_find_bigblock_header_entry(m, stream, &offset);
-        while (bbh == NULL) {
-            size_t newoffset;
-
-            /* allocate a new bigblock header */
-            QALLOC_LOCK(m->bitmap_lock);
-            newoffset = qalloc_findmark_bit(m->bitmap, m->bitmaplength * 8);
-            QALLOC_UNLOCK(m->bitmap_lock);
-            if (newoffset > m->bitmaplength * 8) {
-                /* could not allocate a new bigblock header... */
-                if ((m->streamcount > 1) &&
-                    ((stream + 1) % m->streamcount != original_stream)) {
-                    /* ...so we'll try the other streams */
-                    stream = (stream + 1) % m->streamcount;
-                    bbh    =
-                        qalloc_find_bigblock_header_entry(m, stream, &offset);
-                } else {
-                    /* either we don't have multiple streams, or we've searched
-                     * all of them, thus, the only thing we can do is return
-                     * NULL */
-                    qalloc_unmarkbits(m->bitmap, offset, blocks);
-                    return NULL;
-                }
-            } else {
-                bbh = ((bigblock_header_t *)(m->base)) + newoffset;
-                memset(bbh->bitmap, 0, BIGBLOCK_BITMAP_LEN);
-                qassert(pthread_mutex_init(&bbh->lock, NULL), 0);
-                QALLOC_LOCK(m->stream_locks + stream);
-                bbh->next            = m->bigblocks[stream];
-                m->bigblocks[stream] = bbh;
-                QALLOC_LOCK(&bbh->lock);
-                QALLOC_UNLOCK(m->stream_locks + stream);
-                offset =
-                    qalloc_findmark_bit(bbh->bitmap, BIGBLOCK_ENTRY_COUNT);
-            }
+    }
+    return ret;
+}                                      /*}}} */
+
+void *qalloc_dynmalloc(struct dynmapinfo_s *m,
+                       size_t               size)
+{                                      /*{{{ */
+    size_t             stream, offset, s, blocks;
+    bigblock_header_t *bbh = NULL;
+    void              *ret;
+
+    if (size <= SMALLBLOCK_SLICE_SIZE) {
+        return qalloc_dynmalloc_small(m);
+    }
+    /* a BIG allocation */
+    blocks = QT_CEIL_POW2(size, 11);
+    offset = qalloc_claim_bits(m->bitmap, m->blocks, blocks);
+    if (offset == (size_t)-1) {
+        /* trying other streams won't help, because the bitmap isn't
+         * stream-specific */
+        return NULL;
+    }
+    ret    = ((bigblock_header_t *)(m->base)) + offset;
+    stream = qalloc_stream(m->streamcount);
+    bbh    = qalloc_bigblock_list_claim(m->bigblocks[stream], &offset);
+    if (bbh == NULL) {
+        /* allocate a new bigblock header */
+        size_t newoffset = qalloc_claim_bit(m->bitmap, m->blocks);
+
+        if (newoffset != (size_t)-1) {
+            bbh = ((bigblock_header_t *)(m->base)) + newoffset;
+            memset(bbh->bitmap, 0, BIGBLOCK_BITMAP_LEN);
+            bbh->bitmap[0] = QALLOC_BIT(0);
+            offset         = 0;
+            qassert(pthread_mutex_init(&bbh->lock, NULL), 0);
+            QALLOC_PUSH(m->bigblocks + stream, bbh);
+            QALLOC_DIRTY(m, m->bigblocks + stream, sizeof(void *));
+            QALLOC_DIRTY(m, m->bitmap + newoffset / 8, 1);
         }
-        bbh->entries[offset].entry       = ret;
-        bbh->entries[offset].block_count = blocks;
-        QALLOC_UNLOCK(&bbh->lock);
     }
+    for (s = 1; bbh == NULL && s < m->streamcount; ++s) {
+        bbh = qalloc_bigblock_list_claim(m->bigblocks[(stream + s) % m->streamcount], &offset);
+    }
+    if (bbh == NULL) {
+        qalloc_release_bits(m->bitmap,
+                            ((size_t)ret - (size_t)(m->base)) / 2048, blocks);
+        return NULL;
+    }
+    bbh->entries[offset].entry       = ret;
+    bbh->entries[offset].block_count = blocks;
+    QALLOC_DIRTY(m, bbh, sizeof(bigblock_header_t));
+    QALLOC_DIRTY(m, m->bitmap + ((size_t)ret - (size_t)(m->base)) / 2048 / 8,
+                 QT_CEIL_DIV8(blocks) + 1);
+    /* the caller is about to fill it in */
+    QALLOC_DIRTY(m, ret, blocks * 2048);
     return ret;
 }                                      /*}}} */
 
@@ -805,14 +1056,15 @@ void *qalloc_malloc(void  *mapinfo,
 void qalloc_statfree(void             *block,
                      struct mapinfo_s *m)
 {                                      /*{{{ */
-    pthread_t me     = pthread_self();
-    size_t    stream = (size_t)me % m->streamcount;
-    void    **b      = (void **)block;
+    size_t stream = qalloc_stream(m->streamcount);
+    void **b      = (void **)block;
 
     QALLOC_LOCK(m->stream_locks + stream);
     *b                 = m->streams[stream];
     m->streams[stream] = b;
     QALLOC_UNLOCK(m->stream_locks + stream);
+    QALLOC_DIRTY(m, m->streams + stream, sizeof(void *));
+    QALLOC_DIRTY(m, b, sizeof(void *));
 }                                      /*}}} */
 
 void qalloc_dynfree(void                *block,
@@ -823,71 +1075,48 @@ void qalloc_dynfree(void                *block,
         /* this figures out the sb pointer from the address being free'd */
         smallblock_t *sb =
             (smallblock_t
-             *)((((size_t)block - (size_t)(m->base)) & ~(size_t)0x7ff) +
+             *)((((size_t)block - (size_t)(m->base)) / m->sb_stride * m->sb_stride) +
                 (size_t)(m->base));
-        /* this figures out the slot number within the sb from the block address */
-        unsigned int slot =
+        /* this figures out the slot number within the sb from the block
+         * address; slices have no owner, so whoever frees one simply gives
+         * its bit back */
+        size_t slot =
             (((size_t)block) -
-             ((size_t)(sb->slices))) / SMALLBLOCK_SLICE_SIZE;
-        unsigned char *byte;
-
-        /* that slot (read: "bit") is in which byte? */
-        byte = sb->bitmap + (slot / 8);
-        /* which bit in that byte? */
-        slot -= (slot / 8) * 8;
-        /* QUICK! before anyone notices! */
-        QALLOC_LOCK(&sb->lock);
-        *byte &= ~(0x80 >> slot);
-        QALLOC_UNLOCK(&sb->lock);
-    } else {                           /* aligned */
-        /* must be big */
-        pthread_t          me     = pthread_self();
-        size_t             stream = (size_t)me & m->streamcount;
-        bigblock_header_t *bbh;
-        size_t             blocks       = 0;
-        int                stillLooking = 1;
+             ((size_t)QALLOC_SB_SLICE(m, sb, 0))) / SMALLBLOCK_SLICE_SIZE;
 
-        QALLOC_LOCK(m->stream_locks + stream);
-        bbh = m->bigblocks[stream];
-        if (bbh) {
-            QALLOC_LOCK(&bbh->lock);
-        }
-        QALLOC_UNLOCK(m->stream_locks + stream);
-        /* chase down the bigblock header containing this ptr */
-        while (bbh && stillLooking) {
-            size_t             slot;
-            bigblock_header_t *next;
-
-            for (slot = 0; slot < BIGBLOCK_ENTRY_COUNT; ++slot) {
-                if (bbh->entries[slot].entry == block) {
-                    unsigned char *byte = bbh->bitmap + (slot / 8);
-                    unsigned char  bit  = slot - ((slot / 8) * 8);
-
-                    *byte                         &= ~(0x80 >> bit);
-                    blocks                         = bbh->entries[slot].block_count;
-                    bbh->entries[slot].entry       = NULL;
-                    bbh->entries[slot].block_count = 0;
-                    stillLooking                   = 0;
-                    break;
+        qalloc_release_bits(sb->bitmap, slot, 1);
+        QALLOC_DIRTY(m, sb, QALLOC_SB_LEN(m));
+    } else {                           /* aligned */
+        /* must be big; its entry could be in any stream's headers, but is
+         * most likely in ours */
+        const size_t first = qalloc_stream(m->streamcount);
+        size_t       s;
+
+        for (s = 0; s < m->streamcount; ++s) {
+            bigblock_header_t *bbh;
+
+            for (bbh = m->bigblocks[(first + s) % m->streamcount];
+                 bbh != NULL; bbh = bbh->next) {
+                size_t slot;
+
+                for (slot = 0; slot < BIGBLOCK_ENTRY_COUNT; ++slot) {
+                    if (qalloc_bit_isset(bbh->bitmap, slot) &&
+                        (bbh->entries[slot].entry == block)) {
+                        size_t blocks = bbh->entries[slot].block_count;
+
+                        bbh->entries[slot].entry       = NULL;
+                        bbh->entries[slot].block_count = 0;
+                        qalloc_release_bits(bbh->bitmap, slot, 1);
+                        qalloc_release_bits(m->bitmap,
+                                            ((size_t)block - (size_t)(m->base)) / 2048,
+                                            blocks);
+                        QALLOC_DIRTY(m, bbh, sizeof(bigblock_header_t));
+                        QALLOC_DIRTY(m, m->bitmap + ((size_t)block - (size_t)(m->base)) / 2048 / 8,
+                                     QT_CEIL_DIV8(blocks) + 1);
+                        return;
+                    }
                 }
             }
-            if (stillLooking) {
-                break;
-            }
-            next = bbh->next;
-            if (next) {
-                QALLOC_LOCK(&next->lock);
-            }
-            QALLOC_UNLOCK(&bbh->lock);
-            bbh = next;
-        }
-        if ((blocks > 0) && !stillLooking) {
-            /* lock the bitmap and unmark the corresponding bits */
-            QALLOC_LOCK(m->bitmap_lock);
-            qalloc_unmarkbits(m->bitmap,
-                              ((size_t)block - (size_t)(m->base)) / 2048,
-                              blocks);
-            QALLOC_UNLOCK(m->bitmap_lock);
         }
     }
     /* XXX: consider freeing unused smallblocks or bigblock header blocks */
@@ -903,25 +1132,213 @@ void qalloc_free(void *block,
     }
 }                                      /*}}} */
 
+void qalloc_dirty(void       *mapinfo,
+                  const void *addr,
+                  size_t      len)
+{                                      /*{{{ */
+    struct mapinfo_s *m = (struct mapinfo_s *)mapinfo;
+
+    if ((len == 0) || ((const char *)addr < (const char *)m->map) ||
+        ((const char *)addr + len > (const char *)m->map + m->size)) {
+        return;
+    }
+    QALLOC_DIRTY(m, addr, len);
+}                                      /*}}} */
+
+typedef struct {
+    char  *start;
+    size_t len;
+} qalloc_range_t;
+
+typedef struct {
+    qalloc_range_t *ranges;
+    size_t          count;
+    size_t          next;
+    int             failed;
+} qalloc_flush_t;
+
+static void *qalloc_flusher(void *arg)
+{                                      /*{{{ */
+    qalloc_flush_t *f = (qalloc_flush_t *)arg;
+    size_t          i;
+
+    while ((i = __sync_fetch_and_add(&f->next, 1)) < f->count) {
+        if (msync(f->ranges[i].start, f->ranges[i].len,
+                  MS_INVALIDATE | MS_SYNC) != 0) {
+            perror("checkpoint");
+            f->failed = 1;
+        }
+    }
+    return NULL;
+}                                      /*}}} */
+
+/* msync()s the ranges, with a few more threads if there's enough to do */
+static int qalloc_flush(qalloc_range_t *ranges,
+                        size_t          count,
+                        size_t          bytes)
+{                                      /*{{{ */
+    pthread_t      threads[QALLOC_FLUSHERS - 1];
+    size_t         nthreads = 0, i;
+    qalloc_flush_t f;
+
+    f.ranges = ranges;
+    f.count  = count;
+    f.next   = 0;
+    f.failed = 0;
+    if ((count > 1) && (bytes >= QALLOC_PARALLEL_FLUSH)) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        nthreads = QALLOC_FLUSHERS;
+        if ((cpus > 0) && ((size_t)cpus < nthreads)) {
+            nthreads = (size_t)cpus;
+        }
+        if (count < nthreads) {
+            nthreads = count;
+        }
+        for (i = 0; i + 1 < nthreads; ++i) {
+            if (pthread_create(threads + i, NULL, qalloc_flusher, &f) != 0) {
+                break;
+            }
+        }
+        nthreads = i;
+    }
+    qalloc_flusher(&f);
+    for (i = 0; i < nthreads; ++i) {
+        qassert(pthread_join(threads[i], NULL), 0);
+    }
+    return f.failed ? -1 : 0;
+}                                      /*}}} */
+
+/* takes the dirty chunks (or all of them) in [first, last) off the map's
+ * dirty list, merged into as few ranges as possible */
+static size_t qalloc_take_chunks(struct mapinfo_s *m,
+                                 size_t            first,
+                                 size_t            last,
+                                 int               everything,
+                                 qalloc_range_t   *ranges,
+                                 size_t           *bytes)
+{                                      /*{{{ */
+    struct qalloc_ckpt_s *c = &m->ckpt;
+    size_t                n = 0, chunk;
+
+    for (chunk = first; chunk < last; ++chunk) {
+        char  *start;
+        size_t len;
+
+        if (!everything) {
+            if (((chunk & 7) == 0) && (c->dirty[chunk / 8] == 0)) {
+                chunk += 7;
+                continue;
+            }
+            if ((__sync_fetch_and_and(c->dirty + chunk / 8,
+                                      (unsigned char)~QALLOC_BIT(chunk)) &
+                 QALLOC_BIT(chunk)) == 0) {
+                continue;
+            }
+        } else {
+            __sync_fetch_and_and(c->dirty + chunk / 8,
+                                 (unsigned char)~QALLOC_BIT(chunk));
+        }
+        start = (char *)m->map + (chunk << QALLOC_CHUNK_SHIFT);
+        len   = (size_t)1 << QALLOC_CHUNK_SHIFT;
+        if (start + len > (char *)m->map + m->size) {
+            len = (size_t)((char *)m->map + m->size - start);
+        }
+        if ((n > 0) && (ranges[n - 1].start + ranges[n - 1].len == start)) {
+            ranges[n - 1].len += len;
+        } else {
+            ranges[n].start = start;
+            ranges[n].len   = len;
+            n++;
+        }
+        *bytes += len;
+    }
+    return n;
+}                                      /*}}} */
+
+/* returns the number of chunks written */
+static size_t qalloc_sync_map(struct mapinfo_s *m,
+                              int               everything)
+{                                      /*{{{ */
+    struct qalloc_ckpt_s *c          = &m->ckpt;
+    const size_t          metachunks =
+        (c->metalen + (1 << QALLOC_CHUNK_SHIFT) - 1) >> QALLOC_CHUNK_SHIFT;
+    const unsigned long   epoch      = c->epoch + 1;
+    qalloc_range_t       *ranges;
+    size_t                n, bytes = 0, i, written = 0;
+    int                   failed = 0;
+
+    ranges = (qalloc_range_t *)malloc(sizeof(qalloc_range_t) * (c->chunks / 2 + 1));
+    if (ranges == NULL) {
+        perror("checkpoint");
+        return 0;
+    }
+    if (qalloc_write_record(c, epoch, c->epoch) != 0) {
+        free(ranges);
+        return 0;
+    }
+    c->epoch = epoch;
+    /* first the data, then the header that refers to it; ranges start on a
+     * chunk, and only the last one in the map may end short of one */
+    n = qalloc_take_chunks(m, metachunks, c->chunks, everything, ranges, &bytes);
+    if (qalloc_flush(ranges, n, bytes) == 0) {
+        for (i = 0; i < n; ++i) {
+            written += (ranges[i].len + (1 << QALLOC_CHUNK_SHIFT) - 1) >> QALLOC_CHUNK_SHIFT;
+        }
+        bytes = 0;
+        n     = qalloc_take_chunks(m, 0, metachunks, everything, ranges, &bytes);
+        if (qalloc_flush(ranges, n, bytes) == 0) {
+            for (i = 0; i < n; ++i) {
+                written += (ranges[i].len + (1 << QALLOC_CHUNK_SHIFT) - 1) >> QALLOC_CHUNK_SHIFT;
+            }
+            (void)qalloc_write_record(c, epoch, epoch);
+        } else {
+            failed = 1;
+        }
+    } else {
+        failed = 1;
+    }
+    if (failed) {
+        /* leave the record saying this checkpoint didn't finish, and try
+         * everything we took again next time */
+        for (i = 0; i < n; ++i) {
+            QALLOC_DIRTY(m, ranges[i].start, ranges[i].len);
+        }
+    }
+    free(ranges);
+    return written;
+}                                      /*}}} */
+
 void qalloc_checkpoint(void)
 {                                      /*{{{ */
     struct mapinfo_s    *m  = mmaps;
     struct dynmapinfo_s *dm = dynmmaps;
 
     while (m) {
-        if (msync(m->map, m->size, MS_INVALIDATE | MS_SYNC) != 0) {
-            perror("checkpoint");
-            // abort();
-        }
+        (void)qalloc_sync_map(m, 1);
         m = m->next;
     }
     while (dm) {
-        if (msync(dm->map, dm->size, MS_INVALIDATE | MS_SYNC) != 0) {
-            perror("checkpoint");
-            // abort();
-        }
+        (void)qalloc_sync_map((struct mapinfo_s *)dm, 1);
         dm = dm->next;
     }
 }                                      /*}}} */
 
+size_t qalloc_checkpoint_dirty(void)
+{                                      /*{{{ */
+    struct mapinfo_s    *m  = mmaps;
+    struct dynmapinfo_s *dm = dynmmaps;
+    size_t               written = 0;
+
+    while (m) {
+        written += qalloc_sync_map(m, 0);
+        m        = m->next;
+    }
+    while (dm) {
+        written += qalloc_sync_map((struct mapinfo_s *)dm, 0);
+        dm       = dm->next;
+    }
+    return written;
+}                                      /*}}} */
+
 /* vim:set expandtab: */
@@ -76,6 +76,11 @@
 #include "qt_feb.h"
 #include "qt_syncvar.h"
 #include "qt_spawncache.h"
+#include "qt_stats.h"
+#include "qt_trace.h"
+#include "qt_perf_counters.h"
+#include "qt_latency.h"
+#include "qt_contention.h"
 #ifdef QTHREAD_MULTINODE
 # include "qt_multinode_innards.h"
 #endif
@@ -453,6 +458,7 @@ static void *qthread_master(void *arg)
     /* Initialize myself                                                           */
     /*******************************************************************************/
     TLS_SET(shepherd_structs, arg);
+    qt_perf_worker_start(me_worker);
 #ifdef QTHREAD_USE_SPAWNCACHE
     localqueue = qt_init_local_spawncache();
 #endif
@@ -530,12 +536,25 @@ static void *qthread_master(void *arg)
         while (!QTHREAD_CASLOCK_READ_UI(me_worker->active)) {
             SPINLOCK_BODY();
         }
+        /* timers that came due, and I/O that finished, while this worker
+         * was busy */
+        (void)qt_timer_wheel_tick(me);
+        (void)qt_io_reactor_tick(me, me_worker);
+        QTHREAD_TRACE_POLL();
+        QTHREAD_CONTENTION_POLL();
+        /* only clock the dequeue when it looks like it will have to wait */
+        if (qt_stats_enabled && (qt_threadqueue_advisory_queuelen(threadqueue) == 0)) {
+            qt_stats_idle_begin(me_worker, qt_timer_now());
+        }
 #ifdef QTHREAD_LOCAL_PRIORITY
         t = qt_scheduler_get_thread(threadqueue, localpriorityqueue, localqueue, QTHREAD_CASLOCK_READ_UI(me->active));
 #else
         t = qt_scheduler_get_thread(threadqueue, localqueue, QTHREAD_CASLOCK_READ_UI(me->active));
 #endif /* ifdef QTHREAD_LOCAL_PRIORITY */
         assert(t);
+        if (me_worker->stats->idle_since) {
+            qt_stats_idle_end(me_worker, qt_timer_now());
+        }
 #ifdef QTHREAD_SHEPHERD_PROFILING
         qtimer_stop(idle);
         me->idle_count++;
@@ -634,6 +653,11 @@ qt_run:
 #endif
 
                 *current = t;
+                QTHREAD_STAT(me_worker, tasks_run, t->thread_state == QTHREAD_STATE_NEW);
+                QTHREAD_STAT(me_worker, context_switches, 1);
+                QTHREAD_TRACE(me_worker, QT_TRACE_EXEC, t, t->f, 0);
+                QTHREAD_LATENCY_RUN(me_worker, t);
+                QTHREAD_PERF_BEGIN(me_worker);
 
 #ifdef HAVE_NATIVE_MAKECONTEXT
                 getcontext(&my_context);
@@ -643,6 +667,8 @@ qt_run:
 
                 t = *current; // necessary for direct-swap sanity
                 *current = NULL; // neessary for "queue sanity"
+                QTHREAD_PERF_END(me_worker, t->f, t->thread_state == QTHREAD_STATE_TERMINATED);
+                QTHREAD_TRACE(me_worker, QT_TRACE_RETURN, t, 0, t->thread_state);
 #ifdef QTHREAD_USE_EUREKAS
                 *current = NULL; // necessary for eureka sanity
 #endif /* QTHREAD_USE_EUREKAS */
@@ -701,6 +727,7 @@ qt_run:
                                     "id(%u): thread tid=%i(%p) entering user queue (q=%p, type=%u)\n",
                                     my_id, t->thread_id, t, q, q->type);
                             assert(q);
+                            QTHREAD_STAT(me_worker, tasks_blocked, 1);
                             qthread_queue_internal_enqueue(q, t);
                             break;
                         }
@@ -710,11 +737,14 @@ qt_run:
                         qthread_debug(THREAD_DETAILS | FEB_DETAILS | SHEPHERD_DETAILS,
                                       "id(%u): thread tid=%i(%p) blocked on FEB (m=%p, EFQ=%p)\n",
                                       my_id, t->thread_id, t, m, m->EFQ);
+                        QTHREAD_STAT(me_worker, tasks_blocked, 1);
+                        QTHREAD_STAT(me_worker, feb_blocks, 1);
                         QTHREAD_FASTLOCK_UNLOCK(&(m->lock));
                         break;
                     }
 
                     case QTHREAD_STATE_PARENT_YIELD:
+                        QTHREAD_STAT(me_worker, tasks_blocked, 1);
                         t->thread_state = QTHREAD_STATE_PARENT_BLOCKED;
                         break;
 
@@ -742,6 +772,7 @@ qt_run:
                         qthread_debug(THREAD_DETAILS | IO_DETAILS | SHEPHERD_DETAILS,
                                       "id(%u): thread %i made a syscall\n",
                                       my_id, t->thread_id);
+                        QTHREAD_STAT(me_worker, tasks_blocked, 1);
                         qt_blocking_subsystem_enqueue(t->rdata->blockedon.io);
                         break;
 #ifdef QTHREAD_USE_EUREKAS
@@ -908,6 +939,9 @@ int API_FUNC qthread_initialize(void)
 
     qthread_internal_alignment_init();
     qt_hash_initialize_subsystem();
+#ifdef QTHREAD_RUNTIME_SCHEDULER
+    qt_threadqueue_select();
+#endif
 
     qt_topology_init(&nshepherds,
                      &nworkerspershep,
@@ -1062,6 +1096,11 @@ int API_FUNC qthread_initialize(void)
     qt_syncvar_subsystem_init(need_sync);
     qt_threadqueue_subsystem_init();
     qt_blocking_subsystem_init();
+    qt_stats_subsystem_init();
+    qt_trace_subsystem_init();
+    qt_perf_subsystem_init();
+    qt_latency_subsystem_init();
+    qt_contention_subsystem_init();
 
 /* Set up agg methods*/
     qlib->agg_cost = qthread_default_agg_cost;
@@ -1248,6 +1287,7 @@ int API_FUNC qthread_initialize(void)
 
     qthread_debug(CORE_DETAILS, "calling component init functions\n");
     qt_barrier_internal_init();
+    qt_stats_page_init();
 #ifdef QTHREAD_USE_ROSE_EXTENSIONS
 # ifdef QTHREAD_RCRTOOL
     if (rcrtoollevel > 0) {
@@ -2001,6 +2041,21 @@ size_t API_FUNC qthread_readstate(const enum introspective_state type)
                 return 0;
             }
 
+        case IO_QUEUE_DEPTH:
+            return qt_blocking_subsystem_queue_depth();
+
+        case IO_PROXIES:
+            return qt_blocking_subsystem_proxies();
+
+        case IO_SYSCALLS:
+            return qt_blocking_subsystem_latency(0);
+
+        case IO_LATENCY_P50:
+            return qt_blocking_subsystem_latency(50);
+
+        case IO_LATENCY_P99:
+            return qt_blocking_subsystem_latency(99);
+
         default:
             return (size_t)(-1);
     }
@@ -2072,6 +2127,9 @@ static QINLINE qthread_t *qthread_thread_new(const qthread_f f,
 #endif /* ifdef QTHREAD_NONLAZY_THREADIDS */
 
     t->target_shepherd = NO_SHEPHERD;
+#ifdef QTHREAD_LATENCY_PROFILING
+    t->ready_at = 0;
+#endif
 
     // should I use the builtin block for args?
     if (arg_size > 0) {
@@ -2290,6 +2348,7 @@ static void qthread_wrapper(void *ptr)
         qthread_t *parent              = t->parent;
         aligned_t *parent_task_counter = &(parent->task_counter);
         aligned_t  newval, oldval, test;
+        QTHREAD_TRACE_SYNC(QT_TRACE_SIGNAL, parent_task_counter);
         oldval = *parent_task_counter;
         while (1) {
             assert(tcount_get_children(oldval) > 0);
@@ -2304,6 +2363,7 @@ static void qthread_wrapper(void *ptr)
         }
         if (newval == tcount_finished_state) {
             while(parent->thread_state != QTHREAD_STATE_PARENT_BLOCKED) SPINLOCK_BODY();
+            QTHREAD_TRACE_HERE(QT_TRACE_WAKE, parent, 0, 0);
             t->thread_state = QTHREAD_STATE_PARENT_UNBLOCKED;
         }
     }
@@ -2693,6 +2753,9 @@ int API_FUNC qthread_spawn(qthread_f             f,
         }
     }
     qthread_debug(THREAD_DETAILS, "tid %i spawning new thread %u with flags %u\n", me ? ((int)me->thread_id) : -1, t->thread_id, t->flags);
+    QTHREAD_STAT_HERE(tasks_spawned, 1);
+    QTHREAD_TRACE_HERE(QT_TRACE_SPAWN, t, t->f, dest_shep);
+    QTHREAD_LATENCY_READY(t, QT_LATENCY_SPAWN);
     /* Step 5: Prepare the input preconditions (if necessary) */
     if (QTHREAD_LIKELY(!preconds) || (qthread_check_feb_preconds(t) == 0)) {
         /* Step 6: Set it going */
@@ -3269,6 +3332,9 @@ void qthread_parent_yield_state(void)
     t->prev_thread_state = t->thread_state;
     t->thread_state      = QTHREAD_STATE_PARENT_YIELD;
     qthread_back_to_master(t);
+    /* the children have all signaled; the next wait is for new ones */
+    QTHREAD_TRACE_SYNC(QT_TRACE_READ, &t->task_counter);
+    QTHREAD_TRACE_SYNC(QT_TRACE_EMPTY, &t->task_counter);
 } /*}}}*/
 
 aligned_t *qthread_task_counter(void)
@@ -17,6 +17,7 @@
 #include "qthread_innards.h" /* for qlib */
 
 #include "qt_queue.h"
+#include "qt_latency.h"
 
 /* Memory Management */
 #ifdef UNPOOLED
@@ -113,6 +114,7 @@ static void qthread_queue_internal_launch(qthread_t          *t,
 {
     assert(t);
     assert(cur_shep);
+    QTHREAD_LATENCY_READY(t, QT_LATENCY_QUEUE);
     t->thread_state = QTHREAD_STATE_RUNNING;
     if ((t->flags & QTHREAD_UNSTEALABLE) && (t->rdata->shepherd_ptr != cur_shep)) {
         qthread_debug(FEB_DETAILS, "qthread(%p:%i) enqueueing in target_shep's ready queue (%p:%i)\n", t, (int)t->thread_id, t->rdata->shepherd_ptr, (int)t->rdata->shepherd_ptr->shepherd_id);
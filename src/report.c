@@ -0,0 +1,104 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Public Headers */
+#include "qthread/qthread.h"
+
+/* Internal Headers */
+#include "qt_report.h"
+#include "qt_visibility.h"
+#include "qt_asserts.h"
+#include "qt_output_macros.h"
+#include "qt_qthread_mgmt.h"           /* for qthread_internal_self() */
+
+/* which report each signal asks for */
+static volatile sig_atomic_t *signal_requests[NSIG];
+
+typedef struct {
+    qt_report_t *r;
+    const char  *path;
+    int          ret;
+} report_arg_t;
+
+static void *report_thread(void *arg)
+{   /*{{{*/
+    report_arg_t *a = arg;
+
+    a->ret = a->r->write(a->path);
+    return NULL;
+} /*}}}*/
+
+/* stdio needs more stack than a qthread has, so a qthread's report is
+ * written by a thread of its own; anything else writes it in place. */
+int INTERNAL qt_report_dump(qt_report_t *r,
+                            const char  *path)
+{   /*{{{*/
+    report_arg_t arg = { r, path, QTHREAD_SUCCESS };
+    pthread_t    writer;
+
+    if (qthread_cas(&r->busy, 0, 1) != 0) {
+        return QTHREAD_OPFAIL;
+    }
+    if (qthread_internal_self() == NULL) {
+        arg.ret = r->write(path);
+    } else if (pthread_create(&writer, NULL, report_thread, &arg) == 0) {
+        qassert(pthread_join(writer, NULL), 0);
+    } else {
+        print_warning("could not start a thread to write the %s\n", r->what);
+        arg.ret = QTHREAD_THIRD_PARTY_ERROR;
+    }
+    r->busy = 0;
+    return arg.ret;
+} /*}}}*/
+
+void INTERNAL qt_report_dump_requested(qt_report_t *r,
+                                       const char  *path)
+{   /*{{{*/
+    char numbered[4096];
+
+    if (!__sync_bool_compare_and_swap(r->requested, 1, 0)) {
+        return; /* another worker got it */
+    }
+    if ((path != NULL) && (path[0] != 0) && strcmp(path, "-")) {
+        snprintf(numbered, sizeof(numbered), "%s.%lu", path,
+                 (unsigned long)qthread_incr(&r->dumps, 1) + 1);
+        path = numbered;
+    }
+    (void)qt_report_dump(r, path);
+} /*}}}*/
+
+static void report_signal_handler(int sig)
+{   /*{{{*/
+    *signal_requests[sig] = 1;
+} /*}}}*/
+
+void INTERNAL qt_report_signal(qt_report_t *r,
+                               int          sig)
+{   /*{{{*/
+    struct sigaction sa;
+
+    if (sig <= 0) {
+        return;
+    }
+    if (sig >= NSIG) {
+        print_warning("there is no signal %d to catch for the %s\n", sig, r->what);
+        return;
+    }
+    signal_requests[sig] = r->requested;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = report_signal_handler;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(sig, &sa, NULL) != 0) {
+        print_warning("could not catch signal %d for the %s\n", sig, r->what);
+    }
+} /*}}}*/
+
+/* vim:set expandtab: */
@@ -20,6 +20,7 @@
 #include "qt_aligned_alloc.h"
 #include "qt_debug.h"
 #include "qt_int_ceil.h"
+#include "qt_trace.h"
 
 typedef aligned_t qt_sinc_count_t;
 
@@ -309,6 +310,7 @@ void API_FUNC qt_sinc_submit(qt_sinc_t *restrict  sinc_,
     }
 
     // Update counter
+    QTHREAD_TRACE_SYNC(QT_TRACE_SIGNAL, &sinc->ready);
     qt_sinc_count_t count = qthread_incr(&sinc->counter, -1);
     assert(count > 0);
     if (1 == count) { // This is the final submit
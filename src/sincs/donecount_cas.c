@@ -20,6 +20,7 @@
 #include "qt_aligned_alloc.h"
 #include "qt_debug.h"
 #include "qt_int_ceil.h"
+#include "qt_trace.h"
 
 typedef aligned_t qt_sinc_count_t;
 
@@ -250,6 +251,7 @@ void qt_sinc_submit(qt_sinc_t *restrict sinc_,
     }
 
     // Update counter
+    QTHREAD_TRACE_SYNC(QT_TRACE_SIGNAL, &sinc->ready);
     qt_sinc_count_t oldc = sinc->counter, newc = 0;
     while ((newc = qthread_cas(&sinc->counter, oldc, oldc - 1)) != oldc) oldc = newc;
     if (1 == newc) { // This is the final submit
@@ -20,6 +20,7 @@
 #include "qt_shepherd_innards.h"
 #include "qt_visibility.h"
 #include "qt_int_ceil.h"
+#include "qt_trace.h"
 
 typedef saligned_t qt_sinc_count_t;
 
@@ -365,6 +366,7 @@ void qt_sinc_submit(qt_sinc_t *restrict sinc,
 
         sinc->op(values, value);
     }
+    QTHREAD_TRACE_SYNC(QT_TRACE_SIGNAL, &sinc->ready);
 
 #if defined(SINCS_PROFILE)
     int dist = 0;
@@ -19,6 +19,7 @@
 #include "qt_expect.h"
 #include "qt_visibility.h"
 #include "qt_int_ceil.h"
+#include "qt_trace.h"
 
 typedef aligned_t qt_sinc_count_t;
 
@@ -376,6 +377,8 @@ void qt_sinc_submit(qt_sinc_t *restrict sinc_,
         }
     }
 
+    QTHREAD_TRACE_SYNC(QT_TRACE_SIGNAL, &sinc->ready);
+
     qt_sinc_snzi_t *const restrict snzi = sinc->snzi;
     assert(snzi->counts);
 
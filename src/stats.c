@@ -0,0 +1,149 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <stddef.h>                    /* for offsetof() */
+#include <string.h>                    /* for memset() */
+
+/* Public Headers */
+#include "qthread/qthread.h"
+
+/* Internal Headers */
+#include "qt_stats.h"
+#include "qt_timer_wheel.h"               /* for qt_timer_now() */
+#include "qt_aligned_alloc.h"
+#include "qt_asserts.h"
+#include "qt_debug.h"
+#include "qt_envariables.h"
+#include "qthread_innards.h"           /* for qlib */
+#include "qt_subsystems.h"
+
+/* A worker's slot, alone on its cache line(s) */
+typedef union {
+    qt_stats_slot_t slot;
+    char            pad[((sizeof(qt_stats_slot_t) + CACHELINE_WIDTH - 1) / CACHELINE_WIDTH) * CACHELINE_WIDTH];
+} qt_stats_padded_t;
+
+#define STATS_FIELDS (sizeof(qthread_stats_t) / sizeof(uint64_t))
+
+int qt_stats_enabled = 1;
+
+/* One slot per worker, in packed_worker_id order, then one for everybody
+ * else. Resetting doesn't touch the slots (their owners may be adding to
+ * them); it records a baseline that snapshots subtract. */
+static qt_stats_padded_t *slots    = NULL;
+static qthread_stats_t   *baseline = NULL;
+static size_t             nslots   = 0;
+
+/* by now, the workers (and their pointers into the slots) are gone */
+static void qt_stats_internal_teardown(void)
+{   /*{{{*/
+    qthread_internal_aligned_free(slots, CACHELINE_WIDTH);
+    FREE(baseline, nslots * sizeof(qthread_stats_t));
+    slots    = NULL;
+    baseline = NULL;
+    nslots   = 0;
+} /*}}}*/
+
+void INTERNAL qt_stats_subsystem_init(void)
+{   /*{{{*/
+    const size_t nworkers = qlib->nshepherds * qlib->nworkerspershep;
+
+    qt_stats_enabled = qt_internal_get_env_bool("STATS", 1);
+    nslots           = nworkers + 1;
+    slots            = qthread_internal_aligned_alloc(nslots * sizeof(qt_stats_padded_t), CACHELINE_WIDTH);
+    baseline         = MALLOC(nslots * sizeof(qthread_stats_t));
+    assert(slots && baseline);
+    memset(slots, 0, nslots * sizeof(qt_stats_padded_t));
+    memset(baseline, 0, nslots * sizeof(qthread_stats_t));
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        for (qthread_worker_id_t j = 0; j < qlib->nworkerspershep; ++j) {
+            qlib->shepherds[i].workers[j].stats = &slots[i * qlib->nworkerspershep + j].slot;
+        }
+    }
+    qthread_internal_cleanup(qt_stats_internal_teardown);
+} /*}}}*/
+
+void INTERNAL qt_stats_count_external(size_t   offset,
+                                      uint64_t n)
+{   /*{{{*/
+    if (slots != NULL) {
+        (void)__sync_fetch_and_add((uint64_t *)((char *)&slots[nslots - 1].slot.s + offset), n);
+    }
+} /*}}}*/
+
+int API_FUNC qthread_stats_enable(int enable)
+{   /*{{{*/
+    const int was = qt_stats_enabled;
+
+    qt_stats_enabled = (enable != 0);
+    return was;
+} /*}}}*/
+
+void API_FUNC qthread_stats_reset(void)
+{   /*{{{*/
+    for (size_t i = 0; i < nslots; ++i) {
+        baseline[i] = *(volatile qthread_stats_t *)&slots[i].slot.s;
+    }
+} /*}}}*/
+
+/* Sums the slots, less the baseline if there is one; a wait that hasn't
+ * ended yet counts up to now. */
+static void stats_collect(const qthread_stats_t *base_slots,
+                          qthread_stats_t       *total,
+                          qthread_stats_t       *per_worker,
+                          uint8_t               *idle)
+{   /*{{{*/
+    qthread_stats_t sum;
+    const uint64_t  now = qt_timer_now();
+
+    memset(&sum, 0, sizeof(sum));
+    for (size_t i = 0; i < nslots; ++i) {
+        const volatile qt_stats_slot_t *slot = &slots[i].slot;
+        const volatile uint64_t        *cur  = (const volatile uint64_t *)&slot->s;
+        const uint64_t                 *base = (const uint64_t *)&base_slots[i];
+        qthread_stats_t                 one;
+        uint64_t                       *o     = (uint64_t *)&one;
+        uint64_t                       *s     = (uint64_t *)&sum;
+        const uint64_t                  since = slot->idle_since;
+
+        for (size_t f = 0; f < STATS_FIELDS; ++f) {
+            o[f] = cur[f] - (base_slots ? base[f] : 0);
+        }
+        if ((since != 0) && (now > since)) {
+            one.idle_ns += now - since; /* still waiting */
+        }
+        for (size_t f = 0; f < STATS_FIELDS; ++f) {
+            s[f] += o[f];
+        }
+        if (i < nslots - 1) {
+            if (per_worker) { per_worker[i] = one; }
+            if (idle) { idle[i] = (since != 0); }
+        }
+    }
+    if (total) {
+        *total = sum;
+    }
+} /*}}}*/
+
+void INTERNAL qt_stats_internal_sample(qthread_stats_t *total,
+                                       qthread_stats_t *per_worker,
+                                       uint8_t         *idle)
+{   /*{{{*/
+    if (slots != NULL) {
+        stats_collect(NULL, total, per_worker, idle);
+    }
+} /*}}}*/
+
+int API_FUNC qthread_stats_snapshot(qthread_stats_t *total,
+                                    qthread_stats_t *per_worker)
+{   /*{{{*/
+    if (slots == NULL) {
+        return QTHREAD_NOT_ALLOWED;
+    }
+    stats_collect(baseline, total, per_worker, NULL);
+    return QTHREAD_SUCCESS;
+} /*}}}*/
+
+/* vim:set expandtab: */
@@ -0,0 +1,229 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>                    /* for getpid() */
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+/* Public Headers */
+#include "qthread/qthread.h"
+
+/* Internal Headers */
+#include "qt_visibility.h"
+#include "qt_stats.h"
+#include "qt_stats_page.h"
+#include "qt_asserts.h"
+#include "qt_atomics.h"
+#include "qt_debug.h"
+#include "qt_envariables.h"
+#include "qt_feb.h"                    /* for qt_feb_subsystem_entries() */
+#include "qt_io.h"                     /* for qt_blocking_subsystem_queue_depth() */
+#include "qt_mpool.h"                  /* for qt_mpool_subsystem_bytes() */
+#include "qt_output_macros.h"
+#include "qt_subsystems.h"
+#include "qt_threadqueues.h"
+#include "qt_timer_wheel.h"            /* for qt_timer_now() */
+#include "qthread_innards.h"           /* for qlib */
+
+/* See qt_stats_page.h. The page is written by a thread of its own, so that
+ * nobody on the scheduling path ever waits for it or even knows it is
+ * there. */
+
+static qt_stats_page_t *page      = NULL;
+static size_t           page_size = 0;
+static int              page_id   = -1;
+static uint64_t         interval_ns;
+
+static pthread_t       writer;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  writer_wake = PTHREAD_COND_INITIALIZER;
+static int             stopping    = 0;
+
+/* scratch for each sample, owned by the writer */
+static qthread_stats_t *per_worker = NULL;
+static uint8_t         *idle       = NULL;
+
+static void stats_page_write(int finalized)
+{   /*{{{*/
+    const size_t    wps = qlib->nworkerspershep;
+    qthread_stats_t total;
+
+    qt_stats_internal_sample(&total, per_worker, idle);
+
+    page->seq++;                       /* odd: being written */
+    MACHINE_FENCE;
+    page->samples++;
+    page->sample_ns        = qt_timer_now();
+    page->finalized        = finalized;
+    page->tasks_spawned    = total.tasks_spawned;
+    page->tasks_run        = total.tasks_run;
+    page->tasks_blocked    = total.tasks_blocked;
+    page->tasks_stolen     = total.tasks_stolen;
+    page->steal_attempts   = total.steal_attempts;
+    page->steal_failures   = total.steal_failures;
+    page->feb_blocks       = total.feb_blocks;
+    page->context_switches = total.context_switches;
+    page->idle_ns          = total.idle_ns;
+    page->feb_entries      = qt_feb_subsystem_entries();
+    page->io_queue_depth   = qt_blocking_subsystem_queue_depth();
+    page->io_proxies       = qt_blocking_subsystem_proxies();
+    page->pool_bytes       = qt_mpool_subsystem_bytes();
+    for (size_t i = 0; i < qlib->nshepherds; ++i) {
+        qthread_shepherd_t       *shep = &qlib->shepherds[i];
+        qt_stats_page_shepherd_t *s    = &page->shepherds[i];
+
+        memset(s, 0, sizeof(*s));
+        s->queue_length = qt_threadqueue_advisory_queuelen(shep->ready);
+        s->workers      = wps;
+        for (size_t j = 0; j < wps; ++j) {
+            const qthread_stats_t *w = &per_worker[i * wps + j];
+
+            s->active_workers += (QTHREAD_CASLOCK_READ_UI(shep->workers[j].active) != 0);
+            s->idle_workers   += idle[i * wps + j];
+            s->tasks_spawned  += w->tasks_spawned;
+            s->tasks_run      += w->tasks_run;
+            s->tasks_stolen   += w->tasks_stolen;
+            s->steal_attempts += w->steal_attempts;
+            s->feb_blocks     += w->feb_blocks;
+            s->idle_ns        += w->idle_ns;
+        }
+    }
+    MACHINE_FENCE;
+    page->seq++;                       /* even: consistent */
+} /*}}}*/
+
+static void *stats_page_writer(void *arg)
+{   /*{{{*/
+    pthread_mutex_lock(&writer_lock);
+    while (!stopping) {
+        struct timespec when;
+        uint64_t        ns;
+
+        stats_page_write(0);
+        clock_gettime(CLOCK_REALTIME, &when); /* what the condition waits on */
+        ns           = when.tv_nsec + interval_ns;
+        when.tv_sec += ns / 1000000000;
+        when.tv_nsec = ns % 1000000000;
+        while (!stopping &&
+               pthread_cond_timedwait(&writer_wake, &writer_lock, &when) != ETIMEDOUT) {}
+    }
+    pthread_mutex_unlock(&writer_lock);
+    return NULL;
+} /*}}}*/
+
+/* Runs before the workers are taken apart. The last sample says that the
+ * library is gone; the segment itself goes away once the last reader lets go
+ * of it. */
+static void qt_stats_page_internal_teardown(void)
+{   /*{{{*/
+    pthread_mutex_lock(&writer_lock);
+    stopping = 1;
+    pthread_cond_signal(&writer_wake);
+    pthread_mutex_unlock(&writer_lock);
+    pthread_join(writer, NULL);
+
+    stats_page_write(1);
+    shmctl(page_id, IPC_RMID, NULL);
+    shmdt(page);
+    page    = NULL;
+    page_id = -1;
+    FREE(per_worker, qlib->nshepherds * qlib->nworkerspershep * sizeof(qthread_stats_t));
+    FREE(idle, qlib->nshepherds * qlib->nworkerspershep);
+    per_worker = NULL;
+    idle       = NULL;
+} /*}}}*/
+
+/* Whether the segment that has our key is a statistics page that a process
+ * with our pid left behind, without cleaning up after itself, and that
+ * nobody is reading: the process that wrote it would still be attached if
+ * it were alive. Anything else there is somebody else's business. */
+static int stale_page(int id,
+                      int key)
+{   /*{{{*/
+    struct shmid_ds        ds;
+    const qt_stats_page_t *old;
+    int                    ret;
+
+    if ((shmctl(id, IPC_STAT, &ds) != 0) || (ds.shm_nattch != 0) ||
+        (ds.shm_perm.uid != geteuid()) || (ds.shm_segsz < sizeof(qt_stats_page_t))) {
+        return 0;
+    }
+    old = shmat(id, NULL, SHM_RDONLY);
+    if (old == (void *)-1) {
+        return 0;
+    }
+    ret = (old->magic == QT_STATS_PAGE_MAGIC) && (QT_STATS_PAGE_KEY(old->pid) == key);
+    shmdt(old);
+    return ret;
+} /*}}}*/
+
+void INTERNAL qt_stats_page_init(void)
+{   /*{{{*/
+    const size_t nworkers = qlib->nshepherds * qlib->nworkerspershep;
+    const int    key      = QT_STATS_PAGE_KEY(getpid());
+
+    if (!qt_internal_get_env_bool("STATS_PAGE", 0)) {
+        return;
+    }
+    interval_ns = qt_internal_get_env_num("STATS_PAGE_INTERVAL", 250, 1) * 1000000;
+    page_size   = sizeof(qt_stats_page_t) + qlib->nshepherds * sizeof(qt_stats_page_shepherd_t);
+
+    page_id = shmget(key, page_size, IPC_CREAT | IPC_EXCL | 0644);
+    if ((page_id < 0) && (errno == EEXIST)) {
+        int stale = shmget(key, 0, 0);
+
+        if ((stale < 0) || !stale_page(stale, key)) {
+            print_warning("shared memory key %#x is taken by something other than a "
+                          "stale statistics page; not publishing statistics\n", key);
+            return;
+        }
+        shmctl(stale, IPC_RMID, NULL);
+        page_id = shmget(key, page_size, IPC_CREAT | IPC_EXCL | 0644);
+    }
+    if (page_id < 0) {
+        print_warning("could not create the statistics page (%s)\n", strerror(errno));
+        return;
+    }
+    page = shmat(page_id, NULL, 0);
+    if (page == (void *)-1) {
+        print_warning("could not attach the statistics page (%s)\n", strerror(errno));
+        shmctl(page_id, IPC_RMID, NULL);
+        page    = NULL;
+        page_id = -1;
+        return;
+    }
+    memset(page, 0, page_size);
+    page->version         = QT_STATS_PAGE_VERSION;
+    page->size            = page_size;
+    page->pid             = getpid();
+    page->interval_ns     = interval_ns;
+    page->nshepherds      = qlib->nshepherds;
+    page->nworkerspershep = qlib->nworkerspershep;
+    per_worker            = MALLOC(nworkers * sizeof(qthread_stats_t));
+    idle                  = MALLOC(nworkers);
+    assert(per_worker && idle);
+    MACHINE_FENCE;
+    page->magic = QT_STATS_PAGE_MAGIC; /* last, so readers never see half a header */
+
+    stopping = 0;
+    if (pthread_create(&writer, NULL, stats_page_writer, NULL) != 0) {
+        print_warning("could not start the statistics page writer\n");
+        shmctl(page_id, IPC_RMID, NULL);
+        shmdt(page);
+        page    = NULL;
+        page_id = -1;
+        FREE(per_worker, nworkers * sizeof(qthread_stats_t));
+        FREE(idle, nworkers);
+        return;
+    }
+    qthread_internal_cleanup_early(qt_stats_page_internal_teardown);
+} /*}}}*/
+
+/* vim:set expandtab: */
@@ -25,6 +25,9 @@
 #include "qt_qthread_mgmt.h"
 #include "qt_threadqueues.h"
 #include "qt_debug.h"
+#include "qt_trace.h"
+#include "qt_latency.h"
+#include "qt_contention.h"
 #ifdef QTHREAD_USE_EUREKAS
 #include "qt_eurekas.h"
 #endif /* QTHREAD_USE_EUREKAS */
@@ -391,6 +394,7 @@ int API_FUNC qthread_syncvar_readFF(uint64_t *restrict  dest,
             if (dest) {
                 *dest = local_copy_of_src.u.s.data;
             }
+            QTHREAD_TRACE_SYNC(QT_TRACE_READ, src);
             return QTHREAD_SUCCESS;
         }
     }
@@ -400,6 +404,7 @@ int API_FUNC qthread_syncvar_readFF(uint64_t *restrict  dest,
                   (uintptr_t)src->u.w, ret);
     if (e.cf) {                        /* there was a timeout */
         QTHREAD_WAIT_TIMER_DECLARATION;
+        QTHREAD_CONTENTION_DECLARATION;
         const int           lockbin = QTHREAD_CHOOSE_STRIPE(src);
         qthread_addrstat_t *m;
         qthread_addrres_t  *X;
@@ -465,9 +470,11 @@ got_m:
         qthread_debug(SYNCVAR_DETAILS, "back to parent\n");
         me->thread_state          = QTHREAD_STATE_FEB_BLOCKED;
         me->rdata->blockedon.addr = m;
+        QTHREAD_CONTENTION_BLOCK(src, m);
         QTHREAD_WAIT_TIMER_START();
         qthread_back_to_master(me);
         QTHREAD_WAIT_TIMER_STOP(me, febwait);
+        QTHREAD_CONTENTION_WAKE(me);
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
@@ -481,6 +488,7 @@ locked_full:
         if (dest) { *dest = ret; }
     }
     QTHREAD_FEB_TIMER_STOP(febblock, me);
+    QTHREAD_TRACE_SYNC(QT_TRACE_READ, src);
     return QTHREAD_SUCCESS;
 }                                      /*}}} */
 
@@ -514,6 +522,7 @@ int INTERNAL qthread_syncvar_readFF_nb(uint64_t *restrict  dest,
             if (dest) {
                 *dest = local_copy_of_src.u.s.data;
             }
+            QTHREAD_TRACE_SYNC(QT_TRACE_READ, src);
             return QTHREAD_SUCCESS;
         }
     }
@@ -531,6 +540,7 @@ int INTERNAL qthread_syncvar_readFF_nb(uint64_t *restrict  dest,
         UNLOCK_THIS_MODIFIED_SYNCVAR(src, ret, e.sf);
         if (dest) { *dest = ret; }
     }
+    QTHREAD_TRACE_SYNC(QT_TRACE_READ, src);
     return QTHREAD_SUCCESS;
 }                                      /*}}} */
 
@@ -610,6 +620,7 @@ got_m:
         assert(e.pf == 0);
         UNLOCK_THIS_MODIFIED_SYNCVAR(addr, ret, e.sf);
     }
+    QTHREAD_TRACE_SYNC(QT_TRACE_FILL, addr);
     return QTHREAD_SUCCESS;
 }                                      /*}}} */
 
@@ -688,6 +699,7 @@ got_m:
         assert(e.pf == 1);
         UNLOCK_THIS_MODIFIED_SYNCVAR(addr, ret, SYNCFEB_STATE_EMPTY_NO_WAITERS | e.sf);
     }
+    QTHREAD_TRACE_SYNC(QT_TRACE_EMPTY, addr);
     return QTHREAD_SUCCESS;
 }                                      /*}}} */
 
@@ -721,6 +733,7 @@ int API_FUNC qthread_syncvar_readFE(uint64_t *restrict  dest,
                   (uintptr_t)src->u.w);
     if (e.cf) {                        /* there was a timeout */
         QTHREAD_WAIT_TIMER_DECLARATION;
+        QTHREAD_CONTENTION_DECLARATION;
         qthread_addrstat_t *m;
         qthread_addrres_t  *X;
 
@@ -793,9 +806,11 @@ got_m:
         qthread_debug(SYNCVAR_DETAILS, "back to parent\n");
         me->thread_state          = QTHREAD_STATE_FEB_BLOCKED;
         me->rdata->blockedon.addr = m;
+        QTHREAD_CONTENTION_BLOCK(src, m);
         QTHREAD_WAIT_TIMER_START();
         qthread_back_to_master(me);
         QTHREAD_WAIT_TIMER_STOP(me, febwait);
+        QTHREAD_CONTENTION_WAKE(me);
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
@@ -860,6 +875,7 @@ locked_full:
     }
     QTHREAD_FEB_TIMER_STOP(febblock, me);
     qthread_debug(SYNCVAR_DETAILS, "src(%p) exiting\n", src);
+    QTHREAD_TRACE_SYNC(QT_TRACE_READ, src);
     return QTHREAD_SUCCESS;
 }                                      /*}}} */
 
@@ -948,6 +964,7 @@ got_m:
         *dest = ret;
     }
     qthread_debug(SYNCVAR_DETAILS, "src(%p) exiting\n", src);
+    QTHREAD_TRACE_SYNC(QT_TRACE_READ, src);
     return QTHREAD_SUCCESS;
 }                                      /*}}} */
 
@@ -956,6 +973,8 @@ static QINLINE void qthread_syncvar_schedule(qthread_t          *waiter,
 {   /*{{{*/
     assert(waiter);
     assert(shep);
+    QTHREAD_TRACE_HERE(QT_TRACE_WAKE, waiter, 0, 0);
+    QTHREAD_LATENCY_READY(waiter, QT_LATENCY_FEB);
     waiter->thread_state = QTHREAD_STATE_RUNNING;
     if (waiter->flags & QTHREAD_UNSTEALABLE) {
         qt_threadqueue_enqueue(waiter->rdata->shepherd_ptr->ready, waiter);
@@ -1186,6 +1205,7 @@ got_m:
         UNLOCK_THIS_MODIFIED_SYNCVAR(dest, ret, 0);
     }
 
+    QTHREAD_TRACE_SYNC(QT_TRACE_FILL, dest);
     return QTHREAD_SUCCESS;
 }                                      /*}}} */
 
@@ -1216,6 +1236,7 @@ int API_FUNC qthread_syncvar_writeEF(syncvar_t *restrict      dest,
     (void)qthread_mwaitc(dest, SYNCFEB_EMPTY, INITIAL_TIMEOUT, &e);
     if (e.cf) {                        /* there was a timeout */
         QTHREAD_WAIT_TIMER_DECLARATION;
+        QTHREAD_CONTENTION_DECLARATION;
         qthread_addrstat_t *m;
         qthread_addrres_t  *X;
 
@@ -1281,9 +1302,11 @@ got_m:
         qthread_debug(SYNCVAR_DETAILS, ": back to parent\n");
         me->thread_state          = QTHREAD_STATE_FEB_BLOCKED;
         me->rdata->blockedon.addr = m;
+        QTHREAD_CONTENTION_BLOCK(dest, m);
         QTHREAD_WAIT_TIMER_START();
         qthread_back_to_master(me);
         QTHREAD_WAIT_TIMER_STOP(me, febwait);
+        QTHREAD_CONTENTION_WAKE(me);
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
@@ -1356,6 +1379,7 @@ locked_empty:
                       (uintptr_t)BUILD_UNLOCKED_SYNCVAR(val, SYNCFEB_STATE_FULL_NO_WAITERS));
     }
     QTHREAD_FEB_TIMER_STOP(febblock, me);
+    QTHREAD_TRACE_SYNC(QT_TRACE_FILL, dest);
     return QTHREAD_SUCCESS;
 }                                      /*}}} */
 
@@ -4,6 +4,7 @@
 
 /* System Headers */
 #include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
 
 #ifdef HAVE_SYS_SYSCALL_H
 # include <unistd.h>
@@ -23,10 +24,30 @@ int qt_accept(int                       socket,
               struct sockaddr *restrict address,
               socklen_t *restrict       address_len)
 {
-    qt_blocking_queue_node_t *job = ALLOC_SYSCALLJOB();
+    qt_blocking_queue_node_t *job;
     int                       ret;
-    qthread_t                *me = qthread_internal_self();
+    qthread_t                *me;
 
+    if (qt_io_reactor_pollable(socket)) {
+        for (;;) {
+#if HAVE_SYSCALL && HAVE_DECL_SYS_ACCEPT
+            ret = syscall(SYS_accept, socket, address, address_len);
+#else
+            ret = (accept)(socket, address, address_len);
+#endif
+            if (ret >= 0) {
+                /* a new fd, though perhaps a reused number */
+                qt_io_reactor_forget(ret);
+                return ret;
+            } else if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                return ret;
+            }
+            qt_io_reactor_wait(socket, POLLIN);
+        }
+    }
+
+    job = ALLOC_SYSCALLJOB();
+    me  = qthread_internal_self();
     assert(job);
     job->next   = NULL;
     job->thread = me;
@@ -41,6 +62,7 @@ int qt_accept(int                       socket,
     qthread_back_to_master(me);
     ret = job->ret;
     FREE_SYSCALLJOB(job);
+    qt_io_reactor_forget(ret);
     return ret;
 }
 
@@ -0,0 +1,39 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <unistd.h>                /* for close() */
+
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>        /* for SYS_close */
+#endif
+
+/* Public Headers */
+#include "qthread/qt_syscalls.h"
+
+/* Internal Headers */
+#include "qt_io.h"
+
+/* close() does not block, so there is nothing to hand to the proxies; but
+ * the fd number may be reused for something else, which the reactor must
+ * look at afresh. */
+int qt_close(int filedes)
+{
+    qt_io_reactor_forget(filedes);
+#if HAVE_SYSCALL && HAVE_DECL_SYS_CLOSE
+    return syscall(SYS_close, filedes);
+#else
+    return (close)(filedes); /* (close) dodges the USE_HEADER_SYSCALLS macro */
+#endif
+}
+
+#if HAVE_SYSCALL && HAVE_DECL_SYS_CLOSE
+int close(int filedes)
+{
+    return qt_close(filedes);
+}
+
+#endif /* if HAVE_SYSCALL && HAVE_DECL_SYS_CLOSE */
+
+/* vim:set expandtab: */
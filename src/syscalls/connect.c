@@ -4,6 +4,7 @@
 
 /* System Headers */
 #include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
 
 #ifdef HAVE_SYS_SYSCALL_H
 # include <unistd.h>
@@ -23,10 +24,38 @@ int qt_connect(int                    socket,
                const struct sockaddr *address,
                socklen_t              address_len)
 {
-    qthread_t                *me  = qthread_internal_self();
-    qt_blocking_queue_node_t *job = ALLOC_SYSCALLJOB();
+    qthread_t                *me;
+    qt_blocking_queue_node_t *job;
     int                       ret;
 
+    if (qt_io_reactor_pollable(socket)) {
+#if HAVE_SYSCALL && HAVE_DECL_SYS_CONNECT
+        ret = syscall(SYS_connect, socket, address, address_len);
+#else
+        ret = (connect)(socket, address, address_len);
+#endif
+        if ((ret == 0) || (errno != EINPROGRESS)) {
+            return ret;
+        }
+        /* the connection completes (or fails) when the socket is writable */
+        qt_io_reactor_wait(socket, POLLOUT);
+        {
+            int       err;
+            socklen_t len = sizeof(int);
+
+            if (getsockopt(socket, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+                return -1;
+            }
+            if (err != 0) {
+                errno = err;
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    me  = qthread_internal_self();
+    job = ALLOC_SYSCALLJOB();
     assert(job);
     job->next   = NULL;
     job->thread = me;
@@ -0,0 +1,73 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
+#include <unistd.h>              /* for copy_file_range() */
+
+/* Public Headers */
+#include "qthread/qt_syscalls.h"
+
+/* Internal Headers */
+#include "qt_io.h"
+#include "qt_asserts.h"
+#include "qthread_innards.h" /* for qlib */
+#include "qt_qthread_mgmt.h"
+
+ssize_t qt_copy_file_range(int          fd_in,
+                           off_t       *off_in,
+                           int          fd_out,
+                           off_t       *off_out,
+                           size_t       len,
+                           unsigned int flags)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+    qthread_t                *me  = qthread_internal_self();
+    qt_blocking_queue_node_t *job = ALLOC_SYSCALLJOB();
+    loff_t                    in, out;
+    ssize_t                   ret;
+
+    /* off_t and loff_t need not be the same type */
+    if (off_in) {
+        in = *off_in;
+    }
+    if (off_out) {
+        out = *off_out;
+    }
+    assert(job);
+    job->next   = NULL;
+    job->thread = me;
+    job->op     = COPY_FILE_RANGE;
+    memcpy(&job->args[0], &fd_in, sizeof(int));
+    job->args[1] = (uintptr_t)(off_in ? &in : NULL);
+    memcpy(&job->args[2], &fd_out, sizeof(int));
+    job->args[3] = (uintptr_t)(off_out ? &out : NULL);
+    memcpy(&job->args[4], &len, sizeof(size_t));
+    memcpy(&job->args[5], &flags, sizeof(unsigned int));
+
+    assert(me->rdata);
+
+    me->rdata->blockedon.io = job;
+    me->thread_state        = QTHREAD_STATE_SYSCALL;
+    qthread_back_to_master(me);
+    ret = job->ret;
+    if (ret < 0) {
+        errno = job->err;
+    }
+    FREE_SYSCALLJOB(job);
+    if (off_in) {
+        *off_in = in;
+    }
+    if (off_out) {
+        *off_out = out;
+    }
+    return ret;
+#else /* ifdef HAVE_COPY_FILE_RANGE */
+    errno = ENOSYS;
+    return -1;
+#endif /* ifdef HAVE_COPY_FILE_RANGE */
+}
+
+/* vim:set expandtab: */
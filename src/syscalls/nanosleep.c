@@ -6,6 +6,7 @@
 #include <qthread/qthread-int.h> /* for uint64_t */
 
 #include <time.h>
+#include <errno.h>
 
 #ifdef HAVE_SYS_SYSCALL_H
 # include <unistd.h>
@@ -14,31 +15,27 @@
 
 /* API Headers */
 #include "qthread/qthread.h"
-#include "qthread/qtimer.h"
 
 /* Internal Headers */
 #include "qt_io.h"
 #include "qthread_innards.h" /* for qlib */
 #include "qt_qthread_mgmt.h"
+#include "qt_timer_wheel.h"
 
 int nanosleep(const struct timespec *rqtp,
               struct timespec       *rmtp)
 {
     if (qt_blockable()) {
-        qtimer_t t       = qtimer_create();
-        double   seconds = rqtp->tv_sec + (rqtp->tv_nsec * 1e-9);
-
-        qtimer_start(t);
-        do {
-            qthread_yield();
-            qtimer_stop(t);
-        } while (qtimer_secs(t) < seconds);
+        if ((rqtp->tv_sec < 0) || (rqtp->tv_nsec < 0) || (rqtp->tv_nsec >= 1000000000)) {
+            errno = EINVAL;
+            return -1;
+        }
+        qt_timer_sleep_until(qt_timer_now() + qt_timer_deadline(rqtp));
+        /* never interrupted, so there is never any time left */
         if (rmtp) {
-            time_t secs = (time_t)qtimer_secs(t);
-            rmtp->tv_sec = rqtp->tv_sec - secs;
-            rmtp->tv_nsec = (long)(qtimer_secs(t) - (double)secs) * 1e9;
+            rmtp->tv_sec  = 0;
+            rmtp->tv_nsec = 0;
         }
-        qtimer_destroy(t);
         return 0;
     } else {
 #if HAVE_SYSCALL && HAVE_DECL_SYS_NANOSLEEP
@@ -4,6 +4,7 @@
 
 /* System Headers */
 #include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
 
 #ifdef HAVE_SYS_SYSCALL_H
 # include <unistd.h>
@@ -23,10 +24,34 @@ int qt_poll(struct pollfd fds[],
             nfds_t        nfds,
             int           timeout)
 {
-    qthread_t                *me  = qthread_internal_self();
-    qt_blocking_queue_node_t *job = ALLOC_SYSCALLJOB();
+    qthread_t                *me;
+    qt_blocking_queue_node_t *job;
     int                       ret;
 
+    /* first see if anything is ready already, which needs no proxy */
+#if HAVE_SYSCALL && HAVE_DECL_SYS_POLL
+    ret = syscall(SYS_poll, fds, nfds, 0);
+#else
+    ret = (poll)(fds, nfds, 0);
+#endif
+    if ((ret != 0) || (timeout == 0)) {
+        return ret;
+    }
+    /* a single fd, waited on indefinitely, is just a reactor wait */
+    if ((nfds == 1) && (timeout < 0) && qt_io_reactor_pollable(fds[0].fd)) {
+        do {
+            qt_io_reactor_wait(fds[0].fd, fds[0].events);
+#if HAVE_SYSCALL && HAVE_DECL_SYS_POLL
+            ret = syscall(SYS_poll, fds, nfds, 0);
+#else
+            ret = (poll)(fds, nfds, 0);
+#endif
+        } while (ret == 0);
+        return ret;
+    }
+
+    me  = qthread_internal_self();
+    job = ALLOC_SYSCALLJOB();
     assert(job);
     job->next    = NULL;
     job->thread  = me;
@@ -0,0 +1,50 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
+#include <sys/uio.h>             /* for struct iovec */
+
+/* Public Headers */
+#include "qthread/qt_syscalls.h"
+
+/* Internal Headers */
+#include "qt_io.h"
+#include "qt_asserts.h"
+#include "qthread_innards.h" /* for qlib */
+#include "qt_qthread_mgmt.h"
+
+ssize_t qt_preadv(int                 filedes,
+                 const struct iovec *iov,
+                 int                 iovcnt,
+                 off_t               offset)
+{
+    qthread_t                *me  = qthread_internal_self();
+    qt_blocking_queue_node_t *job = ALLOC_SYSCALLJOB();
+    ssize_t                   ret;
+
+    assert(job);
+    job->next   = NULL;
+    job->thread = me;
+    job->op     = PREADV;
+    memcpy(&job->args[0], &filedes, sizeof(int));
+    job->args[1] = (uintptr_t)iov;
+    job->args[2] = (uintptr_t)iovcnt;
+    memcpy(&job->args[3], &offset, sizeof(off_t));
+
+    assert(me->rdata);
+
+    me->rdata->blockedon.io = job;
+    me->thread_state        = QTHREAD_STATE_SYSCALL;
+    qthread_back_to_master(me);
+    ret = job->ret;
+    if (ret < 0) {
+        errno = job->err;
+    }
+    FREE_SYSCALLJOB(job);
+    return ret;
+}
+
+/* vim:set expandtab: */
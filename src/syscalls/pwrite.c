@@ -4,6 +4,7 @@
 
 /* System Headers */
 #include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
 
 #ifdef HAVE_SYS_SYSCALL_H
 # include <unistd.h>
@@ -43,6 +44,42 @@ ssize_t qt_pwrite(int         filedes,
     me->thread_state        = QTHREAD_STATE_SYSCALL;
     qthread_back_to_master(me);
     ret = job->ret;
+    if (ret < 0) {
+        errno = job->err;
+    }
+    FREE_SYSCALLJOB(job);
+    return ret;
+}
+
+ssize_t qt_pwrite_fixed(int         filedes,
+                        const void *buf,
+                        size_t      nbyte,
+                        off_t       offset,
+                        int         buf_index)
+{
+    qthread_t                *me  = qthread_internal_self();
+    qt_blocking_queue_node_t *job = ALLOC_SYSCALLJOB();
+    ssize_t                   ret;
+
+    assert(job);
+    job->next   = NULL;
+    job->thread = me;
+    job->op     = PWRITE_FIXED;
+    memcpy(&job->args[0], &filedes, sizeof(int));
+    job->args[1] = (uintptr_t)buf;
+    job->args[2] = (uintptr_t)nbyte;
+    memcpy(&job->args[3], &offset, sizeof(off_t));
+    job->args[4] = (uintptr_t)buf_index;
+
+    assert(me->rdata);
+
+    me->rdata->blockedon.io = job;
+    me->thread_state        = QTHREAD_STATE_SYSCALL;
+    qthread_back_to_master(me);
+    ret = job->ret;
+    if (ret < 0) {
+        errno = job->err;
+    }
     FREE_SYSCALLJOB(job);
     return ret;
 }
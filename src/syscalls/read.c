@@ -4,6 +4,8 @@
 
 /* System Headers */
 #include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
+#include <unistd.h>                /* for read() */
 
 #ifdef HAVE_SYS_SYSCALL_H
 # include <unistd.h>
@@ -23,10 +25,26 @@ ssize_t qt_read(int    filedes,
                 void  *buf,
                 size_t nbyte)
 {
-    qthread_t                *me  = qthread_internal_self();
-    qt_blocking_queue_node_t *job = ALLOC_SYSCALLJOB();
+    qthread_t                *me;
+    qt_blocking_queue_node_t *job;
     ssize_t                   ret;
 
+    if (qt_io_reactor_pollable(filedes)) {
+        for (;;) {
+#if HAVE_SYSCALL && HAVE_DECL_SYS_READ
+            ret = syscall(SYS_read, filedes, buf, nbyte);
+#else
+            ret = (read)(filedes, buf, nbyte); /* (read) dodges the USE_HEADER_SYSCALLS macro */
+#endif
+            if ((ret >= 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+                return ret;
+            }
+            qt_io_reactor_wait(filedes, POLLIN);
+        }
+    }
+
+    me  = qthread_internal_self();
+    job = ALLOC_SYSCALLJOB();
     assert(job);
     job->next   = NULL;
     job->thread = me;
@@ -41,6 +59,9 @@ ssize_t qt_read(int    filedes,
     me->thread_state        = QTHREAD_STATE_SYSCALL;
     qthread_back_to_master(me);
     ret = job->ret;
+    if (ret < 0) {
+        errno = job->err;
+    }
     FREE_SYSCALLJOB(job);
     return ret;
 }
@@ -0,0 +1,87 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
+#include <sys/socket.h>            /* for recv() */
+#ifdef HAVE_SYS_SYSCALL_H
+# include <unistd.h>
+# include <sys/syscall.h>        /* for SYS_accept and others */
+#endif
+
+/* Public Headers */
+#include "qthread/qt_syscalls.h"
+
+/* Internal Headers */
+#include "qt_io.h"
+#include "qt_asserts.h"
+#include "qthread_innards.h" /* for qlib */
+#include "qt_qthread_mgmt.h"
+
+ssize_t qt_recv(int    socket,
+                void   *buffer,
+                size_t length,
+                int    flags)
+{
+    qthread_t                *me;
+    qt_blocking_queue_node_t *job;
+    ssize_t                   ret;
+
+    /* MSG_DONTWAIT means no waiting at all, in the reactor or a proxy */
+    if (qt_io_reactor_pollable(socket) || (flags & MSG_DONTWAIT)) {
+        for (;;) {
+#if HAVE_SYSCALL && HAVE_DECL_SYS_RECVFROM
+            ret = syscall(SYS_recvfrom, socket, buffer, length, flags, NULL, NULL);
+#else
+            ret = (recv)(socket, buffer, length, flags);
+#endif
+            if ((ret >= 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK)) ||
+                (flags & MSG_DONTWAIT)) {
+                return ret;
+            }
+            qt_io_reactor_wait(socket, POLLIN);
+        }
+    }
+
+    me  = qthread_internal_self();
+    job = ALLOC_SYSCALLJOB();
+    assert(job);
+    job->next   = NULL;
+    job->thread = me;
+    job->op     = RECV;
+    memcpy(&job->args[0], &socket, sizeof(int));
+    job->args[1] = (uintptr_t)buffer;
+    memcpy(&job->args[2], &length, sizeof(size_t));
+    memcpy(&job->args[3], &flags, sizeof(int));
+
+    assert(me->rdata);
+
+    me->rdata->blockedon.io = job;
+    me->thread_state        = QTHREAD_STATE_SYSCALL;
+    qthread_back_to_master(me);
+    ret = job->ret;
+    if (ret < 0) {
+        errno = job->err;
+    }
+    FREE_SYSCALLJOB(job);
+    return ret;
+}
+
+#if HAVE_SYSCALL && HAVE_DECL_SYS_RECVFROM
+ssize_t recv(int    socket,
+             void   *buffer,
+             size_t length,
+             int    flags)
+{
+    if (qt_blockable()) {
+        return qt_recv(socket, buffer, length, flags);
+    } else {
+        return syscall(SYS_recvfrom, socket, buffer, length, flags, NULL, NULL);
+    }
+}
+
+#endif /* if HAVE_SYSCALL && HAVE_DECL_SYS_RECVFROM */
+
+/* vim:set expandtab: */
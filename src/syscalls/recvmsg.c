@@ -0,0 +1,83 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
+#include <sys/socket.h>            /* for recvmsg() */
+#ifdef HAVE_SYS_SYSCALL_H
+# include <unistd.h>
+# include <sys/syscall.h>        /* for SYS_accept and others */
+#endif
+
+/* Public Headers */
+#include "qthread/qt_syscalls.h"
+
+/* Internal Headers */
+#include "qt_io.h"
+#include "qt_asserts.h"
+#include "qthread_innards.h" /* for qlib */
+#include "qt_qthread_mgmt.h"
+
+ssize_t qt_recvmsg(int           socket,
+                   struct msghdr *message,
+                   int           flags)
+{
+    qthread_t                *me;
+    qt_blocking_queue_node_t *job;
+    ssize_t                   ret;
+
+    if (qt_io_reactor_pollable(socket) || (flags & MSG_DONTWAIT)) {
+        for (;;) {
+#if HAVE_SYSCALL && HAVE_DECL_SYS_RECVMSG
+            ret = syscall(SYS_recvmsg, socket, message, flags);
+#else
+            ret = (recvmsg)(socket, message, flags);
+#endif
+            if ((ret >= 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK)) ||
+                (flags & MSG_DONTWAIT)) {
+                return ret;
+            }
+            qt_io_reactor_wait(socket, POLLIN);
+        }
+    }
+
+    me  = qthread_internal_self();
+    job = ALLOC_SYSCALLJOB();
+    assert(job);
+    job->next   = NULL;
+    job->thread = me;
+    job->op     = RECVMSG;
+    memcpy(&job->args[0], &socket, sizeof(int));
+    job->args[1] = (uintptr_t)message;
+    memcpy(&job->args[2], &flags, sizeof(int));
+
+    assert(me->rdata);
+
+    me->rdata->blockedon.io = job;
+    me->thread_state        = QTHREAD_STATE_SYSCALL;
+    qthread_back_to_master(me);
+    ret = job->ret;
+    if (ret < 0) {
+        errno = job->err;
+    }
+    FREE_SYSCALLJOB(job);
+    return ret;
+}
+
+#if HAVE_SYSCALL && HAVE_DECL_SYS_RECVMSG
+ssize_t recvmsg(int           socket,
+                struct msghdr *message,
+                int           flags)
+{
+    if (qt_blockable()) {
+        return qt_recvmsg(socket, message, flags);
+    } else {
+        return syscall(SYS_recvmsg, socket, message, flags);
+    }
+}
+
+#endif /* if HAVE_SYSCALL && HAVE_DECL_SYS_RECVMSG */
+
+/* vim:set expandtab: */
@@ -0,0 +1,86 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
+#include <sys/socket.h>            /* for send() */
+#ifdef HAVE_SYS_SYSCALL_H
+# include <unistd.h>
+# include <sys/syscall.h>        /* for SYS_accept and others */
+#endif
+
+/* Public Headers */
+#include "qthread/qt_syscalls.h"
+
+/* Internal Headers */
+#include "qt_io.h"
+#include "qt_asserts.h"
+#include "qthread_innards.h" /* for qlib */
+#include "qt_qthread_mgmt.h"
+
+ssize_t qt_send(int        socket,
+                const void *buffer,
+                size_t     length,
+                int        flags)
+{
+    qthread_t                *me;
+    qt_blocking_queue_node_t *job;
+    ssize_t                   ret;
+
+    if (qt_io_reactor_pollable(socket) || (flags & MSG_DONTWAIT)) {
+        for (;;) {
+#if HAVE_SYSCALL && HAVE_DECL_SYS_SENDTO
+            ret = syscall(SYS_sendto, socket, buffer, length, flags, NULL, 0);
+#else
+            ret = (send)(socket, buffer, length, flags);
+#endif
+            if ((ret >= 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK)) ||
+                (flags & MSG_DONTWAIT)) {
+                return ret;
+            }
+            qt_io_reactor_wait(socket, POLLOUT);
+        }
+    }
+
+    me  = qthread_internal_self();
+    job = ALLOC_SYSCALLJOB();
+    assert(job);
+    job->next   = NULL;
+    job->thread = me;
+    job->op     = SEND;
+    memcpy(&job->args[0], &socket, sizeof(int));
+    job->args[1] = (uintptr_t)buffer;
+    memcpy(&job->args[2], &length, sizeof(size_t));
+    memcpy(&job->args[3], &flags, sizeof(int));
+
+    assert(me->rdata);
+
+    me->rdata->blockedon.io = job;
+    me->thread_state        = QTHREAD_STATE_SYSCALL;
+    qthread_back_to_master(me);
+    ret = job->ret;
+    if (ret < 0) {
+        errno = job->err;
+    }
+    FREE_SYSCALLJOB(job);
+    return ret;
+}
+
+#if HAVE_SYSCALL && HAVE_DECL_SYS_SENDTO
+ssize_t send(int        socket,
+             const void *buffer,
+             size_t     length,
+             int        flags)
+{
+    if (qt_blockable()) {
+        return qt_send(socket, buffer, length, flags);
+    } else {
+        return syscall(SYS_sendto, socket, buffer, length, flags, NULL, 0);
+    }
+}
+
+#endif /* if HAVE_SYSCALL && HAVE_DECL_SYS_SENDTO */
+
+/* vim:set expandtab: */
@@ -0,0 +1,81 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>       /* for sendfile() */
+#endif
+
+/* Public Headers */
+#include "qthread/qt_syscalls.h"
+
+/* Internal Headers */
+#include "qt_io.h"
+#include "qt_asserts.h"
+#include "qthread_innards.h" /* for qlib */
+#include "qt_qthread_mgmt.h"
+
+ssize_t qt_sendfile(int    out_fd,
+                    int    in_fd,
+                    off_t *offset,
+                    size_t count)
+{
+#ifdef QTHREAD_LINUX_SENDFILE
+    qthread_t                *me;
+    qt_blocking_queue_node_t *job;
+    ssize_t                   ret;
+
+    /* the data stays in the kernel either way; a non-blocking socket just
+     * means the task can wait for room in the reactor, between chunks */
+    if (qt_io_reactor_pollable(out_fd)) {
+        size_t moved = 0;
+
+        while (moved < count) {
+            ret = sendfile(out_fd, in_fd, offset, count - moved);
+            if (ret > 0) {
+                moved += ret;
+            } else if (ret == 0) {
+                break;         /* end of the input */
+            } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                qt_io_reactor_wait(out_fd, POLLOUT);
+            } else if (moved > 0) {
+                break;         /* report what got through; the error will recur */
+            } else {
+                return -1;
+            }
+        }
+        return moved;
+    }
+
+    me  = qthread_internal_self();
+    job = ALLOC_SYSCALLJOB();
+    assert(job);
+    job->next   = NULL;
+    job->thread = me;
+    job->op     = SENDFILE;
+    memcpy(&job->args[0], &out_fd, sizeof(int));
+    memcpy(&job->args[1], &in_fd, sizeof(int));
+    job->args[2] = (uintptr_t)offset;
+    memcpy(&job->args[3], &count, sizeof(size_t));
+
+    assert(me->rdata);
+
+    me->rdata->blockedon.io = job;
+    me->thread_state        = QTHREAD_STATE_SYSCALL;
+    qthread_back_to_master(me);
+    ret = job->ret;
+    if (ret < 0) {
+        errno = job->err;
+    }
+    FREE_SYSCALLJOB(job);
+    return ret;
+#else /* ifdef QTHREAD_LINUX_SENDFILE */
+    errno = ENOSYS;
+    return -1;
+#endif /* ifdef QTHREAD_LINUX_SENDFILE */
+}
+
+/* vim:set expandtab: */
@@ -12,24 +12,18 @@
 
 /* API Headers */
 #include "qthread/qthread.h"
-#include "qthread/qtimer.h"
 
 /* Internal Headers */
 #include "qt_io.h"
 #include "qt_asserts.h"
 #include "qthread_innards.h" /* for qlib */
 #include "qt_qthread_mgmt.h"
+#include "qt_timer_wheel.h"
 
 unsigned int sleep(unsigned int seconds)
 {
     if (qt_blockable()) {
-        qtimer_t t = qtimer_create();
-        qtimer_start(t);
-        do {
-            qthread_yield();
-            qtimer_stop(t);
-        } while (qtimer_secs(t) < seconds);
-        qtimer_destroy(t);
+        qt_timer_sleep_until(qt_timer_now() + (uint64_t)seconds * 1000000000);
         return 0;
     } else {
 #if HAVE_SYSCALL
@@ -0,0 +1,122 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
+#include <fcntl.h>               /* for splice() */
+#include <poll.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SYS_SYSCALL_H
+# include <unistd.h>
+# include <sys/syscall.h>        /* for SYS_poll */
+#endif
+
+/* Public Headers */
+#include "qthread/qt_syscalls.h"
+
+/* Internal Headers */
+#include "qt_io.h"
+#include "qt_asserts.h"
+#include "qthread_innards.h" /* for qlib */
+#include "qt_qthread_mgmt.h"
+
+#ifdef HAVE_SPLICE
+/* Files on disk never say EAGAIN, so they don't keep the other end from
+ * being waited on in the reactor. */
+static int qt_splice_end_waitable(int fd)
+{
+    struct stat st;
+
+    if (qt_io_reactor_pollable(fd)) {
+        return 1;
+    }
+    return (fstat(fd, &st) == 0) && S_ISREG(st.st_mode);
+}
+
+#endif
+
+ssize_t qt_splice(int          fd_in,
+                  off_t       *off_in,
+                  int          fd_out,
+                  off_t       *off_out,
+                  size_t       len,
+                  unsigned int flags)
+{
+#ifdef HAVE_SPLICE
+    qthread_t                *me;
+    qt_blocking_queue_node_t *job;
+    loff_t                    in, out;
+    ssize_t                   ret;
+
+    /* off_t and loff_t need not be the same type */
+    if (off_in) {
+        in = *off_in;
+    }
+    if (off_out) {
+        out = *off_out;
+    }
+    if (flags & SPLICE_F_NONBLOCK) {
+        ret = splice(fd_in, off_in ? &in : NULL, fd_out, off_out ? &out : NULL, len, flags);
+    } else if ((qt_io_reactor_pollable(fd_in) || qt_io_reactor_pollable(fd_out)) &&
+               qt_splice_end_waitable(fd_in) && qt_splice_end_waitable(fd_out)) {
+        for (;;) {
+            struct pollfd ends[2] = { { fd_in, POLLIN, 0 }, { fd_out, POLLOUT, 0 } };
+
+            ret = splice(fd_in, off_in ? &in : NULL, fd_out, off_out ? &out : NULL, len, flags);
+            if ((ret >= 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+                break;
+            }
+            /* either end may be the one that isn't ready */
+#if HAVE_SYSCALL && HAVE_DECL_SYS_POLL
+            (void)syscall(SYS_poll, ends, 2, 0);
+#else
+            (void)(poll)(ends, 2, 0);
+#endif
+            if (qt_io_reactor_pollable(fd_in) && !(ends[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+                qt_io_reactor_wait(fd_in, POLLIN);
+            } else if (qt_io_reactor_pollable(fd_out) && !(ends[1].revents & (POLLOUT | POLLERR))) {
+                qt_io_reactor_wait(fd_out, POLLOUT);
+            }
+        }
+    } else {
+        me  = qthread_internal_self();
+        job = ALLOC_SYSCALLJOB();
+        assert(job);
+        job->next   = NULL;
+        job->thread = me;
+        job->op     = SPLICE;
+        memcpy(&job->args[0], &fd_in, sizeof(int));
+        job->args[1] = (uintptr_t)(off_in ? &in : NULL);
+        memcpy(&job->args[2], &fd_out, sizeof(int));
+        job->args[3] = (uintptr_t)(off_out ? &out : NULL);
+        memcpy(&job->args[4], &len, sizeof(size_t));
+        memcpy(&job->args[5], &flags, sizeof(unsigned int));
+
+        assert(me->rdata);
+
+        me->rdata->blockedon.io = job;
+        me->thread_state        = QTHREAD_STATE_SYSCALL;
+        qthread_back_to_master(me);
+        ret = job->ret;
+        if (ret < 0) {
+            errno = job->err;
+        }
+        FREE_SYSCALLJOB(job);
+    }
+    if (off_in) {
+        *off_in = in;
+    }
+    if (off_out) {
+        *off_out = out;
+    }
+    return ret;
+#else /* ifdef HAVE_SPLICE */
+    errno = ENOSYS;
+    return -1;
+#endif /* ifdef HAVE_SPLICE */
+}
+
+/* vim:set expandtab: */
@@ -12,24 +12,17 @@
 
 /* Public Headers */
 #include "qthread/qthread.h"
-#include "qthread/qtimer.h"
 
 /* Internal Headers */
 #include "qt_io.h"
 #include "qthread_innards.h" /* for qlib */
 #include "qt_qthread_mgmt.h"
+#include "qt_timer_wheel.h"
 
 int usleep(useconds_t useconds)
 {
-    if ((qlib != NULL) && (qthread_internal_self() != NULL)) {
-        qtimer_t t       = qtimer_create();
-        double   seconds = useconds * 1e-6;
-        qtimer_start(t);
-        do {
-            qthread_yield();
-            qtimer_stop(t);
-        } while (qtimer_secs(t) < seconds);
-        qtimer_destroy(t);
+    if ((qlib != NULL) && qt_blockable()) {
+        qt_timer_sleep_until(qt_timer_now() + (uint64_t)useconds * 1000);
         return 0;
     } else {
 #if HAVE_SYSCALL
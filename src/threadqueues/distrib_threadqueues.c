@@ -27,15 +27,18 @@
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_expect.h"
 #include "qt_subsystems.h"
+#include "qt_io.h" /* for qt_io_reactor_idle() */
+#include "qt_stats.h"
+#include "qt_trace.h"
 
 // Non portable
 typedef uint8_t cacheline[CACHELINE_WIDTH];
 
 /* Cutoff variables */
-int max_backoff; 
-int spinloop_backoff;
-int condwait_backoff;
-int steal_ratio;
+static int max_backoff;
+static int spinloop_backoff;
+static int condwait_backoff;
+static int steal_ratio;
 
 /* Data Structures */
 struct _qt_threadqueue_node {
@@ -66,9 +69,9 @@ struct _qt_threadqueue {
 }; 
 
 // global cond pool
-int finalizing;
+static int finalizing;
 
-qthread_t *mccoy = NULL;
+static qthread_t *mccoy = NULL;
 
 /* Memory Management and Initialization/Shutdown */
 qt_threadqueue_pools_t generic_threadqueue_pools;
@@ -356,15 +359,21 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *qe,
 
     // If we've done QT_STEAL_RATIO waits on local queue, try to steal 
     if(!node && steal_ratio > 0 && numwaits % steal_ratio == 0) {
+      QTHREAD_STAT_HERE(steal_attempts, 1);
       for(int i=0; i < qlib->nshepherds; i++){
         qt_threadqueue_t *victim_queue = qlib->shepherds[i].ready;
         node = qt_threadqueue_dequeue_head(victim_queue);
         if (node){
+          if (victim_queue != qe) {
+            QTHREAD_STAT_HERE(tasks_stolen, 1);
+            QTHREAD_TRACE_HERE(QT_TRACE_STEAL, i, 0, 1);
+          }
           t = node->value;
           free_tqnode(node);
           return t;
         }
       }
+      QTHREAD_STAT_HERE(steal_failures, 1);
     }
 
     if(!node && qthread_worker(NULL) == 0 && mccoy){
@@ -372,7 +381,10 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *qe,
       mccoy = NULL;
       return t; 
     } else if(!node){
-      if(numwaits > condwait_backoff && !finalizing){
+      if(qt_io_reactor_idle(my_shepherd)){
+        continue;
+      }
+      if(numwaits > condwait_backoff && !finalizing && qt_io_reactor_parked == 0){
         QTHREAD_COND_LOCK(qe->cond);
         qe->numwaiters++;
         MACHINE_FENCE;
@@ -419,4 +431,10 @@ size_t INTERNAL qt_threadqueue_policy(const enum threadqueue_policy policy){
   }
 }
 
+#ifdef QT_THREADQUEUE_NAME
+const qt_threadqueue_ops_t INTERNAL qt_threadqueue_impl = {
+    QT_THREADQUEUE_IMPL_COMMON
+};
+#endif
+
 /* vim:set expandtab: */
@@ -21,6 +21,7 @@
 #include "qt_eurekas.h"
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_subsystems.h"
+#include "qt_io.h" /* for qt_io_reactor_idle() */
 
 /* Note: this queue is SAFE to use with multiple de-queuers, with the caveat
  * that if you have multiple dequeuer's, you'll need to solve the ABA problem.
@@ -252,11 +253,14 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
         while (q->stack == NULL) {
+            if (qt_io_reactor_idle(qthread_internal_getshep())) {
+                continue;
+            }
 #ifndef QTHREAD_CONDWAIT_BLOCKING_QUEUE
             SPINLOCK_BODY();
 #else
             COMPILER_FENCE;
-            if (qthread_incr(&q->frustration, 1) > 1000) {
+            if ((qthread_incr(&q->frustration, 1) > 1000) && (qt_io_reactor_parked == 0)) {
                 QTHREAD_COND_LOCK(q->trigger);
                 if (q->frustration > 1000) {
                     QTHREAD_COND_WAIT(q->trigger);
@@ -365,4 +369,13 @@ size_t INTERNAL qt_threadqueue_policy(const enum threadqueue_policy policy)
     }
 }
 
+#ifdef QT_THREADQUEUE_NAME
+const qt_threadqueue_ops_t INTERNAL qt_threadqueue_impl = {
+    QT_THREADQUEUE_IMPL_COMMON,
+    .filter            = qt_threadqueue_filter,
+    .steal_stat        = qthread_steal_stat,
+    .cas_steal_stat    = qthread_cas_steal_stat,
+};
+#endif
+
 /* vim:set expandtab: */
@@ -19,6 +19,7 @@
 #include "qt_envariables.h"
 #include "qt_threadqueue_stack.h"
 #include "qt_asserts.h"
+#include "qt_io.h" /* for qt_io_reactor_idle() */
 
 #ifdef QTHREAD_RCRTOOL
 void saveEnergy(int64_t i);
@@ -235,6 +236,10 @@ qthread_t static QINLINE *qt_threadqueue_dequeue_helper(qt_threadqueue_t *q)
     int        local_length = qlib->nworkerspershep + 1;
     qthread_t *t            = NULL;
 
+    if (qt_io_reactor_idle(qthread_internal_getshep())) {
+        return(NULL); /* parked I/O woke up; go look for it */
+    }
+
     for(i = 1; i < local_length; i++) {
         next = (id + i) % local_length;
         if (!q->local[next]->stack.empty) {
@@ -607,4 +612,14 @@ size_t INTERNAL qt_threadqueue_policy(const enum threadqueue_policy policy)
     }
 }
 
+#ifdef QT_THREADQUEUE_NAME
+const qt_threadqueue_ops_t INTERNAL qt_threadqueue_impl = {
+    QT_THREADQUEUE_IMPL_COMMON,
+    .filter            = qt_threadqueue_filter,
+# ifdef STEAL_PROFILE
+    .steal_stat        = qthread_steal_stat,
+# endif
+};
+#endif
+
 /* vim:set expandtab: */
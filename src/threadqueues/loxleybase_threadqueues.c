@@ -18,6 +18,7 @@
 #include "qt_envariables.h"
 #include "qt_threadqueue_stack.h"
 #include "qt_asserts.h"
+#include "qt_io.h" /* for qt_io_reactor_idle() */
 
 #ifdef STEAL_PROFILE
 # define steal_profile_increment(shepherd, field) qthread_incr(&(shepherd->field), 1)
@@ -146,6 +147,10 @@ qthread_t static QINLINE *qt_threadqueue_dequeue_helper(qt_threadqueue_t *q)
 {
     qthread_t *t = NULL;
 
+    if (qt_io_reactor_idle(qthread_internal_getshep())) {
+        return(NULL); /* parked I/O woke up; go look for it */
+    }
+
     q->stealing = 1;
 
     QTHREAD_FASTLOCK_LOCK(&q->steallock);
@@ -358,4 +363,31 @@ void INTERNAL qthread_steal_disable(void)
 void INTERNAL qthread_cas_steal_stat(void)
 {}
 
+qthread_shepherd_id_t INTERNAL qt_threadqueue_choose_dest(qthread_shepherd_t * curr_shep)
+{
+    if (curr_shep) {
+        return curr_shep->shepherd_id;
+    } else {
+        return (qthread_shepherd_id_t)0;
+    }
+}
+
+size_t INTERNAL qt_threadqueue_policy(const enum threadqueue_policy policy)
+{
+    switch (policy) {
+        default:
+            return THREADQUEUE_POLICY_UNSUPPORTED;
+    }
+}
+
+#ifdef QT_THREADQUEUE_NAME
+const qt_threadqueue_ops_t INTERNAL qt_threadqueue_impl = {
+    QT_THREADQUEUE_IMPL_COMMON,
+# ifdef STEAL_PROFILE
+    .steal_stat        = qthread_steal_stat,
+# endif
+    .cas_steal_stat    = qthread_cas_steal_stat,
+};
+#endif
+
 /* vim:set expandtab: */
@@ -24,6 +24,7 @@
 #include "qt_eurekas.h"
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_subsystems.h"
+#include "qt_io.h" /* for qt_io_reactor_idle() */
 
 /* Data Structures */
 struct _qt_threadqueue_node {
@@ -316,8 +317,11 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
         hazardous_ptr(1, next_ptr);
 
         if (next_ptr == NULL) { // queue is empty
+            if (qt_io_reactor_idle(qthread_internal_getshep())) {
+                continue;
+            }
 #ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE
-            if (qthread_internal_incr(&q->fruitless, &q->fruitless_m, 1) > 1000) {
+            if ((qthread_internal_incr(&q->fruitless, &q->fruitless_m, 1) > 1000) && (qt_io_reactor_parked == 0)) {
 # ifdef QTHREAD_USE_EUREKAS
                 qt_eureka_check(0);
 # endif /* QTHREAD_USE_EUREKAS */
@@ -483,4 +487,13 @@ size_t INTERNAL qt_threadqueue_policy(const enum threadqueue_policy policy)
     }
 }
 
+#ifdef QT_THREADQUEUE_NAME
+const qt_threadqueue_ops_t INTERNAL qt_threadqueue_impl = {
+    QT_THREADQUEUE_IMPL_COMMON,
+    .filter            = qt_threadqueue_filter,
+    .steal_stat        = qthread_steal_stat,
+    .cas_steal_stat    = qthread_cas_steal_stat,
+};
+#endif
+
 /* vim:set expandtab: */
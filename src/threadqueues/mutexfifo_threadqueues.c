@@ -24,6 +24,7 @@
 #include "qt_eurekas.h"
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_subsystems.h"
+#include "qt_io.h" /* for qt_io_reactor_idle() */
 
 /* Data Structures */
 struct _qt_threadqueue_node {
@@ -217,7 +218,9 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(1);
 #endif /* QTHREAD_USE_EUREKAS */
-        SPINLOCK_BODY();
+        if (!qt_io_reactor_idle(qthread_internal_getshep())) {
+            SPINLOCK_BODY();
+        }
     }
     return p;
 }                                      /*}}} */
@@ -325,4 +328,13 @@ size_t INTERNAL qt_threadqueue_policy(const enum threadqueue_policy policy)
     }
 }
 
+#ifdef QT_THREADQUEUE_NAME
+const qt_threadqueue_ops_t INTERNAL qt_threadqueue_impl = {
+    QT_THREADQUEUE_IMPL_COMMON,
+    .filter            = qt_threadqueue_filter,
+    .steal_stat        = qthread_steal_stat,
+    .cas_steal_stat    = qthread_cas_steal_stat,
+};
+#endif
+
 /* vim:set expandtab: */
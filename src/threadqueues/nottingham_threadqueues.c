@@ -20,6 +20,9 @@
 #include "qt_prefetch.h"
 #include "qt_threadqueues.h"
 #include "qt_envariables.h"
+#include "qt_io.h" /* for qt_io_reactor_idle() */
+#include "qt_stats.h"
+#include "qt_trace.h"
 
 #ifndef NOINLINE
 # define NOINLINE __attribute__ ((noinline))
@@ -453,6 +456,10 @@ qthread_t static QINLINE *qt_threadqueue_dequeue_helper(qt_threadqueue_t *q)
 {
     qthread_t *t = NULL;
 
+    if (qt_io_reactor_idle(qthread_internal_getshep())) {
+        return(NULL); /* parked I/O woke up; go look for it */
+    }
+
     q->stealing = 1;
 
     QTHREAD_FASTLOCK_LOCK(&q->spinlock);
@@ -723,9 +730,12 @@ static QINLINE qthread_t *qthread_steal(qt_threadqueue_t *thiefq)
         }
         victim_shepherd = &qlib->shepherds[shepherd_offset];
         if (victim_shepherd->ready->empty) { continue; }
+        QTHREAD_STAT(worker, steal_attempts, 1);
         int amtStolen = qt_threadqueue_dequeue_steal(victim_shepherd->ready,
                                                      nostealbuffer, stealbuffer);
         if (amtStolen > 0) {
+            QTHREAD_STAT(worker, tasks_stolen, amtStolen);
+            QTHREAD_TRACE(worker, QT_TRACE_STEAL, shepherd_offset, 0, amtStolen);
 #ifdef STEAL_PROFILE                   // should give mechanism to make steal profiling optional
             qthread_incr(&thief_shepherd->steal_successful, 1);
 #endif
@@ -738,6 +748,7 @@ static QINLINE qthread_t *qthread_steal(qt_threadqueue_t *thiefq)
             qthread_incr(&thief_shepherd->steal_failed, 1);
         }
 #endif
+        QTHREAD_STAT(worker, steal_failures, 1);
     }
     thiefq->stealing = 0;
     return(NULL);
@@ -976,4 +987,16 @@ size_t INTERNAL qt_threadqueue_policy(const enum threadqueue_policy policy)
     }
 }
 
+#ifdef QT_THREADQUEUE_NAME
+const qt_threadqueue_ops_t INTERNAL qt_threadqueue_impl = {
+    QT_THREADQUEUE_IMPL_COMMON,
+# ifdef STEAL_PROFILE
+    .steal_stat        = qthread_steal_stat,
+# endif
+# ifdef CAS_STEAL_PROFILE
+    .cas_steal_stat    = qthread_cas_steal_stat,
+# endif
+};
+#endif
+
 /* vim:set expandtab: */
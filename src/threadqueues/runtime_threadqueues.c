@@ -0,0 +1,102 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <string.h>
+
+/* API Headers */
+#include "qthread/qthread.h"
+
+/* Internal Headers */
+#include "qt_visibility.h"
+#include "qt_threadqueues.h"
+#include "qt_envariables.h"
+#include "qt_output_macros.h"
+
+#ifdef QTHREAD_USE_SPAWNCACHE
+# error The spawn cache needs a scheduler that is chosen at configure time
+#endif
+
+/* With --with-scheduler=runtime, each of the other files in this directory is
+ * built into the library under its own name (see qt_threadqueues.h), and this
+ * one picks among them when the library starts, according to QT_SCHEDULER.
+ * The rest of the library calls the chosen scheduler through
+ * qt_threadqueue_ops, which is a copy of its table rather than a pointer to
+ * it, so that there is one less load on the way to each call. */
+
+extern const qt_threadqueue_ops_t INTERNAL sherwood_threadqueue_impl;
+extern const qt_threadqueue_ops_t INTERNAL nemesis_threadqueue_impl;
+extern const qt_threadqueue_ops_t INTERNAL lifo_threadqueue_impl;
+extern const qt_threadqueue_ops_t INTERNAL mutexfifo_threadqueue_impl;
+extern const qt_threadqueue_ops_t INTERNAL mtsfifo_threadqueue_impl;
+extern const qt_threadqueue_ops_t INTERNAL distrib_threadqueue_impl;
+extern const qt_threadqueue_ops_t INTERNAL loxley_threadqueue_impl;
+extern const qt_threadqueue_ops_t INTERNAL loxleybase_threadqueue_impl;
+#ifdef QTHREAD_SCHEDULER_NOTTINGHAM
+extern const qt_threadqueue_ops_t INTERNAL nottingham_threadqueue_impl;
+#endif
+
+static const qt_threadqueue_ops_t *const schedulers[] = {
+    &sherwood_threadqueue_impl,        /* the first is the default */
+    &nemesis_threadqueue_impl,
+    &lifo_threadqueue_impl,
+    &mutexfifo_threadqueue_impl,
+    &mtsfifo_threadqueue_impl,
+    &distrib_threadqueue_impl,
+    &loxley_threadqueue_impl,
+    &loxleybase_threadqueue_impl,
+#ifdef QTHREAD_SCHEDULER_NOTTINGHAM
+    &nottingham_threadqueue_impl,
+#endif
+};
+#define NUM_SCHEDULERS (sizeof(schedulers) / sizeof(schedulers[0]))
+
+qt_threadqueue_ops_t INTERNAL qt_threadqueue_ops Q_ALIGNED(CACHELINE_WIDTH);
+
+static void list_schedulers(void)
+{   /*{{{*/
+    char   names[256] = "";
+    size_t i;
+
+    for (i = 0; i < NUM_SCHEDULERS; i++) {
+        if (i) { strncat(names, ", ", sizeof(names) - strlen(names) - 1); }
+        strncat(names, schedulers[i]->name, sizeof(names) - strlen(names) - 1);
+    }
+    print_warning("the schedulers in this library are: %s\n", names);
+} /*}}}*/
+
+/* Has to run before anything asks the scheduler a question: the topology code
+ * asks whether it runs one worker per shepherd. */
+void INTERNAL qt_threadqueue_select(void)
+{   /*{{{*/
+    const char                 *name   = qt_internal_get_env_str("SCHEDULER", NULL);
+    const qt_threadqueue_ops_t *chosen = schedulers[0];
+
+    if (name && *name) {
+        size_t i;
+
+        for (i = 0; i < NUM_SCHEDULERS; i++) {
+            if (!strcmp(name, schedulers[i]->name)) { break; }
+        }
+        if (i < NUM_SCHEDULERS) {
+            chosen = schedulers[i];
+        } else {
+            print_warning("unknown scheduler '%s'; using %s\n", name, chosen->name);
+            list_schedulers();
+        }
+    }
+#ifdef QTHREAD_USE_EUREKAS
+    if (chosen->filter == NULL) {
+        print_warning("the %s scheduler cannot filter its queues, which eurekas need; using %s\n",
+                      chosen->name, schedulers[0]->name);
+        chosen = schedulers[0];
+    }
+#endif
+    if (qt_internal_get_env_num("INFO", 0, 1)) {
+        print_status("Using the %s scheduler\n", chosen->name);
+    }
+    qt_threadqueue_ops = *chosen;
+} /*}}}*/
+
+/* vim:set expandtab: */
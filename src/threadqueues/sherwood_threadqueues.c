@@ -27,6 +27,9 @@
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_expect.h"
 #include "qt_subsystems.h"
+#include "qt_io.h" /* for qt_io_reactor_idle() */
+#include "qt_stats.h"
+#include "qt_trace.h"
 
 /* Data Structures */
 struct _qt_threadqueue_node {
@@ -73,8 +76,8 @@ static long      steal_chunksize = 0;
 qt_threadqueue_node_t INTERNAL *qt_threadqueue_dequeue_steal(qt_threadqueue_t *h,
                                                              qt_threadqueue_t *v);
 
-void INTERNAL qt_threadqueue_enqueue_multiple(qt_threadqueue_t      *q,
-                                              qt_threadqueue_node_t *first);
+size_t INTERNAL qt_threadqueue_enqueue_multiple(qt_threadqueue_t      *q,
+                                                qt_threadqueue_node_t *first);
 
 qthread_t INTERNAL *qt_init_agg_task(void);
 int INTERNAL        qt_keep_adding_agg_task(qthread_t *agg_task,
@@ -888,6 +891,10 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
         }
 #endif
 
+        if ((node == NULL) && qt_io_reactor_idle(my_shepherd)) {
+            continue; /* some parked I/O just became runnable */
+        }
+
         if ((node == NULL) && my_shepherd->stealing) {
             if (worker_id == NO_WORKER) {
                 worker_id = qthread_worker(NULL);
@@ -905,7 +912,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
                 if (!steal_disable) {
                     node = qthread_steal(my_shepherd); // TODO: same agg behavior when stealing
                 } else {
-                    while (NULL == q->head) SPINLOCK_BODY();
+                    while (NULL == q->head && !qt_io_reactor_idle(my_shepherd)) SPINLOCK_BODY();
                     continue;
                 }
             }
@@ -947,9 +954,9 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
     return (t);
 } /*}}}*/
 
-/* enqueue multiple (from steal) */
-void INTERNAL qt_threadqueue_enqueue_multiple(qt_threadqueue_t      *q,
-                                              qt_threadqueue_node_t *first)
+/* enqueue multiple (from steal); returns how many */
+size_t INTERNAL qt_threadqueue_enqueue_multiple(qt_threadqueue_t      *q,
+                                                qt_threadqueue_node_t *first)
 {   /*{{{*/
     qt_threadqueue_node_t *last;
     size_t                 addCnt = 1;
@@ -976,6 +983,7 @@ void INTERNAL qt_threadqueue_enqueue_multiple(qt_threadqueue_t      *q,
     q->qlength           += addCnt;
     q->qlength_stealable += addCnt;
     QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    return addCnt;
 } /*}}}*/
 
 #ifdef QTHREAD_USE_SPAWNCACHE
@@ -1116,6 +1124,7 @@ qt_threadqueue_node_t INTERNAL *qt_threadqueue_dequeue_steal(qt_threadqueue_t *h
     }
     QTHREAD_TRYLOCK_UNLOCK(&v->qlock);
     STEAL_AMOUNT(v, amtStolen);
+    QTHREAD_STAT_HERE(tasks_stolen, amtStolen);
 
     return (first);
 }                                      /*}}} */
@@ -1164,18 +1173,22 @@ static QINLINE qt_threadqueue_node_t *qthread_steal(qthread_shepherd_t *thief_sh
         qt_threadqueue_t *victim_queue = shepherds[sorted_sheplist[i]].ready;
         if (0 != victim_queue->qlength_stealable) {
             STEAL_ATTEMPTED(thief_shepherd);
+            QTHREAD_STAT_HERE(steal_attempts, 1);
             stolen = qt_threadqueue_dequeue_steal(myqueue, victim_queue);
             if (stolen) {
                 qt_threadqueue_node_t *surplus = stolen->next;
+                size_t                 taken   = 1;
                 if (surplus) {
                     stolen->next  = NULL;
                     surplus->prev = NULL;
-                    qt_threadqueue_enqueue_multiple(myqueue, surplus);
+                    taken        += qt_threadqueue_enqueue_multiple(myqueue, surplus);
                 }
+                QTHREAD_TRACE_HERE(QT_TRACE_STEAL, sorted_sheplist[i], 0, taken);
                 STEAL_SUCCESSFUL(thief_shepherd);
                 break;
             } else {
                 STEAL_FAILED(thief_shepherd);
+                QTHREAD_STAT_HERE(steal_failures, 1);
             }
         }
 #ifdef QTHREAD_LOCAL_PRIORITY
@@ -1199,6 +1212,9 @@ static QINLINE qt_threadqueue_node_t *qthread_steal(qthread_shepherd_t *thief_sh
 #elif defined(HAVE_SCHED_YIELD)
             sched_yield();
 #endif
+            if (qt_io_reactor_idle(thief_shepherd)) {
+                break; /* parked I/O woke up at home */
+            }
         }
         SPINLOCK_BODY();
     }
@@ -1514,4 +1530,14 @@ size_t INTERNAL qt_threadqueue_policy(const enum threadqueue_policy policy)
     }
 }
 
+#ifdef QT_THREADQUEUE_NAME
+const qt_threadqueue_ops_t INTERNAL qt_threadqueue_impl = {
+    QT_THREADQUEUE_IMPL_COMMON,
+    .filter            = qt_threadqueue_filter,
+# ifdef STEAL_PROFILE
+    .steal_stat        = qthread_steal_stat,
+# endif
+};
+#endif
+
 /* vim:set expandtab: */
@@ -0,0 +1,379 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <qthread/qthread-int.h>       /* for uint64_t */
+#include <time.h>                      /* for clock_gettime() and nanosleep() */
+#include <sys/time.h>                  /* for gettimeofday() */
+#include <errno.h>
+
+/* Public Headers */
+#include "qthread/qthread.h"
+
+/* Internal Headers */
+#include "qt_timer_wheel.h"
+#include "qt_io.h"
+#include "qt_macros.h"
+#include "qt_asserts.h"
+#include "qthread_innards.h" /* for qlib */
+#include "qt_threadqueues.h"
+#include "qt_debug.h"
+#include "qt_subsystems.h"
+#include "qt_latency.h"
+
+/*
+ * Timers for sleeping tasks and timed FEB waits. Each shepherd has a
+ * hierarchical timer wheel: WHEEL_LEVELS levels of WHEEL_SLOTS slots, where a
+ * slot on level 0 holds the timers that expire in one tick, and a slot on
+ * level n holds the timers that expire in WHEEL_SLOTS^n ticks' worth of time.
+ * When the wheel's clock reaches the start of a higher-level slot's span, that
+ * slot's timers are cascaded down onto the lower levels. Arming and cancelling
+ * are O(1); expiring costs about one step per tick that has a timer in it,
+ * since empty stretches of the wheel are skipped a whole span at a time.
+ *
+ * A task arms its timer on the wheel of the shepherd it is running on, and the
+ * workers of that shepherd expire it: idle workers from the schedulers' idle
+ * loops (through qt_io_reactor_idle(), which counts armed timers as parked
+ * tasks) and busy ones each time they go back to their queue for work. So a
+ * timer fires no earlier than its deadline, and no later than the first
+ * scheduling point on its shepherd after that.
+ */
+
+#define WHEEL_BITS   6
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+#define TICK_SHIFT   16                  /* ticks are 2^16 ns, about 65us */
+#define WHEEL_SPAN   ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+typedef struct {
+    QTHREAD_FASTLOCK_TYPE lock;
+    uint64_t              now;                    /* the last tick expired */
+    uint64_t              occupied[WHEEL_LEVELS]; /* a bit per non-empty slot */
+    aligned_t             expiring;               /* a worker is expiring */
+    qt_timer_t           *slots[WHEEL_LEVELS * WHEEL_SLOTS];
+    uint32_t              padding[CACHELINE_WIDTH / sizeof(uint32_t)];
+} qt_timer_wheel_t;
+
+static qt_timer_wheel_t *wheels = NULL;
+saligned_t               qt_timers_armed = 0;
+
+uint64_t INTERNAL qt_timer_now(void)
+{   /*{{{*/
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    qassert(clock_gettime(CLOCK_MONOTONIC, &ts), 0);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+
+#else
+    struct timeval tv;
+
+    qassert(gettimeofday(&tv, NULL), 0);
+    return (uint64_t)tv.tv_sec * 1000000000 + (uint64_t)tv.tv_usec * 1000;
+#endif
+} /*}}}*/
+
+/* Never 0, which the timed FEB calls take to mean "no deadline"; the epoch
+ * itself is as long past as any other time before now. */
+uint64_t INTERNAL qt_timer_deadline(const struct timespec *abstime)
+{   /*{{{*/
+    const uint64_t ns = (uint64_t)abstime->tv_sec * 1000000000 + (uint64_t)abstime->tv_nsec;
+
+    if ((abstime->tv_sec < 0) || (abstime->tv_nsec < 0) || (ns == 0)) {
+        return 1; /* long past */
+    }
+    return ns;
+} /*}}}*/
+
+static void qt_timer_wheel_internal_teardown(void)
+{   /*{{{*/
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        QTHREAD_FASTLOCK_DESTROY(wheels[i].lock);
+    }
+    FREE(wheels, qlib->nshepherds * sizeof(qt_timer_wheel_t));
+    wheels          = NULL;
+    qt_timers_armed = 0;
+} /*}}}*/
+
+void INTERNAL qt_timer_wheel_init(void)
+{   /*{{{*/
+    const uint64_t now = qt_timer_now() >> TICK_SHIFT;
+
+    wheels = MALLOC(qlib->nshepherds * sizeof(qt_timer_wheel_t));
+    assert(wheels);
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        QTHREAD_FASTLOCK_INIT(wheels[i].lock);
+        wheels[i].now      = now;
+        wheels[i].expiring = 0;
+        for (int l = 0; l < WHEEL_LEVELS; ++l) {
+            wheels[i].occupied[l] = 0;
+        }
+        for (int s = 0; s < WHEEL_LEVELS * WHEEL_SLOTS; ++s) {
+            wheels[i].slots[s] = NULL;
+        }
+    }
+    /* tasks may still be asleep when the shepherds go */
+    qthread_internal_cleanup(qt_timer_wheel_internal_teardown);
+} /*}}}*/
+
+/* Puts t in the slot for its deadline, relative to the wheel's clock; a timer
+ * that is already due goes in the next tick's slot. The wheel must be locked. */
+static void qt_timer_place(qt_timer_wheel_t *w,
+                           qt_timer_t       *t)
+{   /*{{{*/
+    /* round up, so as never to fire early */
+    uint64_t tick = (t->deadline + ((uint64_t)1 << TICK_SHIFT) - 1) >> TICK_SHIFT;
+    uint64_t delta;
+    int      level, slot;
+
+    if (tick <= w->now) {
+        tick = w->now + 1;
+    }
+    delta = tick - w->now;
+    if (delta >= WHEEL_SPAN) {
+        /* beyond the wheel: park it at the far end, to be cascaded again */
+        tick  = w->now + WHEEL_SPAN - 1;
+        delta = WHEEL_SPAN - 1;
+    }
+    for (level = 0; level < WHEEL_LEVELS - 1; ++level) {
+        if (delta < ((uint64_t)1 << (WHEEL_BITS * (level + 1)))) {
+            break;
+        }
+    }
+    slot = (int)((tick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+    w->occupied[level] |= (uint64_t)1 << slot;
+    slot               += level * WHEEL_SLOTS;
+    t->prev             = NULL;
+    t->next             = w->slots[slot];
+    if (t->next) {
+        t->next->prev = t;
+    }
+    w->slots[slot] = t;
+    t->slot        = slot;
+} /*}}}*/
+
+static qt_timer_t *qt_timer_take_slot(qt_timer_wheel_t *w,
+                                      int               level,
+                                      int               slot)
+{   /*{{{*/
+    qt_timer_t *list = w->slots[level * WHEEL_SLOTS + slot];
+
+    w->slots[level * WHEEL_SLOTS + slot] = NULL;
+    w->occupied[level]                  &= ~((uint64_t)1 << slot);
+    return list;
+} /*}}}*/
+
+/* Takes a timer off the wheel for expiring, pushing it on *expired. */
+static void qt_timer_take(qt_timer_t  *t,
+                          qt_timer_t **expired)
+{   /*{{{*/
+    t->state = QT_TIMER_FIRING;
+    t->next  = *expired;
+    *expired = t;
+    (void)qthread_incr(&qt_timers_armed, -1);
+    (void)qthread_incr(&qt_io_reactor_parked, -1);
+} /*}}}*/
+
+/* Moves the wheel's clock up to target, collecting the timers it passes. The
+ * wheel must be locked. */
+static void qt_timer_advance(qt_timer_wheel_t *w,
+                             uint64_t          target,
+                             qt_timer_t      **expired)
+{   /*{{{*/
+    while (w->now < target) {
+        uint64_t span = 1;
+        uint64_t next;
+
+        /* skip ahead to the next tick where something can happen */
+        if (w->occupied[0] == 0) {
+            span = WHEEL_SLOTS;
+            for (int l = 1; l < WHEEL_LEVELS - 1 && w->occupied[l] == 0; ++l) {
+                span <<= WHEEL_BITS;
+            }
+        }
+        next = (w->now & ~(span - 1)) + span;
+        if (next > target) {
+            w->now = target;
+            break;
+        }
+        w->now = next;
+        /* cascade, from the lowest level up, at each span boundary */
+        for (int l = 1; l < WHEEL_LEVELS; ++l) {
+            qt_timer_t *t;
+
+            if ((next & (((uint64_t)1 << (WHEEL_BITS * l)) - 1)) != 0) {
+                break;
+            }
+            t = qt_timer_take_slot(w, l, (int)((next >> (WHEEL_BITS * l)) & (WHEEL_SLOTS - 1)));
+            while (t) {
+                qt_timer_t *n = t->next;
+
+                if (t->deadline <= (next << TICK_SHIFT)) {
+                    qt_timer_take(t, expired);
+                } else {
+                    qt_timer_place(w, t);
+                }
+                t = n;
+            }
+        }
+        {
+            qt_timer_t *t = qt_timer_take_slot(w, 0, (int)(next & (WHEEL_SLOTS - 1)));
+
+            while (t) {
+                qt_timer_t *n = t->next;
+
+                qt_timer_take(t, expired);
+                t = n;
+            }
+        }
+    }
+} /*}}}*/
+
+void INTERNAL qt_timer_arm(qthread_shepherd_t *shep,
+                           qt_timer_t         *t)
+{   /*{{{*/
+    qt_timer_wheel_t *w;
+
+    assert(wheels);
+    assert(shep);
+    w        = &wheels[shep->shepherd_id];
+    t->shep  = shep->shepherd_id;
+    t->state = QT_TIMER_ARMED;
+    QTHREAD_FASTLOCK_LOCK(&w->lock);
+    qt_timer_place(w, t);
+    (void)qthread_incr(&qt_timers_armed, 1);
+    (void)qthread_incr(&qt_io_reactor_parked, 1);
+    QTHREAD_FASTLOCK_UNLOCK(&w->lock);
+    qthread_debug(IO_DETAILS, "armed timer %p for thread %p on shep %i\n", t, t->waiter, t->shep);
+} /*}}}*/
+
+int INTERNAL qt_timer_cancel(qt_timer_t *t)
+{   /*{{{*/
+    qt_timer_wheel_t *w = &wheels[t->shep];
+
+    QTHREAD_FASTLOCK_LOCK(&w->lock);
+    if (t->state == QT_TIMER_ARMED) {
+        if (t->prev) {
+            t->prev->next = t->next;
+        } else {
+            w->slots[t->slot] = t->next;
+            if (t->next == NULL) {
+                w->occupied[t->slot / WHEEL_SLOTS] &= ~((uint64_t)1 << (t->slot % WHEEL_SLOTS));
+            }
+        }
+        if (t->next) {
+            t->next->prev = t->prev;
+        }
+        t->state = QT_TIMER_IDLE;
+        (void)qthread_incr(&qt_timers_armed, -1);
+        (void)qthread_incr(&qt_io_reactor_parked, -1);
+        QTHREAD_FASTLOCK_UNLOCK(&w->lock);
+        return 1;
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&w->lock);
+    /* it is off the wheel, but its callback may still be using it */
+    while (t->state == QT_TIMER_FIRING) {
+        SPINLOCK_BODY();
+    }
+    return 0;
+} /*}}}*/
+
+int INTERNAL qt_timer_wheel_expire(qthread_shepherd_t *shep)
+{   /*{{{*/
+    qt_timer_wheel_t *w;
+    qt_timer_t       *expired = NULL;
+    uint64_t          target;
+    int               woken = 0;
+
+    if ((wheels == NULL) || (shep == NULL)) {
+        return 0;
+    }
+    w      = &wheels[shep->shepherd_id];
+    target = qt_timer_now() >> TICK_SHIFT;
+    if ((target <= w->now) || (qthread_cas(&w->expiring, 0, 1) != 0)) {
+        return 0;
+    }
+    QTHREAD_FASTLOCK_LOCK(&w->lock);
+    qt_timer_advance(w, target, &expired);
+    QTHREAD_FASTLOCK_UNLOCK(&w->lock);
+    w->expiring = 0;
+
+    while (expired) {
+        qt_timer_t *t      = expired;
+        qthread_t  *waiter = t->waiter;
+
+        expired = t->next;
+        if (t->expire) {
+            int fired = t->expire(t);
+
+            MACHINE_FENCE;
+            /* from here on, t belongs to its owner again */
+            t->state = fired ? QT_TIMER_FIRED : QT_TIMER_MISSED;
+            woken   += fired;
+        } else {
+            t->state = QT_TIMER_FIRED;
+            qthread_debug(IO_DETAILS, "timer expired, waking thread %p\n", waiter);
+            QTHREAD_LATENCY_READY(waiter, QT_LATENCY_TIMER);
+            qt_threadqueue_enqueue(waiter->rdata->shepherd_ptr->ready, waiter);
+            woken++;
+        }
+    }
+    return woken;
+} /*}}}*/
+
+void INTERNAL qt_timer_sleep_until(uint64_t deadline)
+{   /*{{{*/
+    qthread_t                *me = qthread_internal_self();
+    qt_blocking_queue_node_t *job;
+    qt_timer_t                t;
+
+    assert(me && me->rdata);
+    if (deadline <= qt_timer_now()) {
+        return;
+    }
+    t.deadline = deadline;
+    t.waiter   = me;
+    t.expire   = NULL;
+    t.arg      = NULL;
+
+    /* the job gets the timer armed once this task has switched out; see
+     * qt_blocking_subsystem_enqueue() */
+    job = ALLOC_SYSCALLJOB();
+    assert(job);
+    job->next    = NULL;
+    job->thread  = me;
+    job->op      = SLEEP_UNTIL;
+    job->args[0] = (uintptr_t)&t;
+
+    me->rdata->blockedon.io = job;
+    me->thread_state        = QTHREAD_STATE_SYSCALL;
+    qthread_back_to_master(me);
+    assert(t.state == QT_TIMER_FIRED);
+    FREE_SYSCALLJOB(job);
+} /*}}}*/
+
+int API_FUNC qthread_sleep_until(const struct timespec *deadline)
+{   /*{{{*/
+    if (deadline == NULL) {
+        return QTHREAD_BADARGS;
+    }
+    if (qt_blockable()) {
+        qt_timer_sleep_until(qt_timer_deadline(deadline));
+    } else {
+        const uint64_t d = qt_timer_deadline(deadline);
+        uint64_t       now;
+
+        /* not a task, so just sleep (our nanosleep() passes this through) */
+        while ((now = qt_timer_now()) < d) {
+            struct timespec left;
+
+            left.tv_sec  = (time_t)((d - now) / 1000000000);
+            left.tv_nsec = (long)((d - now) % 1000000000);
+            (void)nanosleep(&left, NULL);
+        }
+    }
+    return QTHREAD_SUCCESS;
+} /*}}}*/
+
+/* vim:set expandtab: */
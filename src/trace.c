@@ -0,0 +1,365 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>                    /* for getpid() */
+
+/* Public Headers */
+#include "qthread/qthread.h"
+
+/* Internal Headers */
+#include "qt_visibility.h"
+#include "qt_trace.h"
+
+#ifdef QTHREAD_TRACING
+
+# include "qt_asserts.h"
+# include "qt_output_macros.h"
+# include "qt_debug.h"
+# include "qt_envariables.h"
+# include "qt_report.h"
+# include "qt_subsystems.h"
+# include "qt_threadstate.h"
+# include "qthread_innards.h"         /* for qlib */
+
+int                   qt_trace_enabled        = 0;
+volatile sig_atomic_t qt_trace_dump_requested = 0;
+
+/* one ring per worker, in packed_worker_id order */
+static qt_trace_ring_t *rings        = NULL;
+static size_t           nrings       = 0;
+static const char      *trace_path   = NULL;
+
+/* where the trace clock and the nanosecond clock started out */
+static uint64_t clock_base;
+static uint64_t ns_base;
+
+static const char *state_names[] = {
+    [QTHREAD_STATE_NASCENT]          = "nascent",
+    [QTHREAD_STATE_NEW]              = "new",
+    [QTHREAD_STATE_RUNNING]          = "running",
+    [QTHREAD_STATE_YIELDED]          = "yielded",
+    [QTHREAD_STATE_YIELDED_NEAR]     = "yielded",
+    [QTHREAD_STATE_QUEUE]            = "queue",
+    [QTHREAD_STATE_FEB_BLOCKED]      = "feb_blocked",
+    [QTHREAD_STATE_PARENT_YIELD]     = "parent_blocked",
+    [QTHREAD_STATE_PARENT_BLOCKED]   = "parent_blocked",
+    [QTHREAD_STATE_PARENT_UNBLOCKED] = "parent_unblocked",
+    [QTHREAD_STATE_ASSASSINATED]     = "assassinated",
+    [QTHREAD_STATE_TERMINATED]       = "terminated",
+    [QTHREAD_STATE_MIGRATING]        = "migrating",
+    [QTHREAD_STATE_SYSCALL]          = "syscall",
+    [QTHREAD_STATE_ILLEGAL]          = "illegal",
+    [QTHREAD_STATE_TERM_SHEP]        = "term_shep"
+};
+
+static const char *state_name(uint32_t state)
+{   /*{{{*/
+    if ((state < sizeof(state_names) / sizeof(state_names[0])) && state_names[state]) {
+        return state_names[state];
+    }
+    return "unknown";
+} /*}}}*/
+
+typedef struct {
+    FILE    *f;
+    double   us_per_tick;
+    uint64_t now;
+    int      pid;
+    int      first;
+} trace_writer_t;
+
+static void trace_begin_event(trace_writer_t *w)
+{   /*{{{*/
+    fputs(w->first ? "\n" : ",\n", w->f);
+    w->first = 0;
+} /*}}}*/
+
+static double trace_us(const trace_writer_t *w,
+                       uint64_t              ts)
+{   /*{{{*/
+    return (double)(int64_t)(ts - clock_base) * w->us_per_tick;
+} /*}}}*/
+
+/* Copies out what is left of a ring; a worker may be adding to it as we
+ * read, so anything it could have overwritten in the meantime is dropped.
+ * Returns the number of events in *out, which the caller frees, and says in
+ * *whole whether they go back to the ring's first event. */
+static size_t trace_copy_ring(const qt_trace_ring_t *r,
+                              qt_trace_event_t     **out,
+                              int                   *whole)
+{   /*{{{*/
+    const uint64_t    size  = r->mask + 1;
+    const uint64_t    head  = *(volatile uint64_t *)&r->head;
+    uint64_t          first = (head > size) ? head - size : 0;
+    uint64_t          after;
+    qt_trace_event_t *copy;
+
+    *out   = NULL;
+    *whole = 0;
+    if (head == first) {
+        return 0;
+    }
+    copy = MALLOC((head - first) * sizeof(qt_trace_event_t));
+    if (copy == NULL) {
+        return 0;
+    }
+    for (uint64_t i = first; i < head; ++i) {
+        copy[i - first] = r->events[i & r->mask];
+    }
+    MACHINE_FENCE;
+    after = *(volatile uint64_t *)&r->head;
+    if ((after > size) && (after - size > first)) {
+        const uint64_t lost = (after - size) - first;
+
+        if (lost >= head - first) {
+            FREE(copy, (head - first) * sizeof(qt_trace_event_t));
+            return 0;
+        }
+        memmove(copy, copy + lost, (head - first - lost) * sizeof(qt_trace_event_t));
+        first += lost;
+    }
+    *out   = copy;
+    *whole = (first == 0);
+    return head - first;
+} /*}}}*/
+
+/* A stretch of time that a task ran; f is 0 if the stretch began before the
+ * ring's first event, and so did the task's name. */
+static void trace_write_slice(trace_writer_t *w,
+                              size_t          worker,
+                              uint64_t        f,
+                              uint64_t        t,
+                              uint64_t        start,
+                              uint64_t        end,
+                              const char     *state)
+{   /*{{{*/
+    char name[32];
+
+    if (f) {
+        snprintf(name, sizeof(name), "%#llx", (unsigned long long)f);
+    } else {
+        strcpy(name, "qthread");
+    }
+    trace_begin_event(w);
+    fprintf(w->f, "{\"name\":\"%s\",\"cat\":\"task\",\"ph\":\"X\","
+            "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%lu,"
+            "\"args\":{\"qthread\":\"%#llx\",\"state\":\"%s\"}}",
+            name, trace_us(w, start), trace_us(w, end) - trace_us(w, start),
+            w->pid, (unsigned long)worker, (unsigned long long)t, state);
+} /*}}}*/
+
+static const char *sync_names[] = {
+    [QT_TRACE_FILL]   = "fill",
+    [QT_TRACE_EMPTY]  = "empty",
+    [QT_TRACE_READ]   = "read",
+    [QT_TRACE_SIGNAL] = "signal"
+};
+
+static void trace_write_worker(trace_writer_t *w,
+                               size_t          worker)
+{   /*{{{*/
+    qt_trace_event_t       *ev;
+    int                     whole;
+    size_t                  n       = trace_copy_ring(&rings[worker], &ev, &whole);
+    const qt_trace_event_t *exec    = NULL;
+    int                     bounded = 0; /* seen a task start or stop yet? */
+
+    trace_begin_event(w);
+    fprintf(w->f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%lu,"
+            "\"args\":{\"name\":\"shepherd %lu worker %lu\"}}",
+            w->pid, (unsigned long)worker,
+            (unsigned long)(worker / qlib->nworkerspershep),
+            (unsigned long)(worker % qlib->nworkerspershep));
+    for (size_t i = 0; i < n; ++i) {
+        const qt_trace_event_t *e = &ev[i];
+
+        switch (e->type) {
+            case QT_TRACE_EXEC:
+                exec    = e;
+                bounded = 1;
+                break;
+            case QT_TRACE_RETURN:
+                if (exec) {
+                    trace_write_slice(w, worker, exec->arg, e->obj, exec->ts, e->ts,
+                                      state_name(e->aux));
+                } else if (!bounded) {
+                    /* it was already running when the ring begins */
+                    trace_write_slice(w, worker, 0, e->obj, whole ? clock_base : ev[0].ts,
+                                      e->ts, state_name(e->aux));
+                }
+                bounded = 1;
+                if (e->aux != QTHREAD_STATE_TERMINATED) {
+                    trace_begin_event(w);
+                    fprintf(w->f, "{\"name\":\"%s\",\"cat\":\"block\",\"ph\":\"i\",\"s\":\"t\","
+                            "\"ts\":%.3f,\"pid\":%d,\"tid\":%lu,\"args\":{\"qthread\":\"%#llx\"}}",
+                            state_name(e->aux), trace_us(w, e->ts), w->pid,
+                            (unsigned long)worker, (unsigned long long)e->obj);
+                }
+                exec = NULL;
+                break;
+            case QT_TRACE_SPAWN:
+                trace_begin_event(w);
+                fprintf(w->f, "{\"name\":\"spawn\",\"cat\":\"spawn\",\"ph\":\"i\",\"s\":\"t\","
+                        "\"ts\":%.3f,\"pid\":%d,\"tid\":%lu,"
+                        "\"args\":{\"qthread\":\"%#llx\",\"func\":\"%#llx\",\"shepherd\":%lu}}",
+                        trace_us(w, e->ts), w->pid, (unsigned long)worker,
+                        (unsigned long long)e->obj, (unsigned long long)e->arg,
+                        (unsigned long)e->aux);
+                break;
+            case QT_TRACE_STEAL:
+                trace_begin_event(w);
+                fprintf(w->f, "{\"name\":\"steal\",\"cat\":\"steal\",\"ph\":\"i\",\"s\":\"t\","
+                        "\"ts\":%.3f,\"pid\":%d,\"tid\":%lu,"
+                        "\"args\":{\"victim\":%llu,\"tasks\":%lu}}",
+                        trace_us(w, e->ts), w->pid, (unsigned long)worker,
+                        (unsigned long long)e->obj, (unsigned long)e->aux);
+                break;
+            case QT_TRACE_BARRIER:
+                trace_begin_event(w);
+                fprintf(w->f, "{\"name\":\"barrier\",\"cat\":\"barrier\",\"ph\":\"i\",\"s\":\"t\","
+                        "\"ts\":%.3f,\"pid\":%d,\"tid\":%lu,"
+                        "\"args\":{\"barrier\":\"%#llx\",\"id\":%lu}}",
+                        trace_us(w, e->ts), w->pid, (unsigned long)worker,
+                        (unsigned long long)e->obj, (unsigned long)e->aux);
+                break;
+            case QT_TRACE_WAKE:
+                trace_begin_event(w);
+                fprintf(w->f, "{\"name\":\"wake\",\"cat\":\"sync\",\"ph\":\"i\",\"s\":\"t\","
+                        "\"ts\":%.3f,\"pid\":%d,\"tid\":%lu,\"args\":{\"qthread\":\"%#llx\"}}",
+                        trace_us(w, e->ts), w->pid, (unsigned long)worker,
+                        (unsigned long long)e->obj);
+                break;
+            case QT_TRACE_FILL:
+            case QT_TRACE_EMPTY:
+            case QT_TRACE_READ:
+            case QT_TRACE_SIGNAL:
+                trace_begin_event(w);
+                fprintf(w->f, "{\"name\":\"%s\",\"cat\":\"sync\",\"ph\":\"i\",\"s\":\"t\","
+                        "\"ts\":%.3f,\"pid\":%d,\"tid\":%lu,\"args\":{\"addr\":\"%#llx\"}}",
+                        sync_names[e->type], trace_us(w, e->ts), w->pid,
+                        (unsigned long)worker, (unsigned long long)e->obj);
+                break;
+        }
+    }
+    /* whatever is still running goes up to the time of the dump */
+    if (exec) {
+        trace_write_slice(w, worker, exec->arg, exec->obj, exec->ts, w->now, "running");
+    } else if (!bounded && (n > 0)) {
+        trace_write_slice(w, worker, 0, 0, whole ? clock_base : ev[0].ts, w->now, "running");
+    }
+    if (ev) {
+        FREE(ev, n * sizeof(qt_trace_event_t));
+    }
+} /*}}}*/
+
+static int trace_write(const char *path)
+{   /*{{{*/
+    trace_writer_t w;
+    uint64_t       now   = qt_trace_clock();
+    uint64_t       ticks = now - clock_base;
+    uint64_t       ns    = qt_timer_now() - ns_base;
+
+    w.f = fopen(path, "w");
+    if (w.f == NULL) {
+        print_warning("could not write trace %s (%s)\n", path, strerror(errno));
+        return QTHREAD_THIRD_PARTY_ERROR;
+    }
+    w.us_per_tick = (ticks > 0) ? ((double)ns / 1000.0) / (double)ticks : 0.001;
+    w.now         = now;
+    w.pid         = (int)getpid();
+    w.first       = 1;
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", w.f);
+    trace_begin_event(&w);
+    fprintf(w.f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+            "\"args\":{\"name\":\"qthreads\"}}", w.pid);
+    for (size_t i = 0; i < nrings; ++i) {
+        trace_write_worker(&w, i);
+    }
+    fputs("\n]}\n", w.f);
+    if (fclose(w.f) != 0) {
+        print_warning("could not write trace %s (%s)\n", path, strerror(errno));
+        return QTHREAD_THIRD_PARTY_ERROR;
+    }
+    return QTHREAD_SUCCESS;
+} /*}}}*/
+
+static qt_report_t report = { "trace", trace_write, &qt_trace_dump_requested, 0, 0 };
+
+void INTERNAL qt_trace_internal_dump_requested(void)
+{   /*{{{*/
+    qt_report_dump_requested(&report, trace_path);
+} /*}}}*/
+
+static void qt_trace_internal_teardown(void)
+{   /*{{{*/
+    /* the workers are all gone, so the rings are quiet */
+    qt_trace_enabled = 0;
+    (void)trace_write(trace_path);
+    for (size_t i = 0; i < nrings; ++i) {
+        FREE(rings[i].events, (rings[i].mask + 1) * sizeof(qt_trace_event_t));
+    }
+    FREE(rings, nrings * sizeof(qt_trace_ring_t));
+    rings  = NULL;
+    nrings = 0;
+} /*}}}*/
+
+void INTERNAL qt_trace_subsystem_init(void)
+{   /*{{{*/
+    unsigned long events;
+    uint64_t      size = 16;
+
+    trace_path = qt_internal_get_env_str("TRACE", NULL);
+    if ((trace_path == NULL) || (trace_path[0] == 0)) {
+        qt_trace_enabled = 0;
+        return;
+    }
+    events = qt_internal_get_env_num("TRACE_EVENTS", 65536, 16);
+    while (size < events) {
+        size <<= 1;
+    }
+    nrings = qlib->nshepherds * qlib->nworkerspershep;
+    rings  = MALLOC(nrings * sizeof(qt_trace_ring_t));
+    assert(rings);
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        for (qthread_worker_id_t j = 0; j < qlib->nworkerspershep; ++j) {
+            qt_trace_ring_t *r = &rings[i * qlib->nworkerspershep + j];
+
+            r->head   = 0;
+            r->mask   = size - 1;
+            r->events = MALLOC(size * sizeof(qt_trace_event_t));
+            assert(r->events);
+            qlib->shepherds[i].workers[j].trace = r;
+        }
+    }
+    clock_base = qt_trace_clock();
+    ns_base    = qt_timer_now();
+
+    qt_report_signal(&report, (int)qt_internal_get_env_num("TRACE_SIGNAL", 0, 0));
+    qt_trace_enabled = 1;
+    qthread_internal_cleanup(qt_trace_internal_teardown);
+} /*}}}*/
+
+int API_FUNC qthread_trace_dump(const char *path)
+{   /*{{{*/
+    if (rings == NULL) {
+        return QTHREAD_NOT_ALLOWED;
+    }
+    return qt_report_dump(&report, path ? path : trace_path);
+} /*}}}*/
+
+#else /* ifdef QTHREAD_TRACING */
+
+int API_FUNC qthread_trace_dump(const char *path)
+{   /*{{{*/
+    return QTHREAD_NOT_ALLOWED;
+} /*}}}*/
+
+#endif /* ifdef QTHREAD_TRACING */
+
+/* vim:set expandtab: */
@@ -7,16 +7,165 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+/* Several threads allocating and freeing small and big blocks from one
+ * dynamic map at once; each fills its blocks with its own id and checks that
+ * nobody else wrote over them before freeing them. */
+#define STRESS_THREADS 4
+#define STRESS_LIVE    32
+#define STRESS_ITERS   2000
+
+static void *stress_map;
+
+static void *stress(void *arg)
+{
+    const unsigned char id = (unsigned char)(uintptr_t)arg;
+    char *live[STRESS_LIVE] = { NULL };
+    size_t sizes[STRESS_LIVE];
+
+    for (int i = 0; i < STRESS_ITERS; i++) {
+        int slot = i % STRESS_LIVE;
+
+        if (live[slot]) {
+            for (size_t j = 0; j < sizes[slot]; j++) {
+                assert((unsigned char)live[slot][j] == id);
+            }
+            qalloc_free(live[slot], stress_map);
+        }
+        sizes[slot] = (i % 3) ? 48 : 3000;
+        live[slot] = qalloc_malloc(stress_map, sizes[slot]);
+        assert(live[slot] != NULL);
+        memset(live[slot], id, sizes[slot]);
+    }
+    for (int slot = 0; slot < STRESS_LIVE; slot++) {
+        qalloc_free(live[slot], stress_map);
+    }
+    return NULL;
+}
+
+/* A map made before smallblocks were one basic block each has no layout in
+ * the top byte of its stream count, and its smallblocks are 2056 bytes apart
+ * with their slices at offset 130. This writes one by hand, with two
+ * smallblocks (the second straddling a block the old code never claimed), and
+ * checks that it loads and goes on being used in that layout. */
+#define OLD_STRIDE 2056
+#define OLD_SLICES 130
+#define OLD_SMALL  100
+
+static int test_old_layout(const char *file,
+                           off_t       size)
+{
+    const size_t  mutexsz   = sizeof(pthread_mutex_t);
+    const size_t  bitmapoff = 5 * sizeof(void *) + 2 * mutexsz;
+    const size_t  baseoff   = bitmapoff + (size / 2048 + 7) / 8;
+    char         *map, *base, *small[OLD_SMALL], *big[8];
+    void         *word;
+    unsigned char bits[4];
+    int           fd;
+
+    assert(qalloc_makedynmap(size, NULL, file, 1) != NULL);
+    qalloc_cleanup();
+    fd = open(file, O_RDWR);
+    assert(fd != -1);
+    assert(pread(fd, &map, sizeof(map), 0) == sizeof(map));
+    base = map + baseoff;
+    /* one stream, and no layout */
+    word = (void *)(uintptr_t)1;
+    assert(pwrite(fd, &word, sizeof(word), 2 * sizeof(void *)) == sizeof(word));
+    /* the stream's smallblocks: the first, then the second */
+    word = base;
+    assert(pwrite(fd, &word, sizeof(word), 3 * sizeof(void *)) == sizeof(word));
+    word = base + OLD_STRIDE;
+    assert(pwrite(fd, &word, sizeof(word), baseoff) == sizeof(word));
+    /* slice 0 of the first and 29 of the second (whose tail is in the third
+     * block) are in use; bits 30 and 31
+     * are never free */
+    memset(bits, 0, sizeof(bits));
+    bits[0] = 0x80;
+    bits[3] = 0x03;
+    assert(pwrite(fd, bits, 4, baseoff + sizeof(void *) + mutexsz) == 4);
+    bits[0] = 0;
+    bits[3] = 0x07;
+    assert(pwrite(fd, bits, 4, baseoff + OLD_STRIDE + sizeof(void *) + mutexsz) == 4);
+    assert(pwrite(fd, "legacy", 7, baseoff + OLD_SLICES) == 7);
+    assert(pwrite(fd, "second", 7, baseoff + OLD_STRIDE + OLD_SLICES + 29 * 64 + 56) == 7);
+    /* the old code claimed blocks 0 and 1 for them */
+    bits[0] = 0xc0;
+    assert(pwrite(fd, bits, 1, bitmapoff) == 1);
+    close(fd);
+
+    word = qalloc_loadmap(file);
+    if (word == NULL) {
+        fprintf(stderr, "could not load an old-layout map!\n");
+        return -1;
+    }
+    assert(strcmp(base + OLD_SLICES, "legacy") == 0);
+    /* the next slice is the first one's neighbour, in the old layout */
+    small[0] = qalloc_malloc(word, 16);
+    if (small[0] != base + OLD_SLICES + 64) {
+        fprintf(stderr, "old-layout slice at %p, not %p!\n",
+                (void *)small[0], (void *)(base + OLD_SLICES + 64));
+        return -1;
+    }
+    qalloc_free(base + OLD_SLICES, word);
+    assert(qalloc_malloc(word, 16) == base + OLD_SLICES);
+    /* big blocks, then the rest of the old smallblocks and a few new ones;
+     * nothing may land on anything else */
+    for (int i = 0; i < 8; i++) {
+        big[i] = qalloc_malloc(word, 3000);
+        assert(big[i] != NULL);
+        memset(big[i], 0xaa, 3000);
+    }
+    for (int i = 1; i < OLD_SMALL; i++) {
+        small[i] = qalloc_malloc(word, 64);
+        assert(small[i] != NULL);
+        assert(((size_t)(small[i] - base) % OLD_STRIDE - OLD_SLICES) % 64 == 0);
+        memset(small[i], i, 64);
+    }
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 3000; j++) {
+            assert((unsigned char)big[i][j] == 0xaa);
+        }
+    }
+    assert(strcmp(base + OLD_STRIDE + OLD_SLICES + 29 * 64 + 56, "second") == 0);
+    for (int i = 1; i < OLD_SMALL; i++) {
+        for (int j = 0; j < 64; j++) {
+            assert(small[i][j] == (char)i);
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        qalloc_free(big[i], word);
+    }
+    qalloc_cleanup();
+
+    /* it is still an old map, and still has what was put in it */
+    fd = open(file, O_RDONLY);
+    assert(fd != -1);
+    assert(pread(fd, &word, sizeof(word), 2 * sizeof(void *)) == sizeof(word));
+    close(fd);
+    assert(word == (void *)(uintptr_t)1);
+    word = qalloc_loadmap(file);
+    assert(word != NULL);
+    assert(strcmp(base + OLD_STRIDE + OLD_SLICES + 29 * 64 + 56, "second") == 0);
+    assert(small[OLD_SMALL - 1][63] == (char)(OLD_SMALL - 1));
+    qalloc_free(small[OLD_SMALL - 1], word);
+    qalloc_cleanup();
+    return 0;
+}
 
 int main(int argc,
          char *argv[])
 {
     void *r, *r2;
     const char teststring[16] = "This is a test.";
-    char filestat[30] = "/tmp/testqallocstatXXXXXX";
-    char filedyn[30] = "/tmp/testqallocdynXXXXXX";
+    char filestat[40] = "/tmp/testqallocstatXXXXXX";
+    char filedyn[40] = "/tmp/testqallocdynXXXXXX";
+    char filelegacy[40] = "/tmp/testqalloclegacyXXXXXX";
     char *ts, *ts2;
     off_t size = 4;
     int fd;
@@ -33,6 +182,11 @@ int main(int argc,
         return -1;
     }
     close(fd);
+    if ((fd = mkstemp(filelegacy)) == -1) {
+        perror("mktemp filelegacy");
+        return -1;
+    }
+    close(fd);
     /* making maps */
     r2 = qalloc_makedynmap(size, NULL, filedyn, 3);
     /*r2 = qalloc_loadmap("test2.img"); */
@@ -70,7 +224,59 @@ int main(int argc,
     }
     memset(ts2, 0x55, 128);
     qalloc_free(ts2, r2);
+
+    stress_map = r2;
+    {
+        pthread_t threads[STRESS_THREADS];
+
+        for (int i = 0; i < STRESS_THREADS; i++) {
+            assert(pthread_create(&threads[i], NULL, stress, (void *)(uintptr_t)(i + 1)) == 0);
+        }
+        for (int i = 0; i < STRESS_THREADS; i++) {
+            assert(pthread_join(threads[i], NULL) == 0);
+        }
+    }
+
+    /* the map reloads with what was in it, after an incremental checkpoint */
+    ts2 = (char *)qalloc_malloc(r2, 16);
+    sprintf(ts2, "012345678901");
+    assert(qalloc_checkpoint_dirty() > 0);
+    assert(qalloc_checkpoint_dirty() == 0);
+    /* a write into the block isn't seen until it is reported, and then only
+     * its own chunk is written */
+    ts2[0] = 'x';
+    if (qalloc_checkpoint_dirty() != 0) {
+        fprintf(stderr, "an unreported write was checkpointed!\n");
+        return -1;
+    }
+    qalloc_dirty(r2, ts2, 1);
+    if (qalloc_checkpoint_dirty() != 1) {
+        fprintf(stderr, "a reported one-byte write didn't flush exactly one chunk!\n");
+        return -1;
+    }
+    assert(qalloc_checkpoint_dirty() == 0);
+    qalloc_cleanup();
+    r2 = qalloc_loadmap(filedyn);
+    if (r2 == NULL) {
+        fprintf(stderr, "loadmap returned NULL!\n");
+        return -1;
+    }
+    if (strcmp(ts2, "x12345678901") != 0) {
+        fprintf(stderr, "reloaded map lost its contents!\n");
+        return -1;
+    }
+    qalloc_free(ts2, r2);
+    ts2 = (char *)qalloc_malloc(r2, 4096);
+    if (ts2 == NULL) {
+        fprintf(stderr, "dynmalloc after reload returned NULL!\n");
+        return -1;
+    }
+    qalloc_free(ts2, r2);
     qalloc_cleanup();
+
+    if (test_old_layout(filelegacy, size) != 0) {
+        return -1;
+    }
     /* the following is just so that it can be used in the automake test: */
     if (unlink(filestat) != 0) {
         perror("unlinking filestat");
@@ -80,6 +286,19 @@ int main(int argc,
         perror("unlinking test2.img");
         return -1;
     }
+    if (unlink(filelegacy) != 0) {
+        perror("unlinking filelegacy");
+        return -1;
+    }
+    /* and the checkpoint records */
+    strcat(filestat, ".ckpt");
+    strcat(filedyn, ".ckpt");
+    strcat(filelegacy, ".ckpt");
+    if ((unlink(filestat) != 0) || (unlink(filedyn) != 0) ||
+        (unlink(filelegacy) != 0)) {
+        perror("unlinking checkpoint records");
+        return -1;
+    }
     return 0;
 }
 
@@ -0,0 +1,386 @@
+#!/usr/bin/perl
+
+# Runs a matrix of benchmarks and shepherd layouts a number of times each, and
+# writes what it measured as JSON; or compares two such files.
+#
+# Each benchmark is a program in this directory, the environment it gets
+# (which is how these programs take their arguments), and, optionally, a
+# pattern that finds the time the program reports for itself in its output.
+# Where there is no pattern, or it doesn't match, the time is the wall clock
+# time of the whole process.
+
+use strict;
+use warnings;
+
+use JSON::PP;
+use POSIX qw/strftime floor ceil/;
+use Sys::Hostname;
+use Time::HiRes qw/time/;
+
+my %suite = (
+    spawn => {
+        program => 'time_task_spawn',
+        env     => { MT_COUNT => 262144 },
+        metric  => '^\d+ \d+ (\S+)$',
+    },
+    spawn_parallel => {
+        program => 'time_task_spawn',
+        env     => { MT_COUNT => 262144, MT_PAR_FORK => 1 },
+        metric  => '^\d+ \d+ (\S+)$',
+    },
+    fib => {
+        program => 'time_fib',
+        env     => { FIB_INPUT => 24 },
+        metric  => '^\d+ \d+ \d+ (\S+)$',
+    },
+    uts => {
+        program => 'time_uts_sinc',
+        env     => { UTS_TREE_TYPE => 0, UTS_BF_0 => 8000, UTS_NON_LEAF_PROB => 0.12,
+                     UTS_NON_LEAF_NUM => 8, UTS_ROOT_SEED => 42 },
+        metric  => '^exec-time (\S+)',
+    },
+    feb_stream => {
+        program => 'time_febs_stream_test',
+        env     => { NUM_TASKS => 4096, NUM_ELEMS => 4096 },
+        metric  => '^aligned_t (\S+)',
+    },
+    loop => {
+        program => 'spawn_parallel_qthreads',
+        env     => { MT_COUNT => 262144, LOOP_STYLE => 1 },
+        metric  => 'Total time: (\S+)',
+    },
+);
+
+# Collect command-line options
+my @benchmarks;
+my @layouts = ('default');
+my @extra_env;
+my @compare;
+my $bindir = '.';
+my $suite_file = '';
+my $output = '';
+my $label = '';
+my $config_status = '';
+my $repeat = 10;
+my $warmup = 1;
+my $timeout = 300;
+my $threshold = 5;
+my $list = 0;
+my $dry_run = 0;
+my $need_help = 0;
+
+while (@ARGV) {
+    my $flag = shift @ARGV;
+
+    if ($flag =~ m/--benchmarks=(.*)/) {
+        @benchmarks = split(/,/, $1);
+    } elsif ($flag =~ m/--layouts=(.*)/) {
+        @layouts = split(/,/, $1);
+    } elsif ($flag =~ m/--env=(.*)/) {
+        push @extra_env, $1;
+    } elsif ($flag =~ m/--bindir=(.*)/) {
+        $bindir = $1;
+    } elsif ($flag =~ m/--suite=(.*)/) {
+        $suite_file = $1;
+    } elsif ($flag =~ m/--output=(.*)/) {
+        $output = $1;
+    } elsif ($flag =~ m/--label=(.*)/) {
+        $label = $1;
+    } elsif ($flag =~ m/--config-status=(.*)/) {
+        $config_status = $1;
+    } elsif ($flag =~ m/--repeat=(.*)/) {
+        $repeat = int($1);
+    } elsif ($flag =~ m/--warmup=(.*)/) {
+        $warmup = int($1);
+    } elsif ($flag =~ m/--timeout=(.*)/) {
+        $timeout = int($1);
+    } elsif ($flag =~ m/--threshold=(.*)/) {
+        $threshold = $1;
+    } elsif ($flag eq '--compare') {
+        @compare = splice(@ARGV, 0, 2);
+    } elsif ($flag eq '--list') {
+        $list = 1;
+    } elsif ($flag eq '--dry-run') {
+        $dry_run = 1;
+    } elsif ($flag eq '--help' || $flag eq '-h') {
+        $need_help = 1;
+    } else {
+        print "Unsupported option '$flag'.\n";
+        exit(1);
+    }
+}
+
+if ($need_help) {
+    print "usage: perl bench.pl [options]\n";
+    print "       perl bench.pl --compare old.json new.json [--threshold=<percent>]\n";
+    print "Options:\n";
+    print "\t--benchmarks=<names>    comma-separated list of benchmarks to run\n";
+    print "\t                        (default: all of them; see --list).\n";
+    print "\t--layouts=<layouts>     comma-separated list of shepherd layouts: SxW for\n";
+    print "\t                        S shepherds of W workers each, N for N workers\n";
+    print "\t                        laid out by the library (QT_HWPAR), or 'default'.\n";
+    print "\t--repeat=<n>            timed runs of each benchmark in each layout\n";
+    print "\t                        (default: $repeat).\n";
+    print "\t--warmup=<n>            untimed runs before those (default: $warmup).\n";
+    print "\t--timeout=<seconds>     how long a run may take (default: $timeout).\n";
+    print "\t--env=<VAR=value>       extra environment for every run; may be repeated.\n";
+    print "\t--suite=<file>          a JSON object of benchmarks to use instead of the\n";
+    print "\t                        built-in ones, in the same form as --list shows.\n";
+    print "\t--bindir=<dir>          where the benchmark programs are (default: .).\n";
+    print "\t--output=<file>         where to write the results (default: stdout).\n";
+    print "\t--label=<string>        recorded in the results, to tell runs apart.\n";
+    print "\t--config-status=<file>  the build's config.status, whose configure\n";
+    print "\t                        options are recorded in the results.\n";
+    print "\t--threshold=<percent>   how much slower a median has to be to count as a\n";
+    print "\t                        regression when comparing (default: $threshold).\n";
+    print "\t--list                  print the benchmarks and exit.\n";
+    print "\t--dry-run               print what would be run, but don't run it.\n";
+    exit(1);
+}
+
+my $json = JSON::PP->new->pretty->canonical;
+
+if (@compare) {
+    die "--compare needs two result files\n" unless (scalar @compare == 2);
+    exit(compare(@compare));
+}
+
+if ($suite_file ne '') {
+    open(my $fh, '<', $suite_file) or die "Cannot read $suite_file: $!\n";
+    local $/;
+    %suite = %{ $json->decode(<$fh>) };
+    close($fh);
+}
+if ($list) {
+    print $json->encode(\%suite);
+    exit(0);
+}
+@benchmarks = sort keys %suite unless (@benchmarks);
+foreach my $name (@benchmarks) {
+    die "Unknown benchmark '$name' (try --list).\n" unless exists $suite{$name};
+}
+
+my %results = (
+    version => 1,
+    date    => strftime('%Y-%m-%dT%H:%M:%S%z', localtime),
+    host    => hostname(),
+    label   => $label,
+    repeat  => $repeat,
+    warmup  => $warmup,
+    results => [],
+);
+if ($config_status ne '' && -x $config_status) {
+    my $config = `$config_status --config`;
+    chomp $config;
+    $results{configure} = $config;
+}
+
+printf STDERR "%-16s %-8s %10s %10s %10s %10s  %s\n",
+    'benchmark', 'layout', 'median', 'p90', 'p99', 'ci95', 'metric';
+foreach my $name (@benchmarks) {
+    foreach my $layout (@layouts) {
+        my $result = run_benchmark($name, $layout);
+        next unless defined $result;
+        push @{ $results{results} }, $result;
+        if ($result->{runs} && @{ $result->{runs} }) {
+            printf STDERR "%-16s %-8s %10.6f %10.6f %10.6f %10.6f  %s%s\n",
+                $name, $layout, $result->{median}, $result->{p90}, $result->{p99},
+                ($result->{ci95}[1] - $result->{ci95}[0]) / 2, $result->{metric},
+                ($result->{failed} ? " ($result->{failed} failed)" : '');
+        } else {
+            printf STDERR "%-16s %-8s %10s\n", $name, $layout, 'failed';
+        }
+    }
+}
+exit(0) if ($dry_run);
+
+if ($output ne '') {
+    open(my $fh, '>', $output) or die "Cannot write $output: $!\n";
+    print $fh $json->encode(\%results);
+    close($fh);
+} else {
+    print $json->encode(\%results);
+}
+exit(0);
+
+sub layout_env {
+    my $layout = shift;
+
+    return () if ($layout eq 'default');
+    return (QT_NUM_SHEPHERDS => $1, QT_NUM_WORKERS_PER_SHEPHERD => $2)
+        if ($layout =~ m/^(\d+)x(\d+)$/);
+    return (QT_HWPAR => $1) if ($layout =~ m/^(\d+)$/);
+    die "Unparsable layout '$layout'.\n";
+}
+
+# Runs the program once; returns how long it took (by its own account if
+# possible), whether that was its own account, and whether it succeeded.
+sub run_once {
+    my ($program, $env, $metric) = @_;
+    my $start = time;
+    my $out;
+    my $pid = open(my $fh, '-|');
+
+    die "Cannot fork: $!\n" unless defined $pid;
+    if ($pid == 0) {
+        @ENV{ keys %$env } = values %$env;
+        open(STDERR, '>&', \*STDOUT);
+        exec($program) or exit(127);
+    }
+    eval {
+        local $SIG{ALRM} = sub { die "timeout\n" };
+        alarm($timeout);
+        local $/;
+        $out = <$fh>;
+        alarm(0);
+    };
+    if ($@) {
+        kill('KILL', $pid);
+        close($fh);
+        return (undef, 0, 0);
+    }
+    close($fh);
+    my $ok = ($? == 0);
+    my $wall = time - $start;
+
+    if (defined $metric && defined $out && $out =~ m/$metric/m) {
+        return ($1 + 0, 1, $ok);
+    }
+    return ($wall, 0, $ok);
+}
+
+sub run_benchmark {
+    my ($name, $layout) = @_;
+    my $bench = $suite{$name};
+    my $program = "$bindir/$bench->{program}";
+    my %env = (%{ $bench->{env} || {} }, layout_env($layout));
+    my (@runs, $reported, $failed);
+
+    foreach my $setting (@extra_env) {
+        my ($var, $value) = split(/=/, $setting, 2);
+        $env{$var} = $value;
+    }
+    if ($dry_run) {
+        print join(' ', map { "$_=$env{$_}" } sort keys %env), " $program\n";
+        return undef;
+    }
+    if (!-x $program) {
+        print STDERR "$program is missing; skipping $name\n";
+        return undef;
+    }
+    $reported = 1;
+    $failed = 0;
+    for (my $i = 0; $i < $warmup + $repeat; $i++) {
+        my ($secs, $own, $ok) = run_once($program, \%env, $bench->{metric});
+
+        next if ($i < $warmup);
+        if (!$ok || !defined $secs) {
+            $failed++;
+            next;
+        }
+        $reported &&= $own;
+        push @runs, $secs;
+    }
+    my %result = (
+        benchmark => $name,
+        layout    => $layout,
+        program   => $bench->{program},
+        env       => \%env,
+        metric    => ($reported ? 'reported' : 'wall'),
+        failed    => $failed,
+        runs      => \@runs,
+    );
+    %result = (%result, summarize(@runs)) if (@runs);
+    return \%result;
+}
+
+# Linear interpolation between the closest ranks
+sub percentile {
+    my ($p, @sorted) = @_;
+    my $rank = $p / 100 * (scalar(@sorted) - 1);
+    my $lo = floor($rank);
+    my $hi = ceil($rank);
+
+    return $sorted[$lo] + ($sorted[$hi] - $sorted[$lo]) * ($rank - $lo);
+}
+
+sub summarize {
+    my @sorted = sort { $a <=> $b } @_;
+    my $n = scalar @sorted;
+    my ($sum, $sq) = (0, 0);
+
+    $sum += $_ foreach @sorted;
+    my $mean = $sum / $n;
+    $sq += ($_ - $mean) ** 2 foreach @sorted;
+
+    # A distribution-free 95% interval for the median, from the order
+    # statistics; with few runs, it is simply the whole range.
+    my $lo = floor($n / 2 - 0.98 * sqrt($n));
+    my $hi = ceil(1 + $n / 2 + 0.98 * sqrt($n));
+    $lo = 1 if ($lo < 1);
+    $hi = $n if ($hi > $n);
+
+    return (
+        median => percentile(50, @sorted),
+        p90    => percentile(90, @sorted),
+        p99    => percentile(99, @sorted),
+        min    => $sorted[0],
+        max    => $sorted[-1],
+        mean   => $mean,
+        stddev => ($n > 1 ? sqrt($sq / ($n - 1)) : 0),
+        ci95   => [ $sorted[$lo - 1], $sorted[$hi - 1] ],
+    );
+}
+
+sub load_results {
+    my $file = shift;
+    my %by_key;
+
+    open(my $fh, '<', $file) or die "Cannot read $file: $!\n";
+    local $/;
+    my $results = $json->decode(<$fh>);
+    close($fh);
+    foreach my $r (@{ $results->{results} }) {
+        $by_key{"$r->{benchmark} $r->{layout}"} = $r if (defined $r->{median});
+    }
+    return \%by_key;
+}
+
+# A benchmark has regressed if its median is more than the threshold slower
+# and the two confidence intervals don't overlap, so that noise alone doesn't
+# get flagged. Returns nonzero if anything regressed.
+sub compare {
+    my ($old_file, $new_file) = @_;
+    my $old = load_results($old_file);
+    my $new = load_results($new_file);
+    my $regressions = 0;
+
+    printf "%-16s %-8s %12s %12s %8s  %s\n", 'benchmark', 'layout', 'old', 'new', 'change', '';
+    foreach my $key (sort keys %$old) {
+        my ($name, $layout) = split(/ /, $key);
+        my $o = $old->{$key};
+        my $n = $new->{$key};
+        my $verdict = '';
+
+        if (!defined $n) {
+            printf "%-16s %-8s %12.6f %12s\n", $name, $layout, $o->{median}, 'missing';
+            next;
+        }
+        my $change = 100 * ($n->{median} - $o->{median}) / $o->{median};
+        if ($change > $threshold && $n->{ci95}[0] > $o->{ci95}[1]) {
+            $verdict = 'REGRESSION';
+            $regressions++;
+        } elsif ($change < -$threshold && $n->{ci95}[1] < $o->{ci95}[0]) {
+            $verdict = 'improvement';
+        }
+        printf "%-16s %-8s %12.6f %12.6f %+7.1f%%  %s\n",
+            $name, $layout, $o->{median}, $n->{median}, $change, $verdict;
+    }
+    foreach my $key (sort keys %$new) {
+        next if exists $old->{$key};
+        my ($name, $layout) = split(/ /, $key);
+        printf "%-16s %-8s %12s %12.6f\n", $name, $layout, 'new', $new->{$key}{median};
+    }
+    print "$regressions regression(s)\n" if ($regressions);
+    return $regressions ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"                   /* for _GNU_SOURCE */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <qthread/qthread.h>
+#include <qthread/qt_syscalls.h>
+#include <qthread/qtimer.h>
+#include "argparsing.h"
+
+/* Streams a file through qt_pwrite() and qt_pread() from many tasks at once,
+ * first with the proxy pthreads doing the I/O, and then with io_uring (if
+ * the library was built with it). Each task owns a contiguous stripe of the
+ * file and walks it a chunk at a time. */
+
+static size_t MEGABYTES = 64;
+static size_t CHUNK     = 65536;
+static size_t TASKS     = 64;
+static size_t ITERS     = 3;
+
+static int    fd;
+static size_t stripe;
+
+static aligned_t stream_write(void *arg)
+{
+    const size_t id  = (size_t)(uintptr_t)arg;
+    char        *buf = malloc(CHUNK);
+
+    assert(buf);
+    for (size_t i = 0; i < CHUNK; i++) buf[i] = (char)(id + i);
+    for (size_t off = 0; off < stripe; off += CHUNK) {
+        ssize_t ret = qt_pwrite(fd, buf, CHUNK, (off_t)(id * stripe + off));
+        assert(ret == (ssize_t)CHUNK);
+    }
+    free(buf);
+    return 0;
+}
+
+static aligned_t stream_read(void *arg)
+{
+    const size_t id  = (size_t)(uintptr_t)arg;
+    char        *buf = malloc(CHUNK);
+
+    assert(buf);
+    for (size_t off = 0; off < stripe; off += CHUNK) {
+        ssize_t ret = qt_pread(fd, buf, CHUNK, (off_t)(id * stripe + off));
+        assert(ret == (ssize_t)CHUNK);
+    }
+    assert(buf[1] == (char)(id + 1));
+    free(buf);
+    return 0;
+}
+
+static double run(qthread_f f,
+                  aligned_t *rets)
+{
+    qtimer_t timer = qtimer_create();
+    double   secs;
+
+    qtimer_start(timer);
+    for (size_t t = 0; t < TASKS; t++) {
+        qthread_fork(f, (void *)(uintptr_t)t, &rets[t]);
+    }
+    for (size_t t = 0; t < TASKS; t++) {
+        qthread_readFF(NULL, &rets[t]);
+    }
+    qtimer_stop(timer);
+    secs = qtimer_secs(timer);
+    qtimer_destroy(timer);
+    return secs;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    static const char *const paths[] = { "proxy", "io_uring" };
+    char                     name[]  = "/tmp/time_file_streamXXXXXX";
+    aligned_t               *rets;
+    double                   mb;
+
+    CHECK_VERBOSE();
+    NUMARG(MEGABYTES, "MEGABYTES");
+    NUMARG(CHUNK, "CHUNK");
+    NUMARG(TASKS, "TASKS");
+    NUMARG(ITERS, "ITERS");
+    stripe = (MEGABYTES << 20) / TASKS / CHUNK * CHUNK;
+    assert(stripe > 0);
+    mb = (double)(stripe * TASKS) / (1 << 20);
+
+    fd = mkstemp(name);
+    assert(fd >= 0);
+    unlink(name);
+    rets = malloc(TASKS * sizeof(aligned_t));
+    assert(rets);
+
+    /* the environment picks the path when the library starts up */
+    for (int p = 0; p < 2; p++) {
+        double wsecs = 0, rsecs = 0;
+
+        setenv("QT_IO_URING", p ? "1" : "0", 1);
+        /* the tasks get big enough stacks for malloc() */
+        setenv("QT_STACK_SIZE", "65536", 0);
+        assert(qthread_initialize() == 0);
+        for (size_t i = 0; i < ITERS; i++) {
+            wsecs += run(stream_write, rets);
+            rsecs += run(stream_read, rets);
+        }
+        printf("%-8s %3lu tasks, %6lu-byte chunks: write %8.1f MB/s, read %8.1f MB/s\n",
+               paths[p], (unsigned long)TASKS, (unsigned long)CHUNK,
+               mb * ITERS / wsecs, mb * ITERS / rsecs);
+        qthread_finalize();
+    }
+
+    free(rets);
+    close(fd);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <unistd.h>
 #include <qthread/qthread.h>
 #include <qthread/qarray.h>
 #include "argparsing.h"
@@ -42,6 +44,88 @@ static void assignoff1(const size_t startat,
     qthread_incr(&count, stopat - startat);
 }
 
+/* file-backed arrays: 12-byte elements, each holding its own index */
+static size_t MAPPED_COUNT = 400000;
+
+static void checkmapped(const size_t startat,
+                        const size_t stopat,
+                        qarray * q,
+                        void *arg)
+{
+    const uint32_t bump = (uint32_t)(uintptr_t)arg;
+
+    for (size_t i = startat; i < stopat; i++) {
+        const char *elem = qarray_elem_nomigrate(q, i);
+        uint64_t    idx;
+        uint32_t    tag;
+
+        memcpy(&idx, elem, sizeof(idx));
+        memcpy(&tag, elem + sizeof(idx), sizeof(tag));
+        assert(idx == i);
+        assert(tag == (uint32_t)i + bump);
+    }
+    qthread_incr(&count, stopat - startat);
+}
+
+static void bumpmapped(const size_t startat,
+                       const size_t stopat,
+                       qarray * q,
+                       void *arg)
+{
+    for (size_t i = startat; i < stopat; i++) {
+        char    *elem = qarray_elem_nomigrate(q, i);
+        uint32_t tag;
+
+        memcpy(&tag, elem + sizeof(uint64_t), sizeof(tag));
+        tag++;
+        memcpy(elem + sizeof(uint64_t), &tag, sizeof(tag));
+    }
+}
+
+static void test_mapped(void)
+{
+    char    path[] = "/tmp/qarray_mappedXXXXXX";
+    int     fd     = mkstemp(path);
+    char    elem[12];
+    qarray *a;
+
+    assert(fd >= 0);
+    for (size_t i = 0; i < MAPPED_COUNT; i++) {
+        uint64_t idx = i;
+        uint32_t tag = (uint32_t)i;
+
+        memcpy(elem, &idx, sizeof(idx));
+        memcpy(elem + sizeof(idx), &tag, sizeof(tag));
+        assert(write(fd, elem, sizeof(elem)) == sizeof(elem));
+    }
+
+    a = qarray_create_mapped(path, sizeof(elem), QARRAY_MAP_RDONLY);
+    assert(a != NULL);
+    assert(a->count == MAPPED_COUNT);
+    count = 0;
+    qarray_iter_loop(a, 0, MAPPED_COUNT, checkmapped, NULL);
+    assert(count == MAPPED_COUNT);
+    qarray_destroy(a);
+    iprintf("mapped read-only: correct result!\n");
+
+    /* copy-on-write: the array changes, the file doesn't */
+    a = qarray_create_mapped(path, sizeof(elem), QARRAY_MAP_COW);
+    assert(a != NULL);
+    qarray_iter_loop(a, 0, MAPPED_COUNT, bumpmapped, NULL);
+    count = 0;
+    qarray_iter_loop(a, 0, MAPPED_COUNT, checkmapped, (void *)1);
+    assert(count == MAPPED_COUNT);
+    qarray_destroy(a);
+    assert(pread(fd, elem, sizeof(elem), (MAPPED_COUNT - 1) * sizeof(elem)) == sizeof(elem));
+    assert(memcmp(elem + sizeof(uint64_t), &(uint32_t){ (uint32_t)(MAPPED_COUNT - 1) }, sizeof(uint32_t)) == 0);
+    iprintf("mapped copy-on-write: correct result!\n");
+
+    /* a file that isn't a whole number of elements */
+    assert(qarray_create_mapped(path, 7, QARRAY_MAP_RDONLY) == NULL);
+    close(fd);
+    unlink(path);
+}
+
 int main(int argc,
          char *argv[])
 {
@@ -98,6 +182,22 @@ int main(int argc,
             }
         }
         iprintf("%s: correct result!\n", distnames[dt_index]);
+        if (a->dist_type == DIST) {
+            /* move every segment to the next shepherd; the data stays put */
+            size_t i;
+
+            for (i = 0; i < ELEMENT_COUNT; i += a->segment_size) {
+                qthread_shepherd_id_t shep = qarray_shepof(a, i);
+
+                shep = (shep + 1) % qthread_num_shepherds();
+                qarray_set_shepof(a, i, shep);
+                assert(qarray_shepof(a, i) == shep);
+            }
+            for (i = 0; i < ELEMENT_COUNT; i++) {
+                assert(*(double *)qarray_elem_nomigrate(a, i) == 1.0);
+            }
+            iprintf("%s: relocated segments\n", distnames[dt_index]);
+        }
         qarray_destroy(a);
 
         /* now test an array of giant things */
@@ -173,6 +273,9 @@ int main(int argc,
         qarray_destroy(a);
     }
 
+    NUMARG(MAPPED_COUNT, "MAPPED_COUNT");
+    test_mapped();
+
     return 0;
 }
 
@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <qthread/qarray.h>
+#include "argparsing.h"
+
+static size_t ELEMENT_COUNT = 100000;
+
+typedef struct {
+    aligned_t key;
+    aligned_t tag;                     /* the element's original index */
+} pair_t;
+
+static int cmp_pair(const void *a,
+                    const void *b)
+{
+    const pair_t *x = (const pair_t *)a, *y = (const pair_t *)b;
+
+    if (x->key != y->key) {
+        return (x->key < y->key) ? -1 : 1;
+    }
+    return (x->tag < y->tag) ? -1 : (x->tag > y->tag);
+}
+
+static uint64_t pair_key(const void *elem)
+{
+    return ((const pair_t *)elem)->key;
+}
+
+static void fill_pairs(const size_t startat,
+                       const size_t stopat,
+                       qarray      *q,
+                       void        *arg)
+{
+    const aligned_t modulus = *(aligned_t *)arg;
+
+    for (size_t i = startat; i < stopat; i++) {
+        pair_t *p = (pair_t *)qarray_elem_nomigrate(q, i);
+
+        /* a permutation-ish spread, with repeats when modulus is small */
+        p->key = ((i * 2654435761UL) ^ (i >> 7)) % modulus;
+        p->tag = i;
+    }
+}
+
+static void fill_index(const size_t startat,
+                       const size_t stopat,
+                       qarray      *q,
+                       void        *arg)
+{
+    for (size_t i = startat; i < stopat; i++) {
+        *(aligned_t *)qarray_elem_nomigrate(q, i) = i;
+    }
+}
+
+static void check_sorted(qarray *a,
+                         int     by_tag)
+{
+    aligned_t tagsum = 0;
+
+    for (size_t i = 0; i < ELEMENT_COUNT; i++) {
+        pair_t *p = (pair_t *)qarray_elem_nomigrate(a, i);
+
+        tagsum += p->tag;
+        if (i > 0) {
+            pair_t *q = (pair_t *)qarray_elem_nomigrate(a, i - 1);
+
+            assert(q->key <= p->key);
+            if (by_tag) {
+                assert(q->key < p->key || q->tag < p->tag);
+            }
+        }
+    }
+    /* nothing lost or duplicated (the tags are 0..n-1) */
+    assert(tagsum == (aligned_t)(ELEMENT_COUNT * (ELEMENT_COUNT - 1) / 2));
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    distribution_t disttypes[] = {
+        FIXED_HASH, FIXED_FIELDS, ALL_LOCAL, DIST_RAND, DIST_STRIPES
+    };
+    const char *distnames[] = {
+        "FIXED_HASH", "FIXED_FIELDS", "ALL_LOCAL", "DIST_RAND", "DIST_STRIPES"
+    };
+    const unsigned int num_dists = sizeof(disttypes) / sizeof(distribution_t);
+
+    assert(qthread_initialize() == 0);
+    CHECK_VERBOSE();
+    NUMARG(ELEMENT_COUNT, "ELEMENT_COUNT");
+
+    for (unsigned int d = 0; d < num_dists; d++) {
+        qarray   *a;
+        aligned_t modulus, sum, expected;
+
+        /* sort by comparator, then by key (with lots of repeated keys) */
+        a = qarray_create_configured(ELEMENT_COUNT, sizeof(pair_t),
+                                     disttypes[d], 0, 0);
+        assert(a);
+        modulus = ELEMENT_COUNT;
+        qarray_iter_loop(a, 0, ELEMENT_COUNT, fill_pairs, &modulus);
+        qarray_sort(a, cmp_pair, NULL);
+        check_sorted(a, 1);
+        modulus = 17;
+        qarray_iter_loop(a, 0, ELEMENT_COUNT, fill_pairs, &modulus);
+        qarray_sort(a, NULL, pair_key);
+        check_sorted(a, 0);
+        qarray_iter_loop(a, 0, ELEMENT_COUNT, fill_pairs, &modulus);
+        qarray_sort(a, cmp_pair, pair_key);
+        check_sorted(a, 1);
+        qarray_destroy(a);
+        iprintf("%s: sorts passed\n", distnames[d]);
+
+        /* scans and reductions over 0..n-1 */
+        a = qarray_create_configured(ELEMENT_COUNT, sizeof(aligned_t),
+                                     disttypes[d], 0, 0);
+        assert(a);
+        qarray_iter_loop(a, 0, ELEMENT_COUNT, fill_index, NULL);
+        qarray_reduce(a, qt_uint_add_acc, &sum);
+        expected = ELEMENT_COUNT * (ELEMENT_COUNT - 1) / 2;
+        assert(sum == expected);
+        qarray_reduce(a, qt_uint_max_acc, &sum);
+        assert(sum == ELEMENT_COUNT - 1);
+
+        qarray_inclusive_scan(a, qt_uint_add_acc);
+        for (size_t i = 0; i < ELEMENT_COUNT; i++) {
+            assert(*(aligned_t *)qarray_elem_nomigrate(a, i) == i * (i + 1) / 2);
+        }
+        qarray_iter_loop(a, 0, ELEMENT_COUNT, fill_index, NULL);
+        sum = 0;
+        qarray_exclusive_scan(a, qt_uint_add_acc, &sum);
+        for (size_t i = 0; i < ELEMENT_COUNT; i++) {
+            assert(*(aligned_t *)qarray_elem_nomigrate(a, i) == i * (i - 1) / 2);
+        }
+        qarray_destroy(a);
+        iprintf("%s: scans and reductions passed\n", distnames[d]);
+    }
+
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>                  /* for mincore() */
+#include <qthread/qthread.h>
+#include <qthread/qarray.h>
+#include "argparsing.h"
+
+/* Arrays made with huge pages, on more than one shepherd, so that each
+ * segment is a huge page that its owning shepherd faults in itself. */
+#define HUGEPAGE ((size_t)2 * 1024 * 1024)
+
+static size_t SEGMENTS = 5;
+
+static aligned_t count = 0;
+
+static void assignidx(const size_t startat,
+                      const size_t stopat,
+                      qarray      *q,
+                      void        *arg)
+{
+    for (size_t i = startat; i < stopat; i++) {
+        *(uint64_t *)qarray_elem_nomigrate(q, i) = i;
+    }
+    qthread_incr(&count, stopat - startat);
+}
+
+/* every page of the body should be in memory already, put there by the
+ * shepherds that own it rather than by anything this program did */
+static void check_resident(const qarray *a,
+                           size_t        segments)
+{
+    const size_t   pagesize = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t   len      = segments * a->segment_bytes;
+    unsigned char *vec      = malloc(len / pagesize + 1);
+
+    assert(vec);
+    assert(mincore(a->base_ptr, len, (void *)vec) == 0);
+    for (size_t p = 0; p < len / pagesize; p++) {
+        if ((vec[p] & 1) == 0) {
+            printf("page %lu of %lu was never touched\n",
+                   (unsigned long)p, (unsigned long)(len / pagesize));
+            assert(vec[p] & 1);
+        }
+    }
+    free(vec);
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    distribution_t disttypes[] = { DIST_STRIPES, ALL_LOCAL, FIXED_HASH };
+    const char    *distnames[] = { "DIST_STRIPES", "ALL_LOCAL", "FIXED_HASH" };
+    qthread_shepherd_id_t nsheps;
+
+    /* unless told otherwise; first touch needs more than one shepherd */
+    setenv("QT_QARRAY_HUGEPAGES", "transparent", 0);
+    setenv("QT_NUM_SHEPHERDS", "2", 0);
+    qthread_initialize();
+    CHECK_VERBOSE();
+    NUMARG(SEGMENTS, "SEGMENTS");
+    nsheps = qthread_num_shepherds();
+    iprintf("%i shepherds\n", (int)nsheps);
+
+    for (unsigned int dt = 0; dt < sizeof(disttypes) / sizeof(disttypes[0]); dt++) {
+        const size_t elems = SEGMENTS * HUGEPAGE / sizeof(uint64_t);
+        qarray      *a     = qarray_create_configured(elems, sizeof(uint64_t),
+                                                      disttypes[dt], 0, 0);
+        size_t       segments;
+
+        assert(a);
+        /* segments are whole huge pages, and so is the body */
+        assert(a->segment_bytes % HUGEPAGE == 0);
+        assert(((uintptr_t)a->base_ptr & (HUGEPAGE - 1)) == 0);
+        segments = (elems + a->segment_size - 1) / a->segment_size;
+        iprintf("%s: %lu segments of %lu bytes\n", distnames[dt],
+                (unsigned long)segments, (unsigned long)a->segment_bytes);
+        if (nsheps > 1) {
+            check_resident(a, segments);
+        }
+        if (a->dist_type == DIST) {
+            /* the stripes' owners wrote down their own ids */
+            for (size_t s = 0; s < segments; s++) {
+                assert(qarray_shepof(a, s * a->segment_size) == s % nsheps);
+            }
+        }
+        count = 0;
+        qarray_iter_loop(a, 0, elems, assignidx, NULL);
+        assert(count == elems);
+        for (size_t i = 0; i < elems; i++) {
+            assert(*(uint64_t *)qarray_elem_nomigrate(a, i) == i);
+        }
+        qarray_destroy(a);
+        iprintf("%s: correct result!\n", distnames[dt]);
+    }
+
+    return 0;
+}
+
+/* vim:set expandtab */
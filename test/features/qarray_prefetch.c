@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <qthread/qarray.h>
+#include "argparsing.h"
+
+/* The loops in qarray.c, with every array prefetched rather than only the
+ * file-backed ones, over a window wide enough to run past the end of each
+ * shepherd's share: every element must still be visited exactly once. */
+
+static size_t ELEMENT_COUNT = 100000;
+
+static aligned_t count = 0;
+
+typedef struct {
+    uint32_t idx;
+    char     pad[37];
+} offsize;
+
+static void assignidx(const size_t startat,
+                      const size_t stopat,
+                      qarray      *q,
+                      void        *arg)
+{
+    for (size_t i = startat; i < stopat; i++) {
+        offsize *elem = qarray_elem_nomigrate(q, i);
+
+        elem->idx += (uint32_t)i + 1;
+    }
+    qthread_incr(&count, stopat - startat);
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    distribution_t disttypes[] = {
+        FIXED_HASH, FIXED_FIELDS,
+        ALL_LOCAL, ALL_RAND, ALL_LEAST,
+        DIST_RAND, DIST_STRIPES, DIST_FIELDS, DIST_LEAST
+    };
+    const char *distnames[] = {
+        "FIXED_HASH", "FIXED_FIELDS",
+        "ALL_LOCAL", "ALL_RAND", "ALL_LEAST",
+        "DIST_RAND", "DIST_STRIPES", "DIST_FIELDS", "DIST_LEAST"
+    };
+
+    setenv("QT_QARRAY_PREFETCH", "all", 1);
+    setenv("QT_QARRAY_PREFETCH_DISTANCE", "2", 0);
+    setenv("QT_QARRAY_PREFETCH_DEPTH", "8", 0);
+    qthread_initialize();
+    CHECK_VERBOSE();
+    NUMARG(ELEMENT_COUNT, "ELEMENT_COUNT");
+
+    for (unsigned int dt = 0; dt < sizeof(disttypes) / sizeof(disttypes[0]); dt++) {
+        qarray *a = qarray_create_configured(ELEMENT_COUNT, sizeof(offsize),
+                                             disttypes[dt], 0, 0);
+
+        assert(a);
+        for (size_t i = 0; i < ELEMENT_COUNT; i++) {
+            ((offsize *)qarray_elem_nomigrate(a, i))->idx = 0;
+        }
+        count = 0;
+        qarray_iter_loop(a, 0, ELEMENT_COUNT, assignidx, NULL);
+        assert(count == ELEMENT_COUNT);
+        for (size_t i = 0; i < ELEMENT_COUNT; i++) {
+            const offsize *elem = qarray_elem_nomigrate(a, i);
+
+            if (elem->idx != (uint32_t)i + 1) {
+                printf("element %lu is %lu, dt = %s\n", (unsigned long)i,
+                       (unsigned long)elem->idx, distnames[dt]);
+                assert(elem->idx == (uint32_t)i + 1);
+            }
+        }
+        iprintf("%s: correct result!\n", distnames[dt]);
+        qarray_destroy(a);
+    }
+
+    qthread_finalize();
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -4,11 +4,22 @@
 #include "argparsing.h"
 
 #include <qthread/qthread.h>
+#include <qthread/qloop.h>
+#include <qthread/qtimer.h>
 #include <qthread/dictionary.h>
 #include <qthread/hash.h>
 
 #define EXPECTED_ENTRIES 4
 
+static size_t    elementcount = 100000;
+static aligned_t int_cleanups = 0;
+static aligned_t visited      = 0;
+static aligned_t visited_sum  = 0;
+
+/* integer keys are 1..elementcount; 0 is not a valid key */
+#define KEY(i) ((void *)(uintptr_t)((i) + 1))
+#define VAL(i) ((void *)(uintptr_t)((i) * 2 + 1))
+
 int my_key_equals(void *first,
                   void *second);
 int my_hashcode(void *string);
@@ -30,6 +41,182 @@ void my_destructor(void *key, void *val)
     iprintf("\tdeleting value key=%p (%s), val=%p (%s)\n", key, key, val, val);
 }
 
+static void int_cleanup(void *key,
+                        void *val)
+{
+    qthread_incr(&int_cleanups, 1);
+}
+
+static void par_put(const size_t startat,
+                    const size_t stopat,
+                    void        *arg)
+{
+    qt_dictionary *d = (qt_dictionary *)arg;
+
+    for (size_t i = startat; i < stopat; i++) {
+        void *ret = qt_dictionary_put(d, KEY(i), VAL(i));
+        assert(ret == VAL(i));
+    }
+}
+
+static void par_get(const size_t startat,
+                    const size_t stopat,
+                    void        *arg)
+{
+    qt_dictionary *d = (qt_dictionary *)arg;
+
+    for (size_t i = startat; i < stopat; i++) {
+        void *ret = qt_dictionary_get(d, KEY(i));
+        assert(ret == VAL(i));
+    }
+}
+
+static void par_put_if_absent(const size_t startat,
+                              const size_t stopat,
+                              void        *arg)
+{
+    qt_dictionary *d = (qt_dictionary *)arg;
+
+    for (size_t i = startat; i < stopat; i++) {
+        void *ret = qt_dictionary_put_if_absent(d, KEY(i), NULL);
+        assert(ret == VAL(i));
+    }
+}
+
+static void par_delete_odd(const size_t startat,
+                           const size_t stopat,
+                           void        *arg)
+{
+    qt_dictionary *d = (qt_dictionary *)arg;
+
+    for (size_t i = startat; i < stopat; i++) {
+        if (i & 1) {
+            void *ret = qt_dictionary_delete(d, KEY(i));
+            assert(ret == VAL(i));
+        }
+    }
+}
+
+static void count_visit(void *key,
+                        void *value,
+                        void *arg)
+{
+    assert(value == VAL((uintptr_t)key - 1));
+    qthread_incr(&visited, 1);
+    qthread_incr(&visited_sum, (uintptr_t)key);
+}
+
+static void report(const char *phase,
+                   size_t      ops,
+                   qtimer_t    timer)
+{
+    double secs = qtimer_secs(timer);
+
+    iprintf("%-14s %lu ops in %f secs: %.2f Mops/sec\n", phase,
+            (unsigned long)ops, secs, (secs > 0) ? (ops / secs / 1e6) : 0.0);
+}
+
+/* throughput of the basic operations, with integer keys */
+static void throughput(void)
+{
+    qt_dictionary          *d     = qt_dictionary_create(NULL, NULL, int_cleanup);
+    qtimer_t                timer = qtimer_create();
+    qt_dictionary_iterator *it;
+    size_t                  no_entries = 0;
+
+    qtimer_start(timer);
+    qt_loop_balance(0, elementcount, par_put, d);
+    qtimer_stop(timer);
+    report("put", elementcount, timer);
+
+    qtimer_start(timer);
+    qt_loop_balance(0, elementcount, par_get, d);
+    qtimer_stop(timer);
+    report("get", elementcount, timer);
+
+    qtimer_start(timer);
+    qt_loop_balance(0, elementcount, par_put_if_absent, d);
+    qtimer_stop(timer);
+    report("put_if_absent", elementcount, timer);
+
+    qtimer_start(timer);
+    qt_loop_balance(0, elementcount, par_delete_odd, d);
+    qtimer_stop(timer);
+    report("delete (half)", elementcount, timer);
+
+    for (size_t i = 0; i < elementcount; i++) {
+        assert(qt_dictionary_get(d, KEY(i)) == ((i & 1) ? NULL : VAL(i)));
+    }
+    assert(int_cleanups == elementcount / 2);
+
+    it = qt_dictionary_iterator_create(d);
+    while (NULL != qt_dictionary_iterator_next(it)) {
+        list_entry *le = qt_dictionary_iterator_get(it);
+        assert(le != NULL);
+        assert((((uintptr_t)le->key - 1) & 1) == 0);
+        no_entries++;
+    }
+    qt_dictionary_iterator_destroy(it);
+    iprintf("Found %lu entries after deleting half\n", (unsigned long)no_entries);
+    assert(no_entries == elementcount - elementcount / 2);
+
+    qtimer_start(timer);
+    qt_dictionary_parallel_for_each(d, count_visit, NULL);
+    qtimer_stop(timer);
+    report("for_each", elementcount - elementcount / 2, timer);
+    assert(visited == elementcount - elementcount / 2);
+
+    if (verbose) { qt_dictionary_printbuckets(d); }
+    qt_dictionary_destroy(d);
+    assert(int_cleanups == elementcount);
+    qtimer_destroy(timer);
+}
+
+/* bulk loading, compared with the parallel puts above */
+static void bulk(void)
+{
+    qt_dictionary *d            = qt_dictionary_create(NULL, NULL, NULL);
+    qtimer_t       timer        = qtimer_create();
+    void         **keys         = malloc(elementcount * sizeof(void *));
+    void         **values       = malloc(elementcount * sizeof(void *));
+    aligned_t      expected_sum = 0;
+
+    assert(keys && values);
+    for (size_t i = 0; i < elementcount; i++) {
+        keys[i]       = KEY(i);
+        values[i]     = VAL(i);
+        expected_sum += (uintptr_t)KEY(i);
+    }
+
+    qtimer_start(timer);
+    assert(qt_dictionary_put_bulk(d, keys, values, elementcount) == elementcount);
+    qtimer_stop(timer);
+    report("put_bulk", elementcount, timer);
+    qt_loop_balance(0, elementcount, par_get, d);
+
+    /* repeated keys keep their last value */
+    values[0] = VAL(7);
+    values[1] = VAL(9);
+    keys[1]   = KEY(0);
+    assert(qt_dictionary_put_bulk(d, keys, values, 2) == 2);
+    assert(qt_dictionary_get(d, KEY(0)) == VAL(9));
+    assert(qt_dictionary_put(d, KEY(0), VAL(0)) == VAL(0));
+
+    visited     = 0;
+    visited_sum = 0;
+    qtimer_start(timer);
+    qt_dictionary_parallel_for_each(d, count_visit, NULL);
+    qtimer_stop(timer);
+    report("for_each", elementcount, timer);
+    assert(visited == elementcount);
+    assert(visited_sum == expected_sum);
+
+    qt_dictionary_destroy(d);
+    free(keys);
+    free(values);
+    qtimer_destroy(timer);
+}
+
 int main(int    argc,
          char **argv)
 {
@@ -38,6 +225,7 @@ int main(int    argc,
     CHECK_VERBOSE();
 
     qthread_initialize();
+    NUMARG(elementcount, "ELEMENT_COUNT");
     qt_dictionary *dict   = qt_dictionary_create(my_key_equals, my_hashcode, my_destructor);
     char          *mykey1 = "k1";
     char          *myval1 = "v1";
@@ -158,6 +346,9 @@ int main(int    argc,
     qt_dictionary_iterator_destroy(it2);
     qt_dictionary_destroy(dict);
 
+    throughput();
+    bulk();
+
     return 0;
 }
 
@@ -0,0 +1,252 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "argparsing.h"
+
+#include <qthread/qthread.h>
+#include <qthread/qloop.h>
+#include <qthread/ordered_dict.h>
+
+static size_t elementcount = 10000;
+
+static aligned_t cleanups    = 0;
+static aligned_t visited     = 0;
+static aligned_t visited_sum = 0;
+
+#define KEY(i) ((void *)(uintptr_t)(i))
+#define VAL(i) ((void *)(uintptr_t)((i) * 2))
+
+static int my_cmp(void *a,
+                  void *b)
+{
+    uintptr_t x = (uintptr_t)a, y = (uintptr_t)b;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+static void my_cleanup(void *key,
+                       void *val)
+{
+    qthread_incr(&cleanups, 1);
+}
+
+/* Keys that cleanup retires, to catch a retired key being compared. They are
+ * marked rather than freed, so that the check itself is safe. */
+typedef struct {
+    uintptr_t k;
+    int       dead;
+} boxed_key_t;
+
+static int boxed_cmp(void *a,
+                     void *b)
+{
+    const boxed_key_t *x = a, *y = b;
+
+    assert(!x->dead && !y->dead);
+    return (x->k < y->k) ? -1 : (x->k > y->k);
+}
+
+static void boxed_cleanup(void *key,
+                          void *val)
+{
+    ((boxed_key_t *)key)->dead = 1;
+}
+
+static qt_ordered_dict *boxed_dict;
+static boxed_key_t     *boxed_keys;
+
+/* deletes the key it is on, and enough keys after it that its node would be
+ * reclaimed, before the range resumes from it */
+static void deleting_visit(void *key,
+                           void *value,
+                           void *arg)
+{
+    size_t *seen = (size_t *)arg;
+
+    if (++*seen == 64) {
+        const uintptr_t k = ((boxed_key_t *)key)->k;
+
+        assert(qt_ordered_dict_delete(boxed_dict, key) != NULL);
+        for (uintptr_t j = k + 200; j < k + 400; j++) {
+            qt_ordered_dict_delete(boxed_dict, &boxed_keys[j]);
+        }
+    }
+}
+
+static void count_visit(void *key,
+                        void *value,
+                        void *arg)
+{
+    assert(value == VAL((uintptr_t)key));
+    qthread_incr(&visited, 1);
+    qthread_incr(&visited_sum, (uintptr_t)key);
+}
+
+static void ordered_visit(void *key,
+                          void *value,
+                          void *arg)
+{
+    uintptr_t *last = (uintptr_t *)arg;
+
+    assert((uintptr_t)key > *last);
+    *last = (uintptr_t)key;
+    visited++;
+}
+
+static void par_insert(const size_t startat,
+                       const size_t stopat,
+                       void        *arg)
+{
+    qt_ordered_dict *d = (qt_ordered_dict *)arg;
+
+    for (size_t i = startat; i < stopat; i++) {
+        /* keys 1..2n, odd keys are deleted below */
+        void *ret = qt_ordered_dict_put(d, KEY(i + 1), VAL(i + 1));
+        assert(ret == VAL(i + 1));
+    }
+}
+
+static void par_delete_odd(const size_t startat,
+                           const size_t stopat,
+                           void        *arg)
+{
+    qt_ordered_dict *d = (qt_ordered_dict *)arg;
+
+    for (size_t i = startat; i < stopat; i++) {
+        if ((i + 1) & 1) {
+            void *ret = qt_ordered_dict_delete(d, KEY(i + 1));
+            assert(ret == VAL(i + 1));
+        } else {
+            assert(qt_ordered_dict_get(d, KEY(i + 1)) == VAL(i + 1));
+        }
+    }
+}
+
+int main(int    argc,
+         char **argv)
+{
+    qt_ordered_dict          *d;
+    qt_ordered_dict_iterator *it;
+    qt_ordered_dict_entry    *e;
+    uintptr_t                 last;
+    aligned_t                 expected_sum = 0;
+
+    CHECK_VERBOSE();
+    assert(qthread_initialize() == 0);
+    NUMARG(elementcount, "ELEMENT_COUNT");
+
+    d = qt_ordered_dict_create(my_cmp, my_cleanup);
+    assert(d);
+
+    /* serial semantics */
+    assert(qt_ordered_dict_put(d, KEY(10), VAL(10)) == VAL(10));
+    assert(qt_ordered_dict_put(d, KEY(30), VAL(30)) == VAL(30));
+    assert(qt_ordered_dict_put(d, KEY(20), VAL(20)) == VAL(20));
+    assert(qt_ordered_dict_get(d, KEY(20)) == VAL(20));
+    assert(qt_ordered_dict_get(d, KEY(25)) == NULL);
+    assert(qt_ordered_dict_put_if_absent(d, KEY(20), VAL(99)) == VAL(20));
+    assert(qt_ordered_dict_put(d, KEY(20), VAL(99)) == VAL(99));
+    assert(qt_ordered_dict_get(d, KEY(20)) == VAL(99));
+    assert(qt_ordered_dict_put(d, KEY(20), VAL(20)) == VAL(20));
+
+    it = qt_ordered_dict_lower_bound(d, KEY(15));
+    e  = qt_ordered_dict_iterator_next(it);
+    assert(e && e->key == KEY(20) && e->value == VAL(20));
+    e = qt_ordered_dict_iterator_next(it);
+    assert(e && e->key == KEY(30));
+    assert(qt_ordered_dict_iterator_next(it) == NULL);
+    qt_ordered_dict_iterator_destroy(it);
+
+    it = qt_ordered_dict_lower_bound(d, KEY(20));
+    e  = qt_ordered_dict_iterator_next(it);
+    assert(e && e->key == KEY(20));
+    qt_ordered_dict_iterator_destroy(it);
+
+    assert(qt_ordered_dict_delete(d, KEY(20)) == VAL(20));
+    assert(qt_ordered_dict_delete(d, KEY(20)) == NULL);
+    assert(qt_ordered_dict_get(d, KEY(20)) == NULL);
+    assert(qt_ordered_dict_delete(d, KEY(10)) == VAL(10));
+    assert(qt_ordered_dict_delete(d, KEY(30)) == VAL(30));
+    iprintf("serial tests passed\n");
+
+    /* concurrent inserts and deletes */
+    qt_loop_balance(0, 2 * elementcount, par_insert, d);
+    qt_loop_balance(0, 2 * elementcount, par_delete_odd, d);
+    for (size_t i = 1; i <= 2 * elementcount; i++) {
+        assert(qt_ordered_dict_get(d, KEY(i)) == ((i & 1) ? NULL : VAL(i)));
+        if (!(i & 1)) { expected_sum += i; }
+    }
+    iprintf("concurrent put/delete passed\n");
+
+    /* full ordered walk */
+    last = 0;
+    it   = qt_ordered_dict_lower_bound(d, NULL);
+    while ((e = qt_ordered_dict_iterator_next(it)) != NULL) {
+        assert((uintptr_t)e->key > last);
+        last = (uintptr_t)e->key;
+        visited++;
+    }
+    qt_ordered_dict_iterator_destroy(it);
+    iprintf("iterated over %lu entries\n", (unsigned long)visited);
+    assert(visited == elementcount);
+
+    /* serial range [100, 200) holds the 50 even keys 100..198 */
+    visited = 0;
+    last    = 0;
+    qt_ordered_dict_range(d, KEY(100), KEY(200), ordered_visit, &last);
+    assert(visited == 50);
+    assert(last == 198);
+
+    /* parallel range over everything, then over a sub-range */
+    visited = 0;
+    qt_ordered_dict_range_parallel(d, NULL, NULL, count_visit, NULL);
+    iprintf("parallel range visited %lu entries (sum %lu)\n",
+            (unsigned long)visited, (unsigned long)visited_sum);
+    assert(visited == elementcount);
+    assert(visited_sum == expected_sum);
+
+    visited     = 0;
+    visited_sum = 0;
+    qt_ordered_dict_range_parallel(d, KEY(101), KEY(1001), count_visit, NULL);
+    assert(visited == 450);
+
+    qt_ordered_dict_destroy(d);
+    iprintf("%lu cleanups\n", (unsigned long)cleanups);
+    assert(cleanups <= 2 * elementcount + 3);
+
+    /* an iterator and a range resume from keys that were deleted, and would
+     * have been cleaned up, between batches */
+    boxed_keys = calloc(1000, sizeof(boxed_key_t));
+    assert(boxed_keys);
+    boxed_dict = qt_ordered_dict_create(boxed_cmp, boxed_cleanup);
+    for (uintptr_t j = 0; j < 1000; j++) {
+        boxed_keys[j].k = j;
+        qt_ordered_dict_put(boxed_dict, &boxed_keys[j], VAL(1));
+    }
+    it = qt_ordered_dict_lower_bound(boxed_dict, NULL);
+    for (int j = 0; j < 64; j++) {
+        e = qt_ordered_dict_iterator_next(it);
+        assert(e && ((boxed_key_t *)e->key)->k == (uintptr_t)j);
+    }
+    assert(qt_ordered_dict_delete(boxed_dict, e->key) != NULL);
+    for (uintptr_t j = 500; j < 700; j++) {
+        qt_ordered_dict_delete(boxed_dict, &boxed_keys[j]);
+    }
+    e = qt_ordered_dict_iterator_next(it);
+    assert(e && ((boxed_key_t *)e->key)->k == 64);
+    qt_ordered_dict_iterator_destroy(it);
+    {
+        size_t seen = 0;
+
+        qt_ordered_dict_range(boxed_dict, NULL, NULL, deleting_visit, &seen);
+        assert(seen > 64);
+    }
+    qt_ordered_dict_destroy(boxed_dict);
+    free(boxed_keys);
+    iprintf("resuming from deleted keys passed\n");
+
+    return 0;
+}
+
+/* vim:set expandtab: */
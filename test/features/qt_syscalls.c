@@ -0,0 +1,520 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <qthread/qthread.h>
+#include <qthread/qt_syscalls.h>
+#include "argparsing.h"
+
+/* Exercises the I/O wrappers. The pipes and sockets are non-blocking, so the
+ * tasks wait on them in the reactor; there is only one proxy pthread, which
+ * the pipe chain below would deadlock if it were doing the waiting. */
+
+#define CHAIN 32
+
+static int chain[CHAIN][2];
+
+static aligned_t chain_link(void *arg)
+{
+    const long i = (long)(intptr_t)arg;
+    char       tok;
+
+    assert(qt_read(chain[i - 1][0], &tok, 1) == 1);
+    tok++;
+    assert(qt_write(chain[i][1], &tok, 1) == 1);
+    return 0;
+}
+
+/* A reader parked in the reactor, and a task that keeps the same shepherd
+ * busy until the reader wakes, so that its idle loop never runs. The spinner
+ * gives up after a few seconds rather than hang the test. */
+static int           busy_pipe[2];
+static volatile int  busy_woken;
+static aligned_t busy_reader(void *arg)
+{
+    char c;
+
+    assert(qt_read(busy_pipe[0], &c, 1) == 1);
+    busy_woken = 1;
+    return 0;
+}
+
+static aligned_t busy_spinner(void *arg)
+{
+    const time_t give_up = time(NULL) + 5;
+
+    while (!busy_woken && time(NULL) < give_up) {
+        qthread_yield();
+    }
+    assert(busy_woken);
+    return 0;
+}
+
+/* on the reader's shepherd, which has one worker: if the read blocked that
+ * worker, this would never get to write */
+static aligned_t late_writer(void *arg)
+{
+    for (int i = 0; i < 100; i++) {
+        qthread_yield();
+    }
+    assert(write(busy_pipe[1], "w", 1) == 1);
+    return 0;
+}
+
+/* Reads busy_pipe once while it is non-blocking, so that the reactor has
+ * seen it that way, and then again after whatever changed puts it in
+ * blocking mode. */
+static void read_after_change(aligned_t *rets,
+                              int        change)
+{
+    fcntl(busy_pipe[0], F_SETFL, O_NONBLOCK);
+    assert(write(busy_pipe[1], "r", 1) == 1);
+    qthread_fork_to(busy_reader, NULL, &rets[0], 0);
+    qthread_readFF(NULL, &rets[0]);
+    if (change == 0) {
+        fcntl(busy_pipe[0], F_SETFL, 0);
+    } else {
+        /* closed without telling the reactor (unless close() is
+         * intercepted), its number going to a blocking pipe */
+        const int old = busy_pipe[0];
+
+        close(busy_pipe[0]);
+        close(busy_pipe[1]);
+        assert(pipe(busy_pipe) == 0);
+        if (busy_pipe[0] != old) {
+            return;
+        }
+    }
+    alarm(10);
+    qthread_fork_to(busy_reader, NULL, &rets[0], 0);
+    qthread_fork_to(late_writer, NULL, &rets[1], 0);
+    qthread_readFF(NULL, &rets[0]);
+    qthread_readFF(NULL, &rets[1]);
+    alarm(0);
+}
+
+static int       pp[2];
+static int       rounds = 1000;
+static aligned_t pinger(void *arg)
+{
+    const int me = (int)(intptr_t)arg;
+
+    for (int r = 0; r < rounds; r++) {
+        int v;
+        if ((r & 1) == me) {
+            assert(qt_write(pp[me], &r, sizeof(int)) == sizeof(int));
+        } else {
+            assert(qt_read(pp[me], &v, sizeof(int)) == sizeof(int));
+            assert(v == r);
+        }
+    }
+    return 0;
+}
+
+static int                listener;
+static struct sockaddr_in listen_addr;
+static aligned_t acceptor(void *arg)
+{
+    char buf[6];
+    int  s = qt_accept(listener, NULL, NULL);
+
+    assert(s >= 0);
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+    assert(qt_read(s, buf, 6) == 6);
+    assert(memcmp(buf, "hello", 6) == 0);
+    close(s);
+    return 0;
+}
+
+static aligned_t connector(void *arg)
+{
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+
+    assert(s >= 0);
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+    assert(qt_connect(s, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) == 0);
+    assert(qt_write(s, "hello", 6) == 6);
+    close(s);
+    return 0;
+}
+
+static int       blocking[2];
+static aligned_t blocking_select(void *arg)
+{
+    fd_set readable;
+
+    /* nothing but a proxy does select() */
+    FD_ZERO(&readable);
+    FD_SET(blocking[0], &readable);
+    assert(qt_select(blocking[0] + 1, &readable, NULL, NULL, NULL) == 1);
+    assert(FD_ISSET(blocking[0], &readable));
+    return 0;
+}
+
+static int       sv[2], bv[2];
+static aligned_t socket_recver(void *arg)
+{
+    char          a[3], b[3];
+    struct iovec  iov[2] = { { a, 3 }, { b, 3 } };
+    struct msghdr msg;
+
+    /* these wait in the reactor until socket_sender gets around to them */
+    assert(qt_recv(sv[0], a, 5, 0) == 5);
+    assert(memcmp(a, "ping", 5) == 0);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 2;
+    assert(qt_recvmsg(sv[0], &msg, MSG_WAITALL) == 6);
+    assert(memcmp(a, "abc", 3) == 0 && memcmp(b, "def", 3) == 0);
+    assert(qt_readv(sv[0], iov, 2) == 6);
+    assert(memcmp(a, "ghi", 3) == 0 && memcmp(b, "jkl", 3) == 0);
+    return 0;
+}
+
+static aligned_t socket_sender(void *arg)
+{
+    struct iovec  iov[2] = { { "abc", 3 }, { "def", 3 } };
+    struct msghdr msg;
+
+    assert(qt_send(sv[1], "ping", 5, 0) == 5);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 2;
+    assert(qt_sendmsg(sv[1], &msg, 0) == 6);
+    iov[0].iov_base = "ghi";
+    iov[1].iov_base = "jkl";
+    assert(qt_writev(sv[1], iov, 2) == 6);
+    return 0;
+}
+
+static aligned_t socket_blocking(void *arg)
+{
+    char buf[8];
+
+    /* bv is in blocking mode, so these go to a proxy */
+    assert(qt_sendto(bv[1], "dgram", 6, 0, NULL, 0) == 6);
+    assert(qt_recvfrom(bv[0], buf, sizeof(buf), 0, NULL, NULL) == 6);
+    assert(memcmp(buf, "dgram", 6) == 0);
+    /* ...but not this one */
+    assert(qt_recv(bv[0], buf, sizeof(buf), MSG_DONTWAIT) == -1);
+    assert(errno == EAGAIN || errno == EWOULDBLOCK);
+    return 0;
+}
+
+/* a file bigger than a socket buffer, so the sender has to wait for room */
+#define SERVED (1 << 20)
+static int       served_fd;
+static aligned_t file_sender(void *arg)
+{
+    off_t off = 0;
+
+    assert(qt_sendfile(sv[1], served_fd, &off, SERVED) == SERVED);
+    assert(off == SERVED);
+    return 0;
+}
+
+/* task stacks are small, so the buffers live out here */
+static char      recv_buf[512], splice_buf[4096];
+static aligned_t file_receiver(void *arg)
+{
+    char  *buf = recv_buf;
+    size_t got = 0;
+
+    while (got < SERVED) {
+        ssize_t ret = qt_recv(sv[0], buf, sizeof(recv_buf), 0);
+
+        assert(ret > 0);
+        for (ssize_t j = 0; j < ret; j++) assert(buf[j] == (char)((got + j) / 4096));
+        got += ret;
+    }
+    return 0;
+}
+
+static aligned_t file_copier(void *arg)
+{
+    const int copy_fd = (int)(intptr_t)arg;
+    off_t     in      = 0, out = 0;
+    int       p[2];
+
+    /* file to file, and file to a blocking pipe, both by proxy */
+    assert(qt_copy_file_range(served_fd, &in, copy_fd, &out, SERVED, 0) == SERVED);
+    assert(in == SERVED && out == SERVED);
+    assert(pipe(p) == 0);
+    in = 8192;
+    assert(qt_splice(copy_fd, &in, p[1], NULL, sizeof(splice_buf), 0) == sizeof(splice_buf));
+    assert(in == 8192 + sizeof(splice_buf));
+    assert(qt_read(p[0], splice_buf, sizeof(splice_buf)) == sizeof(splice_buf));
+    assert(splice_buf[0] == 2 && splice_buf[4095] == 2);
+    close(p[0]);
+    close(p[1]);
+    return 0;
+}
+
+static int       file_fd;
+static char      fixed_bufs[2][64];
+static aligned_t file_io(void *arg)
+{
+    const long   i = (long)(intptr_t)arg;
+    char         block[64];
+    char         a[32], b[32];
+    struct iovec iov[2] = { { a, 32 }, { b, 32 } };
+
+    /* each task has its own 64-byte record in the file */
+    for (int j = 0; j < 64; j++) block[j] = (char)(i + j);
+    assert(qt_pwrite(file_fd, block, sizeof(block), i * 64) == sizeof(block));
+    for (int j = 0; j < 64; j++) block[j] = 0;
+    assert(qt_pread(file_fd, block, sizeof(block), i * 64) == sizeof(block));
+    for (int j = 0; j < 64; j++) assert(block[j] == (char)(i + j));
+    assert(qt_preadv(file_fd, iov, 2, i * 64) == 64);
+    assert(a[0] == (char)i && b[31] == (char)(i + 63));
+    assert(qt_pwritev(file_fd, iov, 2, i * 64) == 64);
+    return 0;
+}
+
+static aligned_t file_io_fixed(void *arg)
+{
+    const long i = (long)(intptr_t)arg;
+
+    for (int j = 0; j < 64; j++) fixed_bufs[0][j] = 'f';
+    assert(qt_pwrite_fixed(file_fd, fixed_bufs[0], 64, i * 64, 0) == 64);
+    assert(qt_pread_fixed(file_fd, fixed_bufs[1], 64, i * 64, 1) == 64);
+    assert(fixed_bufs[1][0] == 'f' && fixed_bufs[1][63] == 'f');
+    return 0;
+}
+
+static aligned_t file_io_error(void *arg)
+{
+    char c;
+
+    /* no errno = 0 here: the compiler may keep errno's address across the
+     * call, and the task may come back on another worker, with another errno */
+    assert(qt_pread(file_fd, &c, 1, 0) == -1);
+    assert(errno == EBADF);
+    return 0;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t rets[CHAIN];
+    char      tok = 0;
+    long      i;
+
+    setenv("QT_MAX_IO_WORKERS", "1", 1);
+    assert(qthread_initialize() == 0);
+    CHECK_VERBOSE();
+    NUMARG(rounds, "ROUNDS");
+
+    /* a chain of tasks, each waiting on the previous one's pipe; they are
+     * spawned last-first, so they all wait at once */
+    for (i = 0; i < CHAIN; i++) {
+        assert(pipe(chain[i]) == 0);
+        fcntl(chain[i][0], F_SETFL, O_NONBLOCK);
+        fcntl(chain[i][1], F_SETFL, O_NONBLOCK);
+    }
+    for (i = CHAIN - 1; i > 0; i--) {
+        qthread_fork(chain_link, (void *)(intptr_t)i, &rets[i]);
+    }
+    assert(write(chain[0][1], &tok, 1) == 1);
+    for (i = CHAIN - 1; i > 0; i--) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    assert(read(chain[CHAIN - 1][0], &tok, 1) == 1);
+    assert(tok == CHAIN - 1);
+    iprintf("pipe chain of %i passed\n", CHAIN);
+    for (i = 0; i < CHAIN; i++) {
+        close(chain[i][0]);
+        close(chain[i][1]);
+    }
+
+    /* a parked reader on a shepherd that never goes idle */
+    assert(pipe(busy_pipe) == 0);
+    fcntl(busy_pipe[0], F_SETFL, O_NONBLOCK);
+    qthread_fork_to(busy_reader, NULL, &rets[0], 0);
+    qthread_fork_to(busy_spinner, NULL, &rets[1], 0);
+    qthread_yield();
+    assert(write(busy_pipe[1], "r", 1) == 1);
+    qthread_readFF(NULL, &rets[0]);
+    qthread_readFF(NULL, &rets[1]);
+    {
+        const int old = busy_pipe[0];
+
+        qt_close(busy_pipe[0]);
+        close(busy_pipe[1]);
+        iprintf("woke a reader on a busy shepherd\n");
+
+        /* the same fd number, now a blocking pipe, must not be read on the
+         * worker as though it were still non-blocking */
+        assert(pipe(busy_pipe) == 0);
+        if (busy_pipe[0] == old) {
+            busy_woken = 0;
+            qthread_fork_to(busy_reader, NULL, &rets[0], 0);
+            qthread_fork_to(busy_spinner, NULL, &rets[1], 0);
+            qthread_yield();
+            assert(write(busy_pipe[1], "r", 1) == 1);
+            qthread_readFF(NULL, &rets[0]);
+            qthread_readFF(NULL, &rets[1]);
+            iprintf("reused fd %i in blocking mode\n", old);
+        }
+        qt_close(busy_pipe[0]);
+        close(busy_pipe[1]);
+    }
+
+    /* put back in blocking mode, or closed and reused, behind the reactor's
+     * back */
+    assert(pipe(busy_pipe) == 0);
+    read_after_change(rets, 0);
+    iprintf("read a pipe made blocking again\n");
+    read_after_change(rets, 1);
+    iprintf("read a pipe closed behind the reactor's back\n");
+    close(busy_pipe[0]);
+    close(busy_pipe[1]);
+
+    /* two tasks taking turns on a socketpair */
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pp) == 0);
+    fcntl(pp[0], F_SETFL, O_NONBLOCK);
+    fcntl(pp[1], F_SETFL, O_NONBLOCK);
+    qthread_fork(pinger, (void *)0, &rets[0]);
+    qthread_fork(pinger, (void *)1, &rets[1]);
+    qthread_readFF(NULL, &rets[0]);
+    qthread_readFF(NULL, &rets[1]);
+    iprintf("%i rounds of ping-pong passed\n", rounds);
+    close(pp[0]);
+    close(pp[1]);
+
+    /* the rest of the socket family, both ways */
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+    qthread_fork(socket_recver, NULL, &rets[0]);
+    qthread_fork(socket_sender, NULL, &rets[1]);
+    qthread_readFF(NULL, &rets[0]);
+    qthread_readFF(NULL, &rets[1]);
+    close(sv[0]);
+    close(sv[1]);
+    assert(socketpair(AF_UNIX, SOCK_DGRAM, 0, bv) == 0);
+    qthread_fork(socket_blocking, NULL, &rets[0]);
+    qthread_readFF(NULL, &rets[0]);
+    close(bv[0]);
+    close(bv[1]);
+    iprintf("send/recv family passed\n");
+
+    /* serving a file without copying it through the tasks */
+    {
+        char path[] = "/tmp/qt_syscallsXXXXXX";
+        char copy[]  = "/tmp/qt_syscallsXXXXXX";
+        char page[4096];
+        int  copy_fd;
+
+        served_fd = mkstemp(path);
+        assert(served_fd >= 0);
+        unlink(path);
+        for (i = 0; i < SERVED / 4096; i++) {
+            memset(page, (char)i, sizeof(page));
+            assert(write(served_fd, page, sizeof(page)) == sizeof(page));
+        }
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        fcntl(sv[0], F_SETFL, O_NONBLOCK);
+        fcntl(sv[1], F_SETFL, O_NONBLOCK);
+        qthread_fork(file_receiver, NULL, &rets[0]);
+        qthread_fork(file_sender, NULL, &rets[1]);
+        qthread_readFF(NULL, &rets[0]);
+        qthread_readFF(NULL, &rets[1]);
+        close(sv[0]);
+        close(sv[1]);
+        copy_fd = mkstemp(copy);
+        assert(copy_fd >= 0);
+        unlink(copy);
+        qthread_fork(file_copier, (void *)(intptr_t)copy_fd, &rets[0]);
+        qthread_readFF(NULL, &rets[0]);
+        close(copy_fd);
+        close(served_fd);
+        iprintf("sendfile/copy_file_range/splice passed\n");
+    }
+
+    /* accept() and connect() over loopback, if we have it */
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&listen_addr, 0, sizeof(listen_addr));
+    listen_addr.sin_family      = AF_INET;
+    listen_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listen_addr.sin_port        = 0;
+    if ((listener >= 0) &&
+        (bind(listener, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) == 0) &&
+        (listen(listener, 4) == 0)) {
+        socklen_t len = sizeof(listen_addr);
+
+        assert(getsockname(listener, (struct sockaddr *)&listen_addr, &len) == 0);
+        fcntl(listener, F_SETFL, O_NONBLOCK);
+        qthread_fork(acceptor, NULL, &rets[0]);
+        qthread_fork(connector, NULL, &rets[1]);
+        qthread_readFF(NULL, &rets[0]);
+        qthread_readFF(NULL, &rets[1]);
+        iprintf("accept/connect passed\n");
+    } else {
+        iprintf("no loopback; skipping accept/connect\n");
+    }
+    if (listener >= 0) {
+        close(listener);
+    }
+
+    /* regular files go to io_uring, or to the proxy if there isn't one */
+    {
+        char         path[] = "/tmp/qt_syscallsXXXXXX";
+        struct iovec fixed[2] = { { fixed_bufs[0], 64 }, { fixed_bufs[1], 64 } };
+
+        file_fd = mkstemp(path);
+        assert(file_fd >= 0);
+        unlink(path);
+        for (i = 0; i < CHAIN; i++) {
+            qthread_fork(file_io, (void *)(intptr_t)i, &rets[i]);
+        }
+        for (i = 0; i < CHAIN; i++) {
+            qthread_readFF(NULL, &rets[i]);
+        }
+        assert(qt_io_register_buffers(fixed, 2) == 0);
+        qthread_fork(file_io_fixed, (void *)(intptr_t)CHAIN, &rets[0]);
+        qthread_readFF(NULL, &rets[0]);
+        assert(qt_io_unregister_buffers() == 0);
+        close(file_fd);
+        qthread_fork(file_io_error, NULL, &rets[0]);
+        qthread_readFF(NULL, &rets[0]);
+        iprintf("regular file passed\n");
+    }
+
+    /* every shepherd queues its own blocking calls, but there is only the one
+     * proxy, which has to take them from the others' queues */
+    {
+        const int    sheps = qthread_num_shepherds();
+        const size_t calls = qthread_readstate(IO_SYSCALLS);
+
+        assert(pipe(blocking) == 0);
+        assert(write(blocking[1], "b", 1) == 1);
+        for (i = 0; i < CHAIN; i++) {
+            qthread_fork_to(blocking_select, NULL, &rets[i], i % sheps);
+        }
+        for (i = 0; i < CHAIN; i++) {
+            qthread_readFF(NULL, &rets[i]);
+        }
+        close(blocking[0]);
+        close(blocking[1]);
+        assert(qthread_readstate(IO_SYSCALLS) >= calls + CHAIN);
+        assert(qthread_readstate(IO_PROXIES) == 1);
+        assert(qthread_readstate(IO_QUEUE_DEPTH) == 0);
+        assert(qthread_readstate(IO_LATENCY_P50) <= qthread_readstate(IO_LATENCY_P99));
+        iprintf("%i selects on %i shepherds passed; p50 %zu us, p99 %zu us\n",
+                CHAIN, sheps, qthread_readstate(IO_LATENCY_P50),
+                qthread_readstate(IO_LATENCY_P99));
+    }
+
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <time.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* Exercises the shepherds' timer wheels: many sleeping tasks at once, an
+ * absolute deadline, and FEB waits that time out and that don't. */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void in_ns(struct timespec *ts,
+                  uint64_t         ns)
+{
+    uint64_t t = now_ns() + ns;
+
+    ts->tv_sec  = t / 1000000000;
+    ts->tv_nsec = t % 1000000000;
+}
+
+static int sleepers = 1000;
+
+static aligned_t sleeper(void *arg)
+{
+    uint64_t start = now_ns();
+
+    usleep(1000);
+    assert(now_ns() - start >= 1000000);
+    return 0;
+}
+
+static aligned_t until(void *arg)
+{
+    struct timespec deadline;
+
+    in_ns(&deadline, 20000000);
+    assert(qthread_sleep_until(&deadline) == QTHREAD_SUCCESS);
+    assert(now_ns() >= (uint64_t)deadline.tv_sec * 1000000000 + deadline.tv_nsec);
+    return 0;
+}
+
+static aligned_t word;
+static aligned_t reads, writes;
+
+static aligned_t consumer(void *arg)
+{
+    struct timespec deadline;
+    aligned_t       v = 0;
+
+    in_ns(&deadline, 2000000);
+    if (qthread_readFE_timed(&v, &word, &deadline) == QTHREAD_SUCCESS) {
+        qthread_incr(&reads, 1);
+    } else {
+        assert(v == 0);
+    }
+    return 0;
+}
+
+static aligned_t producer(void *arg)
+{
+    for (int i = 0; i < 100; i++) {
+        struct timespec deadline;
+
+        in_ns(&deadline, 1000000);
+        if (qthread_writeEF_const_timed(&word, i + 1, &deadline) == QTHREAD_SUCCESS) {
+            qthread_incr(&writes, 1);
+        }
+    }
+    return 0;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t      *rets;
+    aligned_t       v = 0;
+    struct timespec deadline;
+    uint64_t        start;
+
+    assert(qthread_initialize() == 0);
+    CHECK_VERBOSE();
+    NUMARG(sleepers, "SLEEPERS");
+    (void)now_ns(); /* resolve clock_gettime() outside of the small stacks */
+    rets = malloc((sleepers > 201 ? sleepers : 201) * sizeof(aligned_t));
+    assert(rets);
+
+    /* they all sleep at once, so this takes a few ms, not sleepers ms */
+    start = now_ns();
+    for (int i = 0; i < sleepers; i++) {
+        qthread_fork(sleeper, NULL, &rets[i]);
+    }
+    for (int i = 0; i < sleepers; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    iprintf("%i concurrent 1ms sleeps took %g ms\n", sleepers, (now_ns() - start) * 1e-6);
+
+    qthread_fork(until, NULL, &rets[0]);
+    qthread_readFF(NULL, &rets[0]);
+    iprintf("sleep_until passed\n");
+
+    /* timing out leaves the word and its state alone */
+    qthread_empty(&word);
+    in_ns(&deadline, 5000000);
+    start = now_ns();
+    assert(qthread_readFF_timed(&v, &word, &deadline) == QTHREAD_TIMEOUT);
+    assert(now_ns() - start >= 5000000);
+    assert(v == 0);
+    assert(qthread_feb_status(&word) == 0);
+    in_ns(&deadline, 0);
+    assert(qthread_readFE_timed(&v, &word, &deadline) == QTHREAD_TIMEOUT);
+    /* the epoch is long past, not "no deadline" */
+    deadline.tv_sec  = 0;
+    deadline.tv_nsec = 0;
+    assert(qthread_readFF_timed(&v, &word, &deadline) == QTHREAD_TIMEOUT);
+    assert(qthread_readFE_timed(&v, &word, &deadline) == QTHREAD_TIMEOUT);
+    qthread_writeF_const(&word, 42);
+    in_ns(&deadline, 5000000);
+    assert(qthread_writeEF_const_timed(&word, 7, &deadline) == QTHREAD_TIMEOUT);
+    deadline.tv_sec  = 0;
+    deadline.tv_nsec = 0;
+    assert(qthread_writeEF_const_timed(&word, 7, &deadline) == QTHREAD_TIMEOUT);
+    assert(qthread_feb_status(&word) == 1);
+    in_ns(&deadline, 5000000);
+    assert(qthread_readFE_timed(&v, &word, &deadline) == QTHREAD_SUCCESS);
+    assert(v == 42);
+    iprintf("timeouts passed\n");
+
+    /* consumers and a producer racing their deadlines: every value that got
+     * written was read, except perhaps the last one */
+    for (int i = 0; i < 200; i++) {
+        qthread_fork(consumer, NULL, &rets[i]);
+    }
+    qthread_fork(producer, NULL, &rets[200]);
+    for (int i = 0; i <= 200; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    iprintf("%lu writes, %lu reads\n", (unsigned long)writes, (unsigned long)reads);
+    assert((reads == writes) || (reads + 1 == writes));
+    assert(qthread_feb_status(&word) == (reads != writes));
+
+    free(rets);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* Has a crowd of tasks take turns with one FEB, yielding while they hold it,
+ * and a syncvar that only a couple of tasks wait on, and checks that the
+ * contention report at qthread_finalize() puts the FEB first. Without
+ * --enable-profiling=contention there is no report, and that is all this
+ * checks. */
+
+#define NTASKS 32
+#define ROUNDS 20
+
+static aligned_t hot;
+static syncvar_t cold = SYNCVAR_STATIC_EMPTY_INITIALIZER;
+static aligned_t total;
+
+/* not static, so that it has a dynamic symbol for the report to show */
+aligned_t crowd(void *arg);
+aligned_t crowd(void *arg)
+{
+    for (int i = 0; i < ROUNDS; i++) {
+        aligned_t v;
+
+        qthread_readFE(&v, &hot);
+        qthread_yield();
+        v++;
+        qthread_writeEF(&hot, &v);
+    }
+    return 0;
+}
+
+static aligned_t loner(void *arg)
+{
+    uint64_t v;
+
+    qthread_syncvar_readFF(&v, &cold);
+    (void)qthread_incr(&total, v);
+    return 0;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    char          report[64], line[1024];
+    aligned_t     rets[NTASKS + 2];
+    FILE         *f;
+    void         *first = NULL;
+    unsigned long waits = 0;
+    int           named = 0;
+
+    snprintf(report, sizeof(report), "/tmp/qthread_contention.%d.txt", (int)getpid());
+    setenv("QT_CONTENTION_SAMPLE", "1", 1);
+    setenv("QT_CONTENTION_REPORT", report, 1);
+    unlink(report);
+    assert(qthread_initialize() == 0);
+    CHECK_VERBOSE();
+
+    hot = 0;
+    for (int i = 0; i < 2; i++) {
+        qthread_fork(loner, NULL, &rets[NTASKS + i]);
+    }
+    for (int i = 0; i < NTASKS; i++) {
+        qthread_fork(crowd, NULL, &rets[i]);
+    }
+    for (int i = 0; i < NTASKS; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    qthread_syncvar_writeF_const(&cold, 1);
+    for (int i = 0; i < 2; i++) {
+        qthread_readFF(NULL, &rets[NTASKS + i]);
+    }
+    assert(hot == NTASKS * ROUNDS);
+    assert(total == 2);
+    qthread_finalize();
+
+    f = fopen(report, "r");
+    if (f == NULL) {
+        iprintf("no contention report\n");
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        iprintf("%s", line);
+        /* the first line after the header that starts with an address */
+        if ((first == NULL) && (strncmp(line, "0x", 2) == 0)) {
+            assert(sscanf(line, "%p %lu", &first, &waits) == 2);
+        } else if (first && !named) {
+            /* and its first call site */
+            named = (strstr(line, "crowd <- crowd+") != NULL);
+        }
+    }
+    fclose(f);
+    unlink(report);
+    assert(first == (void *)&hot);
+    assert(waits > 0);
+    assert(named);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* Spawns tasks that wait on FEBs and a qthread_queue_t, wakes them, and checks
+ * the counts in the latency report at qthread_finalize(). Without
+ * --enable-profiling=latency there is no report, and qthread_latency_dump()
+ * says so; that is all this checks then. */
+
+#define NTASKS 32
+
+static aligned_t       gate[NTASKS];
+static qthread_queue_t queue;
+
+static aligned_t feb_waiter(void *arg)
+{
+    qthread_readFF(NULL, &gate[(uintptr_t)arg]);
+    return 1;
+}
+
+static aligned_t queue_waiter(void *arg)
+{
+    qthread_queue_join(queue);
+    return 1;
+}
+
+/* on a qthread's stack, as a program would dump from */
+static aligned_t dumper(void *arg)
+{
+    return (aligned_t)qthread_latency_dump((const char *)arg);
+}
+
+static unsigned long count_of(const char *report,
+                              const char *source)
+{
+    char          line[1024];
+    unsigned long count = 0;
+    size_t        len   = strlen(source);
+    FILE         *f     = fopen(report, "r");
+
+    assert(f);
+    while (fgets(line, sizeof(line), f)) {
+        if ((strncmp(line, source, len) == 0) && (line[len] == ' ')) {
+            assert(sscanf(line + len, "%lu", &count) == 1);
+            break;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    char      report[64], dump[64];
+    aligned_t rets[2 * NTASKS], dumped;
+    int       ret;
+
+    snprintf(report, sizeof(report), "/tmp/qthread_latency.%d.txt", (int)getpid());
+    snprintf(dump, sizeof(dump), "/tmp/qthread_latency.%d.dump", (int)getpid());
+    setenv("QT_LATENCY_REPORT", report, 1);
+    unlink(report);
+    assert(qthread_initialize() == 0);
+    CHECK_VERBOSE();
+
+    queue = qthread_queue_create(QTHREAD_QUEUE_MULTI_JOIN_LENGTH, 0);
+    assert(queue);
+    for (int i = 0; i < NTASKS; i++) {
+        qthread_empty(&gate[i]);
+        qthread_fork(feb_waiter, (void *)(uintptr_t)i, &rets[i]);
+        qthread_fork(queue_waiter, NULL, &rets[NTASKS + i]);
+    }
+    /* let them all block */
+    while (qthread_queue_length(queue) < NTASKS) {
+        qthread_yield();
+    }
+    for (int i = 0; i < NTASKS; i++) {
+        qthread_fill(&gate[i]);
+    }
+    qthread_queue_release_all(queue);
+    for (int i = 0; i < 2 * NTASKS; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+
+    qthread_fork(dumper, dump, &dumped);
+    qthread_readFF(NULL, &dumped);
+    ret = (int)dumped;
+    if (ret == QTHREAD_NOT_ALLOWED) {
+        qthread_finalize();
+        assert(access(report, F_OK) != 0);
+        iprintf("no latency report\n");
+        return 0;
+    }
+    assert(ret == QTHREAD_SUCCESS);
+    assert(count_of(dump, "spawn") >= 2 * NTASKS);
+    unlink(dump);
+    qthread_queue_destroy(queue);
+    qthread_finalize();
+
+    if (verbose) {
+        char  line[1024];
+        FILE *f = fopen(report, "r");
+
+        assert(f);
+        while (fgets(line, sizeof(line), f)) {
+            iprintf("%s", line);
+        }
+        fclose(f);
+    }
+    /* every task was spawned, and the queue waiters all had to be released;
+     * the FEB waiters may have found their FEB full already, and main waits
+     * on FEBs too, so the feb count could be anything */
+    assert(count_of(report, "spawn") >= 2 * NTASKS);
+    assert(count_of(report, "queue") == NTASKS);
+    assert(count_of(report, "all") >= 3 * NTASKS);
+    unlink(report);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* Runs a few tasks that yield now and then, and checks what the perf counter
+ * report at qthread_finalize() says about them. It counts task-clock, which
+ * needs no PMU. Without --enable-profiling=perf (or where the kernel won't
+ * let us count at all), there is no report, and that is all this checks. */
+
+static aligned_t spinner(void *arg)
+{
+    volatile unsigned long sum = 0;
+
+    for (int i = 0; i < 4; i++) {
+        for (unsigned long j = 0; j < 100000; j++) {
+            sum += j;
+        }
+        qthread_yield();
+    }
+    return 0;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    char          report[64], line[1024];
+    aligned_t     rets[4];
+    FILE         *f;
+    unsigned long slices = 0, tasks = 0;
+    int           header = 0;
+
+    snprintf(report, sizeof(report), "/tmp/qthread_perf.%d.txt", (int)getpid());
+    setenv("QT_PERF_EVENTS", "task-clock", 1);
+    setenv("QT_PERF_REPORT", report, 1);
+    unlink(report);
+    assert(qthread_initialize() == 0);
+    CHECK_VERBOSE();
+
+    for (int i = 0; i < 4; i++) {
+        qthread_fork(spinner, NULL, &rets[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    qthread_finalize();
+
+    f = fopen(report, "r");
+    if (f == NULL) {
+        iprintf("no perf counter report\n");
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        iprintf("%s", line);
+        if (strncmp(line, "function ", 9) == 0) {
+            header = 1;
+            assert(strstr(line, "task-clock"));
+        }
+        if (strncmp(line, "total ", 6) == 0) {
+            assert(sscanf(line + 6, "%lu %lu", &slices, &tasks) == 2);
+        }
+    }
+    fclose(f);
+    unlink(report);
+    assert(header);
+    /* every spinner ran to the end, after coming back from four yields */
+    assert(tasks >= 4);
+    assert(slices >= 4 * 5);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,115 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* Runs the same small workload under each of the schedulers that a
+ * --with-scheduler=runtime library can choose among, each in a process of its
+ * own, since the choice is made once, by qthread_initialize(). */
+
+static const char *schedulers[] = {
+    "sherwood", "nemesis", "lifo", "mutexfifo", "mtsfifo", "distrib",
+    "loxley", "loxleybase",
+#ifdef QTHREAD_SCHEDULER_NOTTINGHAM
+    "nottingham",
+#endif
+};
+
+/* the ones that never give a shepherd more than one worker */
+static int single_worker(const char *name)
+{
+    static const char *const single[] = { "nemesis", "lifo", "mutexfifo", "mtsfifo" };
+
+    for (size_t i = 0; i < sizeof(single) / sizeof(single[0]); i++) {
+        if (!strcmp(name, single[i])) { return 1; }
+    }
+    return 0;
+}
+
+static aligned_t fib(void *arg)
+{
+    aligned_t n = (aligned_t)(uintptr_t)arg;
+    aligned_t a, b;
+
+    if (n < 2) { return n; }
+    qthread_fork(fib, (void *)(uintptr_t)(n - 1), &a);
+    qthread_fork(fib, (void *)(uintptr_t)(n - 2), &b);
+    qthread_readFF(NULL, &a);
+    qthread_readFF(NULL, &b);
+    return a + b;
+}
+
+static aligned_t yielder(void *arg)
+{
+    for (int i = 0; i < 10; i++) {
+        qthread_yield();
+    }
+    return 1;
+}
+
+static int run(const char *name)
+{
+    aligned_t ret, rets[64];
+    aligned_t total = 0;
+
+    setenv("QT_SCHEDULER", name, 1);
+    setenv("QT_NUM_WORKERS_PER_SHEPHERD", "2", 1);
+    assert(qthread_initialize() == 0);
+    if (single_worker(name)) {
+        assert(qthread_num_workers() == qthread_num_shepherds());
+    } else {
+        assert(qthread_num_workers() == 2 * qthread_num_shepherds());
+    }
+
+    qthread_fork(fib, (void *)(uintptr_t)15, &ret);
+    qthread_readFF(NULL, &ret);
+    assert(ret == 610);
+
+    for (int i = 0; i < 64; i++) {
+        qthread_fork(yielder, NULL, &rets[i]);
+    }
+    for (int i = 0; i < 64; i++) {
+        qthread_readFF(NULL, &rets[i]);
+        total += rets[i];
+    }
+    assert(total == 64);
+    iprintf("%s: %u shepherd(s), %u worker(s)\n", name,
+            (unsigned)qthread_num_shepherds(), (unsigned)qthread_num_workers());
+    qthread_finalize();
+    return 0;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    CHECK_VERBOSE();
+
+#ifndef QTHREAD_RUNTIME_SCHEDULER
+    iprintf("the library has only the scheduler it was configured with\n");
+    return 0;
+#endif
+    for (size_t i = 0; i < sizeof(schedulers) / sizeof(schedulers[0]); i++) {
+        int   status;
+        pid_t pid = fork();
+
+        assert(pid >= 0);
+        if (pid == 0) {
+            exit(run(schedulers[i]));
+        }
+        assert(waitpid(pid, &status, 0) == pid);
+        if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+            fprintf(stderr, "the %s scheduler failed\n", schedulers[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* vim:set expandtab: */
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* Checks the per-worker counters: what a batch of tasks that block on a FEB
+ * adds up to, that the per-worker numbers agree with the totals, and that
+ * nothing is counted while counting is off. */
+
+static int       tasks = 200;
+static aligned_t gate;
+static aligned_t waiting;
+
+static aligned_t blocker(void *arg)
+{
+    qthread_incr(&waiting, 1);
+    qthread_readFF(NULL, &gate);
+    return 0;
+}
+
+static aligned_t nothing(void *arg)
+{
+    return 0;
+}
+
+static void print_stats(const qthread_stats_t *s)
+{
+    iprintf("spawned %lu run %lu blocked %lu (feb %lu) switches %lu\n",
+            (unsigned long)s->tasks_spawned, (unsigned long)s->tasks_run,
+            (unsigned long)s->tasks_blocked, (unsigned long)s->feb_blocks,
+            (unsigned long)s->context_switches);
+    iprintf("stolen %lu steals %lu (failed %lu) idle %g ms\n",
+            (unsigned long)s->tasks_stolen, (unsigned long)s->steal_attempts,
+            (unsigned long)s->steal_failures, s->idle_ns * 1e-6);
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t       *rets;
+    qthread_stats_t  total, after;
+    qthread_stats_t *per_worker;
+    size_t           nworkers;
+
+    assert(qthread_initialize() == 0);
+    CHECK_VERBOSE();
+    NUMARG(tasks, "TASKS");
+    rets = malloc(tasks * sizeof(aligned_t));
+    assert(rets);
+    nworkers   = qthread_readstate(TOTAL_WORKERS);
+    per_worker = calloc(nworkers, sizeof(qthread_stats_t));
+    assert(per_worker);
+
+    qthread_stats_enable(1);
+    qthread_stats_reset();
+    assert(qthread_stats_snapshot(&total, NULL) == QTHREAD_SUCCESS);
+    assert(total.tasks_spawned == 0);
+
+    qthread_empty(&gate);
+    for (int i = 0; i < tasks; i++) {
+        qthread_fork(blocker, NULL, &rets[i]);
+    }
+    while (waiting != (aligned_t)tasks) {
+        qthread_yield();
+    }
+    qthread_fill(&gate);
+    for (int i = 0; i < tasks; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+
+    assert(qthread_stats_snapshot(&total, per_worker) == QTHREAD_SUCCESS);
+    print_stats(&total);
+    assert(total.tasks_spawned == (uint64_t)tasks);
+    assert(total.tasks_run >= (uint64_t)tasks);
+    assert(total.feb_blocks > 0);
+    assert(total.tasks_blocked >= total.feb_blocks);
+    assert(total.context_switches >= total.tasks_run + total.tasks_blocked);
+    assert(total.steal_failures <= total.steal_attempts);
+    {
+        /* only spawns from outside of the workers are missing here */
+        qthread_stats_t sum = { 0 };
+
+        for (size_t w = 0; w < nworkers; w++) {
+            sum.tasks_spawned += per_worker[w].tasks_spawned;
+            sum.tasks_run     += per_worker[w].tasks_run;
+            sum.feb_blocks    += per_worker[w].feb_blocks;
+        }
+        assert(sum.tasks_spawned == total.tasks_spawned);
+        assert(sum.tasks_run == total.tasks_run);
+        assert(sum.feb_blocks == total.feb_blocks);
+    }
+
+    /* switched off, nothing moves */
+    assert(qthread_stats_enable(0) == 1);
+    for (int i = 0; i < tasks; i++) {
+        qthread_fork(nothing, NULL, &rets[i]);
+    }
+    for (int i = 0; i < tasks; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    assert(qthread_stats_snapshot(&after, NULL) == QTHREAD_SUCCESS);
+    assert(after.tasks_spawned == total.tasks_spawned);
+    assert(after.tasks_run == total.tasks_run);
+    assert(qthread_stats_enable(1) == 0);
+
+    qthread_fork(nothing, NULL, &rets[0]);
+    qthread_readFF(NULL, &rets[0]);
+    assert(qthread_stats_snapshot(&after, NULL) == QTHREAD_SUCCESS);
+    assert(after.tasks_spawned == total.tasks_spawned + 1);
+
+    free(per_worker);
+    free(rets);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+#include "qt_stats_page.h"
+
+/* Reads the live statistics page the way tools/qtstat does, from the same
+ * process: it has to turn up, describe this library, keep being rewritten,
+ * and show the tasks spawned in the meantime. */
+
+static aligned_t nothing(void *arg)
+{
+    return 0;
+}
+
+static void copy_page(const qt_stats_page_t *page,
+                      qt_stats_page_t       *buf)
+{
+    const volatile qt_stats_page_t *p = page;
+
+    for (;;) {
+        const uint64_t seq = p->seq;
+
+        if (seq & 1) { continue; }
+        __sync_synchronize();
+        memcpy(buf, (const void *)page, p->size);
+        __sync_synchronize();
+        if (p->seq == seq) { return; }
+    }
+}
+
+/* In a child, so that the key is free for it to fill first: a segment there
+ * that isn't a stale page of ours must be left alone, and one that is must
+ * be replaced. */
+static void key_taken(int stale)
+{
+    const int        key = QT_STATS_PAGE_KEY(getpid());
+    int              id  = shmget(key, 4096, IPC_CREAT | IPC_EXCL | 0600);
+    qt_stats_page_t *page;
+
+    if (id < 0) {
+        _exit(0);                      /* no SysV shared memory here */
+    }
+    page = shmat(id, NULL, 0);
+    assert(page != (void *)-1);
+    memset(page, 0, 4096);
+    if (stale) {
+        page->magic = QT_STATS_PAGE_MAGIC;
+        page->pid   = getpid();
+    }
+    shmdt(page);
+    assert(qthread_initialize() == 0);
+    page = shmat(shmget(key, 0, 0), NULL, SHM_RDONLY);
+    assert(page != (void *)-1);
+    if (stale) {
+        assert(page->version == QT_STATS_PAGE_VERSION);
+    } else {
+        assert(page->magic == 0);
+        assert(shmget(key, 0, 0) == id);
+    }
+    shmdt(page);
+    qthread_finalize();
+    if (!stale) {
+        shmctl(id, IPC_RMID, NULL);
+    }
+    _exit(0);
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    const qt_stats_page_t *page;
+    qt_stats_page_t       *before, *after;
+    aligned_t              rets[100];
+    int                    id;
+
+    setenv("QT_STATS_PAGE", "1", 1);
+    setenv("QT_STATS_PAGE_INTERVAL", "10", 1);
+    for (int stale = 0; stale < 2; stale++) {
+        pid_t child = fork();
+        int   status;
+
+        assert(child >= 0);
+        if (child == 0) {
+            key_taken(stale);
+        }
+        assert(waitpid(child, &status, 0) == child);
+        assert(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+    }
+    assert(qthread_initialize() == 0);
+    CHECK_VERBOSE();
+
+    id = shmget(QT_STATS_PAGE_KEY(getpid()), 0, 0);
+    if (id < 0) {
+        iprintf("no statistics page; SysV shared memory may be unavailable here\n");
+        return 0;
+    }
+    page = shmat(id, NULL, SHM_RDONLY);
+    assert(page != (void *)-1);
+    assert(page->magic == QT_STATS_PAGE_MAGIC);
+    assert(page->version == QT_STATS_PAGE_VERSION);
+    assert(page->pid == (uint64_t)getpid());
+    assert(page->nshepherds == qthread_num_shepherds());
+    assert(page->nshepherds * page->nworkerspershep == qthread_num_workers());
+    assert(page->size == sizeof(qt_stats_page_t) +
+           page->nshepherds * sizeof(qt_stats_page_shepherd_t));
+    before = malloc(page->size);
+    after  = malloc(page->size);
+    assert(before && after);
+    copy_page(page, before);
+
+    for (int i = 0; i < 100; i++) {
+        qthread_fork(nothing, NULL, &rets[i]);
+    }
+    for (int i = 0; i < 100; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    /* wait for a sample that was taken after all of that */
+    do {
+        usleep(10000);
+        copy_page(page, after);
+    } while (after->samples < before->samples + 2);
+
+    iprintf("%lu samples, spawned %lu -> %lu, pool %lu bytes\n",
+            (unsigned long)after->samples, (unsigned long)before->tasks_spawned,
+            (unsigned long)after->tasks_spawned, (unsigned long)after->pool_bytes);
+    assert(after->sample_ns > before->sample_ns);
+    assert(after->tasks_spawned >= before->tasks_spawned + 100);
+    assert(after->pool_bytes > 0);
+    assert(!after->finalized);
+    for (uint32_t i = 0; i < after->nshepherds; i++) {
+        assert(after->shepherds[i].workers == after->nworkerspershep);
+    }
+
+    qthread_finalize();
+    /* the last sample says so, and the segment is on its way out */
+    copy_page(page, after);
+    assert(after->finalized);
+    assert(shmget(QT_STATS_PAGE_KEY(getpid()), 0, 0) < 0);
+    shmdt(page);
+    free(before);
+    free(after);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <qthread/qthread.h>
+#include <qthread/barrier.h>
+#include "argparsing.h"
+
+/* Traces a few tasks that block on a FEB and meet at a barrier, and checks
+ * that a dump shows them. Without --enable-profiling=trace, there is nothing
+ * to dump, and that is all this checks. */
+
+static aligned_t     gate;
+static qt_barrier_t *barrier;
+
+static aligned_t blocker(void *arg)
+{
+    qthread_readFF(NULL, &gate);
+    return 0;
+}
+
+static aligned_t meeter(void *arg)
+{
+    qt_barrier_enter(barrier);
+    return 0;
+}
+
+static char *slurp(const char *path)
+{
+    FILE  *f = fopen(path, "r");
+    long   len;
+    char  *buf;
+
+    assert(f);
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    rewind(f);
+    buf = malloc(len + 1);
+    assert(buf);
+    assert(fread(buf, 1, len, f) == (size_t)len);
+    buf[len] = 0;
+    fclose(f);
+    return buf;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    char      trace[64], dump[80];
+    aligned_t rets[8];
+    char     *json;
+
+    snprintf(trace, sizeof(trace), "/tmp/qthread_trace.%d.json", (int)getpid());
+    snprintf(dump, sizeof(dump), "%s.now", trace);
+    setenv("QT_TRACE", trace, 1);
+    assert(qthread_initialize() == 0);
+    CHECK_VERBOSE();
+
+    qthread_empty(&gate);
+    for (int i = 0; i < 4; i++) {
+        qthread_fork(blocker, NULL, &rets[i]);
+    }
+    qthread_yield();
+    qthread_fill(&gate);
+    barrier = qt_barrier_create(4, REGION_BARRIER);
+    for (int i = 4; i < 8; i++) {
+        qthread_fork(meeter, NULL, &rets[i]);
+    }
+    for (int i = 0; i < 8; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    qt_barrier_destroy(barrier);
+
+    if (qthread_trace_dump(dump) == QTHREAD_NOT_ALLOWED) {
+        iprintf("tracing is not compiled in\n");
+        return 0;
+    }
+    json = slurp(dump);
+    iprintf("%lu bytes of trace\n", (unsigned long)strlen(json));
+    assert(strncmp(json, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 39) == 0);
+    assert(strstr(json, "\"name\":\"spawn\""));
+    assert(strstr(json, "\"state\":\"terminated\""));
+    assert(strstr(json, "\"name\":\"feb_blocked\""));
+    assert(strstr(json, "\"name\":\"barrier\""));
+    /* what tools/qtdag needs to put the task graph back together */
+    assert(strstr(json, "\"name\":\"wake\""));
+    assert(strstr(json, "\"name\":\"fill\""));
+    assert(strstr(json, "\"name\":\"read\""));
+    assert(strcmp(json + strlen(json) - 4, "\n]}\n") == 0);
+    free(json);
+    unlink(dump);
+
+    /* the rest goes out when the library shuts down */
+    qthread_finalize();
+    json = slurp(trace);
+    assert(strstr(json, "\"name\":\"barrier\""));
+    free(json);
+    unlink(trace);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,624 @@
+/*
+ * qtdag - rebuilds the task graph from a qthreads trace and reports its
+ * work, span and parallelism, and the tasks along its critical path.
+ *
+ * The trace is the Chrome trace-event file that a library built with
+ * --enable-profiling=trace writes (see qthread_trace_dump(3)). Every task
+ * is a chain of the stretches of time it ran; the chains are tied together
+ * by spawns, by the wake-ups of blocked tasks, by reads of FEBs and syncvars
+ * that other tasks filled, and by sinc submissions. Work is the total time
+ * the tasks ran; span is the longest path through the graph, with only the
+ * time the tasks ran counting toward it. What a task spent waiting in a
+ * queue or blocked doesn't count, so work / span is how many workers the
+ * program could keep busy, whatever the runtime does.
+ */
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>                    /* for getopt() */
+
+enum kind {
+    K_START,
+    K_SPAWN,
+    K_WAKE,
+    K_FILL,
+    K_EMPTY,
+    K_READ,
+    K_SIGNAL,
+    K_END
+};
+
+/* what the trace says happened: either one end of a slice (the time a task
+ * ran without a break) or something that happened while one was running */
+typedef struct {
+    double   ts;
+    uint64_t obj;        /* the task (slice ends, spawns, wakes) or the word */
+    uint64_t func;       /* the task's function (slice starts, spawns) */
+    long     tid;
+    int      kind;
+    int      done;       /* K_END: the task ended, rather than blocked */
+} event_t;
+
+/* a point in the graph; pred is the point that the longest path to it
+ * comes from */
+typedef struct {
+    double span;         /* longest path up to here */
+    long   pred;
+    long   task;
+} node_t;
+
+typedef struct {
+    uint64_t ptr;
+    uint64_t func;
+    double   work;       /* time run so far */
+    double   slice_start;
+    double   span;       /* at the last node */
+    long     last;       /* the last node */
+    double   in_span;    /* from spawns and wake-ups, for the next slice */
+    long     in_node;
+    int      done;
+} task_t;
+
+typedef struct {
+    double fill_span;
+    long   fill_node;
+    double signal_span;
+    long   signal_node;
+} word_t;
+
+/* u64 -> index, open addressing */
+typedef struct {
+    uint64_t *keys;
+    long     *vals;
+    size_t    mask;
+    size_t    count;
+} map_t;
+
+static event_t *events  = NULL;
+static size_t   nevents = 0, events_size = 0;
+static node_t  *nodes   = NULL;
+static size_t   nnodes  = 0, nodes_size = 0;
+static task_t  *tasks   = NULL;
+static size_t   ntasks  = 0, tasks_size = 0;
+static word_t  *words   = NULL;
+static size_t   nwords  = 0, words_size = 0;
+
+static void *grow(void   *array,
+                  size_t *size,
+                  size_t  elem)
+{   /*{{{*/
+    *size = (*size == 0) ? 1024 : *size * 2;
+    array = realloc(array, *size * elem);
+    if (array == NULL) {
+        fprintf(stderr, "qtdag: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return array;
+} /*}}}*/
+
+static size_t map_hash(uint64_t k)
+{   /*{{{*/
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    return (size_t)k;
+} /*}}}*/
+
+static long *map_slot(map_t   *m,
+                      uint64_t key)
+{   /*{{{*/
+    size_t i;
+
+    if (m->count * 2 >= m->mask) {
+        map_t bigger;
+
+        bigger.mask  = m->mask ? m->mask * 2 + 1 : 1023;
+        bigger.count = 0;
+        bigger.keys  = calloc(bigger.mask + 1, sizeof(uint64_t));
+        bigger.vals  = malloc((bigger.mask + 1) * sizeof(long));
+        if ((bigger.keys == NULL) || (bigger.vals == NULL)) {
+            fprintf(stderr, "qtdag: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        for (i = 0; i <= bigger.mask; ++i) {
+            bigger.vals[i] = -1;
+        }
+        for (i = 0; m->keys && i <= m->mask; ++i) {
+            if (m->vals[i] >= 0) {
+                *map_slot(&bigger, m->keys[i]) = m->vals[i];
+            }
+        }
+        free(m->keys);
+        free(m->vals);
+        *m = bigger;
+    }
+    for (i = map_hash(key) & m->mask; m->vals[i] >= 0; i = (i + 1) & m->mask) {
+        if (m->keys[i] == key) {
+            return &m->vals[i];
+        }
+    }
+    m->keys[i] = key;
+    m->count++;
+    return &m->vals[i];
+} /*}}}*/
+
+/*********************************************************************
+* Reading the trace; the library writes one event per line.
+*********************************************************************/
+
+static const char *field(const char *line,
+                         const char *key)
+{   /*{{{*/
+    char        pattern[32];
+    const char *p;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    p = strstr(line, pattern);
+    return p ? p + strlen(pattern) : NULL;
+} /*}}}*/
+
+static int field_str(const char *line,
+                     const char *key,
+                     char       *buf,
+                     size_t      len)
+{   /*{{{*/
+    const char *p = field(line, key);
+    size_t      i = 0;
+
+    if ((p == NULL) || (*p++ != '"')) {
+        return 0;
+    }
+    while (*p && *p != '"' && i + 1 < len) {
+        buf[i++] = *p++;
+    }
+    buf[i] = 0;
+    return 1;
+} /*}}}*/
+
+static uint64_t field_hex(const char *line,
+                          const char *key)
+{   /*{{{*/
+    char buf[32];
+
+    return field_str(line, key, buf, sizeof(buf)) ? strtoull(buf, NULL, 0) : 0;
+} /*}}}*/
+
+static double field_num(const char *line,
+                        const char *key)
+{   /*{{{*/
+    const char *p = field(line, key);
+
+    return p ? strtod(p, NULL) : 0.0;
+} /*}}}*/
+
+static event_t *new_event(void)
+{   /*{{{*/
+    if (nevents == events_size) {
+        events = grow(events, &events_size, sizeof(event_t));
+    }
+    memset(&events[nevents], 0, sizeof(event_t));
+    return &events[nevents++];
+} /*}}}*/
+
+static void read_trace(FILE *f)
+{   /*{{{*/
+    static const struct {
+        const char *name;
+        int         kind;
+    } instants[] = {
+        { "spawn",  K_SPAWN  },
+        { "wake",   K_WAKE   },
+        { "fill",   K_FILL   },
+        { "empty",  K_EMPTY  },
+        { "read",   K_READ   },
+        { "signal", K_SIGNAL }
+    };
+    char  *line = NULL;
+    size_t len  = 0;
+    char   ph[8], name[64], state[32];
+
+    while (getline(&line, &len, f) != -1) {
+        event_t *e;
+
+        if (!field_str(line, "ph", ph, sizeof(ph)) ||
+            !field_str(line, "name", name, sizeof(name))) {
+            continue;
+        }
+        if (strcmp(ph, "X") == 0) {
+            const double ts  = field_num(line, "ts");
+            const long   tid = (long)field_num(line, "tid");
+            const uint64_t t = field_hex(line, "qthread");
+
+            field_str(line, "state", state, sizeof(state));
+            e       = new_event();
+            e->kind = K_START;
+            e->ts   = ts;
+            e->tid  = tid;
+            e->obj  = t;
+            e->func = (strcmp(name, "qthread") == 0) ? 0 : strtoull(name, NULL, 0);
+            e       = new_event();
+            e->kind = K_END;
+            e->ts   = ts + field_num(line, "dur");
+            e->tid  = tid;
+            e->obj  = t;
+            e->done = (strcmp(state, "terminated") == 0) ||
+                      (strcmp(state, "parent_unblocked") == 0);
+        } else if (strcmp(ph, "i") == 0) {
+            for (size_t i = 0; i < sizeof(instants) / sizeof(instants[0]); ++i) {
+                if (strcmp(name, instants[i].name) == 0) {
+                    e       = new_event();
+                    e->kind = instants[i].kind;
+                    e->ts   = field_num(line, "ts");
+                    e->tid  = (long)field_num(line, "tid");
+                    if ((e->kind == K_SPAWN) || (e->kind == K_WAKE)) {
+                        e->obj  = field_hex(line, "qthread");
+                        e->func = field_hex(line, "func");
+                    } else {
+                        e->obj = field_hex(line, "addr");
+                    }
+                    break;
+                }
+            }
+        }
+    }
+    free(line);
+} /*}}}*/
+
+/* time order; on one worker, a slice's start comes before and its end after
+ * whatever happened in it */
+static int by_time(const void *a,
+                   const void *b)
+{   /*{{{*/
+    const event_t *x = a, *y = b;
+
+    if (x->ts != y->ts) { return (x->ts < y->ts) ? -1 : 1; }
+    if (x->tid != y->tid) { return (x->tid < y->tid) ? -1 : 1; }
+    if (x->kind != y->kind) {
+        if ((x->kind == K_START) || (y->kind == K_END)) { return -1; }
+        if ((y->kind == K_START) || (x->kind == K_END)) { return 1; }
+    }
+    return 0;
+} /*}}}*/
+
+/*********************************************************************
+* The longest path
+*********************************************************************/
+
+static long new_node(double span,
+                     long   pred,
+                     long   task)
+{   /*{{{*/
+    if (nnodes == nodes_size) {
+        nodes = grow(nodes, &nodes_size, sizeof(node_t));
+    }
+    nodes[nnodes].span = span;
+    nodes[nnodes].pred = pred;
+    nodes[nnodes].task = task;
+    return (long)nnodes++;
+} /*}}}*/
+
+static long new_task(uint64_t ptr,
+                     uint64_t func)
+{   /*{{{*/
+    task_t *t;
+
+    if (ntasks == tasks_size) {
+        tasks = grow(tasks, &tasks_size, sizeof(task_t));
+    }
+    t = &tasks[ntasks];
+    memset(t, 0, sizeof(task_t));
+    t->ptr     = ptr;
+    t->func    = func;
+    t->last    = -1;
+    t->in_node = -1;
+    return (long)ntasks++;
+} /*}}}*/
+
+static word_t *word(map_t   *m,
+                    uint64_t addr)
+{   /*{{{*/
+    long *slot = map_slot(m, addr);
+
+    if (*slot < 0) {
+        if (nwords == words_size) {
+            words = grow(words, &words_size, sizeof(word_t));
+        }
+        words[nwords].fill_span   = 0;
+        words[nwords].fill_node   = -1;
+        words[nwords].signal_span = 0;
+        words[nwords].signal_node = -1;
+        *slot                     = (long)nwords++;
+    }
+    return &words[*slot];
+} /*}}}*/
+
+/* a node at time ts in task t's current slice */
+static long advance(long   t,
+                    double ts)
+{   /*{{{*/
+    task_t      *task = &tasks[t];
+    const double ran  = ts - task->slice_start;
+
+    task->span += ran;
+    task->work += ran;
+    task->slice_start = ts;
+    task->last        = new_node(task->span, task->last, t);
+    return task->last;
+} /*}}}*/
+
+/* the path to t's last node might come from elsewhere */
+static void join(long   t,
+                 double span,
+                 long   from)
+{   /*{{{*/
+    task_t *task = &tasks[t];
+
+    if ((from >= 0) && (span > task->span)) {
+        task->span              = span;
+        nodes[task->last].span  = span;
+        nodes[task->last].pred  = from;
+    }
+} /*}}}*/
+
+/* Follows the events in time order, which puts every edge's source before
+ * its destination. Returns the span, with the last node of the longest path
+ * in *end and the number of events that didn't happen in any slice in
+ * *outside. */
+static double walk(map_t  *live,
+                   long   *end,
+                   size_t *outside)
+{   /*{{{*/
+    map_t   addrs   = { NULL, NULL, 0, 0 };
+    long   *running = NULL;      /* by tid */
+    long    ntids   = 0;
+    double  span    = 0;
+
+    qsort(events, nevents, sizeof(event_t), by_time);
+    *end     = -1;
+    *outside = 0;
+    for (size_t i = 0; i < nevents; ++i) {
+        event_t *e = &events[i];
+        long     t, *slot;
+        word_t  *w;
+
+        if (e->tid >= ntids) {
+            long n = e->tid + 1;
+
+            running = realloc(running, n * sizeof(long));
+            while (ntids < n) { running[ntids++] = -1; }
+        }
+        if (e->kind == K_START) {
+            slot = map_slot(live, e->obj);
+            if ((e->obj == 0) || (*slot < 0) || tasks[*slot].done) {
+                /* spawned before the trace begins, or by something that
+                 * isn't traced */
+                *slot = new_task(e->obj, e->func);
+            }
+            t = *slot;
+            if (tasks[t].func == 0) {
+                tasks[t].func = e->func;
+            }
+            tasks[t].slice_start = e->ts;
+            advance(t, e->ts);
+            join(t, tasks[t].in_span, tasks[t].in_node);
+            tasks[t].in_span = 0;
+            tasks[t].in_node = -1;
+            running[e->tid]  = t;
+            continue;
+        }
+        t = running[e->tid];
+        if (t < 0) {
+            *outside += (e->kind != K_END);
+            continue;
+        }
+        advance(t, e->ts);
+        switch (e->kind) {
+            case K_SPAWN:
+            {
+                long child = new_task(e->obj, e->func);
+
+                *map_slot(live, e->obj) = child;
+                tasks[child].in_span    = tasks[t].span;
+                tasks[child].in_node    = tasks[t].last;
+                break;
+            }
+            case K_WAKE:
+                slot = map_slot(live, e->obj);
+                if ((*slot >= 0) && (tasks[t].span > tasks[*slot].in_span)) {
+                    tasks[*slot].in_span = tasks[t].span;
+                    tasks[*slot].in_node = tasks[t].last;
+                }
+                break;
+            case K_FILL:
+                w            = word(&addrs, e->obj);
+                w->fill_span = tasks[t].span;
+                w->fill_node = tasks[t].last;
+                break;
+            case K_EMPTY:
+                w              = word(&addrs, e->obj);
+                w->signal_span = 0;
+                w->signal_node = -1;
+                break;
+            case K_SIGNAL:
+                w = word(&addrs, e->obj);
+                if (tasks[t].span >= w->signal_span) {
+                    w->signal_span = tasks[t].span;
+                    w->signal_node = tasks[t].last;
+                }
+                break;
+            case K_READ:
+                w = word(&addrs, e->obj);
+                join(t, w->fill_span, w->fill_node);
+                join(t, w->signal_span, w->signal_node);
+                break;
+            case K_END:
+                tasks[t].done   = e->done;
+                running[e->tid] = -1;
+                break;
+        }
+        if (tasks[t].span > span) {
+            span = tasks[t].span;
+            *end = tasks[t].last;
+        }
+    }
+    free(running);
+    free(addrs.keys);
+    free(addrs.vals);
+    return span;
+} /*}}}*/
+
+/*********************************************************************
+* The report
+*********************************************************************/
+
+typedef struct {
+    uint64_t func;
+    double   time;
+    long     tasks;
+} contrib_t;
+
+static int by_time_desc(const void *a,
+                        const void *b)
+{   /*{{{*/
+    const contrib_t *x = a, *y = b;
+
+    return (x->time > y->time) ? -1 : (x->time < y->time);
+} /*}}}*/
+
+static void critical_path(long   end,
+                          double span,
+                          int    top)
+{   /*{{{*/
+    map_t      funcs    = { NULL, NULL, 0, 0 };
+    contrib_t *contribs = NULL;
+    size_t     ncontrib = 0, contrib_size = 0;
+    long       length   = 0, last_task = -1;
+
+    /* along the path, the span only grows where a task ran */
+    for (long n = end; n >= 0; n = nodes[n].pred) {
+        const long   p   = nodes[n].pred;
+        const double ran = (p >= 0 && nodes[p].task == nodes[n].task) ?
+                           nodes[n].span - nodes[p].span : 0;
+        long        *slot;
+
+        slot = map_slot(&funcs, tasks[nodes[n].task].func);
+        if (*slot < 0) {
+            if (ncontrib == contrib_size) {
+                contribs = grow(contribs, &contrib_size, sizeof(contrib_t));
+            }
+            contribs[ncontrib].func  = tasks[nodes[n].task].func;
+            contribs[ncontrib].time  = 0;
+            contribs[ncontrib].tasks = 0;
+            *slot                    = (long)ncontrib++;
+        }
+        contribs[*slot].time += ran;
+        if (nodes[n].task != last_task) {
+            contribs[*slot].tasks++;
+            last_task = nodes[n].task;
+            length++;
+        }
+    }
+    qsort(contribs, ncontrib, sizeof(contrib_t), by_time_desc);
+    printf("\ncritical path: %ld task%s\n", length, (length == 1) ? "" : "s");
+    printf("  %-20s %14s %7s %8s\n", "function", "time (us)", "share", "tasks");
+    for (size_t i = 0; i < ncontrib && (int)i < top; ++i) {
+        char name[32];
+
+        if (contribs[i].func) {
+            snprintf(name, sizeof(name), "%#llx", (unsigned long long)contribs[i].func);
+        } else {
+            strcpy(name, "(unknown)");
+        }
+        printf("  %-20s %14.3f %6.1f%% %8ld\n", name, contribs[i].time,
+               (span > 0) ? 100.0 * contribs[i].time / span : 0.0, contribs[i].tasks);
+    }
+    free(contribs);
+    free(funcs.keys);
+    free(funcs.vals);
+} /*}}}*/
+
+static void usage(void)
+{   /*{{{*/
+    fprintf(stderr, "usage: qtdag [-k count] trace.json\n");
+    exit(EXIT_FAILURE);
+} /*}}}*/
+
+int main(int   argc,
+         char *argv[])
+{   /*{{{*/
+    FILE  *f;
+    map_t  live    = { NULL, NULL, 0, 0 };
+    int    top     = 10, c;
+    long   workers = 0, end;
+    size_t outside;
+    double work    = 0, span, first = 0, last = 0;
+
+    while ((c = getopt(argc, argv, "k:h")) != -1) {
+        switch (c) {
+            case 'k':
+                top = atoi(optarg);
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind + 1 != argc) {
+        usage();
+    }
+    f = fopen(argv[optind], "r");
+    if (f == NULL) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+    read_trace(f);
+    fclose(f);
+    if (nevents == 0) {
+        fprintf(stderr, "qtdag: no task events in %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    span = walk(&live, &end, &outside);
+    for (size_t i = 0; i < ntasks; ++i) {
+        work += tasks[i].work;
+    }
+    first = events[0].ts;
+    last  = events[nevents - 1].ts;
+    for (size_t i = 0; i < nevents; ++i) {
+        if (events[i].tid + 1 > workers) { workers = events[i].tid + 1; }
+    }
+
+    printf("tasks:        %lu\n", (unsigned long)ntasks);
+    printf("work:         %.3f us\n", work);
+    printf("span:         %.3f us\n", span);
+    printf("parallelism:  %.2f\n", (span > 0) ? work / span : 0.0);
+    printf("workers:      %ld\n", workers);
+    printf("elapsed:      %.3f us\n", last - first);
+    if (last > first) {
+        const double elapsed = last - first;
+
+        printf("speedup:      %.2f (at most %.2f)\n", work / elapsed,
+               (work / span < workers) ? work / span : (double)workers);
+        printf("busy:         %.1f%% of the workers' time\n",
+               100.0 * work / (elapsed * workers));
+    }
+    if (outside) {
+        printf("(%lu events happened outside of any task)\n", (unsigned long)outside);
+    }
+    if (end >= 0) {
+        critical_path(end, span, top);
+    }
+    free(live.keys);
+    free(live.vals);
+    free(events);
+    free(nodes);
+    free(tasks);
+    free(words);
+    return EXIT_SUCCESS;
+} /*}}}*/
+
+/* vim:set expandtab: */
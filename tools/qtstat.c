@@ -0,0 +1,231 @@
+/*
+ * qtstat - watches a running qthreads program through the statistics page
+ * that it publishes (see qt_stats_page.h), in the manner of vmstat.
+ *
+ * The program has to have been started with QT_STATS_PAGE=1. qtstat only
+ * ever reads the page, and never waits for the program: if a sample is
+ * being rewritten while qtstat copies it, qtstat copies it again. The first
+ * line covers the time since the library started; each one after that, the
+ * time since the line before.
+ */
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <signal.h>                    /* for kill() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>                    /* for getopt() */
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "qt_stats_page.h"
+
+#define NS 1e9
+
+static const qt_stats_page_t *attach(long pid)
+{   /*{{{*/
+    const int id = shmget(QT_STATS_PAGE_KEY(pid), 0, 0);
+    void     *p;
+
+    if (id < 0) {
+        fprintf(stderr, "qtstat: process %ld has no statistics page (%s); "
+                "was it started with QT_STATS_PAGE=1?\n", pid, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    p = shmat(id, NULL, SHM_RDONLY);
+    if (p == (void *)-1) {
+        fprintf(stderr, "qtstat: cannot attach to the statistics page of process %ld (%s)\n",
+                pid, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return p;
+} /*}}}*/
+
+/* Copies a consistent sample into buf, which is big enough for the whole
+ * page. Returns 0 if the page isn't one that this qtstat understands. */
+static int sample(const qt_stats_page_t *page,
+                  qt_stats_page_t       *buf,
+                  size_t                 size)
+{   /*{{{*/
+    const volatile qt_stats_page_t *p = page;
+
+    if ((p->magic != QT_STATS_PAGE_MAGIC) || (p->version != QT_STATS_PAGE_VERSION) ||
+        (p->size > size)) {
+        return 0;
+    }
+    for (;;) {
+        const uint64_t seq = p->seq;
+
+        if (seq & 1) {
+            struct timespec ms = { 0, 1000000 };
+
+            nanosleep(&ms, NULL);
+            continue;
+        }
+        __sync_synchronize();
+        memcpy(buf, (const void *)page, p->size);
+        __sync_synchronize();
+        if (p->seq == seq) {
+            return 1;
+        }
+    }
+} /*}}}*/
+
+static void header(void)
+{   /*{{{*/
+    printf("%10s %10s %10s %8s %6s %7s %7s %5s %9s %5s %5s %9s\n",
+           "spawned/s", "run/s", "switch/s", "steals/s", "steal%", "queued",
+           "workers", "idle", "febs", "io_q", "io_px", "pool_MB");
+} /*}}}*/
+
+static double rate(uint64_t now,
+                   uint64_t then,
+                   double   secs)
+{   /*{{{*/
+    /* a counter that went backwards belongs to a library that started over */
+    return ((now >= then) && (secs > 0)) ? (now - then) / secs : 0.0;
+} /*}}}*/
+
+static void report(const qt_stats_page_t *cur,
+                   const qt_stats_page_t *prev,
+                   int                    per_shepherd)
+{   /*{{{*/
+    const double secs     = (cur->sample_ns - prev->sample_ns) / NS;
+    const double attempts = rate(cur->steal_attempts, prev->steal_attempts, 1);
+    uint64_t     queued   = 0;
+    unsigned     active   = 0, idle = 0;
+
+    for (uint32_t i = 0; i < cur->nshepherds; ++i) {
+        queued += cur->shepherds[i].queue_length;
+        active += cur->shepherds[i].active_workers;
+        idle   += cur->shepherds[i].idle_workers;
+    }
+    printf("%10.0f %10.0f %10.0f %8.0f %5.1f%% %7lu %3u/%-3u %5u %9lu %5lu %5lu %9.1f\n",
+           rate(cur->tasks_spawned, prev->tasks_spawned, secs),
+           rate(cur->tasks_run, prev->tasks_run, secs),
+           rate(cur->context_switches, prev->context_switches, secs),
+           rate(cur->tasks_stolen, prev->tasks_stolen, secs),
+           attempts ? 100.0 * (1.0 - rate(cur->steal_failures, prev->steal_failures, 1) / attempts) : 0.0,
+           (unsigned long)queued, active, cur->nshepherds * cur->nworkerspershep, idle,
+           (unsigned long)cur->feb_entries, (unsigned long)cur->io_queue_depth,
+           (unsigned long)cur->io_proxies, cur->pool_bytes / 1048576.0);
+    if (per_shepherd) {
+        for (uint32_t i = 0; i < cur->nshepherds; ++i) {
+            const qt_stats_page_shepherd_t *c = &cur->shepherds[i];
+            const qt_stats_page_shepherd_t *p = &prev->shepherds[i];
+            const double                    idle_secs = rate(c->idle_ns, p->idle_ns, NS);
+            double                          busy      = 0.0;
+
+            if ((secs > 0) && c->workers) {
+                busy = 100.0 * (1.0 - idle_secs / (secs * c->workers));
+                busy = (busy < 0) ? 0 : busy;
+            }
+            printf("  shepherd %u: spawned/s %.0f run/s %.0f steals/s %.0f queued %lu "
+                   "workers %u/%u idle %u busy %.0f%%\n",
+                   (unsigned)i,
+                   rate(c->tasks_spawned, p->tasks_spawned, secs),
+                   rate(c->tasks_run, p->tasks_run, secs),
+                   rate(c->tasks_stolen, p->tasks_stolen, secs),
+                   (unsigned long)c->queue_length, c->active_workers, c->workers,
+                   c->idle_workers, busy);
+        }
+    }
+    fflush(stdout);
+} /*}}}*/
+
+static void usage(void)
+{   /*{{{*/
+    fprintf(stderr, "usage: qtstat [-s] [-i seconds] [-n count] pid\n");
+    exit(EXIT_FAILURE);
+} /*}}}*/
+
+int main(int   argc,
+         char *argv[])
+{   /*{{{*/
+    const qt_stats_page_t *page;
+    qt_stats_page_t       *cur, *prev, *tmp;
+    double                 interval     = 1.0;
+    long                   count        = -1, pid, lines = 0;
+    int                    per_shepherd = 0;
+    size_t                 size;
+    int                    c;
+
+    while ((c = getopt(argc, argv, "si:n:h")) != -1) {
+        switch (c) {
+            case 's':
+                per_shepherd = 1;
+                break;
+            case 'i':
+                interval = atof(optarg);
+                break;
+            case 'n':
+                count = atol(optarg);
+                break;
+            default:
+                usage();
+        }
+    }
+    if ((optind + 1 != argc) || (interval <= 0)) {
+        usage();
+    }
+    pid  = atol(argv[optind]);
+    page = attach(pid);
+    size = ((const volatile qt_stats_page_t *)page)->size;
+    if (size < sizeof(qt_stats_page_t)) {
+        size = sizeof(qt_stats_page_t);
+    }
+    cur  = calloc(1, size);
+    prev = calloc(1, size);
+    if (!cur || !prev) {
+        fprintf(stderr, "qtstat: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    if (!sample(page, cur, size)) {
+        fprintf(stderr, "qtstat: the statistics page of process %ld is not one this qtstat can read\n", pid);
+        return EXIT_FAILURE;
+    }
+    /* the first line is everything since startup */
+    memcpy(prev, cur, size);
+    memset(prev->shepherds, 0, cur->nshepherds * sizeof(qt_stats_page_shepherd_t));
+    prev->tasks_spawned = prev->tasks_run = prev->context_switches = 0;
+    prev->tasks_stolen  = prev->steal_attempts = prev->steal_failures = 0;
+    prev->sample_ns     = cur->sample_ns - cur->samples * cur->interval_ns;
+    while (count != 0) {
+        struct timespec ts;
+
+        if (lines++ % 20 == 0) {
+            header();
+        }
+        report(cur, prev, per_shepherd);
+        if (cur->finalized) {
+            printf("qtstat: process %ld has shut down its qthreads\n", pid);
+            break;
+        }
+        if (--count == 0) { break; }
+        ts.tv_sec  = (time_t)interval;
+        ts.tv_nsec = (long)((interval - ts.tv_sec) * NS);
+        nanosleep(&ts, NULL);
+
+        tmp  = prev;
+        prev = cur;
+        cur  = tmp;
+        if (!sample(page, cur, size)) {
+            break;
+        }
+        if ((cur->sample_ns == prev->sample_ns) && (kill((pid_t)pid, 0) != 0)) {
+            printf("qtstat: process %ld is gone\n", pid);
+            break;
+        }
+    }
+    shmdt(page);
+    free(cur);
+    free(prev);
+    return EXIT_SUCCESS;
+} /*}}}*/
+
+/* vim:set expandtab: */